@@ -0,0 +1,142 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef LP_STREAMS_H
+#define LP_STREAMS_H
+
+#include "abort.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * @brief
+ * One object of type T per logical process, e.g. the record buffer of a
+ * trace writer or the sketch of a statistics calculator.
+ *
+ * Under the multithreaded simulator a logical process is run by one thread
+ * at a time, so the object of the calling logical process
+ * (Simulator::GetSystemId) is updated without locking: the slot of each
+ * logical process is an atomic pointer, written once by the thread which
+ * creates the object and read by the others when the results are merged,
+ * which must not overlap with the updates.
+ *
+ * The objects are owned by the LpStreams and deleted with it, by Clear or
+ * by SetMaxStreams.
+ */
+template <class T>
+class LpStreams
+{
+  public:
+    /// Default maximum number of logical processes, the MaxStreams attributes
+    static const uint32_t DEFAULT_MAX_STREAMS = 4096;
+
+    /**
+     * @brief Construct an empty set of streams.
+     *
+     * @param owner The name of the owner, for the error messages
+     * @param maxStreams The maximum number of logical processes
+     */
+    explicit LpStreams(const char* owner, uint32_t maxStreams = DEFAULT_MAX_STREAMS)
+        : m_owner(owner),
+          m_streams(maxStreams)
+    {
+    }
+
+    ~LpStreams()
+    {
+        Clear();
+    }
+
+    LpStreams(const LpStreams&) = delete;
+    LpStreams& operator=(const LpStreams&) = delete;
+
+    /**
+     * @brief Delete the streams and change the maximum number of logical processes.
+     *
+     * @param maxStreams The maximum number of logical processes
+     */
+    void SetMaxStreams(uint32_t maxStreams)
+    {
+        Clear();
+        m_streams = std::vector<std::atomic<T*>>(maxStreams);
+    }
+
+    /**
+     * @brief Get the maximum number of logical processes.
+     *
+     * @return The maximum number of logical processes
+     */
+    uint32_t GetMaxStreams() const
+    {
+        return m_streams.size();
+    }
+
+    /**
+     * @brief Get the stream of a logical process, creating it on first use.
+     *
+     * It must be called by the thread running the logical process.
+     *
+     * @param id The logical process, usually Simulator::GetSystemId ()
+     * @param create A callable returning a new T, owned by the LpStreams
+     * @return The stream of the logical process
+     */
+    template <class F>
+    inline T* Get(uint32_t id, F create)
+    {
+        NS_ABORT_MSG_IF(id >= m_streams.size(),
+                        m_owner << ": logical process " << id << " exceeds MaxStreams "
+                                << m_streams.size());
+        T* s = m_streams[id].load(std::memory_order_acquire);
+        if (s == nullptr)
+        {
+            s = create();
+            // only the thread running this logical process creates its stream
+            m_streams[id].store(s, std::memory_order_release);
+        }
+        return s;
+    }
+
+    /**
+     * @brief Call a function on every stream created so far, by increasing logical process.
+     *
+     * @param f A callable taking a T*
+     */
+    template <class F>
+    void ForEach(F f) const
+    {
+        for (auto& slot : m_streams)
+        {
+            T* s = slot.load(std::memory_order_acquire);
+            if (s != nullptr)
+            {
+                f(s);
+            }
+        }
+    }
+
+    /**
+     * @brief Delete all the streams.
+     */
+    void Clear()
+    {
+        for (auto& slot : m_streams)
+        {
+            delete slot.load(std::memory_order_relaxed);
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    const char* m_owner;                    //!< name of the owner, for the error messages
+    std::vector<std::atomic<T*>> m_streams; //!< stream of each logical process
+};
+
+} // namespace ns3
+
+#endif /* LP_STREAMS_H */
@@ -160,4 +160,13 @@ FlowMonitorHelper::SerializeToXmlFile(std::string fileName,
     }
 }
 
+void
+FlowMonitorHelper::SerializeToCsvFile(std::string fileName)
+{
+    if (m_flowMonitor)
+    {
+        m_flowMonitor->SerializeToCsvFile(fileName);
+    }
+}
+
 } // namespace ns3
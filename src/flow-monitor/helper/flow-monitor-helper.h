@@ -108,6 +108,13 @@ class FlowMonitorHelper
      */
     void SerializeToXmlFile(std::string fileName, bool enableHistograms, bool enableProbes);
 
+    /**
+     * Writes the flow statistics to a file as comma-separated values, see
+     * FlowMonitor::SerializeToCsvStream
+     * \param fileName name or path of the output file that will be created
+     */
+    void SerializeToCsvFile(std::string fileName);
+
   private:
     ObjectFactory m_monitorFactory;        //!< Object factory
     Ptr<FlowMonitor> m_flowMonitor;        //!< the FlowMonitor object
@@ -12,6 +12,8 @@
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <limits>
 #include <sstream>
@@ -81,7 +83,11 @@ FlowMonitor::GetInstanceTypeId() const
 }
 
 FlowMonitor::FlowMonitor()
-    : m_enabled(false)
+    : m_changes(0),
+      m_flowStatsChanges(0),
+      m_flowStatsMerged(false),
+      m_trackedPackets(TRACKED_PACKET_SHARDS),
+      m_enabled(false)
 {
     NS_LOG_FUNCTION(this);
 #ifdef NS3_MTP
@@ -107,35 +113,66 @@ FlowMonitor::DoDispose()
     Object::DoDispose();
 }
 
+void
+FlowMonitor::InitFlowStats(FlowStats& stats) const
+{
+    stats.delaySum = Seconds(0);
+    stats.jitterSum = Seconds(0);
+    stats.lastDelay = Seconds(0);
+    stats.maxDelay = Seconds(0);
+    stats.minDelay = Seconds(std::numeric_limits<double>::max());
+    stats.txBytes = 0;
+    stats.rxBytes = 0;
+    stats.txPackets = 0;
+    stats.rxPackets = 0;
+    stats.lostPackets = 0;
+    stats.timesForwarded = 0;
+    stats.delayHistogram.SetDefaultBinWidth(m_delayBinWidth);
+    stats.jitterHistogram.SetDefaultBinWidth(m_jitterBinWidth);
+    stats.packetSizeHistogram.SetDefaultBinWidth(m_packetSizeBinWidth);
+    stats.flowInterruptionsHistogram.SetDefaultBinWidth(m_flowInterruptionsBinWidth);
+}
+
 inline FlowMonitor::FlowStats&
-FlowMonitor::GetStatsForFlow(FlowId flowId)
+FlowMonitor::GetStatsForFlow(Ptr<FlowProbe> probe, FlowId flowId)
 {
     NS_LOG_FUNCTION(this);
-    auto iter = m_flowStats.find(flowId);
-    if (iter == m_flowStats.end())
-    {
-        FlowMonitor::FlowStats& ref = m_flowStats[flowId];
-        ref.delaySum = Seconds(0);
-        ref.jitterSum = Seconds(0);
-        ref.lastDelay = Seconds(0);
-        ref.maxDelay = Seconds(0);
-        ref.minDelay = Seconds(std::numeric_limits<double>::max());
-        ref.txBytes = 0;
-        ref.rxBytes = 0;
-        ref.txPackets = 0;
-        ref.rxPackets = 0;
-        ref.lostPackets = 0;
-        ref.timesForwarded = 0;
-        ref.delayHistogram.SetDefaultBinWidth(m_delayBinWidth);
-        ref.jitterHistogram.SetDefaultBinWidth(m_jitterBinWidth);
-        ref.packetSizeHistogram.SetDefaultBinWidth(m_packetSizeBinWidth);
-        ref.flowInterruptionsHistogram.SetDefaultBinWidth(m_flowInterruptionsBinWidth);
-        return ref;
-    }
-    else
+    ProbeFlowStats& probeStats = m_probeStats[probe->m_index];
+    probeStats.changes++;
+    auto insert = probeStats.flows.try_emplace(flowId);
+    if (insert.second)
     {
-        return iter->second;
+        InitFlowStats(insert.first->second);
     }
+    return insert.first->second;
+}
+
+inline uint64_t
+FlowMonitor::GetTrackedPacketKey(FlowId flowId, FlowPacketId packetId)
+{
+    return (static_cast<uint64_t>(flowId) << 32) | packetId;
+}
+
+inline FlowMonitor::TrackedPacketShard&
+FlowMonitor::LockTrackedPacketShard(uint64_t key)
+{
+    // consecutive packets of a flow go to different shards
+    TrackedPacketShard& shard =
+        m_trackedPackets[((key * 0x9e3779b97f4a7c15ULL) >> 32) % TRACKED_PACKET_SHARDS];
+#ifdef NS3_MTP
+    while (shard.lock.exchange(true, std::memory_order_acquire))
+    {
+    };
+#endif
+    return shard;
+}
+
+inline void
+FlowMonitor::UnlockTrackedPacketShard(TrackedPacketShard& shard)
+{
+#ifdef NS3_MTP
+    shard.lock.store(false, std::memory_order_release);
+#endif
 }
 
 void
@@ -152,22 +189,19 @@ FlowMonitor::ReportFirstTx(Ptr<FlowProbe> probe,
     }
     Time now = Simulator::Now();
 
-#ifdef NS3_MTP
-    while (m_lock.exchange(true, std::memory_order_acquire))
-    {
-    };
-#endif
-
-    TrackedPacket& tracked = m_trackedPackets[std::make_pair(flowId, packetId)];
+    uint64_t key = GetTrackedPacketKey(flowId, packetId);
+    TrackedPacketShard& shard = LockTrackedPacketShard(key);
+    TrackedPacket& tracked = *shard.packets.Insert(key).first;
     tracked.firstSeenTime = now;
     tracked.lastSeenTime = tracked.firstSeenTime;
     tracked.timesForwarded = 0;
+    UnlockTrackedPacketShard(shard);
     NS_LOG_DEBUG("ReportFirstTx: adding tracked packet (flowId=" << flowId << ", packetId="
                                                                  << packetId << ").");
 
     probe->AddPacketStats(flowId, packetSize, Seconds(0));
 
-    FlowStats& stats = GetStatsForFlow(flowId);
+    FlowStats& stats = GetStatsForFlow(probe, flowId);
     stats.txBytes += packetSize;
     stats.txPackets++;
     if (stats.txPackets == 1)
@@ -175,10 +209,6 @@ FlowMonitor::ReportFirstTx(Ptr<FlowProbe> probe,
         stats.timeFirstTxPacket = now;
     }
     stats.timeLastTxPacket = now;
-
-#ifdef NS3_MTP
-    m_lock.store(false, std::memory_order_release);
-#endif
 }
 
 void
@@ -194,33 +224,23 @@ FlowMonitor::ReportForwarding(Ptr<FlowProbe> probe,
         return;
     }
 
-#ifdef NS3_MTP
-    while (m_lock.exchange(true, std::memory_order_acquire))
-    {
-    };
-#endif
-
-    std::pair<FlowId, FlowPacketId> key(flowId, packetId);
-    auto tracked = m_trackedPackets.find(key);
-    if (tracked == m_trackedPackets.end())
+    uint64_t key = GetTrackedPacketKey(flowId, packetId);
+    TrackedPacketShard& shard = LockTrackedPacketShard(key);
+    TrackedPacket* tracked = shard.packets.Find(key);
+    if (!tracked)
     {
+        UnlockTrackedPacketShard(shard);
         NS_LOG_WARN("Received packet forward report (flowId="
                     << flowId << ", packetId=" << packetId << ") but not known to be transmitted.");
-#ifdef NS3_MTP
-        m_lock.store(false, std::memory_order_release);
-#endif
         return;
     }
 
-    tracked->second.timesForwarded++;
-    tracked->second.lastSeenTime = Simulator::Now();
+    tracked->timesForwarded++;
+    tracked->lastSeenTime = Simulator::Now();
 
-    Time delay = (Simulator::Now() - tracked->second.firstSeenTime);
+    Time delay = (Simulator::Now() - tracked->firstSeenTime);
+    UnlockTrackedPacketShard(shard);
     probe->AddPacketStats(flowId, packetSize, delay);
-
-#ifdef NS3_MTP
-    m_lock.store(false, std::memory_order_release);
-#endif
 }
 
 void
@@ -236,30 +256,33 @@ FlowMonitor::ReportLastRx(Ptr<FlowProbe> probe,
         return;
     }
 
-#ifdef NS3_MTP
-    while (m_lock.exchange(true, std::memory_order_acquire))
-    {
-    };
-#endif
-
-    auto tracked = m_trackedPackets.find(std::make_pair(flowId, packetId));
-    if (tracked == m_trackedPackets.end())
+    uint64_t key = GetTrackedPacketKey(flowId, packetId);
+    TrackedPacketShard& shard = LockTrackedPacketShard(key);
+    TrackedPacket* tracked = shard.packets.Find(key);
+    if (!tracked)
     {
+        UnlockTrackedPacketShard(shard);
         NS_LOG_WARN("Received packet last-tx report (flowId="
                     << flowId << ", packetId=" << packetId << ") but not known to be transmitted.");
-#ifdef NS3_MTP
-        m_lock.store(false, std::memory_order_release);
-#endif
         return;
     }
 
     Time now = Simulator::Now();
-    Time delay = (now - tracked->second.firstSeenTime);
+    Time delay = (now - tracked->firstSeenTime);
+    uint32_t timesForwarded = tracked->timesForwarded;
+
+    NS_LOG_DEBUG("ReportLastTx: removing tracked packet (flowId=" << flowId << ", packetId="
+                                                                  << packetId << ").");
+
+    shard.packets.Erase(key); // we don't need to track this packet anymore
+    UnlockTrackedPacketShard(shard);
+
     probe->AddPacketStats(flowId, packetSize, delay);
 
-    FlowStats& stats = GetStatsForFlow(flowId);
+    FlowStats& stats = GetStatsForFlow(probe, flowId);
     stats.delaySum += delay;
     stats.delayHistogram.AddValue(delay.GetSeconds());
+    stats.delaySketch.Add(delay.GetNanoSeconds());
     if (stats.rxPackets > 0)
     {
         Time jitter = stats.lastDelay - delay;
@@ -301,16 +324,7 @@ FlowMonitor::ReportLastRx(Ptr<FlowProbe> probe,
         }
     }
     stats.timeLastRxPacket = now;
-    stats.timesForwarded += tracked->second.timesForwarded;
-
-    NS_LOG_DEBUG("ReportLastTx: removing tracked packet (flowId=" << flowId << ", packetId="
-                                                                  << packetId << ").");
-
-    m_trackedPackets.erase(tracked); // we don't need to track this packet anymore
-
-#ifdef NS3_MTP
-    m_lock.store(false, std::memory_order_release);
-#endif
+    stats.timesForwarded += timesForwarded;
 }
 
 void
@@ -327,15 +341,9 @@ FlowMonitor::ReportDrop(Ptr<FlowProbe> probe,
         return;
     }
 
-#ifdef NS3_MTP
-    while (m_lock.exchange(true, std::memory_order_acquire))
-    {
-    };
-#endif
-
     probe->AddPacketDropStats(flowId, packetSize, reasonCode);
 
-    FlowStats& stats = GetStatsForFlow(flowId);
+    FlowStats& stats = GetStatsForFlow(probe, flowId);
     stats.lostPackets++;
     if (stats.packetsDropped.size() < reasonCode + 1)
     {
@@ -347,50 +355,185 @@ FlowMonitor::ReportDrop(Ptr<FlowProbe> probe,
     NS_LOG_DEBUG("++stats.packetsDropped["
                  << reasonCode << "]; // becomes: " << stats.packetsDropped[reasonCode]);
 
-    auto tracked = m_trackedPackets.find(std::make_pair(flowId, packetId));
-    if (tracked != m_trackedPackets.end())
+    uint64_t key = GetTrackedPacketKey(flowId, packetId);
+    TrackedPacketShard& shard = LockTrackedPacketShard(key);
+    if (shard.packets.Erase(key))
     {
         // we don't need to track this packet anymore
         // FIXME: this will not necessarily be true with broadcast/multicast
         NS_LOG_DEBUG("ReportDrop: removing tracked packet (flowId=" << flowId << ", packetId="
                                                                     << packetId << ").");
-        m_trackedPackets.erase(tracked);
     }
-
-#ifdef NS3_MTP
-    m_lock.store(false, std::memory_order_release);
-#endif
+    UnlockTrackedPacketShard(shard);
 }
 
 const FlowMonitor::FlowStatsContainer&
 FlowMonitor::GetFlowStats() const
 {
+    // the counts of updates only grow, so their sum changes with any of them
+    uint64_t changes = m_changes;
+    for (const auto& probeStats : m_probeStats)
+    {
+        changes += probeStats.changes;
+    }
+    if (!m_flowStatsMerged || changes != m_flowStatsChanges)
+    {
+        MergeFlowStats(m_flowStats, true);
+        m_flowStatsChanges = changes;
+        m_flowStatsMerged = true;
+    }
     return m_flowStats;
 }
 
+/**
+ * Add the bins of a histogram to another one.
+ * \param to the histogram to add to
+ * \param from the histogram to add
+ */
+static void
+MergeHistogram(Histogram& to, const Histogram& from)
+{
+    if (from.GetNBins() == 0)
+    {
+        return;
+    }
+    if (to.GetNBins() == 0)
+    {
+        to = from;
+        return;
+    }
+    for (uint32_t i = 0; i < from.GetNBins(); i++)
+    {
+        double value = from.GetBinStart(i) + from.GetBinWidth(i) / 2;
+        for (uint32_t n = from.GetBinCount(i); n > 0; n--)
+        {
+            to.AddValue(value);
+        }
+    }
+}
+
+void
+FlowMonitor::MergeFlowStats(FlowStatsContainer& stats, bool histograms) const
+{
+    NS_LOG_FUNCTION(this << histograms);
+    stats.clear();
+    for (const auto& probeStats : m_probeStats)
+    {
+        for (const auto& [flowId, from] : probeStats.flows)
+        {
+            auto insert = stats.try_emplace(flowId);
+            FlowStats& to = insert.first->second;
+            if (insert.second)
+            {
+                InitFlowStats(to);
+            }
+
+            if (from.txPackets > 0)
+            {
+                if (to.txPackets == 0 || from.timeFirstTxPacket < to.timeFirstTxPacket)
+                {
+                    to.timeFirstTxPacket = from.timeFirstTxPacket;
+                }
+                if (to.txPackets == 0 || from.timeLastTxPacket > to.timeLastTxPacket)
+                {
+                    to.timeLastTxPacket = from.timeLastTxPacket;
+                }
+            }
+            if (from.rxPackets > 0)
+            {
+                if (to.rxPackets == 0 || from.timeFirstRxPacket < to.timeFirstRxPacket)
+                {
+                    to.timeFirstRxPacket = from.timeFirstRxPacket;
+                }
+                if (to.rxPackets == 0 || from.timeLastRxPacket > to.timeLastRxPacket)
+                {
+                    to.timeLastRxPacket = from.timeLastRxPacket;
+                    to.lastDelay = from.lastDelay;
+                }
+            }
+            to.delaySum += from.delaySum;
+            to.jitterSum += from.jitterSum;
+            to.maxDelay = std::max(to.maxDelay, from.maxDelay);
+            to.minDelay = std::min(to.minDelay, from.minDelay);
+            to.txBytes += from.txBytes;
+            to.rxBytes += from.rxBytes;
+            to.txPackets += from.txPackets;
+            to.rxPackets += from.rxPackets;
+            to.lostPackets += from.lostPackets;
+            to.timesForwarded += from.timesForwarded;
+            to.delaySketch.Merge(from.delaySketch);
+
+            if (to.packetsDropped.size() < from.packetsDropped.size())
+            {
+                to.packetsDropped.resize(from.packetsDropped.size(), 0);
+                to.bytesDropped.resize(from.bytesDropped.size(), 0);
+            }
+            for (uint32_t reasonCode = 0; reasonCode < from.packetsDropped.size(); reasonCode++)
+            {
+                to.packetsDropped[reasonCode] += from.packetsDropped[reasonCode];
+                to.bytesDropped[reasonCode] += from.bytesDropped[reasonCode];
+            }
+
+            if (histograms)
+            {
+                MergeHistogram(to.delayHistogram, from.delayHistogram);
+                MergeHistogram(to.jitterHistogram, from.jitterHistogram);
+                MergeHistogram(to.packetSizeHistogram, from.packetSizeHistogram);
+                MergeHistogram(to.flowInterruptionsHistogram, from.flowInterruptionsHistogram);
+            }
+        }
+    }
+
+    for (const auto& [flowId, lostPackets] : m_lostPackets)
+    {
+        auto flow = stats.find(flowId);
+        NS_ASSERT(flow != stats.end());
+        flow->second.lostPackets += lostPackets;
+    }
+}
+
 void
 FlowMonitor::CheckForLostPackets(Time maxDelay)
 {
     NS_LOG_FUNCTION(this << maxDelay.As(Time::S));
     Time now = Simulator::Now();
 
-    for (auto iter = m_trackedPackets.begin(); iter != m_trackedPackets.end();)
+#ifdef NS3_MTP
+    while (m_lock.exchange(true, std::memory_order_acquire))
     {
-        if (now - iter->second.lastSeenTime >= maxDelay)
+    };
+#endif
+
+    std::vector<uint64_t> lost;
+    for (auto& shard : m_trackedPackets)
+    {
+#ifdef NS3_MTP
+        while (shard.lock.exchange(true, std::memory_order_acquire))
+        {
+        };
+#endif
+        lost.clear();
+        shard.packets.ForEach([&](uint64_t key, const TrackedPacket& tracked) {
+            if (now - tracked.lastSeenTime >= maxDelay)
+            {
+                lost.push_back(key);
+            }
+        });
+        m_changes += lost.size();
+        for (uint64_t key : lost)
         {
             // packet is considered lost, add it to the loss statistics
-            auto flow = m_flowStats.find(iter->first.first);
-            NS_ASSERT(flow != m_flowStats.end());
-            flow->second.lostPackets++;
+            m_lostPackets[key >> 32]++;
 
             // we won't track it anymore
-            m_trackedPackets.erase(iter++);
-        }
-        else
-        {
-            iter++;
+            shard.packets.Erase(key);
         }
+        UnlockTrackedPacketShard(shard);
     }
+
+#ifdef NS3_MTP
+    m_lock.store(false, std::memory_order_release);
+#endif
 }
 
 void
@@ -416,7 +559,9 @@ FlowMonitor::NotifyConstructionCompleted()
 void
 FlowMonitor::AddProbe(Ptr<FlowProbe> probe)
 {
+    probe->m_index = m_flowProbes.size();
     m_flowProbes.push_back(probe);
+    m_probeStats.emplace_back();
 }
 
 const FlowMonitor::FlowProbeContainer&
@@ -487,12 +632,19 @@ FlowMonitor::SerializeToXmlStream(std::ostream& os,
 {
     NS_LOG_FUNCTION(this << indent << enableHistograms << enableProbes);
     CheckForLostPackets();
+    // the histograms are only merged if they are written
+    FlowStatsContainer merged;
+    if (!enableHistograms)
+    {
+        MergeFlowStats(merged, false);
+    }
+    const FlowStatsContainer& flowStats = enableHistograms ? GetFlowStats() : merged;
 
     os << std::string(indent, ' ') << "<FlowMonitor>\n";
     indent += 2;
     os << std::string(indent, ' ') << "<FlowStats>\n";
     indent += 2;
-    for (auto flowI = m_flowStats.begin(); flowI != m_flowStats.end(); flowI++)
+    for (auto flowI = flowStats.begin(); flowI != flowStats.end(); flowI++)
     {
         os << std::string(indent, ' ');
 #define ATTRIB(name) " " #name "=\"" << flowI->second.name << "\""
@@ -579,33 +731,91 @@ FlowMonitor::SerializeToXmlFile(std::string fileName, bool enableHistograms, boo
     os.close();
 }
 
+void
+FlowMonitor::SerializeToCsvStream(std::ostream& os)
+{
+    NS_LOG_FUNCTION(this);
+    CheckForLostPackets();
+    FlowStatsContainer stats;
+    MergeFlowStats(stats, false);
+
+    os << "flowId,timeFirstTxPacket,timeFirstRxPacket,timeLastTxPacket,timeLastRxPacket,"
+          "delaySum,jitterSum,lastDelay,maxDelay,minDelay,txBytes,rxBytes,txPackets,rxPackets,"
+          "lostPackets,timesForwarded,packetsDropped,bytesDropped,delayP50,delayP99,delayP999\n";
+    for (const auto& [flowId, flow] : stats)
+    {
+        uint64_t packetsDropped = 0;
+        uint64_t bytesDropped = 0;
+        for (uint32_t reasonCode = 0; reasonCode < flow.packetsDropped.size(); reasonCode++)
+        {
+            packetsDropped += flow.packetsDropped[reasonCode];
+            bytesDropped += flow.bytesDropped[reasonCode];
+        }
+        os << flowId << ',' << flow.timeFirstTxPacket.GetNanoSeconds() << ','
+           << flow.timeFirstRxPacket.GetNanoSeconds() << ','
+           << flow.timeLastTxPacket.GetNanoSeconds() << ','
+           << flow.timeLastRxPacket.GetNanoSeconds() << ',' << flow.delaySum.GetNanoSeconds()
+           << ',' << flow.jitterSum.GetNanoSeconds() << ',' << flow.lastDelay.GetNanoSeconds()
+           << ',' << flow.maxDelay.GetNanoSeconds() << ','
+           << (flow.rxPackets > 0 ? flow.minDelay.GetNanoSeconds() : 0) << ',' << flow.txBytes
+           << ',' << flow.rxBytes << ',' << flow.txPackets << ',' << flow.rxPackets << ','
+           << flow.lostPackets << ',' << flow.timesForwarded << ',' << packetsDropped << ','
+           << bytesDropped << ',' << std::llround(flow.delaySketch.GetQuantile(0.5)) << ','
+           << std::llround(flow.delaySketch.GetQuantile(0.99)) << ','
+           << std::llround(flow.delaySketch.GetQuantile(0.999)) << '\n';
+    }
+}
+
+void
+FlowMonitor::SerializeToCsvFile(std::string fileName)
+{
+    NS_LOG_FUNCTION(this << fileName);
+    std::ofstream os(fileName, std::ios::out | std::ios::binary);
+    SerializeToCsvStream(os);
+    os.close();
+}
+
 void
 FlowMonitor::ResetAllStats()
 {
     NS_LOG_FUNCTION(this);
 
-    for (auto& iter : m_flowStats)
-    {
-        auto& flowStat = iter.second;
-        flowStat.delaySum = Seconds(0);
-        flowStat.jitterSum = Seconds(0);
-        flowStat.lastDelay = Seconds(0);
-        flowStat.maxDelay = Seconds(0);
-        flowStat.minDelay = Seconds(std::numeric_limits<double>::max());
-        flowStat.txBytes = 0;
-        flowStat.rxBytes = 0;
-        flowStat.txPackets = 0;
-        flowStat.rxPackets = 0;
-        flowStat.lostPackets = 0;
-        flowStat.timesForwarded = 0;
-        flowStat.bytesDropped.clear();
-        flowStat.packetsDropped.clear();
-
-        flowStat.delayHistogram.Clear();
-        flowStat.jitterHistogram.Clear();
-        flowStat.packetSizeHistogram.Clear();
-        flowStat.flowInterruptionsHistogram.Clear();
+    for (auto& probeStats : m_probeStats)
+    {
+        probeStats.changes++;
+        for (auto& iter : probeStats.flows)
+        {
+            auto& flowStat = iter.second;
+            flowStat.delaySum = Seconds(0);
+            flowStat.jitterSum = Seconds(0);
+            flowStat.lastDelay = Seconds(0);
+            flowStat.maxDelay = Seconds(0);
+            flowStat.minDelay = Seconds(std::numeric_limits<double>::max());
+            flowStat.txBytes = 0;
+            flowStat.rxBytes = 0;
+            flowStat.txPackets = 0;
+            flowStat.rxPackets = 0;
+            flowStat.lostPackets = 0;
+            flowStat.timesForwarded = 0;
+            flowStat.bytesDropped.clear();
+            flowStat.packetsDropped.clear();
+
+            flowStat.delayHistogram.Clear();
+            flowStat.delaySketch.Clear();
+            flowStat.jitterHistogram.Clear();
+            flowStat.packetSizeHistogram.Clear();
+            flowStat.flowInterruptionsHistogram.Clear();
+        }
     }
+#ifdef NS3_MTP
+    while (m_lock.exchange(true, std::memory_order_acquire))
+    {
+    };
+#endif
+    m_lostPackets.clear();
+#ifdef NS3_MTP
+    m_lock.store(false, std::memory_order_release);
+#endif
 }
 
 } // namespace ns3
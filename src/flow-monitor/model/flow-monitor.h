@@ -11,15 +11,18 @@
 
 #include "flow-classifier.h"
 #include "flow-probe.h"
+#include "open-hash-map.h"
 
 #include "ns3/event-id.h"
 #include "ns3/histogram.h"
 #include "ns3/nstime.h"
 #include "ns3/object.h"
 #include "ns3/ptr.h"
+#include "ns3/quantile-sketch.h"
 
 #include <atomic>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace ns3
@@ -106,6 +109,8 @@ class FlowMonitor : public Object
 
         /// Histogram of the packet delays
         Histogram delayHistogram;
+        /// Quantile sketch of the packet delays, in nanoseconds
+        QuantileSketch delaySketch;
         /// Histogram of the packet jitters
         Histogram jitterHistogram;
         /// Histogram of the packet sizes
@@ -237,7 +242,9 @@ class FlowMonitor : public Object
     /// Retrieve all collected the flow statistics.  Note, if the
     /// FlowMonitor has not stopped monitoring yet, you should call
     /// CheckForLostPackets() to make sure all possibly lost packets are
-    /// accounted for.
+    /// accounted for.  The statistics are kept per probe while the
+    /// simulation runs and are merged by this call when they changed since
+    /// the last one, the returned reference is valid until the next one.
     /// \returns the flows statistics
     const FlowStatsContainer& GetFlowStats() const;
 
@@ -268,6 +275,19 @@ class FlowMonitor : public Object
     /// \param enableProbes if true, include also the per-probe/flow pair statistics in the output
     void SerializeToXmlFile(std::string fileName, bool enableHistograms, bool enableProbes);
 
+    /// Serializes the flow statistics to an std::ostream as comma-separated
+    /// values, one line per flow after a header line, without histograms or
+    /// per-probe statistics.  Times are in nanoseconds and packetsDropped and
+    /// bytesDropped are summed over the reason codes.  The histograms of the
+    /// probes are not merged, so this is the cheaper export for simulations
+    /// with many flows.
+    /// \param os the output stream
+    void SerializeToCsvStream(std::ostream& os);
+
+    /// Same as SerializeToCsvStream, but writes to a file instead
+    /// \param fileName name or path of the output file that will be created
+    void SerializeToCsvFile(std::string fileName);
+
     /// Reset all the statistics
     void ResetAllStats();
 
@@ -284,12 +304,45 @@ class FlowMonitor : public Object
         uint32_t timesForwarded; //!< number of times the packet was reportedly forwarded
     };
 
-    /// FlowId --> FlowStats
-    FlowStatsContainer m_flowStats;
+    /// Number of shards of the tracked packets
+#ifdef NS3_MTP
+    static const uint32_t TRACKED_PACKET_SHARDS = 64;
+#else
+    static const uint32_t TRACKED_PACKET_SHARDS = 1;
+#endif
+
+    /// Tracked packets of a shard, (FlowId << 32 | PacketId) --> TrackedPacket
+    struct TrackedPacketShard
+    {
+        OpenHashMap<uint64_t, TrackedPacket> packets; //!< the tracked packets
+#ifdef NS3_MTP
+        std::atomic<bool> lock{false}; //!< protects packets
+#endif
+    };
+
+    /// Statistics of the packets reported by one probe, on a cache line of
+    /// their own as the probes of different threads update them
+    struct alignas(64) ProbeFlowStats
+    {
+        std::unordered_map<FlowId, FlowStats> flows; //!< FlowId --> FlowStats
+        uint64_t changes{0};                         //!< number of updates of flows
+    };
 
-    /// (FlowId,PacketId) --> TrackedPacket
-    typedef std::map<std::pair<FlowId, FlowPacketId>, TrackedPacket> TrackedPacketMap;
-    TrackedPacketMap m_trackedPackets; //!< Tracked packets
+    /// Per-probe statistics, indexed by FlowProbe::m_index.  A probe only
+    /// reports events of its node, so a shard has a single writer.
+    std::vector<ProbeFlowStats> m_probeStats;
+    /// FlowId --> number of packets found lost by CheckForLostPackets
+    std::unordered_map<FlowId, uint32_t> m_lostPackets;
+    /// number of updates of m_lostPackets and of resets of the statistics
+    uint64_t m_changes;
+    /// FlowId --> FlowStats, merged from the shards by GetFlowStats
+    mutable FlowStatsContainer m_flowStats;
+    /// total number of updates of the statistics merged in m_flowStats
+    mutable uint64_t m_flowStatsChanges;
+    /// whether m_flowStats was merged
+    mutable bool m_flowStatsMerged;
+
+    std::vector<TrackedPacketShard> m_trackedPackets; //!< Tracked packets
     Time m_maxPerHopDelay;             //!< Minimum per-hop delay
     FlowProbeContainer m_flowProbes;   //!< all the FlowProbes
 
@@ -305,13 +358,37 @@ class FlowMonitor : public Object
     double m_flowInterruptionsBinWidth; //!< Flow interruptions bin width (for histograms)
     Time m_flowInterruptionsMinTime;    //!< Flow interruptions minimum time
 #ifdef NS3_MTP
-    std::atomic<bool> m_lock;
+    std::atomic<bool> m_lock; //!< protects m_lostPackets
 #endif
 
-    /// Get the stats for a given flow
+    /// Set the stats of a flow without packets
+    /// \param stats the stats to set
+    void InitFlowStats(FlowStats& stats) const;
+
+    /// Get the stats for a given flow in the shard of a probe
+    /// \param probe the reporting probe
     /// \param flowId the Flow identification
     /// \returns the stats of the flow
-    FlowStats& GetStatsForFlow(FlowId flowId);
+    FlowStats& GetStatsForFlow(Ptr<FlowProbe> probe, FlowId flowId);
+
+    /// \param flowId the Flow identification
+    /// \param packetId the Packet identification
+    /// \returns the key of the packet in the tracked packets
+    static uint64_t GetTrackedPacketKey(FlowId flowId, FlowPacketId packetId);
+
+    /// Find the shard of a tracked packet and lock it
+    /// \param key the key of the packet
+    /// \returns the shard
+    TrackedPacketShard& LockTrackedPacketShard(uint64_t key);
+
+    /// Unlock a shard of the tracked packets
+    /// \param shard the shard
+    void UnlockTrackedPacketShard(TrackedPacketShard& shard);
+
+    /// Merge the per-probe statistics and the lost packets
+    /// \param stats the container to fill, cleared first
+    /// \param histograms whether to merge the histograms too
+    void MergeFlowStats(FlowStatsContainer& stats, bool histograms) const;
 
     /// Periodic function to check for lost packets and prune statistics
     void PeriodicCheckForLostPackets();
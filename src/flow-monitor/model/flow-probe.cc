@@ -29,7 +29,8 @@ FlowProbe::~FlowProbe()
 }
 
 FlowProbe::FlowProbe(Ptr<FlowMonitor> flowMonitor)
-    : m_flowMonitor(flowMonitor)
+    : m_flowMonitor(flowMonitor),
+      m_index(0)
 {
     m_flowMonitor->AddProbe(this);
 }
@@ -97,6 +97,10 @@ class FlowProbe : public Object
   protected:
     Ptr<FlowMonitor> m_flowMonitor; //!< the FlowMonitor instance
     Stats m_stats;                  //!< The flow stats
+
+  private:
+    friend class FlowMonitor;
+    uint32_t m_index; //!< index of the probe in its FlowMonitor, set by AddProbe
 };
 
 } // namespace ns3
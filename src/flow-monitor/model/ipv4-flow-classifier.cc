@@ -80,6 +80,14 @@ operator==(const Ipv4FlowClassifier::FiveTuple& t1, const Ipv4FlowClassifier::Fi
             t1.sourcePort == t2.sourcePort && t1.destinationPort == t2.destinationPort);
 }
 
+std::size_t
+Ipv4FlowClassifier::FiveTupleHash::operator()(const FiveTuple& t) const
+{
+    uint64_t h = (uint64_t(t.sourceAddress.Get()) << 32) | t.destinationAddress.Get();
+    h ^= (uint64_t(t.sourcePort) << 40) | (uint64_t(t.destinationPort) << 24) | t.protocol;
+    return h;
+}
+
 Ipv4FlowClassifier::Ipv4FlowClassifier()
 {
 #ifdef NS3_MTP
@@ -143,34 +151,39 @@ Ipv4FlowClassifier::Classify(const Ipv4Header& ipHeader,
 #endif
 
     // try to insert the tuple, but check if it already exists
-    auto insert = m_flowMap.insert(std::pair<FiveTuple, FlowId>(tuple, 0));
+    auto insert = m_flowMap.Insert(tuple);
 
     // if the insertion succeeded, we need to assign this tuple a new flow identifier
     if (insert.second)
     {
-        FlowId newFlowId = GetNewFlowId();
-        insert.first->second = newFlowId;
-        m_flowPktIdMap[newFlowId] = 0;
-        m_flowDscpMap[newFlowId];
+        *insert.first = GetNewFlowId();
+        m_flows.push_back(Flow{tuple, 0, {}});
     }
     else
     {
-        m_flowPktIdMap[insert.first->second]++;
+        m_flows[*insert.first - 1].lastPacketId++;
     }
+    Flow& flow = m_flows[*insert.first - 1];
 
     // increment the counter of packets with the same DSCP value
     Ipv4Header::DscpType dscp = ipHeader.GetDscp();
-    auto dscpInserter = m_flowDscpMap[insert.first->second].insert(
-        std::pair<Ipv4Header::DscpType, uint32_t>(dscp, 1));
-
-    // if the insertion did not succeed, we need to increment the counter
-    if (!dscpInserter.second)
+    auto dscpCount =
+        std::lower_bound(flow.dscpCounts.begin(),
+                         flow.dscpCounts.end(),
+                         dscp,
+                         [](const std::pair<Ipv4Header::DscpType, uint32_t>& count,
+                            Ipv4Header::DscpType value) { return count.first < value; });
+    if (dscpCount != flow.dscpCounts.end() && dscpCount->first == dscp)
+    {
+        dscpCount->second++;
+    }
+    else
     {
-        m_flowDscpMap[insert.first->second][dscp]++;
+        flow.dscpCounts.insert(dscpCount, std::make_pair(dscp, 1));
     }
 
-    *out_flowId = insert.first->second;
-    *out_packetId = m_flowPktIdMap[*out_flowId];
+    *out_flowId = *insert.first;
+    *out_packetId = flow.lastPacketId;
 
 #ifdef NS3_MTP
     m_lock.store(false, std::memory_order_release);
@@ -182,12 +195,9 @@ Ipv4FlowClassifier::Classify(const Ipv4Header& ipHeader,
 Ipv4FlowClassifier::FiveTuple
 Ipv4FlowClassifier::FindFlow(FlowId flowId) const
 {
-    for (auto iter = m_flowMap.begin(); iter != m_flowMap.end(); iter++)
+    if (flowId >= 1 && flowId <= m_flows.size())
     {
-        if (iter->second == flowId)
-        {
-            return iter->first;
-        }
+        return m_flows[flowId - 1].tuple;
     }
     NS_FATAL_ERROR("Could not find the flow with ID " << flowId);
     FiveTuple retval = {Ipv4Address::GetZero(), Ipv4Address::GetZero(), 0, 0, 0};
@@ -204,15 +214,12 @@ Ipv4FlowClassifier::SortByCount::operator()(std::pair<Ipv4Header::DscpType, uint
 std::vector<std::pair<Ipv4Header::DscpType, uint32_t>>
 Ipv4FlowClassifier::GetDscpCounts(FlowId flowId) const
 {
-    auto flow = m_flowDscpMap.find(flowId);
-
-    if (flow == m_flowDscpMap.end())
+    if (flowId < 1 || flowId > m_flows.size())
     {
         NS_FATAL_ERROR("Could not find the flow with ID " << flowId);
     }
 
-    std::vector<std::pair<Ipv4Header::DscpType, uint32_t>> v(flow->second.begin(),
-                                                             flow->second.end());
+    std::vector<std::pair<Ipv4Header::DscpType, uint32_t>> v(m_flows[flowId - 1].dscpCounts);
     std::sort(v.begin(), v.end(), SortByCount());
     return v;
 }
@@ -224,27 +231,33 @@ Ipv4FlowClassifier::SerializeToXmlStream(std::ostream& os, uint16_t indent) cons
     os << "<Ipv4FlowClassifier>\n";
 
     indent += 2;
-    for (auto iter = m_flowMap.begin(); iter != m_flowMap.end(); iter++)
+    // flows in the order of their tuples, as when they were kept in a std::map
+    std::vector<const Flow*> flows;
+    flows.reserve(m_flows.size());
+    for (const auto& flow : m_flows)
+    {
+        flows.push_back(&flow);
+    }
+    std::sort(flows.begin(), flows.end(), [](const Flow* a, const Flow* b) {
+        return a->tuple < b->tuple;
+    });
+
+    for (const Flow* flow : flows)
     {
         Indent(os, indent);
-        os << "<Flow flowId=\"" << iter->second << "\""
-           << " sourceAddress=\"" << iter->first.sourceAddress << "\""
-           << " destinationAddress=\"" << iter->first.destinationAddress << "\""
-           << " protocol=\"" << int(iter->first.protocol) << "\""
-           << " sourcePort=\"" << iter->first.sourcePort << "\""
-           << " destinationPort=\"" << iter->first.destinationPort << "\">\n";
+        os << "<Flow flowId=\"" << flow - m_flows.data() + 1 << "\""
+           << " sourceAddress=\"" << flow->tuple.sourceAddress << "\""
+           << " destinationAddress=\"" << flow->tuple.destinationAddress << "\""
+           << " protocol=\"" << int(flow->tuple.protocol) << "\""
+           << " sourcePort=\"" << flow->tuple.sourcePort << "\""
+           << " destinationPort=\"" << flow->tuple.destinationPort << "\">\n";
 
         indent += 2;
-        auto flow = m_flowDscpMap.find(iter->second);
-
-        if (flow != m_flowDscpMap.end())
+        for (const auto& dscpCount : flow->dscpCounts)
         {
-            for (auto i = flow->second.begin(); i != flow->second.end(); i++)
-            {
-                Indent(os, indent);
-                os << "<Dscp value=\"0x" << std::hex << static_cast<uint32_t>(i->first) << "\""
-                   << " packets=\"" << std::dec << i->second << "\" />\n";
-            }
+            Indent(os, indent);
+            os << "<Dscp value=\"0x" << std::hex << static_cast<uint32_t>(dscpCount.first) << "\""
+               << " packets=\"" << std::dec << dscpCount.second << "\" />\n";
         }
 
         indent -= 2;
@@ -10,12 +10,13 @@
 #define IPV4_FLOW_CLASSIFIER_H
 
 #include "flow-classifier.h"
+#include "open-hash-map.h"
 
 #include "ns3/ipv4-header.h"
 
 #include <atomic>
-#include <map>
 #include <stdint.h>
+#include <vector>
 
 namespace ns3
 {
@@ -39,6 +40,14 @@ class Ipv4FlowClassifier : public FlowClassifier
         uint16_t destinationPort;       //!< Destination port
     };
 
+    /// Hash function of a FiveTuple
+    struct FiveTupleHash
+    {
+        /// \param t the tuple to hash
+        /// \return the hash of t
+        std::size_t operator()(const FiveTuple& t) const;
+    };
+
     Ipv4FlowClassifier();
 
     /// \brief try to classify the packet into flow-id and packet-id
@@ -83,12 +92,19 @@ class Ipv4FlowClassifier : public FlowClassifier
     void SerializeToXmlStream(std::ostream& os, uint16_t indent) const override;
 
   private:
-    /// Map to Flows Identifiers to FlowIds
-    std::map<FiveTuple, FlowId> m_flowMap;
-    /// Map to FlowIds to FlowPacketId
-    std::map<FlowId, FlowPacketId> m_flowPktIdMap;
-    /// Map FlowIds to (DSCP value, packet count) pairs
-    std::map<FlowId, std::map<Ipv4Header::DscpType, uint32_t>> m_flowDscpMap;
+    /// What is known of a flow
+    struct Flow
+    {
+        FiveTuple tuple;           //!< the tuple of the flow
+        FlowPacketId lastPacketId; //!< the identifier of the last packet of the flow
+        /// (DSCP value, packet count) pairs, in increasing DSCP order
+        std::vector<std::pair<Ipv4Header::DscpType, uint32_t>> dscpCounts;
+    };
+
+    /// Flows by FlowId, flow f is at index f - 1
+    std::vector<Flow> m_flows;
+    /// Map FiveTuples to FlowIds
+    OpenHashMap<FiveTuple, FlowId, FiveTupleHash> m_flowMap;
 
 #ifdef NS3_MTP
     std::atomic<bool> m_lock;
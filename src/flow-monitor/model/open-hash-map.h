@@ -0,0 +1,246 @@
+//
+// SPDX-License-Identifier: GPL-2.0-only
+//
+
+#ifndef OPEN_HASH_MAP_H
+#define OPEN_HASH_MAP_H
+
+#include <cstddef>
+#include <functional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \ingroup flow-monitor
+ * \brief Hash map with open addressing and linear probing.
+ *
+ * Keys and values are stored in flat arrays, so a lookup is one hash and
+ * usually a single cache line, without the per-node allocations of
+ * std::map or std::unordered_map.  The table doubles when it is half
+ * full.  Erase shifts the following entries of the probe sequence back,
+ * so there are no tombstones and lookups do not degrade after many
+ * insertions and removals.
+ *
+ * The hash of a key is mixed before use, so an identity hash such as
+ * std::hash<uint64_t> is fine.  Pointers returned by Find and Insert are
+ * valid until the next Insert or Erase.
+ *
+ * \tparam Key the key type, default constructible and equality comparable
+ * \tparam Value the value type, default constructible
+ * \tparam Hash the hash function of the keys
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class OpenHashMap
+{
+  public:
+    OpenHashMap()
+        : m_size(0),
+          m_mask(0)
+    {
+    }
+
+    /**
+     * \param key the key to look for
+     * \return the value of key, or nullptr if key is not in the map
+     */
+    Value* Find(const Key& key)
+    {
+        if (m_size == 0)
+        {
+            return nullptr;
+        }
+        for (std::size_t i = Slot(key); m_used[i]; i = (i + 1) & m_mask)
+        {
+            if (m_keys[i] == key)
+            {
+                return &m_values[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * \param key the key to look for
+     * \return the value of key, or nullptr if key is not in the map
+     */
+    const Value* Find(const Key& key) const
+    {
+        return const_cast<OpenHashMap*>(this)->Find(key);
+    }
+
+    /**
+     * \param key the key to insert
+     * \return the value of key and true if it was inserted, with a default
+     * constructed value, or false if key was already in the map
+     */
+    std::pair<Value*, bool> Insert(const Key& key)
+    {
+        if (2 * (m_size + 1) > m_used.size())
+        {
+            Grow();
+        }
+        std::size_t i = Slot(key);
+        for (; m_used[i]; i = (i + 1) & m_mask)
+        {
+            if (m_keys[i] == key)
+            {
+                return std::make_pair(&m_values[i], false);
+            }
+        }
+        m_used[i] = 1;
+        m_keys[i] = key;
+        m_size++;
+        return std::make_pair(&m_values[i], true);
+    }
+
+    /**
+     * \param key the key to remove
+     * \return true if key was in the map
+     */
+    bool Erase(const Key& key)
+    {
+        if (m_size == 0)
+        {
+            return false;
+        }
+        std::size_t i = Slot(key);
+        for (; m_used[i]; i = (i + 1) & m_mask)
+        {
+            if (m_keys[i] == key)
+            {
+                break;
+            }
+        }
+        if (!m_used[i])
+        {
+            return false;
+        }
+        // move back the entries whose probe sequence passes through the hole
+        for (std::size_t j = (i + 1) & m_mask; m_used[j]; j = (j + 1) & m_mask)
+        {
+            std::size_t home = Slot(m_keys[j]);
+            if (((j - home) & m_mask) >= ((j - i) & m_mask))
+            {
+                m_keys[i] = std::move(m_keys[j]);
+                m_values[i] = std::move(m_values[j]);
+                i = j;
+            }
+        }
+        m_used[i] = 0;
+        m_keys[i] = Key();
+        m_values[i] = Value();
+        m_size--;
+        return true;
+    }
+
+    /**
+     * Call f(key, value) on every entry, in no particular order.  f must not
+     * insert or erase entries.
+     * \param f the function to call
+     */
+    template <typename F>
+    void ForEach(F f)
+    {
+        for (std::size_t i = 0; i < m_used.size(); i++)
+        {
+            if (m_used[i])
+            {
+                f(const_cast<const Key&>(m_keys[i]), m_values[i]);
+            }
+        }
+    }
+
+    /**
+     * Call f(key, value) on every entry, in no particular order.
+     * \param f the function to call
+     */
+    template <typename F>
+    void ForEach(F f) const
+    {
+        for (std::size_t i = 0; i < m_used.size(); i++)
+        {
+            if (m_used[i])
+            {
+                f(m_keys[i], m_values[i]);
+            }
+        }
+    }
+
+    /// Remove all the entries and release the memory
+    void Clear()
+    {
+        m_keys = std::vector<Key>();
+        m_values = std::vector<Value>();
+        m_used = std::vector<uint8_t>();
+        m_size = 0;
+        m_mask = 0;
+    }
+
+    /// \return the number of entries
+    std::size_t GetSize() const
+    {
+        return m_size;
+    }
+
+  private:
+    /**
+     * \param key a key
+     * \return the first slot of the probe sequence of key
+     */
+    std::size_t Slot(const Key& key) const
+    {
+        // 64-bit finalizer of MurmurHash3
+        uint64_t h = Hash()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h & m_mask;
+    }
+
+    /// Double the number of slots and insert the entries again
+    void Grow()
+    {
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        std::vector<uint8_t> used;
+        keys.swap(m_keys);
+        values.swap(m_values);
+        used.swap(m_used);
+
+        std::size_t slots = used.empty() ? 16 : 2 * used.size();
+        m_keys.resize(slots);
+        m_values.resize(slots);
+        m_used.assign(slots, 0);
+        m_mask = slots - 1;
+        for (std::size_t j = 0; j < used.size(); j++)
+        {
+            if (used[j])
+            {
+                std::size_t i = Slot(keys[j]);
+                while (m_used[i])
+                {
+                    i = (i + 1) & m_mask;
+                }
+                m_used[i] = 1;
+                m_keys[i] = std::move(keys[j]);
+                m_values[i] = std::move(values[j]);
+            }
+        }
+    }
+
+    std::vector<Key> m_keys;     //!< the keys, valid where m_used is set
+    std::vector<Value> m_values; //!< the values, valid where m_used is set
+    std::vector<uint8_t> m_used; //!< whether each slot holds an entry
+    std::size_t m_size;          //!< number of entries
+    std::size_t m_mask;          //!< number of slots minus one
+};
+
+} // namespace ns3
+
+#endif /* OPEN_HASH_MAP_H */
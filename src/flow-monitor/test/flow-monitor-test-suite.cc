@@ -0,0 +1,542 @@
+//
+// SPDX-License-Identifier: GPL-2.0-only
+//
+
+#include "ns3/error-model.h"
+#include "ns3/flow-monitor-helper.h"
+#include "ns3/flow-monitor.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-flow-classifier.h"
+#include "ns3/ipv4-flow-probe.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/node-container.h"
+#include "ns3/open-hash-map.h"
+#include "ns3/packet.h"
+#include "ns3/pointer.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/simulator.h"
+#include "ns3/socket.h"
+#include "ns3/string.h"
+#include "ns3/tcp-socket-factory.h"
+#include "ns3/test.h"
+#include "ns3/udp-socket-factory.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \ingroup flow-monitor
+ * \ingroup tests
+ * \defgroup flow-monitor-test flow-monitor module tests
+ */
+
+/**
+ * \ingroup flow-monitor-test
+ *
+ * \brief Hash of the keys of the OpenHashMap test which puts them in 4 slots,
+ * so that the probe sequences are long and run into each other
+ */
+struct OpenHashMapCollidingHash
+{
+    /**
+     * \param key a key
+     * \return its hash
+     */
+    std::size_t operator()(uint64_t key) const
+    {
+        return key % 4;
+    }
+};
+
+/**
+ * \ingroup flow-monitor-test
+ *
+ * \brief OpenHashMap holds the entries of a std::map under random
+ * insertions, erasures and lookups, while it grows and after it empties.
+ *
+ * \tparam Hash the hash function of the keys
+ */
+template <typename Hash>
+class OpenHashMapTestCase : public TestCase
+{
+  public:
+    /**
+     * Constructor
+     * \param name the name of the hash function
+     * \param keys the number of distinct keys
+     */
+    OpenHashMapTestCase(std::string name, uint32_t keys);
+
+  private:
+    void DoRun() override;
+
+    /**
+     * \param map the map to check
+     * \param expected its expected entries
+     * \return whether the entries of map are those expected
+     */
+    static bool SameEntries(const OpenHashMap<uint64_t, uint32_t, Hash>& map,
+                            const std::map<uint64_t, uint32_t>& expected);
+
+    uint32_t m_keys; //!< the number of distinct keys
+};
+
+template <typename Hash>
+OpenHashMapTestCase<Hash>::OpenHashMapTestCase(std::string name, uint32_t keys)
+    : TestCase("OpenHashMap against std::map, " + name + " hash"),
+      m_keys(keys)
+{
+}
+
+template <typename Hash>
+bool
+OpenHashMapTestCase<Hash>::SameEntries(const OpenHashMap<uint64_t, uint32_t, Hash>& map,
+                                       const std::map<uint64_t, uint32_t>& expected)
+{
+    std::map<uint64_t, uint32_t> entries;
+    bool duplicate = false;
+    map.ForEach([&](uint64_t key, uint32_t value) {
+        duplicate = duplicate || !entries.emplace(key, value).second;
+    });
+    return !duplicate && map.GetSize() == expected.size() && entries == expected;
+}
+
+template <typename Hash>
+void
+OpenHashMapTestCase<Hash>::DoRun()
+{
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint64_t> keys(0, m_keys - 1);
+    OpenHashMap<uint64_t, uint32_t, Hash> map;
+    std::map<uint64_t, uint32_t> expected;
+    std::size_t maxSize = 0;
+
+    // the first half of the operations mostly inserts, so that the table grows
+    for (uint32_t op = 0; op < 40 * m_keys; op++)
+    {
+        uint64_t key = keys(rng);
+        uint32_t value = rng();
+        uint32_t kind = rng() % 8;
+        bool present = expected.count(key);
+        if (kind < (op < 20 * m_keys ? 5U : 3U))
+        {
+            std::pair<uint32_t*, bool> insert = map.Insert(key);
+            NS_TEST_ASSERT_MSG_EQ(insert.second, !present, "insertion of key " << key);
+            if (present)
+            {
+                NS_TEST_ASSERT_MSG_EQ(*insert.first, expected[key], "value of key " << key);
+            }
+            *insert.first = value;
+            expected[key] = value;
+        }
+        else if (kind < 6)
+        {
+            NS_TEST_ASSERT_MSG_EQ(map.Erase(key), present, "erasure of key " << key);
+            expected.erase(key);
+        }
+        else
+        {
+            const uint32_t* found = map.Find(key);
+            NS_TEST_ASSERT_MSG_EQ((found != nullptr), present, "lookup of key " << key);
+            if (present)
+            {
+                NS_TEST_ASSERT_MSG_EQ(*found, expected[key], "value of key " << key);
+            }
+        }
+        NS_TEST_ASSERT_MSG_EQ(map.GetSize(), expected.size(), "size after operation " << op);
+        maxSize = std::max(maxSize, map.GetSize());
+        if (op % 1000 == 0)
+        {
+            NS_TEST_ASSERT_MSG_EQ(SameEntries(map, expected), true, "entries at " << op);
+        }
+    }
+    NS_TEST_ASSERT_MSG_EQ(SameEntries(map, expected), true, "entries at the end");
+    NS_TEST_EXPECT_MSG_GT(maxSize, m_keys / 2, "the table did not grow");
+
+    // empty the map in random order, the remaining keys are still found
+    std::vector<uint64_t> remaining;
+    for (const auto& entry : expected)
+    {
+        remaining.push_back(entry.first);
+    }
+    std::shuffle(remaining.begin(), remaining.end(), rng);
+    while (!remaining.empty())
+    {
+        NS_TEST_ASSERT_MSG_EQ(map.Erase(remaining.back()), true, "erasure");
+        expected.erase(remaining.back());
+        remaining.pop_back();
+        if (remaining.size() % 64 == 0)
+        {
+            NS_TEST_ASSERT_MSG_EQ(SameEntries(map, expected), true, "entries while emptying");
+            for (uint64_t key : remaining)
+            {
+                NS_TEST_ASSERT_MSG_NE(map.Find(key), nullptr, "lookup of key " << key);
+            }
+        }
+    }
+    NS_TEST_ASSERT_MSG_EQ(map.GetSize(), 0, "size of the empty map");
+
+    map.Clear();
+    NS_TEST_ASSERT_MSG_EQ(map.Find(1), nullptr, "lookup in the cleared map");
+    *map.Insert(1).first = 2;
+    NS_TEST_ASSERT_MSG_EQ(*map.Find(1), 2, "insertion in the cleared map");
+}
+
+/**
+ * \ingroup flow-monitor-test
+ *
+ * \brief The statistics, XML and CSV output of FlowMonitor for a TCP flow, a
+ * UDP flow with 2 packets lost on a link, and a UDP flow without a route.
+ *
+ * The nodes are n0 -- n1 -- n2.  n0 sends 20 UDP packets and 5 UDP packets to
+ * an address without a route, which n1 drops, and then a TCP flow to n2.
+ */
+class FlowMonitorOutputTestCase : public TestCase
+{
+  public:
+    FlowMonitorOutputTestCase();
+
+  private:
+    void DoRun() override;
+
+    /// Send a UDP packet every millisecond
+    /// \param socket the socket
+    /// \param n the number of packets to send
+    static void SendUdp(Ptr<Socket> socket, uint32_t n);
+    /// Read all the data of a socket
+    /// \param socket the socket
+    static void Drain(Ptr<Socket> socket);
+    /// Read the data of an accepted TCP connection
+    /// \param socket the socket
+    /// \param from the address of the peer
+    static void Accept(Ptr<Socket> socket, const Address& from);
+    /// Send the data of the TCP flow once connected
+    /// \param socket the socket
+    static void Connected(Ptr<Socket> socket);
+
+    /**
+     * \param line a line of XML
+     * \param name the name of an attribute
+     * \return the value of the attribute, or an empty string
+     */
+    static std::string GetXmlAttribute(const std::string& line, const std::string& name);
+
+    /**
+     * Check the counters of the flows in an XML output.
+     * \param xml the output
+     * \param stats the flow statistics
+     */
+    void CheckXml(const std::string& xml, const FlowMonitor::FlowStatsContainer& stats);
+
+    /**
+     * \param h a histogram
+     * \return the number of values in the histogram
+     */
+    static uint32_t GetHistogramCount(const Histogram& h);
+};
+
+FlowMonitorOutputTestCase::FlowMonitorOutputTestCase()
+    : TestCase("FlowMonitor statistics, XML and CSV output")
+{
+}
+
+void
+FlowMonitorOutputTestCase::SendUdp(Ptr<Socket> socket, uint32_t n)
+{
+    socket->Send(Create<Packet>(500));
+    if (n > 1)
+    {
+        Simulator::Schedule(MilliSeconds(1), &FlowMonitorOutputTestCase::SendUdp, socket, n - 1);
+    }
+}
+
+void
+FlowMonitorOutputTestCase::Drain(Ptr<Socket> socket)
+{
+    while (socket->Recv())
+    {
+    }
+}
+
+void
+FlowMonitorOutputTestCase::Accept(Ptr<Socket> socket, const Address& from)
+{
+    socket->SetRecvCallback(MakeCallback(&FlowMonitorOutputTestCase::Drain));
+}
+
+void
+FlowMonitorOutputTestCase::Connected(Ptr<Socket> socket)
+{
+    socket->Send(Create<Packet>(20000));
+    socket->Close();
+}
+
+std::string
+FlowMonitorOutputTestCase::GetXmlAttribute(const std::string& line, const std::string& name)
+{
+    std::string key = " " + name + "=\"";
+    std::size_t start = line.find(key);
+    if (start == std::string::npos)
+    {
+        return "";
+    }
+    start += key.size();
+    return line.substr(start, line.find('"', start) - start);
+}
+
+void
+FlowMonitorOutputTestCase::CheckXml(const std::string& xml,
+                                    const FlowMonitor::FlowStatsContainer& stats)
+{
+    std::istringstream is(xml);
+    std::string line;
+    uint32_t flows = 0;
+    // the classifiers list the flows too, after the statistics
+    while (std::getline(is, line) && line.find("</FlowStats>") == std::string::npos)
+    {
+        if (line.find("<Flow flowId=") == std::string::npos)
+        {
+            continue;
+        }
+        flows++;
+        FlowId flowId = std::stoul(GetXmlAttribute(line, "flowId"));
+        auto flow = stats.find(flowId);
+        NS_TEST_ASSERT_MSG_NE((flow != stats.end()), false, "XML flow " << flowId);
+        const FlowMonitor::FlowStats& s = flow->second;
+        NS_TEST_EXPECT_MSG_EQ(GetXmlAttribute(line, "txPackets"),
+                              std::to_string(s.txPackets),
+                              "XML txPackets of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(GetXmlAttribute(line, "rxPackets"),
+                              std::to_string(s.rxPackets),
+                              "XML rxPackets of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(GetXmlAttribute(line, "txBytes"),
+                              std::to_string(s.txBytes),
+                              "XML txBytes of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(GetXmlAttribute(line, "rxBytes"),
+                              std::to_string(s.rxBytes),
+                              "XML rxBytes of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(GetXmlAttribute(line, "lostPackets"),
+                              std::to_string(s.lostPackets),
+                              "XML lostPackets of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(GetXmlAttribute(line, "timesForwarded"),
+                              std::to_string(s.timesForwarded),
+                              "XML timesForwarded of flow " << flowId);
+    }
+    NS_TEST_EXPECT_MSG_EQ(flows, stats.size(), "flows in the XML output");
+}
+
+uint32_t
+FlowMonitorOutputTestCase::GetHistogramCount(const Histogram& h)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < h.GetNBins(); i++)
+    {
+        count += h.GetBinCount(i);
+    }
+    return count;
+}
+
+void
+FlowMonitorOutputTestCase::DoRun()
+{
+    NodeContainer nodes;
+    nodes.Create(3);
+    InternetStackHelper internet;
+    internet.Install(nodes);
+
+    SimpleNetDeviceHelper simpleHelper;
+    simpleHelper.SetNetDevicePointToPointMode(true);
+    simpleHelper.SetDeviceAttribute("DataRate", StringValue("10Mbps"));
+    simpleHelper.SetChannelAttribute("Delay", StringValue("1ms"));
+    NetDeviceContainer d01 = simpleHelper.Install(NodeContainer(nodes.Get(0), nodes.Get(1)));
+    NetDeviceContainer d12 = simpleHelper.Install(NodeContainer(nodes.Get(1), nodes.Get(2)));
+    // the third and eighth packets received by n2 are lost, both of the UDP flow
+    Ptr<ReceiveListErrorModel> loss = CreateObject<ReceiveListErrorModel>();
+    loss->SetList({2, 7});
+    d12.Get(1)->SetAttribute("ReceiveErrorModel", PointerValue(loss));
+
+    Ipv4AddressHelper ipv4("10.1.1.0", "255.255.255.0");
+    ipv4.Assign(d01);
+    ipv4.NewNetwork();
+    Ipv4Address n2 = ipv4.Assign(d12).GetAddress(1);
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    FlowMonitorHelper flowmon;
+    Ptr<FlowMonitor> monitor = flowmon.InstallAll();
+    monitor->SetAttribute("MaxPerHopDelay", TimeValue(Seconds(1)));
+    Ptr<Ipv4FlowClassifier> classifier = DynamicCast<Ipv4FlowClassifier>(flowmon.GetClassifier());
+
+    Ptr<Socket> udpSink = Socket::CreateSocket(nodes.Get(2), UdpSocketFactory::GetTypeId());
+    udpSink->Bind(InetSocketAddress(Ipv4Address::GetAny(), 9));
+    udpSink->SetRecvCallback(MakeCallback(&FlowMonitorOutputTestCase::Drain));
+    Ptr<Socket> udp = Socket::CreateSocket(nodes.Get(0), UdpSocketFactory::GetTypeId());
+    udp->Connect(InetSocketAddress(n2, 9));
+    Simulator::Schedule(Seconds(1), &FlowMonitorOutputTestCase::SendUdp, udp, 20);
+    Ptr<Socket> noRoute = Socket::CreateSocket(nodes.Get(0), UdpSocketFactory::GetTypeId());
+    noRoute->Connect(InetSocketAddress(Ipv4Address("10.9.9.9"), 9));
+    Simulator::Schedule(Seconds(1), &FlowMonitorOutputTestCase::SendUdp, noRoute, 5);
+
+    Ptr<Socket> tcpSink = Socket::CreateSocket(nodes.Get(2), TcpSocketFactory::GetTypeId());
+    tcpSink->Bind(InetSocketAddress(Ipv4Address::GetAny(), 50000));
+    tcpSink->Listen();
+    tcpSink->SetAcceptCallback(MakeNullCallback<bool, Ptr<Socket>, const Address&>(),
+                               MakeCallback(&FlowMonitorOutputTestCase::Accept));
+    Ptr<Socket> tcp = Socket::CreateSocket(nodes.Get(0), TcpSocketFactory::GetTypeId());
+    tcp->SetConnectCallback(MakeCallback(&FlowMonitorOutputTestCase::Connected),
+                            MakeNullCallback<void, Ptr<Socket>>());
+    Simulator::Schedule(Seconds(2), [tcp, n2]() { tcp->Connect(InetSocketAddress(n2, 50000)); });
+
+    Simulator::Stop(Seconds(5));
+    Simulator::Run();
+    monitor->CheckForLostPackets();
+
+    FlowId udpFlow = 0;
+    FlowId noRouteFlow = 0;
+    FlowId tcpFlow = 0;
+    const FlowMonitor::FlowStatsContainer& stats = monitor->GetFlowStats();
+    for (const auto& [flowId, flow] : stats)
+    {
+        Ipv4FlowClassifier::FiveTuple t = classifier->FindFlow(flowId);
+        if (t.protocol == 17 && t.destinationAddress == n2)
+        {
+            udpFlow = flowId;
+        }
+        else if (t.protocol == 17)
+        {
+            noRouteFlow = flowId;
+        }
+        else if (t.destinationPort == 50000)
+        {
+            tcpFlow = flowId;
+        }
+    }
+    NS_TEST_ASSERT_MSG_NE(udpFlow, 0, "UDP flow");
+    NS_TEST_ASSERT_MSG_NE(noRouteFlow, 0, "UDP flow without a route");
+    NS_TEST_ASSERT_MSG_NE(tcpFlow, 0, "TCP flow");
+
+    const FlowMonitor::FlowStats& u = stats.at(udpFlow);
+    NS_TEST_EXPECT_MSG_EQ(u.txPackets, 20, "UDP packets sent");
+    NS_TEST_EXPECT_MSG_EQ(u.rxPackets, 18, "UDP packets received");
+    NS_TEST_EXPECT_MSG_EQ(u.lostPackets, 2, "UDP packets lost");
+    NS_TEST_EXPECT_MSG_EQ(u.timesForwarded, 18, "UDP packets forwarded");
+    NS_TEST_EXPECT_MSG_EQ(u.rxBytes * 20, u.txBytes * 18, "UDP bytes received");
+    NS_TEST_EXPECT_MSG_EQ(GetHistogramCount(u.delayHistogram), 18, "UDP delay histogram");
+    NS_TEST_EXPECT_MSG_EQ(GetHistogramCount(u.packetSizeHistogram), 18, "UDP size histogram");
+    const FlowMonitor::FlowStats& r = stats.at(noRouteFlow);
+    NS_TEST_EXPECT_MSG_EQ(r.txPackets, 5, "packets sent without a route");
+    NS_TEST_EXPECT_MSG_EQ(r.rxPackets, 0, "packets received without a route");
+    NS_TEST_EXPECT_MSG_EQ(r.lostPackets, 5, "packets lost without a route");
+    NS_TEST_ASSERT_MSG_GT(r.packetsDropped.size(), Ipv4FlowProbe::DROP_NO_ROUTE, "drop reasons");
+    NS_TEST_EXPECT_MSG_EQ(r.packetsDropped[Ipv4FlowProbe::DROP_NO_ROUTE], 5, "no route drops");
+    const FlowMonitor::FlowStats& t = stats.at(tcpFlow);
+    NS_TEST_EXPECT_MSG_GT(t.rxBytes, 20000, "TCP bytes received");
+    NS_TEST_EXPECT_MSG_EQ(t.rxPackets, t.txPackets, "TCP packets received");
+    NS_TEST_EXPECT_MSG_EQ(t.lostPackets, 0, "TCP packets lost");
+
+    // the XML output without histograms leaves those of GetFlowStats alone
+    std::string xml = monitor->SerializeToXmlString(0, false, true);
+    NS_TEST_EXPECT_MSG_EQ((xml.find("<delayHistogram") == std::string::npos),
+                          true,
+                          "histograms in the XML output");
+    NS_TEST_EXPECT_MSG_NE((xml.find("<FlowProbes>") == std::string::npos),
+                          true,
+                          "probes in the XML output");
+    CheckXml(xml, monitor->GetFlowStats());
+    NS_TEST_EXPECT_MSG_EQ(GetHistogramCount(monitor->GetFlowStats().at(udpFlow).delayHistogram),
+                          18,
+                          "UDP delay histogram after the XML output");
+    xml = monitor->SerializeToXmlString(0, true, false);
+    NS_TEST_EXPECT_MSG_NE((xml.find("<delayHistogram") == std::string::npos),
+                          true,
+                          "histograms in the XML output");
+    CheckXml(xml, monitor->GetFlowStats());
+
+    std::ostringstream csv;
+    monitor->SerializeToCsvStream(csv);
+    std::istringstream lines(csv.str());
+    std::string line;
+    std::getline(lines, line);
+    std::map<std::string, uint32_t> column;
+    std::istringstream header(line);
+    uint32_t columns = 0;
+    for (std::string name; std::getline(header, name, ',');)
+    {
+        column[name] = columns++;
+    }
+    uint32_t flows = 0;
+    while (std::getline(lines, line))
+    {
+        flows++;
+        std::vector<std::string> fields;
+        std::istringstream row(line);
+        for (std::string field; std::getline(row, field, ',');)
+        {
+            fields.push_back(field);
+        }
+        NS_TEST_ASSERT_MSG_EQ(fields.size(), columns, "CSV line " << line);
+        FlowId flowId = std::stoul(fields[column["flowId"]]);
+        const FlowMonitor::FlowStats& s = monitor->GetFlowStats().at(flowId);
+        NS_TEST_EXPECT_MSG_EQ(fields[column["txPackets"]],
+                              std::to_string(s.txPackets),
+                              "CSV txPackets of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(fields[column["rxPackets"]],
+                              std::to_string(s.rxPackets),
+                              "CSV rxPackets of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(fields[column["rxBytes"]],
+                              std::to_string(s.rxBytes),
+                              "CSV rxBytes of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(fields[column["lostPackets"]],
+                              std::to_string(s.lostPackets),
+                              "CSV lostPackets of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(fields[column["delaySum"]],
+                              std::to_string(s.delaySum.GetNanoSeconds()),
+                              "CSV delaySum of flow " << flowId);
+        NS_TEST_EXPECT_MSG_EQ(fields[column["packetsDropped"]],
+                              (flowId == noRouteFlow ? "5" : "0"),
+                              "CSV packetsDropped of flow " << flowId);
+    }
+    NS_TEST_EXPECT_MSG_EQ(flows, monitor->GetFlowStats().size(), "flows in the CSV output");
+
+    // the merged statistics follow a reset and the packets after it
+    monitor->ResetAllStats();
+    NS_TEST_EXPECT_MSG_EQ(monitor->GetFlowStats().at(udpFlow).txPackets, 0, "UDP after reset");
+    NS_TEST_EXPECT_MSG_EQ(monitor->GetFlowStats().at(udpFlow).lostPackets, 0, "lost after reset");
+    Simulator::Schedule(Seconds(0), &FlowMonitorOutputTestCase::SendUdp, udp, 3);
+    Simulator::Stop(Seconds(1));
+    Simulator::Run();
+    NS_TEST_EXPECT_MSG_EQ(monitor->GetFlowStats().at(udpFlow).txPackets, 3, "UDP sent again");
+    NS_TEST_EXPECT_MSG_EQ(monitor->GetFlowStats().at(udpFlow).rxPackets, 3, "UDP received again");
+
+    Simulator::Destroy();
+}
+
+/**
+ * \ingroup flow-monitor-test
+ *
+ * \brief FlowMonitor TestSuite
+ */
+class FlowMonitorTestSuite : public TestSuite
+{
+  public:
+    FlowMonitorTestSuite();
+};
+
+FlowMonitorTestSuite::FlowMonitorTestSuite()
+    : TestSuite("flow-monitor", Type::UNIT)
+{
+    AddTestCase(new OpenHashMapTestCase<std::hash<uint64_t>>("identity", 4096),
+                TestCase::Duration::QUICK);
+    AddTestCase(new OpenHashMapTestCase<OpenHashMapCollidingHash>("colliding", 256),
+                TestCase::Duration::QUICK);
+    AddTestCase(new FlowMonitorOutputTestCase, TestCase::Duration::QUICK);
+}
+
+static FlowMonitorTestSuite g_flowMonitorTestSuite; //!< Static variable for test initialization
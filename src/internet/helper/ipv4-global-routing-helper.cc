@@ -61,4 +61,10 @@ Ipv4GlobalRoutingHelper::RecomputeRoutingTables()
     GlobalRouteManager::InitializeRoutes();
 }
 
+void
+Ipv4GlobalRoutingHelper::UpdateRoutingTables()
+{
+    GlobalRouteManager::UpdateRoutes();
+}
+
 } // namespace ns3
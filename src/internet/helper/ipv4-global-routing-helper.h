@@ -78,6 +78,21 @@ class Ipv4GlobalRoutingHelper : public Ipv4RoutingHelper
      *
      */
     static void RecomputeRoutingTables();
+
+    /**
+     * \brief Update the routes after a change of the topology, such as a link
+     * that went down or up.
+     *
+     * The routing tables end up with the same routes as with
+     * RecomputeRoutingTables(), but the shortest path trees of the previous
+     * computation are repaired instead of recomputed, and only the routes
+     * that changed are replaced.  Replaced routes are appended to the tables,
+     * so network routes matching the same destination may be in a different
+     * order, and a per-flow ECMP hash may pick another of them.  Falls back to
+     * RecomputeRoutingTables() when the topology is not made of point-to-point
+     * links or the set of routers changed.
+     */
+    static void UpdateRoutingTables();
 };
 
 } // namespace ns3
@@ -15,17 +15,24 @@
 #include "candidate-queue.h"
 #include "global-router-interface.h"
 #include "ipv4-global-routing.h"
+#include "ipv4-routing-table-entry.h"
 #include "ipv4.h"
 
 #include "ns3/assert.h"
 #include "ns3/fatal-error.h"
+#include "ns3/global-value.h"
 #include "ns3/log.h"
 #include "ns3/node-list.h"
 #include "ns3/simulator.h"
+#include "ns3/uinteger.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <queue>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -34,6 +41,52 @@ namespace ns3
 
 NS_LOG_COMPONENT_DEFINE("GlobalRouteManagerImpl");
 
+/**
+ * \ingroup globalrouting
+ * \brief Number of threads of the compact SPF, 0 for one per hardware thread
+ */
+static GlobalValue g_globalRoutingThreads(
+    "GlobalRoutingThreads",
+    "The number of threads computing global routes, 0 for one per hardware thread",
+    UintegerValue(0),
+    MakeUintegerChecker<uint32_t>());
+
+/**
+ * \brief Run f(task) for every task in [0, n) on the GlobalRoutingThreads threads.
+ *
+ * \param n number of tasks
+ * \param f the task function
+ */
+static void
+SpfParallelFor(uint32_t n, const std::function<void(uint32_t)>& f)
+{
+    UintegerValue value;
+    g_globalRoutingThreads.GetValue(value);
+    uint32_t threads = value.Get();
+    if (threads == 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, std::max(n, 1U));
+    std::atomic<uint32_t> next(0);
+    auto worker = [&]() {
+        for (uint32_t task = next++; task < n; task = next++)
+        {
+            f(task);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (uint32_t t = 1; t < threads; t++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool)
+    {
+        t.join();
+    }
+}
+
 /**
  * \brief Stream insertion operator.
  *
@@ -485,16 +538,27 @@ GlobalRouteManagerLSDB::GetLSA(Ipv4Address addr) const
     //
     // Look up an LSA by its address.
     //
-    for (auto i = m_database.begin(); i != m_database.end(); i++)
+    auto i = m_database.find(addr);
+    if (i != m_database.end())
     {
-        if (i->first == addr)
-        {
-            return i->second;
-        }
+        return i->second;
     }
     return nullptr;
 }
 
+std::vector<GlobalRoutingLSA*>
+GlobalRouteManagerLSDB::GetLSAs() const
+{
+    NS_LOG_FUNCTION(this);
+    std::vector<GlobalRoutingLSA*> lsas;
+    lsas.reserve(m_database.size());
+    for (auto i = m_database.begin(); i != m_database.end(); i++)
+    {
+        lsas.push_back(i->second);
+    }
+    return lsas;
+}
+
 GlobalRoutingLSA*
 GlobalRouteManagerLSDB::GetLSAByLinkData(Ipv4Address addr) const
 {
@@ -550,6 +614,8 @@ GlobalRouteManagerImpl::DebugUseLsdb(GlobalRouteManagerLSDB* lsdb)
         delete m_lsdb;
     }
     m_lsdb = lsdb;
+    m_spfGraph.clear();
+    m_spfTrees.clear();
 }
 
 void
@@ -584,6 +650,8 @@ GlobalRouteManagerImpl::DeleteGlobalRoutes()
         delete m_lsdb;
         m_lsdb = new GlobalRouteManagerLSDB();
     }
+    m_spfGraph.clear();
+    m_spfTrees.clear();
 }
 
 //
@@ -681,6 +749,32 @@ void
 GlobalRouteManagerImpl::InitializeRoutes()
 {
     NS_LOG_FUNCTION(this);
+    m_spfGraph.clear();
+    m_spfTrees.clear();
+    //
+    // Most topologies are routers joined by point-to-point links.  The SPF of
+    // every root then runs on a compact copy of the LSDB, which leaves the
+    // LSAs alone, so that the roots are computed in parallel.
+    //
+    std::vector<SpfRouter> routers;
+    if (BuildSpfGraph(routers))
+    {
+        NS_LOG_INFO("About to start compact SPF calculation");
+        std::vector<uint32_t> roots;
+        for (uint32_t v = 0; v < routers.size(); v++)
+        {
+            if (routers[v].routing)
+            {
+                roots.push_back(v);
+            }
+        }
+        m_spfTrees.resize(routers.size());
+        SpfParallelFor(roots.size(),
+                       [&](uint32_t i) { SpfCompute(routers, roots[i], m_spfTrees[roots[i]]); });
+        m_spfGraph.swap(routers);
+        NS_LOG_INFO("Finished SPF calculation");
+        return;
+    }
     //
     // Walk the list of nodes in the system.
     //
@@ -715,6 +809,104 @@ GlobalRouteManagerImpl::InitializeRoutes()
     NS_LOG_INFO("Finished SPF calculation");
 }
 
+void
+GlobalRouteManagerImpl::UpdateRoutes()
+{
+    NS_LOG_FUNCTION(this);
+    if (m_spfTrees.empty())
+    {
+        DeleteGlobalRoutes();
+        BuildGlobalRoutingDatabase();
+        InitializeRoutes();
+        return;
+    }
+
+    delete m_lsdb;
+    m_lsdb = new GlobalRouteManagerLSDB();
+    BuildGlobalRoutingDatabase();
+    std::vector<SpfRouter> routers;
+    bool sameRouters = BuildSpfGraph(routers) && routers.size() == m_spfGraph.size();
+    for (uint32_t v = 0; sameRouters && v < routers.size(); v++)
+    {
+        sameRouters =
+            routers[v].id == m_spfGraph[v].id && routers[v].routing == m_spfGraph[v].routing;
+    }
+    if (!sameRouters)
+    {
+        NS_LOG_INFO("Routers changed, recomputing all routes");
+        DeleteGlobalRoutes();
+        BuildGlobalRoutingDatabase();
+        InitializeRoutes();
+        return;
+    }
+
+    //
+    // Find the routers whose LSA changed.  The link data of the peer back to
+    // a router is compared too, as the root exits through a link use it.
+    //
+    std::vector<uint8_t> changed(routers.size(), 0);
+    std::vector<uint32_t> changedList;
+    for (uint32_t v = 0; v < routers.size(); v++)
+    {
+        const SpfRouter& a = m_spfGraph[v];
+        const SpfRouter& b = routers[v];
+        bool same = a.links.size() == b.links.size() && a.stubs.size() == b.stubs.size();
+        for (uint32_t k = 0; same && k < a.links.size(); k++)
+        {
+            same = a.links[k].peer == b.links[k].peer && a.links[k].metric == b.links[k].metric &&
+                   a.links[k].local == b.links[k].local &&
+                   a.links[k].remote == b.links[k].remote && a.links[k].outIf == b.links[k].outIf;
+        }
+        for (uint32_t k = 0; same && k < a.stubs.size(); k++)
+        {
+            same = a.stubs[k].network == b.stubs[k].network && a.stubs[k].mask == b.stubs[k].mask;
+        }
+        if (!same)
+        {
+            changed[v] = 1;
+            changedList.push_back(v);
+        }
+    }
+    NS_LOG_INFO(changedList.size() << " of " << routers.size() << " router LSAs changed");
+
+    if (!changedList.empty())
+    {
+        std::vector<uint32_t> roots;
+        for (uint32_t v = 0; v < routers.size(); v++)
+        {
+            if (routers[v].routing)
+            {
+                roots.push_back(v);
+            }
+        }
+        SpfParallelFor(roots.size(), [&](uint32_t i) {
+            uint32_t root = roots[i];
+            SpfTree& tree = m_spfTrees[root];
+            if (!changed[root] && !tree.stub)
+            {
+                SpfRepair(m_spfGraph, routers, changed, changedList, root, tree);
+                return;
+            }
+            // a stub root only has a default route through its neighbor
+            bool affected = changed[root];
+            for (auto l = routers[root].links.begin(); l != routers[root].links.end(); l++)
+            {
+                affected = affected || changed[l->peer];
+            }
+            if (affected)
+            {
+                Ipv4GlobalRouting* gr = routers[root].routing;
+                for (uint32_t j = gr->GetNRoutes(); j > 0; j--)
+                {
+                    gr->RemoveRoute(0);
+                }
+                SpfCompute(routers, root, tree);
+            }
+        });
+    }
+    m_spfGraph.swap(routers);
+}
+
 //
 // This method is derived from quagga ospf_spf_next ().  See RFC2328 Section
 // 16.1 (2) for further details.
@@ -2161,4 +2353,587 @@ GlobalRouteManagerImpl::SPFVertexAddParent(SPFVertex* v)
     }
 }
 
+bool
+GlobalRouteManagerImpl::BuildSpfGraph(std::vector<SpfRouter>& routers) const
+{
+    NS_LOG_FUNCTION(this);
+    if (m_lsdb->GetNumExtLSAs() > 0)
+    {
+        return false;
+    }
+    std::vector<GlobalRoutingLSA*> lsas = m_lsdb->GetLSAs();
+    std::map<Ipv4Address, uint32_t> index;
+    for (uint32_t v = 0; v < lsas.size(); v++)
+    {
+        if (lsas[v]->GetLSType() != GlobalRoutingLSA::RouterLSA)
+        {
+            return false;
+        }
+        index[lsas[v]->GetLinkStateId()] = v;
+    }
+
+    routers.assign(lsas.size(), SpfRouter());
+    for (uint32_t v = 0; v < lsas.size(); v++)
+    {
+        GlobalRoutingLSA* lsa = lsas[v];
+        SpfRouter& r = routers[v];
+        r.id = lsa->GetLinkStateId();
+        r.routing = nullptr;
+        Ptr<Node> node = lsa->GetNode();
+        Ptr<Ipv4> ipv4 = node ? node->GetObject<Ipv4>() : nullptr;
+        Ptr<GlobalRouter> rtr = node ? node->GetObject<GlobalRouter>() : nullptr;
+        if (rtr && rtr->GetRoutingProtocol())
+        {
+            r.routing = PeekPointer(rtr->GetRoutingProtocol());
+        }
+#ifdef NS3_MPI
+        // Only the nodes of our systemId are roots (distributed sim)
+        if (node && node->GetSystemId() != Simulator::GetSystemId())
+        {
+            r.routing = nullptr;
+        }
+#endif
+        for (uint32_t i = 0; i < lsa->GetNLinkRecords(); i++)
+        {
+            GlobalRoutingLinkRecord* l = lsa->GetLinkRecord(i);
+            if (l->GetLinkType() == GlobalRoutingLinkRecord::StubNetwork)
+            {
+                Ipv4Mask mask(l->GetLinkData().Get());
+                r.stubs.push_back(SpfStub{l->GetLinkId().CombineMask(mask), mask});
+                continue;
+            }
+            if (l->GetLinkType() != GlobalRoutingLinkRecord::PointToPoint || l->GetMetric() == 0)
+            {
+                return false;
+            }
+            auto peer = index.find(l->GetLinkId());
+            if (peer == index.end())
+            {
+                return false;
+            }
+            SpfLink link;
+            link.peer = peer->second;
+            link.metric = l->GetMetric();
+            link.local = l->GetLinkData();
+            link.outIf = ipv4 ? ipv4->GetInterfaceForPrefix(link.local, Ipv4Mask::GetOnes()) : -1;
+            // the first record of the peer back to us gives the next hop, as
+            // in SPFGetNextLink, and there must be a point-to-point one
+            bool found = false;
+            bool back = false;
+            GlobalRoutingLSA* peerLsa = lsas[peer->second];
+            for (uint32_t j = 0; !back && j < peerLsa->GetNLinkRecords(); j++)
+            {
+                GlobalRoutingLinkRecord* b = peerLsa->GetLinkRecord(j);
+                if (b->GetLinkId() != r.id)
+                {
+                    continue;
+                }
+                if (!found)
+                {
+                    link.remote = b->GetLinkData();
+                    found = true;
+                }
+                back = b->GetLinkType() == GlobalRoutingLinkRecord::PointToPoint;
+            }
+            if (!back)
+            {
+                return false;
+            }
+            r.links.push_back(link);
+        }
+    }
+    for (uint32_t v = 0; v < routers.size(); v++)
+    {
+        for (uint32_t k = 0; k < routers[v].links.size(); k++)
+        {
+            routers[routers[v].links[k].peer].in.emplace_back(v, k);
+        }
+    }
+    return true;
+}
+
+uint32_t
+GlobalRouteManagerImpl::SpfInternExits(SpfTree& tree, const SpfExits& exits)
+{
+    auto i = tree.setId.find(exits);
+    if (i != tree.setId.end())
+    {
+        return i->second;
+    }
+    tree.sets.push_back(exits);
+    tree.setId.emplace(exits, tree.sets.size() - 1);
+    return tree.sets.size() - 1;
+}
+
+void
+GlobalRouteManagerImpl::SpfAddHostRoutes(Ipv4GlobalRouting* gr,
+                                         const SpfRouter& v,
+                                         const SpfExits& exits)
+{
+    for (auto l = v.links.begin(); l != v.links.end(); l++)
+    {
+        for (auto e = exits.begin(); e != exits.end(); e++)
+        {
+            if (e->second >= 0)
+            {
+                gr->AddHostRouteTo(l->local, e->first, e->second);
+            }
+        }
+    }
+}
+
+void
+GlobalRouteManagerImpl::SpfAddStubRoutes(Ipv4GlobalRouting* gr,
+                                         const SpfRouter& v,
+                                         const SpfExits& exits)
+{
+    for (auto s = v.stubs.begin(); s != v.stubs.end(); s++)
+    {
+        for (auto e = exits.begin(); e != exits.end(); e++)
+        {
+            if (e->second >= 0)
+            {
+                gr->AddNetworkRouteTo(s->network, s->mask, e->first, e->second);
+            }
+        }
+    }
+}
+
+//
+// The compact SPF follows SPFCalculate step by step, so that the routes are
+// the same and added in the same order: CheckForStubNode, then the candidate
+// queue ordered by distance and, for equal distances, by the time a router
+// was added or its distance last decreased, host routes when a router is
+// popped, and stub routes in a depth first walk of the children, in the
+// order they were popped.
+//
+void
+GlobalRouteManagerImpl::SpfCompute(const std::vector<SpfRouter>& routers,
+                                   uint32_t root,
+                                   SpfTree& tree)
+{
+    uint32_t n = routers.size();
+    Ipv4GlobalRouting* gr = routers[root].routing;
+    std::vector<uint32_t>& dist = tree.dist;
+    tree.stub = false;
+    dist.assign(n, SPF_INFINITY);
+    tree.exits.assign(n, 0);
+    tree.sets.assign(1, SpfExits());
+    tree.setId.clear();
+    tree.setId.emplace(SpfExits(), 0);
+    dist[root] = 0;
+
+    const std::vector<SpfLink>& rootLinks = routers[root].links;
+    if (rootLinks.size() <= 1)
+    {
+        tree.stub = true;
+        if (!rootLinks.empty())
+        {
+            const SpfLink& l = rootLinks[0];
+            const std::vector<SpfLink>& peerLinks = routers[l.peer].links;
+            for (auto back = peerLinks.begin(); back != peerLinks.end(); back++)
+            {
+                if (back->peer == root)
+                {
+                    gr->AddNetworkRouteTo(Ipv4Address("0.0.0.0"),
+                                          Ipv4Mask("0.0.0.0"),
+                                          back->local,
+                                          l.outIf);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+
+    std::vector<SpfExits> exits(n);
+    std::vector<uint8_t> state(n, GlobalRoutingLSA::LSA_SPF_NOT_EXPLORED);
+    std::vector<uint32_t> seq(n);
+    typedef std::tuple<uint32_t, uint32_t, uint32_t> Candidate; // distance, seq, router
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<>> candidates;
+    std::vector<uint32_t> order;
+    uint32_t nextSeq = 0;
+    state[root] = GlobalRoutingLSA::LSA_SPF_IN_SPFTREE;
+    for (uint32_t v = root; v < n;)
+    {
+        for (auto l = routers[v].links.begin(); l != routers[v].links.end(); l++)
+        {
+            uint32_t w = l->peer;
+            uint32_t distance = dist[v] + l->metric;
+            if (state[w] == GlobalRoutingLSA::LSA_SPF_IN_SPFTREE ||
+                (state[w] == GlobalRoutingLSA::LSA_SPF_CANDIDATE && dist[w] < distance))
+            {
+                continue;
+            }
+            if (state[w] == GlobalRoutingLSA::LSA_SPF_CANDIDATE && dist[w] == distance)
+            {
+                if (v == root)
+                {
+                    exits[w].emplace_back(l->remote, l->outIf);
+                }
+                else
+                {
+                    exits[w].insert(exits[w].end(), exits[v].begin(), exits[v].end());
+                }
+                std::sort(exits[w].begin(), exits[w].end());
+                exits[w].erase(std::unique(exits[w].begin(), exits[w].end()), exits[w].end());
+                continue;
+            }
+            if (v == root)
+            {
+                exits[w].assign(1, SPFVertex::NodeExit_t(l->remote, l->outIf));
+            }
+            else
+            {
+                exits[w] = exits[v];
+            }
+            dist[w] = distance;
+            state[w] = GlobalRoutingLSA::LSA_SPF_CANDIDATE;
+            seq[w] = nextSeq++;
+            candidates.emplace(distance, seq[w], w);
+        }
+        v = n;
+        while (!candidates.empty())
+        {
+            auto [d, s, w] = candidates.top();
+            candidates.pop();
+            if (state[w] == GlobalRoutingLSA::LSA_SPF_CANDIDATE && seq[w] == s)
+            {
+                v = w;
+                break;
+            }
+        }
+        if (v < n)
+        {
+            state[v] = GlobalRoutingLSA::LSA_SPF_IN_SPFTREE;
+            order.push_back(v);
+            SpfAddHostRoutes(gr, routers[v], exits[v]);
+        }
+    }
+
+    // the parents of a router are the routers of the tree it is one link
+    // farther from, and it is their child in the order it was popped
+    std::vector<std::vector<uint32_t>> children(n);
+    for (uint32_t c : order)
+    {
+        for (auto e = routers[c].in.begin(); e != routers[c].in.end(); e++)
+        {
+            uint32_t p = e->first;
+            if (state[p] == GlobalRoutingLSA::LSA_SPF_IN_SPFTREE &&
+                dist[p] + routers[p].links[e->second].metric == dist[c] &&
+                (children[p].empty() || children[p].back() != c))
+            {
+                children[p].push_back(c);
+            }
+        }
+    }
+    std::vector<uint8_t> visited(n, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack(1, std::make_pair(root, 0));
+    while (!stack.empty())
+    {
+        std::pair<uint32_t, uint32_t>& top = stack.back();
+        if (top.second == children[top.first].size())
+        {
+            stack.pop_back();
+            continue;
+        }
+        uint32_t c = children[top.first][top.second++];
+        if (!visited[c])
+        {
+            visited[c] = 1;
+            SpfAddStubRoutes(gr, routers[c], exits[c]);
+            stack.emplace_back(c, 0);
+        }
+    }
+
+    for (uint32_t v : order)
+    {
+        tree.exits[v] = SpfInternExits(tree, exits[v]);
+    }
+}
+
+//
+// The repair has three steps.  First, the routers that lost all their
+// shortest paths because a changed router no longer has the link or has a
+// higher metric are found in order of distance, as in Ramalingam and Reps:
+// a router is lost if none of its links from a router that is not lost
+// still gives its distance.  Second, the distances of the lost routers and
+// of the routers that a changed router now reaches at a lower cost are
+// settled by Dijkstra from there.  Third, the exits are recomputed in order
+// of distance from every router that may have different parents, and the
+// change is followed down to the children.  The routes to the routers whose
+// exits changed, or whose LSA changed, are then replaced.
+//
+void
+GlobalRouteManagerImpl::SpfRepair(const std::vector<SpfRouter>& before,
+                                  const std::vector<SpfRouter>& after,
+                                  const std::vector<uint8_t>& changed,
+                                  const std::vector<uint32_t>& changedList,
+                                  uint32_t root,
+                                  SpfTree& tree)
+{
+    enum
+    {
+        DECIDED = 1, // checked for the loss of its shortest paths
+        LOST = 2,    // lost all its shortest paths
+        MOVED = 4,   // distance saved in moved
+        DONE = 8,    // exits recomputed
+        PATCHED = 16 // exits saved in patched
+    };
+
+    uint32_t n = after.size();
+    std::vector<uint32_t>& dist = tree.dist;
+    std::vector<uint8_t> flags(n, 0);
+    typedef std::pair<uint32_t, uint32_t> Item; // distance, router
+    std::priority_queue<Item, std::vector<Item>, std::greater<>> queue;
+
+    // the lost routers
+    std::vector<uint32_t> lost;
+    for (uint32_t u : changedList)
+    {
+        if (dist[u] == SPF_INFINITY)
+        {
+            continue;
+        }
+        for (auto l = before[u].links.begin(); l != before[u].links.end(); l++)
+        {
+            if (dist[u] + l->metric == dist[l->peer])
+            {
+                queue.emplace(dist[l->peer], l->peer);
+            }
+        }
+    }
+    while (!queue.empty())
+    {
+        uint32_t w = queue.top().second;
+        queue.pop();
+        if (flags[w] & DECIDED)
+        {
+            continue;
+        }
+        flags[w] |= DECIDED;
+        bool kept = false;
+        for (auto e = after[w].in.begin(); !kept && e != after[w].in.end(); e++)
+        {
+            uint32_t p = e->first;
+            kept = !(flags[p] & LOST) && dist[p] != SPF_INFINITY &&
+                   dist[p] + after[p].links[e->second].metric == dist[w];
+        }
+        if (kept)
+        {
+            continue;
+        }
+        flags[w] |= LOST;
+        lost.push_back(w);
+        for (auto l = before[w].links.begin(); l != before[w].links.end(); l++)
+        {
+            if (dist[w] + l->metric == dist[l->peer])
+            {
+                queue.emplace(dist[l->peer], l->peer);
+            }
+        }
+    }
+
+    // the new distances
+    std::vector<std::pair<uint32_t, uint32_t>> moved; // router, distance before
+    auto setDist = [&](uint32_t w, uint32_t d) {
+        if (!(flags[w] & MOVED))
+        {
+            flags[w] |= MOVED;
+            moved.emplace_back(w, dist[w]);
+        }
+        dist[w] = d;
+    };
+    for (uint32_t w : lost)
+    {
+        setDist(w, SPF_INFINITY);
+    }
+    for (uint32_t w : lost)
+    {
+        uint32_t best = SPF_INFINITY;
+        for (auto e = after[w].in.begin(); e != after[w].in.end(); e++)
+        {
+            if (dist[e->first] != SPF_INFINITY)
+            {
+                best = std::min(best, dist[e->first] + after[e->first].links[e->second].metric);
+            }
+        }
+        if (best != SPF_INFINITY)
+        {
+            setDist(w, best);
+            queue.emplace(best, w);
+        }
+    }
+    for (uint32_t u : changedList)
+    {
+        if (dist[u] == SPF_INFINITY || (flags[u] & LOST))
+        {
+            continue; // a lost router is relaxed when it is settled
+        }
+        for (auto l = after[u].links.begin(); l != after[u].links.end(); l++)
+        {
+            if (dist[u] + l->metric < dist[l->peer])
+            {
+                setDist(l->peer, dist[u] + l->metric);
+                queue.emplace(dist[l->peer], l->peer);
+            }
+        }
+    }
+    while (!queue.empty())
+    {
+        auto [d, w] = queue.top();
+        queue.pop();
+        if (d != dist[w])
+        {
+            continue;
+        }
+        for (auto l = after[w].links.begin(); l != after[w].links.end(); l++)
+        {
+            if (d + l->metric < dist[l->peer])
+            {
+                setDist(l->peer, d + l->metric);
+                queue.emplace(d + l->metric, l->peer);
+            }
+        }
+    }
+
+    // the new exits
+    std::vector<std::pair<uint32_t, uint32_t>> patched; // router, exits before
+    auto setExits = [&](uint32_t w, uint32_t id) {
+        if (!(flags[w] & PATCHED))
+        {
+            flags[w] |= PATCHED;
+            patched.emplace_back(w, tree.exits[w]);
+        }
+        tree.exits[w] = id;
+    };
+    auto seed = [&](uint32_t w) {
+        if (dist[w] != SPF_INFINITY)
+        {
+            queue.emplace(dist[w], w);
+        }
+        else if (tree.exits[w] != 0)
+        {
+            setExits(w, 0);
+        }
+    };
+    for (auto m = moved.begin(); m != moved.end(); m++)
+    {
+        seed(m->first);
+        for (auto l = after[m->first].links.begin(); l != after[m->first].links.end(); l++)
+        {
+            seed(l->peer);
+        }
+    }
+    for (uint32_t u : changedList)
+    {
+        for (auto l = before[u].links.begin(); l != before[u].links.end(); l++)
+        {
+            seed(l->peer);
+        }
+        for (auto l = after[u].links.begin(); l != after[u].links.end(); l++)
+        {
+            seed(l->peer);
+        }
+    }
+    for (auto l = after[root].links.begin(); l != after[root].links.end(); l++)
+    {
+        if (changed[l->peer])
+        {
+            seed(l->peer);
+        }
+    }
+    SpfExits exits;
+    while (!queue.empty())
+    {
+        auto [d, w] = queue.top();
+        queue.pop();
+        if (w == root || d != dist[w] || (flags[w] & DONE))
+        {
+            continue;
+        }
+        flags[w] |= DONE;
+        exits.clear();
+        for (auto e = after[w].in.begin(); e != after[w].in.end(); e++)
+        {
+            uint32_t p = e->first;
+            const SpfLink& l = after[p].links[e->second];
+            if (dist[p] == SPF_INFINITY || dist[p] + l.metric != d)
+            {
+                continue;
+            }
+            if (p == root)
+            {
+                exits.emplace_back(l.remote, l.outIf);
+            }
+            else
+            {
+                const SpfExits& parent = tree.sets[tree.exits[p]];
+                exits.insert(exits.end(), parent.begin(), parent.end());
+            }
+        }
+        std::sort(exits.begin(), exits.end());
+        exits.erase(std::unique(exits.begin(), exits.end()), exits.end());
+        uint32_t id = SpfInternExits(tree, exits);
+        if (id == tree.exits[w])
+        {
+            continue;
+        }
+        setExits(w, id);
+        for (auto l = after[w].links.begin(); l != after[w].links.end(); l++)
+        {
+            if (d + l->metric == dist[l->peer])
+            {
+                queue.emplace(dist[l->peer], l->peer);
+            }
+        }
+    }
+
+    // the routes to the changed routers are replaced as well
+    for (uint32_t u : changedList)
+    {
+        if (u != root && tree.exits[u] != 0 && !(flags[u] & PATCHED))
+        {
+            flags[u] |= PATCHED;
+            patched.emplace_back(u, tree.exits[u]);
+        }
+    }
+    if (patched.empty())
+    {
+        return;
+    }
+    Ipv4GlobalRouting* gr = after[root].routing;
+    std::vector<Ipv4Address> hosts;
+    std::vector<Ipv4RoutingTableEntry> networks;
+    for (auto p = patched.begin(); p != patched.end(); p++)
+    {
+        const SpfRouter& v = before[p->first];
+        const SpfExits& old = tree.sets[p->second];
+        for (auto l = v.links.begin(); !old.empty() && l != v.links.end(); l++)
+        {
+            hosts.push_back(l->local);
+        }
+        for (auto s = v.stubs.begin(); s != v.stubs.end(); s++)
+        {
+            for (auto e = old.begin(); e != old.end(); e++)
+            {
+                if (e->second >= 0)
+                {
+                    networks.push_back(Ipv4RoutingTableEntry::CreateNetworkRouteTo(s->network,
+                                                                                   s->mask,
+                                                                                   e->first,
+                                                                                   e->second));
+                }
+            }
+        }
+    }
+    gr->RemoveRoutes(hosts, networks);
+    for (auto p = patched.begin(); p != patched.end(); p++)
+    {
+        const SpfExits& now = tree.sets[tree.exits[p->first]];
+        SpfAddHostRoutes(gr, after[p->first], now);
+        SpfAddStubRoutes(gr, after[p->first], now);
+    }
+}
+
 } // namespace ns3
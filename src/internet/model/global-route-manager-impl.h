@@ -20,6 +20,7 @@
 #include <map>
 #include <queue>
 #include <stdint.h>
+#include <utility>
 #include <vector>
 
 namespace ns3
@@ -661,6 +662,13 @@ class GlobalRouteManagerLSDB
      */
     uint32_t GetNumExtLSAs() const;
 
+    /**
+     * @brief Get the Link State Advertisements other than the external ones.
+     *
+     * @returns the LSAs, in link state ID order
+     */
+    std::vector<GlobalRoutingLSA*> GetLSAs() const;
+
   private:
     typedef std::map<Ipv4Address, GlobalRoutingLSA*>
         LSDBMap_t; //!< container of IPv4 addresses / Link State Advertisements
@@ -711,9 +719,35 @@ class GlobalRouteManagerImpl
     /**
      * @brief Compute routes using a Dijkstra SPF computation and populate
      * per-node forwarding tables
+     *
+     * When all LSAs are router LSAs with point-to-point and stub network
+     * records, every link has a record in both directions and every metric is
+     * positive, the SPF runs on a compact copy of the LSDB, one root per task
+     * on "GlobalRoutingThreads" threads, and installs the same routes in the
+     * same order as SPFCalculate.  The trees are kept for UpdateRoutes.
+     * Otherwise SPFCalculate runs for one root after the other.
      */
     virtual void InitializeRoutes();
 
+    /**
+     * @brief Update the per-node forwarding tables after a change of the
+     * topology, reusing the shortest path trees of the last computation.
+     *
+     * The LSDB is rebuilt and compared with the previous one.  For every root
+     * whose own LSA did not change, only the part of the tree that depends on
+     * the changed LSAs is recomputed, and only the routes to the routers whose
+     * root exits changed are replaced.  The other roots are recomputed from
+     * scratch.  If the previous routes were not computed by the compact SPF
+     * (see InitializeRoutes), or the set of routers changed, this is
+     * DeleteGlobalRoutes, BuildGlobalRoutingDatabase and InitializeRoutes.
+     *
+     * The routes of a node are those a full recomputation would install, but
+     * replaced routes are appended to the table, so network routes of
+     * different routers that match the same destination may be in a
+     * different order.
+     */
+    virtual void UpdateRoutes();
+
     /**
      * @brief Debugging routine; allow client code to supply a pre-built LSDB
      * @param lsdb the pre-built LSDB
@@ -909,6 +943,112 @@ class GlobalRouteManagerImpl
      * \return the outgoing interface number
      */
     int32_t FindOutgoingInterfaceId(Ipv4Address a, Ipv4Mask amask = Ipv4Mask("255.255.255.255"));
+
+    /// Exits of the root towards a router, sorted, as in SPFVertex
+    typedef std::vector<SPFVertex::NodeExit_t> SpfExits;
+
+    /// A point-to-point link record of a router of the compact SPF graph
+    struct SpfLink
+    {
+        uint32_t peer;      //!< index of the router at the other end
+        uint32_t metric;    //!< metric of the link
+        Ipv4Address local;  //!< link data of the record, the local address
+        Ipv4Address remote; //!< link data of the first record of the peer back to this router
+        int32_t outIf;      //!< interface of the local address
+    };
+
+    /// A stub network record of a router of the compact SPF graph
+    struct SpfStub
+    {
+        Ipv4Address network; //!< the network
+        Ipv4Mask mask;       //!< its mask
+    };
+
+    /// A router of the compact SPF graph
+    struct SpfRouter
+    {
+        Ipv4Address id;              //!< router ID
+        Ipv4GlobalRouting* routing;  //!< routing of the node, null if it is not a root
+        std::vector<SpfLink> links;  //!< point-to-point records, in record order
+        std::vector<SpfStub> stubs;  //!< stub network records, in record order
+        std::vector<std::pair<uint32_t, uint32_t>> in; //!< links to it, as (router, link)
+    };
+
+    /// The shortest path tree of one root, kept for UpdateRoutes
+    struct SpfTree
+    {
+        bool stub;                          //!< only a default route or no route was installed
+        std::vector<uint32_t> dist;         //!< distance of every router from the root
+        std::vector<uint32_t> exits;        //!< exits of every router, index in sets
+        std::vector<SpfExits> sets;         //!< distinct exits, sets[0] is empty
+        std::map<SpfExits, uint32_t> setId; //!< index of the exits in sets
+    };
+
+    /**
+     * @brief Build the compact SPF graph of the LSDB.
+     *
+     * The graph holds router LSAs with point-to-point and stub network
+     * records only.
+     *
+     * @param routers the routers, in link state ID order
+     * @returns false if the LSDB has network or external LSAs, or links that
+     * the compact SPF does not handle, see InitializeRoutes
+     */
+    bool BuildSpfGraph(std::vector<SpfRouter>& routers) const;
+
+    /**
+     * @brief Compute the routes of one root on the compact graph and install
+     * them, in the same order as SPFCalculate.
+     *
+     * @param routers the graph
+     * @param root index of the root
+     * @param tree the tree of the root, computed
+     */
+    static void SpfCompute(const std::vector<SpfRouter>& routers, uint32_t root, SpfTree& tree);
+
+    /**
+     * @brief Repair the tree of a root whose own LSA did not change, and
+     * replace the routes to the routers whose exits changed.
+     *
+     * @param before the graph of the tree
+     * @param after the new graph, with the same routers
+     * @param changed for every router, whether its LSA changed
+     * @param changedList the routers whose LSA changed
+     * @param root index of the root
+     * @param tree the tree of the root, updated
+     */
+    static void SpfRepair(const std::vector<SpfRouter>& before,
+                          const std::vector<SpfRouter>& after,
+                          const std::vector<uint8_t>& changed,
+                          const std::vector<uint32_t>& changedList,
+                          uint32_t root,
+                          SpfTree& tree);
+
+    /**
+     * @param tree a tree
+     * @param exits sorted exits
+     * @returns the index of exits in the sets of the tree
+     */
+    static uint32_t SpfInternExits(SpfTree& tree, const SpfExits& exits);
+
+    /**
+     * @brief Install the host routes to the point-to-point addresses of a router.
+     * @param gr routing of the root
+     * @param v the router
+     * @param exits exits of the root towards it
+     */
+    static void SpfAddHostRoutes(Ipv4GlobalRouting* gr, const SpfRouter& v, const SpfExits& exits);
+
+    /**
+     * @brief Install the routes to the stub networks of a router.
+     * @param gr routing of the root
+     * @param v the router
+     * @param exits exits of the root towards it
+     */
+    static void SpfAddStubRoutes(Ipv4GlobalRouting* gr, const SpfRouter& v, const SpfExits& exits);
+
+    std::vector<SpfRouter> m_spfGraph; //!< compact graph of the last computation
+    std::vector<SpfTree> m_spfTrees;   //!< trees of the last computation, empty if none
 };
 
 } // namespace ns3
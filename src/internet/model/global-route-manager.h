@@ -59,6 +59,12 @@ class GlobalRouteManager
      * per-node forwarding tables
      */
     static void InitializeRoutes();
+
+    /**
+     * @brief Update the per-node forwarding tables after a change of the
+     * topology, reusing the shortest path trees of the last computation.
+     */
+    static void UpdateRoutes();
 };
 
 } // namespace ns3
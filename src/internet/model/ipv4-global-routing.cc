@@ -20,7 +20,9 @@
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
 
+#include <algorithm>
 #include <iomanip>
+#include <iterator>
 #include <vector>
 
 namespace ns3
@@ -60,7 +62,9 @@ Ipv4GlobalRouting::GetTypeId()
 
 Ipv4GlobalRouting::Ipv4GlobalRouting()
     : m_randomEcmpRouting(false),
-      m_respondToInterfaceEvents(false)
+      m_respondToInterfaceEvents(false),
+      m_indexValid(false),
+      m_networkSeq(0)
 {
     NS_LOG_FUNCTION(this);
 
@@ -79,6 +83,10 @@ Ipv4GlobalRouting::AddHostRouteTo(Ipv4Address dest, Ipv4Address nextHop, uint32_
     auto route = new Ipv4RoutingTableEntry();
     *route = Ipv4RoutingTableEntry::CreateHostRouteTo(dest, nextHop, interface);
     m_hostRoutes.push_back(route);
+    if (m_indexValid)
+    {
+        IndexHostRoute(std::prev(m_hostRoutes.end()));
+    }
 }
 
 void
@@ -88,6 +96,10 @@ Ipv4GlobalRouting::AddHostRouteTo(Ipv4Address dest, uint32_t interface)
     auto route = new Ipv4RoutingTableEntry();
     *route = Ipv4RoutingTableEntry::CreateHostRouteTo(dest, interface);
     m_hostRoutes.push_back(route);
+    if (m_indexValid)
+    {
+        IndexHostRoute(std::prev(m_hostRoutes.end()));
+    }
 }
 
 void
@@ -100,6 +112,10 @@ Ipv4GlobalRouting::AddNetworkRouteTo(Ipv4Address network,
     auto route = new Ipv4RoutingTableEntry();
     *route = Ipv4RoutingTableEntry::CreateNetworkRouteTo(network, networkMask, nextHop, interface);
     m_networkRoutes.push_back(route);
+    if (m_indexValid)
+    {
+        IndexNetworkRoute(std::prev(m_networkRoutes.end()));
+    }
 }
 
 void
@@ -109,6 +125,10 @@ Ipv4GlobalRouting::AddNetworkRouteTo(Ipv4Address network, Ipv4Mask networkMask,
     auto route = new Ipv4RoutingTableEntry();
     *route = Ipv4RoutingTableEntry::CreateNetworkRouteTo(network, networkMask, interface);
     m_networkRoutes.push_back(route);
+    if (m_indexValid)
+    {
+        IndexNetworkRoute(std::prev(m_networkRoutes.end()));
+    }
 }
 
 void
@@ -133,45 +153,67 @@ Ipv4GlobalRouting::LookupGlobal(Ipv4Address dest, uint32_t flowHash, Ptr<NetDevi
     typedef std::vector<Ipv4RoutingTableEntry*> RouteVec_t;
     RouteVec_t allRoutes;
 
+    if (!m_indexValid)
+    {
+        BuildIndex();
+    }
+
     NS_LOG_LOGIC("Number of m_hostRoutes = " << m_hostRoutes.size());
-    for (auto i = m_hostRoutes.begin(); i != m_hostRoutes.end(); i++)
+    auto host = m_hostIndex.find(dest.Get());
+    if (host != m_hostIndex.end())
     {
-        NS_ASSERT((*i)->IsHost());
-        if ((*i)->GetDest() == dest)
+        for (auto i = host->second.begin(); i != host->second.end(); i++)
         {
             if (oif)
             {
-                if (oif != m_ipv4->GetNetDevice((*i)->GetInterface()))
+                if (oif != m_ipv4->GetNetDevice((**i)->GetInterface()))
                 {
                     NS_LOG_LOGIC("Not on requested interface, skipping");
                     continue;
                 }
             }
-            allRoutes.push_back(*i);
-            NS_LOG_LOGIC(allRoutes.size() << "Found global host route" << *i);
+            allRoutes.push_back(**i);
+            NS_LOG_LOGIC(allRoutes.size() << "Found global host route" << **i);
         }
     }
     if (allRoutes.empty()) // if no host route is found
     {
         NS_LOG_LOGIC("Number of m_networkRoutes" << m_networkRoutes.size());
-        for (auto j = m_networkRoutes.begin(); j != m_networkRoutes.end(); j++)
+        // all matching routes in table order, whatever their mask
+        std::vector<IndexedRoute> matches;
+        uint32_t nMasks = 0;
+        for (auto m = m_networkIndex.begin(); m != m_networkIndex.end(); m++)
         {
-            Ipv4Mask mask = (*j)->GetDestNetworkMask();
-            Ipv4Address entry = (*j)->GetDestNetwork();
-            if (mask.IsMatch(dest, entry))
+            auto net = m->nets.find(dest.Get() & m->mask);
+            if (net == m->nets.end())
+            {
+                continue;
+            }
+            nMasks++;
+            for (auto j = net->second.begin(); j != net->second.end(); j++)
             {
                 if (oif)
                 {
-                    if (oif != m_ipv4->GetNetDevice((*j)->GetInterface()))
+                    if (oif != m_ipv4->GetNetDevice((*j->route)->GetInterface()))
                     {
                         NS_LOG_LOGIC("Not on requested interface, skipping");
                         continue;
                     }
                 }
-                allRoutes.push_back(*j);
-                NS_LOG_LOGIC(allRoutes.size() << "Found global network route" << *j);
+                matches.push_back(*j);
             }
         }
+        if (nMasks > 1)
+        {
+            std::sort(matches.begin(),
+                      matches.end(),
+                      [](const IndexedRoute& a, const IndexedRoute& b) { return a.seq < b.seq; });
+        }
+        for (auto j = matches.begin(); j != matches.end(); j++)
+        {
+            allRoutes.push_back(*j->route);
+            NS_LOG_LOGIC(allRoutes.size() << "Found global network route" << *j->route);
+        }
     }
     if (allRoutes.empty()) // consider external if no host/network found
     {
@@ -230,6 +272,47 @@ Ipv4GlobalRouting::LookupGlobal(Ipv4Address dest, uint32_t flowHash, Ptr<NetDevi
     }
 }
 
+void
+Ipv4GlobalRouting::BuildIndex()
+{
+    NS_LOG_FUNCTION(this);
+    m_hostIndex.clear();
+    m_networkIndex.clear();
+    m_networkSeq = 0;
+    for (auto i = m_hostRoutes.begin(); i != m_hostRoutes.end(); i++)
+    {
+        IndexHostRoute(i);
+    }
+    for (auto j = m_networkRoutes.begin(); j != m_networkRoutes.end(); j++)
+    {
+        IndexNetworkRoute(j);
+    }
+    m_indexValid = true;
+}
+
+void
+Ipv4GlobalRouting::IndexHostRoute(HostRoutesI route)
+{
+    NS_ASSERT((*route)->IsHost());
+    m_hostIndex[(*route)->GetDest().Get()].push_back(route);
+}
+
+void
+Ipv4GlobalRouting::IndexNetworkRoute(NetworkRoutesI route)
+{
+    uint32_t mask = (*route)->GetDestNetworkMask().Get();
+    auto m = m_networkIndex.begin();
+    while (m != m_networkIndex.end() && m->mask != mask)
+    {
+        m++;
+    }
+    if (m == m_networkIndex.end())
+    {
+        m = m_networkIndex.insert(m, MaskIndex{mask, {}});
+    }
+    m->nets[(*route)->GetDestNetwork().Get() & mask].push_back(IndexedRoute{m_networkSeq++, route});
+}
+
 uint32_t
 Ipv4GlobalRouting::GetNRoutes() const
 {
@@ -289,6 +372,7 @@ void
 Ipv4GlobalRouting::RemoveRoute(uint32_t index)
 {
     NS_LOG_FUNCTION(this << index);
+    m_indexValid = false;
     if (index < m_hostRoutes.size())
     {
         uint32_t tmp = 0;
@@ -339,6 +423,66 @@ Ipv4GlobalRouting::RemoveRoute(uint32_t index)
     NS_ASSERT(false);
 }
 
+void
+Ipv4GlobalRouting::RemoveRoutes(const std::vector<Ipv4Address>& hosts,
+                                const std::vector<Ipv4RoutingTableEntry>& networks)
+{
+    NS_LOG_FUNCTION(this << hosts.size() << networks.size());
+    if (!m_indexValid)
+    {
+        BuildIndex();
+    }
+    for (auto h = hosts.begin(); h != hosts.end(); h++)
+    {
+        auto host = m_hostIndex.find(h->Get());
+        if (host == m_hostIndex.end())
+        {
+            continue;
+        }
+        for (auto i = host->second.begin(); i != host->second.end(); i++)
+        {
+            delete **i;
+            m_hostRoutes.erase(*i);
+        }
+        m_hostIndex.erase(host);
+    }
+    for (auto n = networks.begin(); n != networks.end(); n++)
+    {
+        uint32_t mask = n->GetDestNetworkMask().Get();
+        auto m = m_networkIndex.begin();
+        while (m != m_networkIndex.end() && m->mask != mask)
+        {
+            m++;
+        }
+        if (m == m_networkIndex.end())
+        {
+            continue;
+        }
+        auto net = m->nets.find(n->GetDestNetwork().Get() & mask);
+        if (net == m->nets.end())
+        {
+            continue;
+        }
+        for (auto j = net->second.begin(); j != net->second.end(); j++)
+        {
+            Ipv4RoutingTableEntry* route = *j->route;
+            if (route->GetDestNetwork() == n->GetDestNetwork() &&
+                route->GetGateway() == n->GetGateway() &&
+                route->GetInterface() == n->GetInterface())
+            {
+                delete route;
+                m_networkRoutes.erase(j->route);
+                net->second.erase(j);
+                break;
+            }
+        }
+        if (net->second.empty())
+        {
+            m->nets.erase(net);
+        }
+    }
+}
+
 int64_t
 Ipv4GlobalRouting::AssignStreams(int64_t stream)
 {
@@ -364,6 +508,9 @@ Ipv4GlobalRouting::DoDispose()
     {
         delete (*l);
     }
+    m_hostIndex.clear();
+    m_networkIndex.clear();
+    m_indexValid = false;
 
     Ipv4RoutingProtocol::DoDispose();
 }
@@ -17,6 +17,8 @@
 
 #include <list>
 #include <stdint.h>
+#include <unordered_map>
+#include <vector>
 
 namespace ns3
 {
@@ -210,6 +212,19 @@ class Ipv4GlobalRouting : public Ipv4RoutingProtocol
      */
     void RemoveRoute(uint32_t i);
 
+    /**
+     * \brief Remove a set of host and network routes in one pass over the
+     * routing table.
+     *
+     * \param hosts the destinations whose host routes are all removed
+     * \param networks the network routes to remove; each one removes the first
+     * route of the table with the same network, mask, gateway and interface
+     *
+     * The cost is that of the removed routes, through the lookup index.
+     */
+    void RemoveRoutes(const std::vector<Ipv4Address>& hosts,
+                      const std::vector<Ipv4RoutingTableEntry>& networks);
+
     /**
      * Assign a fixed random variable stream number to the random variables
      * used by this model.  Return the number of streams (possibly zero) that
@@ -268,10 +283,54 @@ class Ipv4GlobalRouting : public Ipv4RoutingProtocol
                                 uint32_t flowHash = 0,
                                 Ptr<NetDevice> oif = nullptr);
 
+    /**
+     * \brief Build the lookup index of the host and network routes.
+     *
+     * Host routes are hashed by destination.  Network routes are grouped by
+     * mask, and hashed by masked network within a group, so a lookup costs
+     * one probe per distinct mask instead of a scan of the whole table.
+     * The index is built on the first lookup or RemoveRoutes after
+     * RemoveRoute, and routes added while it is valid are indexed as they
+     * are added.
+     */
+    void BuildIndex();
+
+    /**
+     * \brief Add a route of m_hostRoutes to the index.
+     * \param route the route
+     */
+    void IndexHostRoute(HostRoutesI route);
+
+    /**
+     * \brief Add a route of m_networkRoutes to the index, after the others.
+     * \param route the route
+     */
+    void IndexNetworkRoute(NetworkRoutesI route);
+
+    /// A network route and its order in m_networkRoutes
+    struct IndexedRoute
+    {
+        uint32_t seq;         //!< increases along m_networkRoutes
+        NetworkRoutesI route; //!< the route
+    };
+
+    /// Network routes sharing one mask, keyed by masked network
+    struct MaskIndex
+    {
+        uint32_t mask;                                                //!< the mask
+        std::unordered_map<uint32_t, std::vector<IndexedRoute>> nets; //!< routes by network
+    };
+
     HostRoutes m_hostRoutes;             //!< Routes to hosts
     NetworkRoutes m_networkRoutes;       //!< Routes to networks
     ASExternalRoutes m_ASexternalRoutes; //!< External routes imported
 
+    bool m_indexValid; //!< m_hostIndex and m_networkIndex match the routes
+    /// host routes by destination, in m_hostRoutes order
+    std::unordered_map<uint32_t, std::vector<HostRoutesI>> m_hostIndex;
+    std::vector<MaskIndex> m_networkIndex; //!< network routes by mask
+    uint32_t m_networkSeq;                 //!< seq of the next indexed network route
+
     Ptr<Ipv4> m_ipv4; //!< associated IPv4 instance
 };
 
@@ -11,11 +11,28 @@
  */
 
 #include "ns3/candidate-queue.h"
+#include "ns3/config.h"
 #include "ns3/global-route-manager-impl.h"
+#include "ns3/global-router-interface.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/ipv4-global-routing.h"
+#include "ns3/ipv4.h"
+#include "ns3/node-container.h"
+#include "ns3/node-list.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device-helper.h"
 #include "ns3/simulator.h"
 #include "ns3/test.h"
+#include "ns3/uinteger.h"
 
+#include <algorithm>
 #include <cstdlib> // for rand()
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
 
 using namespace ns3;
 
@@ -204,6 +221,349 @@ GlobalRouteManagerImplTestCase::DoRun()
     // does not crash
 }
 
+/**
+ * \ingroup internet-test
+ *
+ * \brief Topologies of the global routing tests
+ */
+enum GlobalRoutingTopology
+{
+    LEAF_SPINE,     //!< leaves and spines, with hosts on point-to-point links
+    LEAF_SPINE_LAN, //!< leaves and spines, with the hosts of a leaf on a broadcast link
+    RANDOM,         //!< a ring of routers with random chords and metrics, and some hosts
+};
+
+/**
+ * \ingroup internet-test
+ *
+ * \brief A point-to-point link of a test topology
+ */
+struct GlobalRoutingTestLink
+{
+    Ptr<Ipv4> ipv4[2];   //!< IPv4 of the ends
+    uint32_t ifIndex[2]; //!< interface of the ends
+};
+
+/**
+ * Build a topology of nodes with global routing.
+ *
+ * In the LEAF_SPINE topology, the 4 leaves are linked to the 2 spines, and
+ * the first 2 leaves are also linked directly with a metric of 2, so that
+ * there are 3 equal cost paths between them.  Every leaf has 2 hosts.
+ *
+ * SPFCalculate does not handle equal cost paths to a broadcast network, so
+ * that the LEAF_SPINE_LAN topology is a tree: the leaves and the second
+ * spine are linked to the first spine only.
+ *
+ * \param topology the topology
+ * \param rng random numbers of the RANDOM topology
+ * \returns the point-to-point links
+ */
+static std::vector<GlobalRoutingTestLink>
+BuildGlobalRoutingTopology(GlobalRoutingTopology topology, std::mt19937& rng)
+{
+    NodeContainer nodes;
+    nodes.Create(topology == RANDOM ? 15 : 14);
+    InternetStackHelper internet;
+    Ipv4GlobalRoutingHelper ipv4RoutingHelper;
+    internet.SetRoutingHelper(ipv4RoutingHelper);
+    internet.Install(nodes);
+
+    Ipv4AddressHelper p2pAddress("10.0.0.0", "255.255.255.252");
+    Ipv4AddressHelper lanAddress("10.128.0.0", "255.255.255.0");
+    std::vector<GlobalRoutingTestLink> links;
+    auto link = [&](uint32_t a, uint32_t b, uint16_t metric) {
+        SimpleNetDeviceHelper simpleHelper;
+        simpleHelper.SetNetDevicePointToPointMode(true);
+        NetDeviceContainer net = simpleHelper.Install(NodeContainer(nodes.Get(a), nodes.Get(b)));
+        p2pAddress.Assign(net);
+        p2pAddress.NewNetwork();
+        GlobalRoutingTestLink l;
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            l.ipv4[i] = net.Get(i)->GetNode()->GetObject<Ipv4>();
+            l.ifIndex[i] = l.ipv4[i]->GetInterfaceForDevice(net.Get(i));
+            l.ipv4[i]->SetMetric(l.ifIndex[i], metric);
+        }
+        links.push_back(l);
+    };
+
+    if (topology == RANDOM)
+    {
+        // 10 routers, and a host on 5 of them
+        std::uniform_int_distribution<uint32_t> router(0, 9);
+        std::uniform_int_distribution<uint16_t> metric(1, 3);
+        for (uint32_t r = 0; r < 10; r++)
+        {
+            link(r, (r + 1) % 10, metric(rng));
+        }
+        for (uint32_t c = 0; c < 8; c++)
+        {
+            uint32_t a = router(rng);
+            uint32_t b = router(rng);
+            if (a != b)
+            {
+                link(a, b, metric(rng));
+            }
+        }
+        for (uint32_t h = 0; h < 5; h++)
+        {
+            link(10 + h, router(rng), 1);
+        }
+        return links;
+    }
+
+    // spines 0 and 1, leaves 2 to 5, hosts 6 to 13
+    for (uint32_t leaf = 2; leaf < 6; leaf++)
+    {
+        link(0, leaf, 1);
+        if (topology == LEAF_SPINE)
+        {
+            link(1, leaf, 1);
+        }
+    }
+    if (topology == LEAF_SPINE)
+    {
+        link(2, 3, 2);
+    }
+    else
+    {
+        link(0, 1, 1);
+    }
+    for (uint32_t leaf = 2; leaf < 6; leaf++)
+    {
+        uint32_t host = 6 + 2 * (leaf - 2);
+        if (topology == LEAF_SPINE)
+        {
+            link(leaf, host, 1);
+            link(leaf, host + 1, 1);
+            continue;
+        }
+        SimpleNetDeviceHelper simpleHelper;
+        NodeContainer lan(nodes.Get(leaf), nodes.Get(host), nodes.Get(host + 1));
+        NetDeviceContainer net = simpleHelper.Install(lan, CreateObject<SimpleChannel>());
+        lanAddress.Assign(net);
+        lanAddress.NewNetwork();
+    }
+    return links;
+}
+
+/**
+ * \param topology a topology
+ * \returns its name
+ */
+static std::string
+GetTopologyName(GlobalRoutingTopology topology)
+{
+    switch (topology)
+    {
+    case LEAF_SPINE:
+        return "leaf-spine";
+    case LEAF_SPINE_LAN:
+        return "leaf-spine LAN";
+    default:
+        return "random";
+    }
+}
+
+/**
+ * \param sorted whether to sort the routes of every node
+ * \returns the global routes of every node, in node order
+ */
+static std::vector<std::vector<std::string>>
+GetGlobalRoutes(bool sorted)
+{
+    std::vector<std::vector<std::string>> routes;
+    for (auto i = NodeList::Begin(); i != NodeList::End(); i++)
+    {
+        Ptr<Ipv4GlobalRouting> gr = (*i)->GetObject<GlobalRouter>()->GetRoutingProtocol();
+        routes.emplace_back();
+        for (uint32_t j = 0; j < gr->GetNRoutes(); j++)
+        {
+            std::ostringstream route;
+            route << *gr->GetRoute(j);
+            routes.back().push_back(route.str());
+        }
+        if (sorted)
+        {
+            std::sort(routes.back().begin(), routes.back().end());
+        }
+    }
+    return routes;
+}
+
+/**
+ * \ingroup internet-test
+ *
+ * \brief The compact SPF of InitializeRoutes installs the routes of
+ * SPFCalculate, in the same order.
+ */
+class GlobalRouteManagerImplSpfTestCase : public TestCase
+{
+  public:
+    /**
+     * Constructor
+     * \param topology the topology
+     * \param threads the value of GlobalRoutingThreads
+     */
+    GlobalRouteManagerImplSpfTestCase(GlobalRoutingTopology topology, uint32_t threads);
+
+  private:
+    void DoRun() override;
+
+    GlobalRoutingTopology m_topology; //!< the topology
+    uint32_t m_threads;               //!< the value of GlobalRoutingThreads
+};
+
+GlobalRouteManagerImplSpfTestCase::GlobalRouteManagerImplSpfTestCase(
+    GlobalRoutingTopology topology,
+    uint32_t threads)
+    : TestCase("Compact SPF on the " + GetTopologyName(topology) + " topology, " +
+               std::to_string(threads) + " threads"),
+      m_topology(topology),
+      m_threads(threads)
+{
+}
+
+void
+GlobalRouteManagerImplSpfTestCase::DoRun()
+{
+    Config::SetGlobal("GlobalRoutingThreads", UintegerValue(m_threads));
+    std::mt19937 rng(1);
+    for (uint32_t run = 0; run < (m_topology == RANDOM ? 20 : 1); run++)
+    {
+        BuildGlobalRoutingTopology(m_topology, rng);
+
+        GlobalRouteManagerImpl legacy;
+        legacy.BuildGlobalRoutingDatabase();
+        for (auto i = NodeList::Begin(); i != NodeList::End(); i++)
+        {
+            Ptr<GlobalRouter> rtr = (*i)->GetObject<GlobalRouter>();
+            if (rtr->GetNumLSAs())
+            {
+                legacy.DebugSPFCalculate(rtr->GetRouterId());
+            }
+        }
+        std::vector<std::vector<std::string>> expected = GetGlobalRoutes(false);
+        legacy.DeleteGlobalRoutes();
+
+        GlobalRouteManagerImpl compact;
+        compact.BuildGlobalRoutingDatabase();
+        compact.InitializeRoutes();
+        std::vector<std::vector<std::string>> routes = GetGlobalRoutes(false);
+
+        for (uint32_t n = 0; n < routes.size(); n++)
+        {
+            NS_TEST_EXPECT_MSG_GT(expected[n].size(),
+                                  0,
+                                  "run " << run << ": no route of node " << n);
+            NS_TEST_ASSERT_MSG_EQ(routes[n].size(),
+                                  expected[n].size(),
+                                  "run " << run << ": routes of node " << n);
+            for (uint32_t j = 0; j < routes[n].size(); j++)
+            {
+                NS_TEST_ASSERT_MSG_EQ(routes[n][j],
+                                      expected[n][j],
+                                      "run " << run << ": route " << j << " of node " << n);
+            }
+        }
+        Simulator::Destroy();
+    }
+    Config::SetGlobal("GlobalRoutingThreads", UintegerValue(0));
+}
+
+/**
+ * \ingroup internet-test
+ *
+ * \brief Ipv4GlobalRoutingHelper::UpdateRoutingTables installs the routes of
+ * RecomputeRoutingTables after links go down and up and metrics change.
+ */
+class GlobalRouteManagerImplUpdateTestCase : public TestCase
+{
+  public:
+    /**
+     * Constructor
+     * \param topology the topology
+     */
+    GlobalRouteManagerImplUpdateTestCase(GlobalRoutingTopology topology);
+
+  private:
+    void DoRun() override;
+
+    GlobalRoutingTopology m_topology; //!< the topology
+};
+
+GlobalRouteManagerImplUpdateTestCase::GlobalRouteManagerImplUpdateTestCase(
+    GlobalRoutingTopology topology)
+    : TestCase("Incremental route updates on the " + GetTopologyName(topology) + " topology"),
+      m_topology(topology)
+{
+}
+
+void
+GlobalRouteManagerImplUpdateTestCase::DoRun()
+{
+    std::mt19937 rng(2);
+    std::vector<GlobalRoutingTestLink> links = BuildGlobalRoutingTopology(m_topology, rng);
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+
+    // the changes cycle through link down, link up and metric change; the
+    // routes are compared after 1 to 3 updates
+    std::uniform_int_distribution<uint32_t> link(0, links.size() - 1);
+    std::uniform_int_distribution<uint16_t> metric(1, 4);
+    std::uniform_int_distribution<uint32_t> updates(1, 3);
+    std::vector<uint32_t> down;
+    uint32_t change = 0;
+    for (uint32_t round = 0; round < 30; round++)
+    {
+        for (uint32_t u = updates(rng); u > 0; u--, change++)
+        {
+            if (change % 3 == 1 && !down.empty())
+            {
+                GlobalRoutingTestLink& l = links[down.back()];
+                down.pop_back();
+                l.ipv4[0]->SetUp(l.ifIndex[0]);
+                l.ipv4[1]->SetUp(l.ifIndex[1]);
+            }
+            else if (change % 3 == 2)
+            {
+                // on one end only, the metrics of a link may differ
+                GlobalRoutingTestLink& l = links[link(rng)];
+                uint32_t end = rng() % 2;
+                l.ipv4[end]->SetMetric(l.ifIndex[end], metric(rng));
+            }
+            else
+            {
+                uint32_t i = link(rng);
+                if (std::find(down.begin(), down.end(), i) == down.end())
+                {
+                    down.push_back(i);
+                    links[i].ipv4[0]->SetDown(links[i].ifIndex[0]);
+                    links[i].ipv4[1]->SetDown(links[i].ifIndex[1]);
+                }
+            }
+            Ipv4GlobalRoutingHelper::UpdateRoutingTables();
+        }
+        std::vector<std::vector<std::string>> routes = GetGlobalRoutes(true);
+        Ipv4GlobalRoutingHelper::RecomputeRoutingTables();
+        std::vector<std::vector<std::string>> expected = GetGlobalRoutes(true);
+
+        for (uint32_t n = 0; n < routes.size(); n++)
+        {
+            NS_TEST_ASSERT_MSG_EQ(routes[n].size(),
+                                  expected[n].size(),
+                                  "round " << round << ": routes of node " << n);
+            for (uint32_t j = 0; j < routes[n].size(); j++)
+            {
+                NS_TEST_ASSERT_MSG_EQ(routes[n][j],
+                                      expected[n][j],
+                                      "round " << round << ": route " << j << " of node " << n);
+            }
+        }
+    }
+    Simulator::Destroy();
+}
+
 /**
  * \ingroup internet-test
  *
@@ -221,6 +581,15 @@ GlobalRouteManagerImplTestSuite::GlobalRouteManagerImplTestSuite()
     : TestSuite("global-route-manager-impl", Type::UNIT)
 {
     AddTestCase(new GlobalRouteManagerImplTestCase(), TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplSpfTestCase(LEAF_SPINE, 1), TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplSpfTestCase(LEAF_SPINE, 4), TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplSpfTestCase(LEAF_SPINE_LAN, 1),
+                TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplSpfTestCase(RANDOM, 4), TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplUpdateTestCase(LEAF_SPINE), TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplUpdateTestCase(LEAF_SPINE_LAN),
+                TestCase::Duration::QUICK);
+    AddTestCase(new GlobalRouteManagerImplUpdateTestCase(RANDOM), TestCase::Duration::QUICK);
 }
 
 static GlobalRouteManagerImplTestSuite
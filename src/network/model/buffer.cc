@@ -44,6 +44,8 @@ namespace ns3
 NS_LOG_COMPONENT_DEFINE("Buffer");
 
 uint32_t Buffer::g_recommendedStart = 0;
+constexpr uint32_t ALLOC_OVER_PROVISION = 100; //!< Additional bytes to over-provision.
+
 #ifdef BUFFER_FREE_LIST
 /* The following macros are pretty evil but they are needed to allow us to
  * keep track of 3 possible states for the g_freeList variable:
@@ -132,27 +134,92 @@ Buffer::Create(uint32_t dataSize)
     NS_ASSERT(data->m_count == 1);
     return data;
 }
-#else  /* BUFFER_FREE_LIST */
+#else /* NS3_MTP */
+/* Under multithreaded simulation, every thread keeps its own free lists of
+ * buffers, one per size class, so that ACKs and PFC frames do not take the
+ * block of an MTU-sized packet.  Buffers larger than the last class bypass
+ * the free lists entirely.
+ */
+constexpr uint32_t FREE_LIST_CLASSES = 3;    //!< Number of size classes.
+constexpr uint32_t FREE_LIST_CAPACITY = 1000; //!< Max pooled buffers per thread and class.
+constexpr uint32_t FREE_LIST_DATA_SIZE[FREE_LIST_CLASSES] = {128, 512, 2048}; //!< Class sizes.
+
+ThreadFreeList<Buffer::Data> Buffer::g_threadFreeList[] = {
+    {&Buffer::Deallocate, FREE_LIST_CAPACITY, FREE_LIST_CAPACITY},
+    {&Buffer::Deallocate, FREE_LIST_CAPACITY, FREE_LIST_CAPACITY},
+    {&Buffer::Deallocate, FREE_LIST_CAPACITY, FREE_LIST_CAPACITY},
+};
+
+/**
+ * \param size the buffer size
+ * \returns the smallest size class holding size, FREE_LIST_CLASSES if none
+ */
+static uint32_t
+FreeListClass(uint32_t size)
+{
+    uint32_t c = 0;
+    while (c < FREE_LIST_CLASSES && size > FREE_LIST_DATA_SIZE[c])
+    {
+        c++;
+    }
+    return c;
+}
+
 void
 Buffer::Recycle(Buffer::Data* data)
 {
     NS_LOG_FUNCTION(data);
     NS_ASSERT(data->m_count == 0);
-#ifdef NS3_MTP
     std::atomic_thread_fence(std::memory_order_acquire);
-#endif
-    Deallocate(data);
+    if (data->m_owner == nullptr)
+    {
+        Deallocate(data);
+        return;
+    }
+    // a pooled buffer has the size of its class plus the over-provision
+    uint32_t c = FreeListClass(data->m_size - ALLOC_OVER_PROVISION);
+    NS_ASSERT(c < FREE_LIST_CLASSES);
+    g_threadFreeList[c].Push(data);
 }
 
 Buffer::Data*
 Buffer::Create(uint32_t size)
 {
     NS_LOG_FUNCTION(size);
-    return Allocate(size);
+    uint32_t c = FreeListClass(size);
+    if (c == FREE_LIST_CLASSES)
+    {
+        Buffer::Data* data = Allocate(size);
+        data->m_owner = nullptr;
+        return data;
+    }
+    Buffer::Data* data = g_threadFreeList[c].Pop(FREE_LIST_DATA_SIZE[c]);
+    if (data == nullptr)
+    {
+        data = Allocate(FREE_LIST_DATA_SIZE[c]);
+        g_threadFreeList[c].Adopt(data);
+    }
+    NS_ASSERT(data->m_count == 1);
+    return data;
 }
-#endif /* BUFFER_FREE_LIST */
 
-constexpr uint32_t ALLOC_OVER_PROVISION = 100; //!< Additional bytes to over-provision.
+FreeListStats
+Buffer::GetFreeListStats()
+{
+    FreeListStats stats = {0, 0, 0, 0, 0, 0};
+    for (const auto& list : g_threadFreeList)
+    {
+        FreeListStats s = list.GetStats();
+        stats.hits += s.hits;
+        stats.misses += s.misses;
+        stats.localFrees += s.localFrees;
+        stats.remoteFrees += s.remoteFrees;
+        stats.drops += s.drops;
+        stats.threads = std::max(stats.threads, s.threads);
+    }
+    return stats;
+}
+#endif /* BUFFER_FREE_LIST */
 
 Buffer::Data*
 Buffer::Allocate(uint32_t reqSize)
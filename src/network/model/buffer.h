@@ -17,6 +17,8 @@
 
 #ifndef NS3_MTP
 #define BUFFER_FREE_LIST 1
+#else
+#include "thread-free-list.h"
 #endif
 
 namespace ns3
@@ -636,6 +638,14 @@ class Buffer
     Buffer(uint32_t dataSize, bool initialize);
     ~Buffer();
 
+#ifdef NS3_MTP
+    /**
+     * \brief Get the counters of the per-thread buffer free lists.
+     * \returns the counters summed over all threads
+     */
+    static FreeListStats GetFreeListStats();
+#endif
+
   private:
     /**
      * This data structure is variable-sized through its last member whose size
@@ -676,6 +686,13 @@ class Buffer
          * end of the area in which user bytes were written.
          */
         uint32_t m_dirtyEnd;
+#ifdef NS3_MTP
+        /**
+         * the per-thread free list which this instance is returned to,
+         * or nullptr if it is not pooled.
+         */
+        void* m_owner;
+#endif
         /**
          * The real data buffer holds _at least_ one byte.
          * Its real size is stored in the m_size field.
@@ -802,6 +819,9 @@ class Buffer
     static FreeList* g_freeList;                          //!< Buffer data container
     static LocalStaticDestructor g_localStaticDestructor; //!< Local static destructor
 #endif
+#ifdef NS3_MTP
+    static ThreadFreeList<Buffer::Data> g_threadFreeList[]; //!< Per-thread containers per size class
+#endif
 };
 
 } // namespace ns3
@@ -28,9 +28,12 @@ bool PacketMetadata::m_enableChecking = false;
 bool PacketMetadata::m_metadataSkipped = false;
 uint32_t PacketMetadata::m_maxSize = 0;
 uint16_t PacketMetadata::m_chunkUid = 0;
-PacketMetadata::DataFreeList PacketMetadata::m_freeList;
 #ifdef NS3_MTP
-std::atomic<bool> PacketMetadata::m_freeListUsing(false);
+ThreadFreeList<PacketMetadata::Data> PacketMetadata::m_threadFreeList(&PacketMetadata::Deallocate,
+                                                                      1000,
+                                                                      1000);
+#else
+PacketMetadata::DataFreeList PacketMetadata::m_freeList;
 #endif
 
 PacketMetadata::DataFreeList::~DataFreeList()
@@ -65,6 +68,14 @@ PacketMetadata::EnableChecking()
     m_enableChecking = true;
 }
 
+#ifdef NS3_MTP
+FreeListStats
+PacketMetadata::GetFreeListStats()
+{
+    return m_threadFreeList.GetStats();
+}
+#endif
+
 void
 PacketMetadata::ReserveCopy(uint32_t size)
 {
@@ -564,10 +575,17 @@ PacketMetadata::Create(uint32_t size)
         m_maxSize = size;
     }
 #ifdef NS3_MTP
-    while (m_freeListUsing.exchange(true, std::memory_order_acquire))
+    PacketMetadata::Data* data = m_threadFreeList.Pop(size);
+    if (data != nullptr)
     {
-    };
-#endif
+        NS_LOG_LOGIC("create found size=" << data->m_size);
+        return data;
+    }
+    NS_LOG_LOGIC("create alloc size=" << m_maxSize);
+    data = PacketMetadata::Allocate(m_maxSize);
+    m_threadFreeList.Adopt(data);
+    return data;
+#else
     while (!m_freeList.empty())
     {
         PacketMetadata::Data* data = m_freeList.back();
@@ -576,38 +594,37 @@ PacketMetadata::Create(uint32_t size)
         {
             NS_LOG_LOGIC("create found size=" << data->m_size);
             data->m_count = 1;
-#ifdef NS3_MTP
-            m_freeListUsing.store(false, std::memory_order_release);
-#endif
             return data;
         }
         NS_LOG_LOGIC("create dealloc size=" << data->m_size);
         PacketMetadata::Deallocate(data);
     }
-#ifdef NS3_MTP
-    m_freeListUsing.store(false, std::memory_order_release);
-#endif
     NS_LOG_LOGIC("create alloc size=" << m_maxSize);
     return PacketMetadata::Allocate(m_maxSize);
+#endif
 }
 
 void
 PacketMetadata::Recycle(PacketMetadata::Data* data)
 {
     NS_LOG_FUNCTION(data);
+#ifdef NS3_MTP
+    NS_ASSERT(data->m_count == 0);
+    // metadata is created for every packet even when it is disabled, so the
+    // per-thread free lists are used regardless of m_enable
+    std::atomic_thread_fence(std::memory_order_acquire);
+    NS_LOG_LOGIC("recycle size=" << data->m_size);
+    if (data->m_size < m_maxSize)
+    {
+        data->m_owner = nullptr;
+    }
+    m_threadFreeList.Push(data);
+#else
     if (!m_enable)
     {
-#ifdef NS3_MTP
-        std::atomic_thread_fence(std::memory_order_acquire);
-#endif
         PacketMetadata::Deallocate(data);
         return;
     }
-#ifdef NS3_MTP
-    while (m_freeListUsing.exchange(true, std::memory_order_acquire))
-    {
-    };
-#endif
     NS_LOG_LOGIC("recycle size=" << data->m_size << ", list=" << m_freeList.size());
     NS_ASSERT(data->m_count == 0);
     if (m_freeList.size() > 1000 || data->m_size < m_maxSize)
@@ -618,8 +635,6 @@ PacketMetadata::Recycle(PacketMetadata::Data* data)
     {
         m_freeList.push_back(data);
     }
-#ifdef NS3_MTP
-    m_freeListUsing.store(false, std::memory_order_release);
 #endif
 }
 
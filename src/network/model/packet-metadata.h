@@ -19,6 +19,10 @@
 #include <stdint.h>
 #include <vector>
 
+#ifdef NS3_MTP
+#include "thread-free-list.h"
+#endif
+
 namespace ns3
 {
 
@@ -160,6 +164,14 @@ class PacketMetadata
      */
     static void EnableChecking();
 
+#ifdef NS3_MTP
+    /**
+     * \brief Get the counters of the per-thread metadata free lists.
+     * \returns the counters summed over all threads
+     */
+    static FreeListStats GetFreeListStats();
+#endif
+
     /**
      * \brief Constructor
      * \param uid packet uid
@@ -425,6 +437,10 @@ class PacketMetadata
         uint32_t m_size;
         /** max of the m_used field over all objects which reference this struct Data instance */
         uint16_t m_dirtyEnd;
+#ifdef NS3_MTP
+        /** per-thread free list which this instance is returned to */
+        void* m_owner;
+#endif
         /** variable-sized buffer of bytes */
         uint8_t m_data[PACKET_METADATA_DATA_M_DATA_SIZE];
     };
@@ -670,9 +686,10 @@ class PacketMetadata
     static void Deallocate(PacketMetadata::Data* data);
 
 #ifdef NS3_MTP
-    static std::atomic<bool> m_freeListUsing;
-#endif
+    static ThreadFreeList<Data> m_threadFreeList; //!< the per-thread metadata data storage
+#else
     static DataFreeList m_freeList; //!< the metadata data storage
+#endif
     static bool m_enable;           //!< Enable the packet metadata
     static bool m_enableChecking;   //!< Enable the packet metadata checking
 
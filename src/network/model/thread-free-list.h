@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2023 State Key Laboratory for Novel Software Technology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef THREAD_FREE_LIST_H
+#define THREAD_FREE_LIST_H
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * @ingroup packet
+ * @brief Counters of a ThreadFreeList, summed over all threads.
+ */
+struct FreeListStats
+{
+    uint64_t hits;        //!< Creations served from a free list
+    uint64_t misses;      //!< Creations which had to allocate new memory
+    uint64_t localFrees;  //!< Recycles into the free list of the recycling thread
+    uint64_t remoteFrees; //!< Recycles returned to the free list of another thread
+    uint64_t drops;       //!< Recycles deallocated because a free list was full
+    uint32_t threads;     //!< Number of per-thread free lists created so far
+};
+
+/**
+ * @ingroup packet
+ * @brief A set of per-thread free lists for packet data storage.
+ *
+ * Each thread owns a bounded local free list that it accesses without any
+ * synchronization.  Every block remembers the free list of the thread that
+ * created it.  When a block is recycled by another thread, it is pushed onto
+ * a bounded lock-free return queue of its owner, which the owner drains into
+ * its local list once the local list runs empty.  This keeps blocks flowing
+ * back to the threads that create packets, which in a multithreaded
+ * simulation are usually not the threads that destroy them.
+ *
+ * The block type T must provide a void* m_owner field and a uint8_t m_data
+ * array at least as large as a pointer, which is reused as the link field
+ * of the return queue while the block is free.
+ *
+ * Every instance has its own caches: a thread keeps one cache per free list,
+ * indexed by the id the list gets at construction, so that blocks never move
+ * between the free lists of different size classes.
+ *
+ * @tparam T The data storage type
+ */
+template <typename T>
+class ThreadFreeList
+{
+  public:
+    /** Function used to release a block which is not kept by the free list */
+    typedef void (*Deallocator)(T*);
+
+    /**
+     * @brief Construct the free lists.
+     *
+     * @param deallocate The function releasing blocks
+     * @param localCapacity The maximum number of blocks in a local free list
+     * @param returnCapacity The maximum number of blocks in a return queue
+     */
+    ThreadFreeList(Deallocator deallocate, uint32_t localCapacity, uint32_t returnCapacity);
+
+    /** Release all blocks and all per-thread free lists. */
+    ~ThreadFreeList();
+
+    /**
+     * @brief Take a block of at least the given size from the free list of
+     * the calling thread.
+     *
+     * Blocks which are too small are deallocated on the way.
+     *
+     * @param size The minimum block size
+     * @return The block, or nullptr if none is available
+     */
+    T* Pop(uint32_t size);
+
+    /**
+     * @brief Make the calling thread the owner of a newly allocated block.
+     *
+     * Blocks without an owner are never kept by the free lists.
+     *
+     * @param data The newly allocated block
+     */
+    void Adopt(T* data);
+
+    /**
+     * @brief Give a block back to the free list of its owner.
+     *
+     * The block is deallocated if it has no owner or the free list is full.
+     *
+     * @param data The block to recycle
+     */
+    void Push(T* data);
+
+    /**
+     * @brief Get the counters summed over all threads.
+     *
+     * @return The counters
+     */
+    FreeListStats GetStats() const;
+
+  private:
+    /** The free list state of one thread */
+    struct Cache
+    {
+        std::vector<T*> m_local;                   //!< Blocks owned by this thread
+        std::atomic<T*> m_returnHead{nullptr};     //!< Blocks recycled by other threads
+        std::atomic<uint32_t> m_returnSize{0};     //!< Approximate size of the return queue
+        std::atomic<bool> m_retired{false};        //!< Whether the owner thread has exited
+        std::atomic<uint64_t> m_hits{0};           //!< Creations served locally
+        std::atomic<uint64_t> m_misses{0};         //!< Creations allocating new memory
+        std::atomic<uint64_t> m_localFrees{0};     //!< Local recycles
+        std::atomic<uint64_t> m_remoteFrees{0};    //!< Recycles sent to other threads
+        std::atomic<uint64_t> m_drops{0};          //!< Recycles deallocated
+    };
+
+    /** The live free lists of type T, indexed by their id */
+    struct Registry
+    {
+        std::mutex m_mutex;                  //!< Protects m_lists
+        std::vector<ThreadFreeList*> m_lists; //!< The lists, nullptr once destroyed
+    };
+
+    /** The caches of a thread, retired when the thread exits */
+    struct ThreadCaches
+    {
+        std::vector<Cache*> m_caches; //!< Cache of each free list, indexed by id
+        bool m_exited{false};         //!< Whether the thread is exiting
+        ~ThreadCaches();
+    };
+
+    /**
+     * @brief Get the registry of the free lists.  It is never destroyed, so
+     * that threads exiting after the static destructors can still use it.
+     *
+     * @return The registry
+     */
+    static Registry& GetRegistry();
+
+    /**
+     * @brief Get the cache of the calling thread, creating it on first use.
+     *
+     * @return The cache, or nullptr if the thread has exited or the free
+     * lists are destroyed
+     */
+    Cache* GetCache();
+
+    /**
+     * @brief Move the return queue of a cache into its local free list.
+     *
+     * @param cache The cache owned by the calling thread
+     */
+    void Drain(Cache* cache);
+
+    /**
+     * @brief Release all blocks kept by a cache.
+     *
+     * @param cache The cache to clear
+     */
+    void Clear(Cache* cache);
+
+    /**
+     * @brief Increment a per-thread counter.  Only its owner writes to it, so
+     * no read-modify-write is needed.
+     *
+     * @param counter The counter to increment
+     */
+    static void Count(std::atomic<uint64_t>& counter);
+
+    /**
+     * @brief Read the return queue link of a free block.
+     *
+     * @param data The free block
+     * @return The next block in the return queue
+     */
+    static T* GetNext(T* data);
+
+    /**
+     * @brief Write the return queue link of a free block.
+     *
+     * @param data The free block
+     * @param next The next block in the return queue
+     */
+    static void SetNext(T* data, T* next);
+
+    uint32_t m_id;                         //!< Index in the registry and the thread caches
+    Deallocator m_deallocate;              //!< Function releasing blocks
+    uint32_t m_localCapacity;              //!< Maximum size of a local free list
+    uint32_t m_returnCapacity;             //!< Maximum size of a return queue
+    mutable std::mutex m_cachesMutex;      //!< Protects m_caches
+    std::vector<Cache*> m_caches;          //!< All caches ever created
+    std::atomic<bool> m_destroyed{false};  //!< Set by the static destructor
+
+    static thread_local ThreadCaches t_caches; //!< Caches of the calling thread
+};
+
+template <typename T>
+thread_local typename ThreadFreeList<T>::ThreadCaches ThreadFreeList<T>::t_caches;
+
+template <typename T>
+typename ThreadFreeList<T>::Registry&
+ThreadFreeList<T>::GetRegistry()
+{
+    static auto registry = new Registry;
+    return *registry;
+}
+
+template <typename T>
+ThreadFreeList<T>::ThreadFreeList(Deallocator deallocate,
+                                  uint32_t localCapacity,
+                                  uint32_t returnCapacity)
+    : m_deallocate(deallocate),
+      m_localCapacity(localCapacity),
+      m_returnCapacity(returnCapacity)
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.m_mutex);
+    // ids are not reused, so that a thread never finds the cache of a
+    // destroyed list under the id of a new one
+    m_id = registry.m_lists.size();
+    registry.m_lists.push_back(this);
+}
+
+template <typename T>
+ThreadFreeList<T>::~ThreadFreeList()
+{
+    {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.m_mutex);
+        registry.m_lists[m_id] = nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_cachesMutex);
+    m_destroyed.store(true, std::memory_order_release);
+    for (auto cache : m_caches)
+    {
+        Clear(cache);
+        delete cache;
+    }
+    m_caches.clear();
+}
+
+template <typename T>
+ThreadFreeList<T>::ThreadCaches::~ThreadCaches()
+{
+    m_exited = true;
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> registryLock(registry.m_mutex);
+    for (uint32_t id = 0; id < m_caches.size(); id++)
+    {
+        ThreadFreeList* list = registry.m_lists[id];
+        Cache* cache = m_caches[id];
+        if (list == nullptr || cache == nullptr)
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(list->m_cachesMutex);
+        // blocks returned after this point are deallocated by their senders,
+        // or kept until the cache is adopted by another thread
+        cache->m_retired.store(true, std::memory_order_release);
+        list->Clear(cache);
+    }
+}
+
+template <typename T>
+typename ThreadFreeList<T>::Cache*
+ThreadFreeList<T>::GetCache()
+{
+    ThreadCaches& caches = t_caches;
+    if (caches.m_exited || m_destroyed.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    Cache* cache = m_id < caches.m_caches.size() ? caches.m_caches[m_id] : nullptr;
+    if (cache == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_cachesMutex);
+        if (m_destroyed.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        // reuse the cache of an exited thread before creating a new one
+        for (auto c : m_caches)
+        {
+            if (c->m_retired.load(std::memory_order_acquire))
+            {
+                cache = c;
+                break;
+            }
+        }
+        if (cache == nullptr)
+        {
+            cache = new Cache;
+            cache->m_local.reserve(m_localCapacity);
+            m_caches.push_back(cache);
+        }
+        cache->m_retired.store(false, std::memory_order_release);
+        if (caches.m_caches.size() <= m_id)
+        {
+            caches.m_caches.resize(m_id + 1, nullptr);
+        }
+        caches.m_caches[m_id] = cache;
+    }
+    return cache;
+}
+
+template <typename T>
+T*
+ThreadFreeList<T>::Pop(uint32_t size)
+{
+    Cache* cache = GetCache();
+    if (cache == nullptr)
+    {
+        return nullptr;
+    }
+    if (cache->m_local.empty())
+    {
+        Drain(cache);
+    }
+    while (!cache->m_local.empty())
+    {
+        T* data = cache->m_local.back();
+        cache->m_local.pop_back();
+        if (data->m_size >= size)
+        {
+            Count(cache->m_hits);
+            data->m_count = 1;
+            return data;
+        }
+        data->m_owner = nullptr;
+        m_deallocate(data);
+    }
+    Count(cache->m_misses);
+    return nullptr;
+}
+
+template <typename T>
+void
+ThreadFreeList<T>::Adopt(T* data)
+{
+    Cache* cache = GetCache();
+    data->m_owner = cache;
+}
+
+template <typename T>
+void
+ThreadFreeList<T>::Push(T* data)
+{
+    auto owner = static_cast<Cache*>(data->m_owner);
+    Cache* cache = GetCache();
+    if (owner == nullptr || cache == nullptr)
+    {
+        m_deallocate(data);
+        return;
+    }
+    if (owner == cache)
+    {
+        if (cache->m_local.size() < m_localCapacity)
+        {
+            Count(cache->m_localFrees);
+            cache->m_local.push_back(data);
+        }
+        else
+        {
+            Count(cache->m_drops);
+            m_deallocate(data);
+        }
+        return;
+    }
+    if (owner->m_retired.load(std::memory_order_acquire))
+    {
+        Count(cache->m_drops);
+        m_deallocate(data);
+        return;
+    }
+    if (owner->m_returnSize.fetch_add(1, std::memory_order_relaxed) >= m_returnCapacity)
+    {
+        owner->m_returnSize.fetch_sub(1, std::memory_order_relaxed);
+        Count(cache->m_drops);
+        m_deallocate(data);
+        return;
+    }
+    T* head = owner->m_returnHead.load(std::memory_order_relaxed);
+    do
+    {
+        SetNext(data, head);
+    } while (!owner->m_returnHead.compare_exchange_weak(head,
+                                                        data,
+                                                        std::memory_order_release,
+                                                        std::memory_order_relaxed));
+    Count(cache->m_remoteFrees);
+}
+
+template <typename T>
+void
+ThreadFreeList<T>::Drain(Cache* cache)
+{
+    T* data = cache->m_returnHead.exchange(nullptr, std::memory_order_acquire);
+    uint32_t n = 0;
+    while (data != nullptr)
+    {
+        T* next = GetNext(data);
+        if (cache->m_local.size() < m_localCapacity)
+        {
+            cache->m_local.push_back(data);
+        }
+        else
+        {
+            m_deallocate(data);
+        }
+        data = next;
+        n++;
+    }
+    cache->m_returnSize.fetch_sub(n, std::memory_order_relaxed);
+}
+
+template <typename T>
+void
+ThreadFreeList<T>::Clear(Cache* cache)
+{
+    for (auto data : cache->m_local)
+    {
+        m_deallocate(data);
+    }
+    cache->m_local.clear();
+    T* data = cache->m_returnHead.exchange(nullptr, std::memory_order_acquire);
+    while (data != nullptr)
+    {
+        T* next = GetNext(data);
+        m_deallocate(data);
+        data = next;
+    }
+    cache->m_returnSize.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+FreeListStats
+ThreadFreeList<T>::GetStats() const
+{
+    FreeListStats stats = {0, 0, 0, 0, 0, 0};
+    std::lock_guard<std::mutex> lock(m_cachesMutex);
+    for (auto cache : m_caches)
+    {
+        stats.hits += cache->m_hits.load(std::memory_order_relaxed);
+        stats.misses += cache->m_misses.load(std::memory_order_relaxed);
+        stats.localFrees += cache->m_localFrees.load(std::memory_order_relaxed);
+        stats.remoteFrees += cache->m_remoteFrees.load(std::memory_order_relaxed);
+        stats.drops += cache->m_drops.load(std::memory_order_relaxed);
+    }
+    stats.threads = m_caches.size();
+    return stats;
+}
+
+template <typename T>
+void
+ThreadFreeList<T>::Count(std::atomic<uint64_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+template <typename T>
+T*
+ThreadFreeList<T>::GetNext(T* data)
+{
+    T* next;
+    std::memcpy(&next, data->m_data, sizeof(next));
+    return next;
+}
+
+template <typename T>
+void
+ThreadFreeList<T>::SetNext(T* data, T* next)
+{
+    std::memcpy(data->m_data, &next, sizeof(next));
+}
+
+} // namespace ns3
+
+#endif /* THREAD_FREE_LIST_H */
@@ -11,6 +11,13 @@
 #include "ns3/random-variable-stream.h"
 #include "ns3/test.h"
 
+#ifdef NS3_MTP
+#include "ns3/thread-free-list.h"
+
+#include <thread>
+#include <vector>
+#endif
+
 using namespace ns3;
 
 /**
@@ -384,6 +391,146 @@ BufferTest::DoRun()
     NS_TEST_ASSERT_MSG_EQ(val1, val2, "Bad ReadNtohU16()");
 }
 
+#ifdef NS3_MTP
+/**
+ * \ingroup network-test
+ * \ingroup tests
+ *
+ * Per-thread buffer free list tests.
+ */
+class BufferThreadFreeListTest : public TestCase
+{
+  public:
+    BufferThreadFreeListTest();
+
+  private:
+    void DoRun() override;
+};
+
+BufferThreadFreeListTest::BufferThreadFreeListTest()
+    : TestCase("Per-thread buffer free lists")
+{
+}
+
+void
+BufferThreadFreeListTest::DoRun()
+{
+    FreeListStats before = Buffer::GetFreeListStats();
+
+    // buffers destroyed by the creating thread are reused by that thread
+    {
+        Buffer buffer(100);
+    }
+    {
+        Buffer buffer(100);
+    }
+    FreeListStats local = Buffer::GetFreeListStats();
+    NS_TEST_ASSERT_MSG_GT(local.hits, before.hits, "buffer not reused");
+    NS_TEST_ASSERT_MSG_GT(local.localFrees, before.localFrees, "buffer not recycled locally");
+
+    // buffers destroyed by another thread go back to their creator
+    std::vector<Buffer> buffers;
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        buffers.emplace_back(100);
+    }
+    std::thread destroyer([&buffers]() { buffers.clear(); });
+    destroyer.join();
+    FreeListStats remote = Buffer::GetFreeListStats();
+    NS_TEST_ASSERT_MSG_GT(remote.remoteFrees, local.remoteFrees, "buffer not returned");
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        Buffer buffer(100);
+        buffer.AddAtStart(1000);
+        buffer.Begin().WriteU8(0xab, 1000);
+        NS_TEST_ASSERT_MSG_EQ(buffer.Begin().ReadU8(), 0xab, "corrupted pooled buffer");
+    }
+    FreeListStats drained = Buffer::GetFreeListStats();
+    NS_TEST_ASSERT_MSG_GT(drained.hits, remote.hits + 1, "returned buffers not reused");
+}
+
+/**
+ * \ingroup network-test
+ * \ingroup tests
+ *
+ * Free lists of the same block type keep their blocks apart.
+ */
+class ThreadFreeListClassTest : public TestCase
+{
+  public:
+    ThreadFreeListClassTest();
+
+  private:
+    void DoRun() override;
+
+    /// A block of the free lists
+    struct Block
+    {
+        void* m_owner;     //!< the cache of the thread which created it
+        uint32_t m_count;  //!< the reference count
+        uint32_t m_size;   //!< the size of m_data
+        uint8_t m_data[8]; //!< the data
+    };
+
+    /// Release a block
+    /// \param block the block
+    static void Deallocate(Block* block);
+
+    static uint32_t m_deallocated; //!< number of blocks released
+};
+
+uint32_t ThreadFreeListClassTest::m_deallocated = 0;
+
+ThreadFreeListClassTest::ThreadFreeListClassTest()
+    : TestCase("Per-thread free lists of several size classes")
+{
+}
+
+void
+ThreadFreeListClassTest::Deallocate(Block* block)
+{
+    m_deallocated++;
+    delete block;
+}
+
+void
+ThreadFreeListClassTest::DoRun()
+{
+    m_deallocated = 0;
+    {
+        ThreadFreeList<Block> small(&Deallocate, 10, 10);
+        ThreadFreeList<Block> large(&Deallocate, 10, 10);
+        auto block = new Block{nullptr, 0, 2048, {}};
+        large.Adopt(block);
+        large.Push(block);
+        NS_TEST_ASSERT_MSG_EQ(small.Pop(128), nullptr, "a block of another free list");
+        NS_TEST_ASSERT_MSG_EQ(large.Pop(128), block, "the block of the free list");
+        large.Push(block);
+
+        FreeListStats smallStats = small.GetStats();
+        FreeListStats largeStats = large.GetStats();
+        NS_TEST_EXPECT_MSG_EQ(smallStats.hits, 0, "hits of the small blocks");
+        NS_TEST_EXPECT_MSG_EQ(smallStats.misses, 1, "misses of the small blocks");
+        NS_TEST_EXPECT_MSG_EQ(largeStats.hits, 1, "hits of the large blocks");
+        NS_TEST_EXPECT_MSG_EQ(largeStats.localFrees, 2, "recycles of the large blocks");
+
+        // a thread exiting releases the blocks of each list once
+        std::thread other([&small, &large]() {
+            auto block = new Block{nullptr, 0, 128, {}};
+            small.Adopt(block);
+            small.Push(block);
+            block = new Block{nullptr, 0, 2048, {}};
+            large.Adopt(block);
+            large.Push(block);
+        });
+        other.join();
+        NS_TEST_EXPECT_MSG_EQ(m_deallocated, 2, "blocks released by the exiting thread");
+        NS_TEST_EXPECT_MSG_EQ(small.GetStats().threads, 2, "threads of the small blocks");
+    }
+    NS_TEST_EXPECT_MSG_EQ(m_deallocated, 3, "blocks released by the free lists");
+}
+#endif
+
 /**
  * \ingroup network-test
  * \ingroup tests
@@ -400,6 +547,10 @@ BufferTestSuite::BufferTestSuite()
     : TestSuite("buffer", Type::UNIT)
 {
     AddTestCase(new BufferTest, TestCase::Duration::QUICK);
+#ifdef NS3_MTP
+    AddTestCase(new BufferThreadFreeListTest, TestCase::Duration::QUICK);
+    AddTestCase(new ThreadFreeListClassTest, TestCase::Duration::QUICK);
+#endif
 }
 
 static BufferTestSuite g_bufferTestSuite; //!< Static variable for test initialization
@@ -66,12 +66,13 @@ BEgressQueue::BEgressQueue()
     NS_LOG_FUNCTION_NOARGS();
     m_bytesInQueueTotal = 0;
     m_rrlast = 0;
+    m_qlast = 0;
     for (uint32_t i = 0; i < fCnt; i++)
     {
         m_bytesInQueue[i] = 0;
-        m_queues.push_back(CreateObject<SimpleDropTailQueue>());
-        // m_queues.push_back(CreateObject<PacketQueue>());
     }
+    m_nonEmpty = 0;
+    m_paused = 0;
 }
 
 BEgressQueue::~BEgressQueue()
@@ -79,6 +80,35 @@ BEgressQueue::~BEgressQueue()
     NS_LOG_FUNCTION_NOARGS();
 }
 
+void
+BEgressQueue::PacketRing::Push(Ptr<Packet> p, Time time)
+{
+    // the buffer is allocated on first use, a device only uses a few queues
+    if (size == buf.size())
+    {
+        std::vector<Slot> larger(buf.empty() ? 16 : buf.size() * 2);
+        for (uint32_t i = 0; i < size; i++)
+            larger[i] = buf[(head + i) & (buf.size() - 1)];
+        buf.swap(larger);
+        head = 0;
+    }
+    Slot& slot = buf[(head + size) & (buf.size() - 1)];
+    slot.packet = p;
+    slot.time = time;
+    size++;
+}
+
+Ptr<Packet>
+BEgressQueue::PacketRing::Pop(Time& time)
+{
+    Ptr<Packet> p = buf[head].packet;
+    time = buf[head].time;
+    buf[head].packet = nullptr;
+    head = (head + 1) & (buf.size() - 1);
+    size--;
+    return p;
+}
+
 bool
 BEgressQueue::DoEnqueue(Ptr<Packet> p, uint32_t qIndex)
 {
@@ -86,7 +116,9 @@ BEgressQueue::DoEnqueue(Ptr<Packet> p, uint32_t qIndex)
 
     if (m_bytesInQueueTotal + p->GetSize() < m_maxBytes) // infinite queue
     {
-        m_queues[qIndex]->Enqueue(p);
+        m_queues[qIndex].Push(p, Simulator::Now());
+        if (qIndex < qCnt)
+            m_nonEmpty |= 1u << qIndex;
         m_bytesInQueueTotal += p->GetSize();
         m_bytesInQueue[qIndex] += p->GetSize();
     }
@@ -98,56 +130,39 @@ BEgressQueue::DoEnqueue(Ptr<Packet> p, uint32_t qIndex)
 }
 
 Ptr<Packet>
-BEgressQueue::DoDequeueRR(bool paused[]) // this is for switch only
+BEgressQueue::DoDequeueRR() // this is for switch only
 {
     NS_LOG_FUNCTION(this);
 
-    if (m_bytesInQueueTotal == 0)
-    {
-        NS_LOG_LOGIC("Queue empty");
-        return 0;
-    }
-    bool found = false;
     uint32_t qIndex;
-
-    if (m_queues[0]->GetNPackets() > 0) // 0 is the highest priority
+    if (m_nonEmpty & 1) // 0 is the highest priority
     {
-        found = true;
         qIndex = 0;
     }
     else
     {
-        if (!found)
+        uint32_t eligible = m_nonEmpty & ~m_paused;
+        if (eligible == 0)
         {
-            for (qIndex = 1; qIndex <= qCnt; qIndex++)
-            {
-                if (!paused[(qIndex + m_rrlast) % qCnt] &&
-                    m_queues[(qIndex + m_rrlast) % qCnt]->GetNPackets() > 0) // round robin
-                {
-                    found = true;
-                    break;
-                }
-            }
-            qIndex = (qIndex + m_rrlast) % qCnt;
+            NS_LOG_LOGIC("Nothing can be sent");
+            return 0;
         }
+        // round robin: the first eligible queue after the last one served
+        uint32_t after = eligible & ~((2u << m_rrlast) - 1);
+        qIndex = __builtin_ctz(after ? after : eligible);
+        m_rrlast = qIndex;
     }
-    if (found)
-    {
-        Ptr<Packet> p = m_queues[qIndex]->Dequeue();
-        m_traceBeqDequeue(p, qIndex);
-        m_bytesInQueueTotal -= p->GetSize();
-        m_bytesInQueue[qIndex] -= p->GetSize();
-        if (qIndex != 0)
-        {
-            m_rrlast = qIndex;
-        }
-        m_qlast = qIndex;
-        NS_LOG_LOGIC("Popped " << p);
-        NS_LOG_LOGIC("Number bytes " << m_bytesInQueueTotal);
-        return p;
-    }
-    NS_LOG_LOGIC("Nothing can be sent");
-    return 0;
+    PacketRing& q = m_queues[qIndex];
+    Ptr<Packet> p = q.Pop(m_lastEnqueueTime);
+    if (q.size == 0)
+        m_nonEmpty &= ~(1u << qIndex);
+    m_traceBeqDequeue(p, qIndex);
+    m_bytesInQueueTotal -= p->GetSize();
+    m_bytesInQueue[qIndex] -= p->GetSize();
+    m_qlast = qIndex;
+    NS_LOG_LOGIC("Popped " << p);
+    NS_LOG_LOGIC("Number bytes " << m_bytesInQueueTotal);
+    return p;
 }
 
 bool
@@ -176,9 +191,23 @@ BEgressQueue::Enqueue(Ptr<Packet> p, uint32_t qIndex)
 
 Ptr<Packet>
 BEgressQueue::DequeueRR(bool paused[])
+{
+    for (uint32_t i = 0; i < qCnt; i++)
+        SetPaused(i, paused[i]);
+    return DequeueRR();
+}
+
+void
+BEgressQueue::SetPaused(uint32_t qIndex, bool paused)
+{
+    m_paused = (m_paused & ~(1u << qIndex)) | (uint32_t)paused << qIndex;
+}
+
+Ptr<Packet>
+BEgressQueue::DequeueRR()
 {
     NS_LOG_FUNCTION(this);
-    Ptr<Packet> packet = DoDequeueRR(paused);
+    Ptr<Packet> packet = DoDequeueRR();
     if (packet != nullptr)
     {
         NS_ASSERT(m_nBytes >= packet->GetSize());
@@ -199,7 +228,8 @@ BEgressQueue::DoEnqueue(Ptr<Packet> p) // for compatiability
     NS_LOG_FUNCTION(this << p);
     if (m_bytesInQueueTotal + p->GetSize() < m_maxBytes)
     {
-        m_queues[qIndex]->Enqueue(p);
+        m_queues[qIndex].Push(p, Simulator::Now());
+        m_nonEmpty |= 1u << qIndex;
         m_bytesInQueueTotal += p->GetSize();
         m_bytesInQueue[qIndex] += p->GetSize();
     }
@@ -228,7 +258,7 @@ BEgressQueue::DoPeek(void) const // DoPeek doesn't work for multiple queues!!
         return 0;
     }
     NS_LOG_LOGIC("Number bytes " << m_bytesInQueue);
-    return m_queues[0]->Peek();
+    return m_queues[0].size ? m_queues[0].buf[m_queues[0].head].packet : nullptr;
 }
 
 uint32_t
@@ -249,4 +279,10 @@ BEgressQueue::GetLastQueue()
     return m_qlast;
 }
 
+Time
+BEgressQueue::GetLastEnqueueTime() const
+{
+    return m_lastEnqueueTime;
+}
+
 } // namespace ns3
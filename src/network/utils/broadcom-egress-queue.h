@@ -45,10 +45,22 @@ class BEgressQueue : public PacketQueue
     BEgressQueue();
     virtual ~BEgressQueue();
     bool Enqueue(Ptr<Packet> p, uint32_t qIndex);
+    /**
+     * Dequeue the next packet: queue 0 first, then round robin over the
+     * other queues which are not paused.
+     * \param paused the paused queues, replaces the paused state of SetPaused
+     * \return the packet, or 0 if none can be sent
+     */
     Ptr<Packet> DequeueRR(bool paused[]);
+    /// DequeueRR with the paused state given by SetPaused
+    Ptr<Packet> DequeueRR();
+    /// Pause or resume a queue for DequeueRR(), on PFC
+    void SetPaused(uint32_t qIndex, bool paused);
     uint32_t GetNBytes(uint32_t qIndex) const;
     uint32_t GetNBytesTotal() const;
     uint32_t GetLastQueue();
+    /// \return the enqueue time of the last packet dequeued, for its sojourn time
+    Time GetLastEnqueueTime() const;
 
     TracedCallback<Ptr<const Packet>, uint32_t> m_traceBeqEnqueue;
     TracedCallback<Ptr<const Packet>, uint32_t> m_traceBeqDequeue;
@@ -71,7 +83,7 @@ class BEgressQueue : public PacketQueue
      */
     Ptr<const Packet> Peek(void) const;
     bool DoEnqueue(Ptr<Packet> p, uint32_t qIndex);
-    Ptr<Packet> DoDequeueRR(bool paused[]);
+    Ptr<Packet> DoDequeueRR();
     // for compatibility
     virtual bool DoEnqueue(Ptr<Packet> p);
     virtual Ptr<Packet> DoDequeue(void);
@@ -81,7 +93,29 @@ class BEgressQueue : public PacketQueue
     uint32_t m_bytesInQueueTotal;
     uint32_t m_rrlast;
     uint32_t m_qlast;
-    std::vector<Ptr<SimpleDropTailQueue>> m_queues; // uc queues
+    Time m_lastEnqueueTime;
+
+    /// FIFO of the packets of a queue, a ring which grows to its largest backlog
+    struct PacketRing
+    {
+        struct Slot
+        {
+            Ptr<Packet> packet;
+            Time time; // enqueue time
+        };
+
+        std::vector<Slot> buf; // size is 0 or a power of 2
+        uint32_t head = 0;
+        uint32_t size = 0;
+
+        void Push(Ptr<Packet> p, Time time);
+        Ptr<Packet> Pop(Time& time);
+    };
+
+    static_assert(qCnt <= 32, "a bitmap of the switch queues must fit in 32 bits");
+    PacketRing m_queues[fCnt]; // uc queues
+    uint32_t m_nonEmpty;       // bitmap of the switch queues with packets
+    uint32_t m_paused;         // bitmap of the paused switch queues
 
     TracedCallback<Ptr<const Packet>> m_traceEnqueue;
     TracedCallback<Ptr<const Packet>> m_traceDequeue;
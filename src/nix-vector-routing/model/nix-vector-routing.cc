@@ -19,8 +19,10 @@
 #include "ns3/loopback-net-device.h"
 #include "ns3/names.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <queue>
+#include <thread>
 
 namespace ns3
 {
@@ -42,6 +44,12 @@ std::atomic<bool> NixVectorRouting<T>::g_isMapBuilt(false);
 
 template <typename T>
 std::atomic<bool> NixVectorRouting<T>::g_mapBuilding(false);
+
+template <typename T>
+std::atomic<bool> NixVectorRouting<T>::g_isGraphBuilt(false);
+
+template <typename T>
+std::atomic<bool> NixVectorRouting<T>::g_graphBuilding(false);
 #else
 template <typename T>
 bool NixVectorRouting<T>::g_isCacheDirty = false;
@@ -58,6 +66,18 @@ template <typename T>
 typename NixVectorRouting<T>::NetDeviceToIpInterfaceMap
     NixVectorRouting<T>::g_netdeviceToIpInterfaceMap;
 
+template <typename T>
+std::vector<uint32_t> NixVectorRouting<T>::g_bfsStart;
+
+template <typename T>
+std::vector<uint32_t> NixVectorRouting<T>::g_bfsNeighbor;
+
+template <typename T>
+std::vector<uint32_t> NixVectorRouting<T>::g_nixStart;
+
+template <typename T>
+std::vector<uint32_t> NixVectorRouting<T>::g_nixNeighbor;
+
 template <typename T>
 TypeId
 NixVectorRouting<T>::GetTypeId()
@@ -165,14 +185,22 @@ NixVectorRouting<T>::FlushGlobalNixRoutingCache() const
         NS_LOG_LOGIC("Flushing Nix caches.");
         rp->FlushNixCache();
         rp->FlushIpRouteCache();
+        rp->m_bfsParent.clear();
+        rp->m_bfsParent.shrink_to_fit();
         rp->m_totalNeighbors = 0;
     }
 
     // IP address to node mapping is potentially invalid so clear it.
     // Will be repopulated in lazy evaluation when mapping is needed.
     g_ipAddressToNodeMap.clear();
+    // Same for the adjacency of the BFS trees.
+    g_bfsStart.clear();
+    g_bfsNeighbor.clear();
+    g_nixStart.clear();
+    g_nixNeighbor.clear();
 #ifdef NS3_MTP
     g_isMapBuilt.store(false, std::memory_order_release);
+    g_isGraphBuilt.store(false, std::memory_order_release);
 #endif
 }
 
@@ -219,6 +247,22 @@ NixVectorRouting<T>::GetNixVector(Ptr<Node> source, IpAddress dest, Ptr<NetDevic
         NS_LOG_DEBUG("Do not process packets to self");
         return nullptr;
     }
+    else if (source == m_node && !oif)
+    {
+        // walk up the BFS tree of this node, built once for all
+        // the destinations
+        if (m_bfsParent.empty())
+        {
+            CheckBfsGraph();
+            BuildBfsTree();
+        }
+        if (BuildNixVectorFromTree(destNode->GetId(), nixVector))
+        {
+            return nixVector;
+        }
+        NS_LOG_ERROR("No routing path exists");
+        return nullptr;
+    }
     else
     {
         // otherwise proceed as normal
@@ -1276,64 +1320,17 @@ NixVectorRouting<T>::BFS(uint32_t numberOfNodes,
         else
         {
             // Iterate over the current node's adjacent vertices
-            // and push them into the queue
-            for (uint32_t i = 0; i < (currNode->GetNDevices()); i++)
+            // and push them into the queue, if they aren't
+            // already there.
+            std::vector<Ptr<Node>> neighbors;
+            GetBfsNeighbors(currNode, neighbors);
+            for (auto iter = neighbors.begin(); iter != neighbors.end(); iter++)
             {
-                // Get a net device from the node
-                // as well as the channel, and figure
-                // out the adjacent net device
-                Ptr<NetDevice> localNetDevice = currNode->GetDevice(i);
-
-                // make sure that we can go this way
-                if (ip)
-                {
-                    uint32_t interfaceIndex = (ip)->GetInterfaceForDevice(currNode->GetDevice(i));
-                    if (!(ip->IsUp(interfaceIndex)))
-                    {
-                        NS_LOG_LOGIC("IpInterface is down");
-                        continue;
-                    }
-                }
-                if (!(localNetDevice->IsLinkUp()))
-                {
-                    NS_LOG_LOGIC("Link is down.");
-                    continue;
-                }
-                Ptr<Channel> channel = localNetDevice->GetChannel();
-                if (!channel)
-                {
-                    continue;
-                }
-
-                // this function takes in the local net dev, and channel, and
-                // writes to the netDeviceContainer the adjacent net devs
-                NetDeviceContainer netDeviceContainer;
-                GetAdjacentNetDevices(localNetDevice, channel, netDeviceContainer);
-
-                // Finally we can get the adjacent nodes
-                // and scan through them.  We push them
-                // to the greyNode queue, if they aren't
-                // already there.
-                for (auto iter = netDeviceContainer.Begin(); iter != netDeviceContainer.End();
-                     iter++)
+                Ptr<Node> remoteNode = *iter;
+                if (!parentVector.at(remoteNode->GetId()))
                 {
-                    Ptr<Node> remoteNode = (*iter)->GetNode();
-                    Ptr<IpInterface> remoteIpInterface = GetInterfaceByNetDevice(*iter);
-                    if (!remoteIpInterface || !(remoteIpInterface->IsUp()))
-                    {
-                        NS_LOG_LOGIC("IpInterface either doesn't exist or is down");
-                        continue;
-                    }
-
-                    // check to see if this node has been pushed before
-                    // by checking to see if it has a parent
-                    // if it doesn't (null or 0), then set its parent and
-                    // push to the queue
-                    if (!parentVector.at(remoteNode->GetId()))
-                    {
-                        parentVector.at(remoteNode->GetId()) = currNode;
-                        greyNodeList.push(remoteNode);
-                    }
+                    parentVector.at(remoteNode->GetId()) = currNode;
+                    greyNodeList.push(remoteNode);
                 }
             }
         }
@@ -1347,6 +1344,294 @@ NixVectorRouting<T>::BFS(uint32_t numberOfNodes,
     return false;
 }
 
+template <typename T>
+void
+NixVectorRouting<T>::GetBfsNeighbors(Ptr<Node> node, std::vector<Ptr<Node>>& neighbors) const
+{
+    NS_LOG_FUNCTION(this << node);
+
+    neighbors.clear();
+    Ptr<IpL3Protocol> ip = node->GetObject<IpL3Protocol>();
+    for (uint32_t i = 0; i < node->GetNDevices(); i++)
+    {
+        // Get a net device from the node
+        // as well as the channel, and figure
+        // out the adjacent net device
+        Ptr<NetDevice> localNetDevice = node->GetDevice(i);
+
+        // make sure that we can go this way
+        if (ip)
+        {
+            uint32_t interfaceIndex = (ip)->GetInterfaceForDevice(node->GetDevice(i));
+            if (!(ip->IsUp(interfaceIndex)))
+            {
+                NS_LOG_LOGIC("IpInterface is down");
+                continue;
+            }
+        }
+        if (!(localNetDevice->IsLinkUp()))
+        {
+            NS_LOG_LOGIC("Link is down.");
+            continue;
+        }
+        Ptr<Channel> channel = localNetDevice->GetChannel();
+        if (!channel)
+        {
+            continue;
+        }
+
+        // this function takes in the local net dev, and channel, and
+        // writes to the netDeviceContainer the adjacent net devs
+        NetDeviceContainer netDeviceContainer;
+        GetAdjacentNetDevices(localNetDevice, channel, netDeviceContainer);
+
+        // Finally we can get the adjacent nodes
+        for (auto iter = netDeviceContainer.Begin(); iter != netDeviceContainer.End(); iter++)
+        {
+            Ptr<IpInterface> remoteIpInterface = GetInterfaceByNetDevice(*iter);
+            if (!remoteIpInterface || !(remoteIpInterface->IsUp()))
+            {
+                NS_LOG_LOGIC("IpInterface either doesn't exist or is down");
+                continue;
+            }
+            neighbors.push_back((*iter)->GetNode());
+        }
+    }
+}
+
+template <typename T>
+void
+NixVectorRouting<T>::CheckBfsGraph() const
+{
+#ifdef NS3_MTP
+    if (!g_isGraphBuilt.load(std::memory_order_acquire))
+    {
+        if (g_graphBuilding.exchange(true, std::memory_order_relaxed))
+        {
+            while (!g_isGraphBuilt.load(std::memory_order_acquire))
+            {
+            };
+        }
+        else
+        {
+            BuildBfsGraph();
+            g_isGraphBuilt.store(true, std::memory_order_release);
+            g_graphBuilding.store(false, std::memory_order_release);
+        }
+    }
+#else
+    if (g_bfsStart.empty())
+    {
+        BuildBfsGraph();
+    }
+#endif
+}
+
+template <typename T>
+void
+NixVectorRouting<T>::BuildBfsGraph() const
+{
+    NS_LOG_FUNCTION_NOARGS();
+
+    uint32_t numberOfNodes = NodeList::GetNNodes();
+    g_bfsStart.assign(1, 0);
+    g_bfsNeighbor.clear();
+    g_nixStart.assign(1, 0);
+    g_nixNeighbor.clear();
+
+    std::vector<Ptr<Node>> neighbors;
+    for (uint32_t v = 0; v < numberOfNodes; v++)
+    {
+        Ptr<Node> node = NodeList::GetNode(v);
+        GetBfsNeighbors(node, neighbors);
+        for (auto iter = neighbors.begin(); iter != neighbors.end(); iter++)
+        {
+            g_bfsNeighbor.push_back((*iter)->GetId());
+        }
+        g_bfsStart.push_back(g_bfsNeighbor.size());
+
+        // the neighbors as BuildNixVector numbers them
+        for (uint32_t i = 0; i < node->GetNDevices(); i++)
+        {
+            Ptr<NetDevice> localNetDevice = node->GetDevice(i);
+            if (localNetDevice->IsBridge())
+            {
+                continue;
+            }
+            Ptr<Channel> channel = localNetDevice->GetChannel();
+            if (!channel)
+            {
+                continue;
+            }
+            NetDeviceContainer netDeviceContainer;
+            GetAdjacentNetDevices(localNetDevice, channel, netDeviceContainer);
+            for (auto iter = netDeviceContainer.Begin(); iter != netDeviceContainer.End(); iter++)
+            {
+                g_nixNeighbor.push_back((*iter)->GetNode()->GetId());
+            }
+        }
+        g_nixStart.push_back(g_nixNeighbor.size());
+    }
+    NS_LOG_LOGIC("BFS adjacency of " << numberOfNodes << " nodes, " << g_bfsNeighbor.size()
+                                     << " edges");
+}
+
+template <typename T>
+void
+NixVectorRouting<T>::BuildBfsTree() const
+{
+    uint32_t numberOfNodes = g_bfsStart.size() - 1;
+    uint32_t root = m_node->GetId();
+    NS_ASSERT_MSG(root < numberOfNodes, "Node " << root << " is not in the BFS adjacency");
+
+    m_bfsParent.assign(numberOfNodes, NO_PARENT);
+    std::vector<uint32_t> greyNodeList;
+    greyNodeList.reserve(numberOfNodes);
+    m_bfsParent[root] = root;
+    greyNodeList.push_back(root);
+    for (uint32_t head = 0; head < greyNodeList.size(); head++)
+    {
+        uint32_t currNode = greyNodeList[head];
+        for (uint32_t e = g_bfsStart[currNode]; e < g_bfsStart[currNode + 1]; e++)
+        {
+            uint32_t remoteNode = g_bfsNeighbor[e];
+            if (m_bfsParent[remoteNode] == NO_PARENT)
+            {
+                m_bfsParent[remoteNode] = currNode;
+                greyNodeList.push_back(remoteNode);
+            }
+        }
+    }
+}
+
+template <typename T>
+bool
+NixVectorRouting<T>::BuildNixVectorFromTree(uint32_t dest, Ptr<NixVector> nixVector) const
+{
+    NS_LOG_FUNCTION(this << dest << nixVector);
+
+    if (dest >= m_bfsParent.size() || m_bfsParent[dest] == NO_PARENT)
+    {
+        return false;
+    }
+
+    // BFS stops at the destination, which does not change the parents
+    // on the path, so the tree gives the same nix-vector as BFS
+    uint32_t root = m_node->GetId();
+    for (uint32_t v = dest; v != root; v = m_bfsParent[v])
+    {
+        uint32_t parentNode = m_bfsParent[v];
+        uint32_t first = g_nixStart[parentNode];
+        uint32_t totalNeighbors = g_nixStart[parentNode + 1] - first;
+        uint32_t destId = 0;
+        for (uint32_t e = first; e < first + totalNeighbors; e++)
+        {
+            if (g_nixNeighbor[e] == v)
+            {
+                destId = e - first;
+            }
+        }
+        NS_LOG_LOGIC("Adding Nix: " << destId << " with " << nixVector->BitCount(totalNeighbors)
+                                    << " bits, for node " << parentNode);
+        nixVector->AddNeighborIndex(destId, nixVector->BitCount(totalNeighbors));
+    }
+    return true;
+}
+
+template <typename T>
+void
+NixVectorRouting<T>::PrecomputeBfsTrees(uint32_t threads)
+{
+    NS_LOG_FUNCTION(threads);
+
+    // raw pointers, so that the workers do not touch reference counts
+    std::vector<NixVectorRouting<T>*> routers;
+    for (auto i = NodeList::Begin(); i != NodeList::End(); i++)
+    {
+        Ptr<NixVectorRouting<T>> rp = (*i)->GetObject<NixVectorRouting<T>>();
+        if (rp)
+        {
+            routers.push_back(PeekPointer(rp));
+        }
+    }
+    if (routers.empty())
+    {
+        return;
+    }
+    routers[0]->CheckCacheStateAndFlush();
+    routers[0]->CheckBfsGraph();
+
+    if (threads == 0)
+    {
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+    threads = std::min<uint32_t>(threads, routers.size());
+    std::atomic<uint32_t> next(0);
+    auto worker = [&routers, &next]() {
+        for (uint32_t i = next++; i < routers.size(); i = next++)
+        {
+            if (routers[i]->m_bfsParent.empty())
+            {
+                routers[i]->BuildBfsTree();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (uint32_t t = 1; t < threads; t++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool)
+    {
+        t.join();
+    }
+    NS_LOG_LOGIC("BFS trees of " << routers.size() << " nodes on " << threads << " threads");
+}
+
+template <typename T>
+uint64_t
+NixVectorRouting<T>::GetCacheMemoryUsage()
+{
+    NS_LOG_FUNCTION_NOARGS();
+
+    // approximate overhead of a node of std::map and std::unordered_map
+    const uint64_t treeNode = 4 * sizeof(void*);
+    const uint64_t hashNode = 2 * sizeof(void*);
+
+    uint64_t bytes = 0;
+    for (auto i = NodeList::Begin(); i != NodeList::End(); i++)
+    {
+        Ptr<NixVectorRouting<T>> rp = (*i)->GetObject<NixVectorRouting<T>>();
+        if (!rp)
+        {
+            continue;
+        }
+        for (auto it = rp->m_nixCache.begin(); it != rp->m_nixCache.end(); it++)
+        {
+            bytes += treeNode + sizeof(typename NixMap_t::value_type);
+            if (it->second)
+            {
+                bytes += sizeof(NixVector) + it->second->GetSerializedSize();
+            }
+        }
+        bytes += rp->m_ipRouteCache.size() *
+                 (treeNode + sizeof(typename IpRouteMap_t::value_type) + sizeof(IpRoute));
+        bytes += rp->m_bfsParent.capacity() * sizeof(uint32_t);
+    }
+
+    bytes += g_ipAddressToNodeMap.size() *
+                 (hashNode + sizeof(typename IpAddressToNodeMap::value_type)) +
+             g_ipAddressToNodeMap.bucket_count() * sizeof(void*);
+    bytes += g_netdeviceToIpInterfaceMap.size() *
+                 (hashNode + sizeof(typename NetDeviceToIpInterfaceMap::value_type)) +
+             g_netdeviceToIpInterfaceMap.bucket_count() * sizeof(void*);
+    bytes += (g_bfsStart.capacity() + g_bfsNeighbor.capacity() + g_nixStart.capacity() +
+              g_nixNeighbor.capacity()) *
+             sizeof(uint32_t);
+    return bytes;
+}
+
 template <typename T>
 void
 NixVectorRouting<T>::PrintRoutingPath(Ptr<Node> source,
@@ -1517,6 +1802,10 @@ template void NixVectorRouting<Ipv4RoutingProtocol>::SetNode(Ptr<Node> node);
 template void NixVectorRouting<Ipv6RoutingProtocol>::SetNode(Ptr<Node> node);
 template void NixVectorRouting<Ipv4RoutingProtocol>::FlushGlobalNixRoutingCache() const;
 template void NixVectorRouting<Ipv6RoutingProtocol>::FlushGlobalNixRoutingCache() const;
+template void NixVectorRouting<Ipv4RoutingProtocol>::PrecomputeBfsTrees(uint32_t threads);
+template void NixVectorRouting<Ipv6RoutingProtocol>::PrecomputeBfsTrees(uint32_t threads);
+template uint64_t NixVectorRouting<Ipv4RoutingProtocol>::GetCacheMemoryUsage();
+template uint64_t NixVectorRouting<Ipv6RoutingProtocol>::GetCacheMemoryUsage();
 template void NixVectorRouting<Ipv4RoutingProtocol>::PrintRoutingPath(
     Ptr<Node> source,
     IpAddress dest,
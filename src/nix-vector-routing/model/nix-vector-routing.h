@@ -31,8 +31,10 @@
 #include "ns3/nstime.h"
 
 #include <atomic>
+#include <limits>
 #include <map>
 #include <unordered_map>
+#include <vector>
 
 // NOLINTBEGIN(modernize-use-override)
 
@@ -132,6 +134,30 @@ class NixVectorRouting : public std::enable_if_t<std::is_same_v<Ipv4RoutingProto
                           Ptr<OutputStreamWrapper> stream,
                           Time::Unit unit) const;
 
+    /**
+     * @brief Compute the BFS trees of all the nodes ahead of time
+     *
+     * Every node builds its nix-vectors from a BFS tree rooted at itself,
+     * computed on the first cache miss and kept until the next topology
+     * change.  This computes the trees of all the nodes with nix-vector
+     * routing at once, on a pool of threads.  It must be called while the
+     * simulator is not running, e.g. before Simulator::Run.
+     *
+     * \param threads number of worker threads, 0 for one per hardware thread
+     */
+    static void PrecomputeBfsTrees(uint32_t threads = 0);
+
+    /**
+     * @brief Get the approximate memory used by the routing caches
+     *
+     * The sum covers the nix-vector, IpRoute and BFS tree caches of all the
+     * nodes and the shared address maps and adjacency arrays.  It must be
+     * called while the simulator is not running or from the main thread.
+     *
+     * \returns the number of bytes
+     */
+    static uint64_t GetCacheMemoryUsage();
+
   private:
     /**
      * Flushes the cache which stores nix-vector based on
@@ -246,6 +272,43 @@ class NixVectorRouting : public std::enable_if_t<std::is_same_v<Ipv4RoutingProto
                                       uint32_t nodeIndex,
                                       IpAddress& gatewayIp) const;
 
+    /**
+     * Get the nodes adjacent to a node through its up interfaces and links,
+     * in the order BFS visits them.  A node reachable through several
+     * devices is listed once per device.
+     * \param [in] node node pointer
+     * \param [out] neighbors the adjacent nodes
+     */
+    void GetBfsNeighbors(Ptr<Node> node, std::vector<Ptr<Node>>& neighbors) const;
+
+    /**
+     * Build the shared adjacency arrays g_bfsStart, g_bfsNeighbor,
+     * g_nixStart and g_nixNeighbor from the node list, if not built yet.
+     */
+    void CheckBfsGraph() const;
+
+    /**
+     * Build the shared adjacency arrays from the node list.
+     */
+    void BuildBfsGraph() const;
+
+    /**
+     * Run BFS from m_node over the shared adjacency arrays and store the
+     * parent of every node in m_bfsParent.  Touches no reference counts,
+     * so trees of different nodes can be built concurrently.
+     */
+    void BuildBfsTree() const;
+
+    /**
+     * Build a nix-vector from m_node to dest by walking up m_bfsParent.
+     * The result is the same as BuildNixVector on the parent vector of
+     * BFS from m_node.
+     * \param [in] dest Destination Node index
+     * \param [out] nixVector the NixVector to be used for routing
+     * \returns true on success, false if dest is not reachable.
+     */
+    bool BuildNixVectorFromTree(uint32_t dest, Ptr<NixVector> nixVector) const;
+
     /**
      * \brief Breadth first search algorithm.
      * \param [in] numberOfNodes total number of nodes
@@ -479,6 +542,8 @@ class NixVectorRouting : public std::enable_if_t<std::is_same_v<Ipv4RoutingProto
     static std::atomic<bool> g_cacheFlushing;
     static std::atomic<bool> g_isMapBuilt;
     static std::atomic<bool> g_mapBuilding;
+    static std::atomic<bool> g_isGraphBuilt;
+    static std::atomic<bool> g_graphBuilding;
 #else
     static bool g_isCacheDirty;
 #endif
@@ -494,6 +559,16 @@ class NixVectorRouting : public std::enable_if_t<std::is_same_v<Ipv4RoutingProto
     /** Cache stores IpRoutes based on destination ip */
     mutable IpRouteMap_t m_ipRouteCache;
 
+    /**
+     * BFS tree rooted at m_node: the parent of every node by node id,
+     * m_node for itself and NO_PARENT when not reachable.  Empty until
+     * the first nix-vector is built.
+     */
+    mutable std::vector<uint32_t> m_bfsParent;
+
+    /// Marks an unreachable node in m_bfsParent
+    static constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
     Ptr<Ip> m_ip;     //!< IP object
     Ptr<Node> m_node; //!< Node object
 
@@ -514,6 +589,21 @@ class NixVectorRouting : public std::enable_if_t<std::is_same_v<Ipv4RoutingProto
     typedef std::unordered_map<Ptr<NetDevice>, Ptr<IpInterface>> NetDeviceToIpInterfaceMap;
     static NetDeviceToIpInterfaceMap
         g_netdeviceToIpInterfaceMap; //!< NetDevice pointer to IpInterface pointer map
+
+    /**
+     * Adjacency of the nodes as BFS explores it, shared by all the nodes:
+     * the neighbors of the node with id v are g_bfsNeighbor[g_bfsStart[v]]
+     * up to g_bfsNeighbor[g_bfsStart[v + 1]], see GetBfsNeighbors.
+     */
+    static std::vector<uint32_t> g_bfsStart;
+    static std::vector<uint32_t> g_bfsNeighbor; //!< Neighbor node ids, see g_bfsStart
+
+    /**
+     * Adjacency of the nodes in nix index order, as BuildNixVector counts
+     * it, in the same layout as g_bfsStart and g_bfsNeighbor.
+     */
+    static std::vector<uint32_t> g_nixStart;
+    static std::vector<uint32_t> g_nixNeighbor; //!< Neighbor node ids, see g_nixStart
 };
 
 /**
@@ -14,6 +14,7 @@
 #include "ns3/ipv6-address-helper.h"
 #include "ns3/ipv6-l3-protocol.h"
 #include "ns3/nix-vector-helper.h"
+#include "ns3/nix-vector-routing.h"
 #include "ns3/simple-net-device-helper.h"
 #include "ns3/simulator.h"
 #include "ns3/socket-factory.h"
@@ -382,6 +383,111 @@ NixVectorRoutingTest::DoRun()
     Simulator::Destroy();
 }
 
+/**
+ * \ingroup nix-vector-routing-test
+ * \ingroup tests
+ *
+ * The topology is a ring of six nodes, n0 to n5.
+ *
+ * Following are the tests in this test case:
+ * - Test that precomputing the BFS trees accounts for their memory.
+ * - Test the path from n0 to n3 taken from the precomputed tree.
+ * (Set down the interface of n0 on the n0-n1 channel.)
+ * - Test that the trees are flushed and the other way round the ring is taken.
+ *
+ * \brief IPv4 Nix-Vector Routing BFS Tree Test
+ */
+class NixVectorRoutingBfsTreeTest : public TestCase
+{
+  public:
+    NixVectorRoutingBfsTreeTest();
+
+  private:
+    void DoRun() override;
+};
+
+NixVectorRoutingBfsTreeTest::NixVectorRoutingBfsTreeTest()
+    : TestCase("precomputed BFS trees on a ring")
+{
+}
+
+void
+NixVectorRoutingBfsTreeTest::DoRun()
+{
+    NodeContainer nodes;
+    nodes.Create(6);
+
+    Ipv4NixVectorHelper ipv4NixRouting;
+    InternetStackHelper stack;
+    stack.SetRoutingHelper(ipv4NixRouting);
+    stack.SetIpv6StackInstall(false);
+    stack.Install(nodes);
+
+    SimpleNetDeviceHelper devHelper;
+    devHelper.SetNetDevicePointToPointMode(true);
+    Ipv4AddressHelper address;
+    address.SetBase("10.2.0.0", "255.255.255.0");
+    NetDeviceContainer first;
+    Ipv4InterfaceContainer dst;
+    for (uint32_t i = 0; i < nodes.GetN(); i++)
+    {
+        NetDeviceContainer devices =
+            devHelper.Install(NodeContainer(nodes.Get(i), nodes.Get((i + 1) % nodes.GetN())));
+        Ipv4InterfaceContainer interfaces = address.Assign(devices);
+        address.NewNetwork();
+        if (i == 0)
+        {
+            first = devices;
+        }
+        if (i == 2)
+        {
+            dst = interfaces;
+        }
+    }
+
+    uint64_t before = Ipv4NixVectorRouting::GetCacheMemoryUsage();
+    Ipv4NixVectorRouting::PrecomputeBfsTrees(2);
+    uint64_t after = Ipv4NixVectorRouting::GetCacheMemoryUsage();
+    NS_TEST_EXPECT_MSG_GT_OR_EQ(after - before,
+                                6 * 6 * sizeof(uint32_t),
+                                "The BFS trees should be accounted for.");
+
+    Ptr<Ipv4NixVectorRouting> rp = nodes.Get(0)->GetObject<Ipv4NixVectorRouting>();
+    std::ostringstream path1;
+    rp->PrintRoutingPath(nodes.Get(0),
+                         dst.GetAddress(1),
+                         Create<OutputStreamWrapper>(&path1),
+                         Time::S);
+    const std::string p_n0n1n2n3 =
+        "Time: +0s, Nix Routing\n"
+        "Route path from Node 0 to Node 3, Nix Vector: 011 (3 bits left)\n"
+        "10.2.0.1                 (Node 0)  ---->   10.2.0.2                 (Node 1)\n"
+        "10.2.1.1                 (Node 1)  ---->   10.2.1.2                 (Node 2)\n"
+        "10.2.2.1                 (Node 2)  ---->   10.2.2.2                 (Node 3)\n\n";
+    NS_TEST_EXPECT_MSG_EQ(path1.str(), p_n0n1n2n3, "Routing Path is incorrect.");
+
+    Ptr<Ipv4> ipv4 = nodes.Get(0)->GetObject<Ipv4>();
+    ipv4->SetDown(ipv4->GetInterfaceForDevice(first.Get(0)));
+
+    std::ostringstream path2;
+    rp->PrintRoutingPath(nodes.Get(0),
+                         dst.GetAddress(1),
+                         Create<OutputStreamWrapper>(&path2),
+                         Time::S);
+    const std::string p_n0n5n4n3 =
+        "Time: +0s, Nix Routing\n"
+        "Route path from Node 0 to Node 3, Nix Vector: 000 (3 bits left)\n"
+        "10.2.5.2                 (Node 0)  ---->   10.2.5.1                 (Node 5)\n"
+        "10.2.4.2                 (Node 5)  ---->   10.2.4.1                 (Node 4)\n"
+        "10.2.3.2                 (Node 4)  ---->   10.2.2.2                 (Node 3)\n\n";
+    NS_TEST_EXPECT_MSG_EQ(path2.str(), p_n0n5n4n3, "Routing Path is incorrect.");
+    NS_TEST_EXPECT_MSG_LT(Ipv4NixVectorRouting::GetCacheMemoryUsage(),
+                          after,
+                          "The BFS trees of the other nodes should have been flushed.");
+
+    Simulator::Destroy();
+}
+
 /**
  * \ingroup nix-vector-routing-test
  * \ingroup tests
@@ -395,6 +501,7 @@ class NixVectorRoutingTestSuite : public TestSuite
         : TestSuite("nix-vector-routing", Type::UNIT)
     {
         AddTestCase(new NixVectorRoutingTest(), TestCase::Duration::QUICK);
+        AddTestCase(new NixVectorRoutingBfsTreeTest(), TestCase::Duration::QUICK);
     }
 };
 
@@ -24,14 +24,16 @@
 #include "ns3/names.h"
 #include "ns3/packet.h"
 #include "ns3/point-to-point-channel.h"
-#include "ns3/point-to-point-remote-channel.h"
+#include "ns3/pointer.h"
 #include "ns3/qbb-channel.h"
 #include "ns3/qbb-net-device.h"
 #include "ns3/qbb-remote-channel.h"
 #include "ns3/queue.h"
 #include "ns3/simulator.h"
 
+#include <atomic>
 #include <iostream>
+#include <thread>
 #ifdef NS3_MPI
 #include "ns3/mpi-interface.h"
 #include "ns3/mpi-receiver.h"
@@ -42,6 +44,7 @@
 #include "ns3/custom-header.h"
 #include "ns3/trace-format.h"
 #include "ns3/trace-helper.h"
+#include "ns3/trace-writer.h"
 
 NS_LOG_COMPONENT_DEFINE("QbbHelper");
 
@@ -49,10 +52,13 @@ namespace ns3
 {
 
 QbbHelper::QbbHelper()
+    : m_threads(0)
 {
     m_queueFactory.SetTypeId("ns3::SimpleDropTailQueue");
     m_deviceFactory.SetTypeId("ns3::QbbNetDevice");
     m_channelFactory.SetTypeId("ns3::QbbChannel");
+    m_telemetryFactory.SetTypeId("ns3::QbbTelemetry");
+    m_deadlockDetectorFactory.SetTypeId("ns3::PfcDeadlockDetector");
     m_remoteChannelFactory.SetTypeId("ns3::QbbRemoteChannel");
 }
 
@@ -339,6 +345,100 @@ QbbHelper::Install(std::string aName, std::string bName)
     return Install(a, b);
 }
 
+void
+QbbHelper::SetThreads(uint32_t threads)
+{
+    m_threads = threads;
+}
+
+NetDeviceContainer
+QbbHelper::Install(NodeContainer nodes, const std::vector<std::pair<uint32_t, uint32_t>>& links)
+{
+    NetDeviceContainer container;
+#ifdef NS3_MPI
+    if (MpiInterface::IsEnabled())
+    {
+        // remote channels need an MpiReceiver per device
+        for (const auto& link : links)
+        {
+            container.Add(Install(nodes.Get(link.first), nodes.Get(link.second)));
+        }
+        return container;
+    }
+#endif
+    uint32_t n = links.size();
+    if (n == 0)
+    {
+        return container;
+    }
+
+    // MAC addresses and channel ids come from global counters, keep them in link order
+    std::vector<Mac48Address> addresses(2 * n);
+    for (auto& address : addresses)
+    {
+        address = Mac48Address::Allocate();
+    }
+    std::vector<Ptr<QbbChannel>> channels(n);
+    for (auto& channel : channels)
+    {
+        channel = m_channelFactory.Create<QbbChannel>();
+    }
+
+    // the devices of a link only touch the objects of the link
+    std::vector<Ptr<QbbNetDevice>> devices(2 * n);
+    auto createLink = [&](uint32_t i) {
+        for (uint32_t j = 2 * i; j < 2 * i + 2; j++)
+        {
+            devices[j] = m_deviceFactory.Create<QbbNetDevice>();
+            devices[j]->SetAddress(addresses[j]);
+            devices[j]->SetQueue(CreateObject<BEgressQueue>());
+            devices[j]->Attach(channels[i]);
+        }
+    };
+    // the first link registers the TypeIds of its objects before the threads start
+    createLink(0);
+
+    const uint32_t linksPerTask = 256;
+    uint32_t tasks = (n - 1 + linksPerTask - 1) / linksPerTask;
+#ifdef NS3_MTP
+    uint32_t threads = m_threads ? m_threads : std::max(1u, std::thread::hardware_concurrency());
+#else
+    // reference counts are only atomic with NS3_MTP
+    uint32_t threads = 1;
+#endif
+    threads = std::min(threads, std::max(tasks, 1u));
+    std::atomic<uint32_t> next(0);
+    auto worker = [&]() {
+        for (uint32_t task = next++; task < tasks; task = next++)
+        {
+            uint32_t end = std::min(n, 1 + (task + 1) * linksPerTask);
+            for (uint32_t i = 1 + task * linksPerTask; i < end; i++)
+            {
+                createLink(i);
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (uint32_t t = 1; t < threads; t++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool)
+    {
+        t.join();
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        nodes.Get(links[i].first)->AddDevice(devices[2 * i]);
+        nodes.Get(links[i].second)->AddDevice(devices[2 * i + 1]);
+        container.Add(devices[2 * i]);
+        container.Add(devices[2 * i + 1]);
+    }
+    return container;
+}
+
 void
 QbbHelper::GetTraceFromPacket(TraceFormat& tr,
                               Ptr<QbbNetDevice> dev,
@@ -521,4 +621,146 @@ QbbHelper::EnableTracing(FILE* file, NodeContainer node_container)
     }
 }
 
+void
+QbbHelper::PacketEventWriterCallback(Ptr<TraceWriter> writer,
+                                     Ptr<QbbNetDevice> dev,
+                                     Ptr<const Packet> p,
+                                     uint32_t qidx,
+                                     EventEnum event,
+                                     bool hasL2)
+{
+    TraceFormat tr;
+    GetTraceFromPacket(tr, dev, p, qidx, event, hasL2);
+    writer->Write(tr);
+}
+
+void
+QbbHelper::MacRxWriterCallback(Ptr<TraceWriter> writer,
+                               Ptr<QbbNetDevice> dev,
+                               Ptr<const Packet> p)
+{
+    PacketEventWriterCallback(writer, dev, p, 0, Recv, true);
+}
+
+void
+QbbHelper::EnqueueWriterCallback(Ptr<TraceWriter> writer,
+                                 Ptr<QbbNetDevice> dev,
+                                 Ptr<const Packet> p,
+                                 uint32_t qidx)
+{
+    PacketEventWriterCallback(writer, dev, p, qidx, Enqu, true);
+}
+
+void
+QbbHelper::DequeueWriterCallback(Ptr<TraceWriter> writer,
+                                 Ptr<QbbNetDevice> dev,
+                                 Ptr<const Packet> p,
+                                 uint32_t qidx)
+{
+    PacketEventWriterCallback(writer, dev, p, qidx, Dequ, true);
+}
+
+void
+QbbHelper::DropWriterCallback(Ptr<TraceWriter> writer,
+                              Ptr<QbbNetDevice> dev,
+                              Ptr<const Packet> p,
+                              uint32_t qidx)
+{
+    PacketEventWriterCallback(writer, dev, p, qidx, Drop, true);
+}
+
+void
+QbbHelper::QpDequeueWriterCallback(Ptr<TraceWriter> writer,
+                                   Ptr<QbbNetDevice> dev,
+                                   Ptr<const Packet> p,
+                                   Ptr<RdmaQueuePair> qp)
+{
+    PacketEventWriterCallback(writer, dev, p, qp->m_pg, Dequ, true);
+}
+
+void
+QbbHelper::EnableTracingDevice(Ptr<TraceWriter> writer, Ptr<QbbNetDevice> nd)
+{
+    if (writer->IsEnabled(Recv))
+        nd->TraceConnectWithoutContext(
+            "MacRx",
+            MakeBoundCallback(&QbbHelper::MacRxWriterCallback, writer, nd));
+    if (writer->IsEnabled(Enqu))
+        nd->TraceConnectWithoutContext(
+            "QbbEnqueue",
+            MakeBoundCallback(&QbbHelper::EnqueueWriterCallback, writer, nd));
+    if (writer->IsEnabled(Dequ))
+    {
+        nd->TraceConnectWithoutContext(
+            "QbbDequeue",
+            MakeBoundCallback(&QbbHelper::DequeueWriterCallback, writer, nd));
+        nd->TraceConnectWithoutContext(
+            "RdmaQpDequeue",
+            MakeBoundCallback(&QbbHelper::QpDequeueWriterCallback, writer, nd));
+    }
+    if (writer->IsEnabled(Drop))
+        nd->TraceConnectWithoutContext(
+            "QbbDrop",
+            MakeBoundCallback(&QbbHelper::DropWriterCallback, writer, nd));
+}
+
+void
+QbbHelper::EnableTracing(Ptr<TraceWriter> writer, NodeContainer node_container)
+{
+    for (NodeContainer::Iterator i = node_container.Begin(); i != node_container.End(); ++i)
+    {
+        Ptr<Node> node = *i;
+        for (uint32_t j = 0; j < node->GetNDevices(); ++j)
+        {
+            if (node->GetDevice(j)->IsQbb())
+                EnableTracingDevice(writer, DynamicCast<QbbNetDevice>(node->GetDevice(j)));
+        }
+    }
+}
+
+void
+QbbHelper::EnableTelemetry(NodeContainer node_container)
+{
+    for (NodeContainer::Iterator i = node_container.Begin(); i != node_container.End(); ++i)
+    {
+        Ptr<Node> node = *i;
+        for (uint32_t j = 0; j < node->GetNDevices(); ++j)
+        {
+            if (node->GetDevice(j)->IsQbb())
+            {
+                node->GetDevice(j)->SetAttribute("Telemetry",
+                                                 PointerValue(m_telemetryFactory.Create()));
+            }
+        }
+    }
+}
+
+void
+QbbHelper::SetTelemetryAttribute(std::string n1, const AttributeValue& v1)
+{
+    m_telemetryFactory.Set(n1, v1);
+}
+
+Ptr<PfcDeadlockDetector>
+QbbHelper::EnableDeadlockDetection(NodeContainer node_container)
+{
+    Ptr<PfcDeadlockDetector> detector = m_deadlockDetectorFactory.Create<PfcDeadlockDetector>();
+    for (NodeContainer::Iterator i = node_container.Begin(); i != node_container.End(); ++i)
+    {
+        Ptr<Node> node = *i;
+        for (uint32_t j = 0; j < node->GetNDevices(); ++j)
+        {
+            if (node->GetDevice(j)->IsQbb())
+                node->GetDevice(j)->SetAttribute("DeadlockDetector", PointerValue(detector));
+        }
+    }
+    return detector;
+}
+
+void
+QbbHelper::SetDeadlockDetectorAttribute(std::string n1, const AttributeValue& v1)
+{
+    m_deadlockDetectorFactory.Set(n1, v1);
+}
+
 } // namespace ns3
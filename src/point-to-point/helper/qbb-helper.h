@@ -28,8 +28,11 @@
 #include "ns3/qbb-net-device.h"
 #include "ns3/trace-format.h"
 #include "ns3/trace-helper.h"
+#include "ns3/trace-writer.h"
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace ns3
 {
@@ -156,6 +159,32 @@ class QbbHelper : public PcapHelperForDevice, public AsciiTraceHelperForDevice
      */
     NetDeviceContainer Install(std::string aNode, std::string bNode);
 
+    /**
+     * \param threads number of threads creating the devices in
+     * Install(NodeContainer, links), 0 for one per hardware thread
+     */
+    void SetThreads(uint32_t threads);
+
+    /**
+     * \param nodes the nodes of the topology
+     * \param links the links to install, as pairs of indices in nodes
+     * \returns the two devices of each link, in the order of links
+     *
+     * Install every link as Install(a, b) would, with the same MAC
+     * addresses, channel ids and interface indices, but in bulk: MAC
+     * addresses and channels are allocated first, then the devices and
+     * queues of the links are created and attached to their channel on a
+     * pool of threads, and last they are added to their nodes in the order
+     * of links.  Node::AddDevice schedules the initialization of the device,
+     * so it runs on the calling thread.
+     *
+     * Object creation only takes thread-safe reference counts with the
+     * multithreaded simulator (NS3_MTP); without it, the devices are created
+     * on the calling thread.  With MPI, the links are installed one by one.
+     */
+    NetDeviceContainer Install(NodeContainer nodes,
+                               const std::vector<std::pair<uint32_t, uint32_t>>& links);
+
     static void GetTraceFromPacket(TraceFormat& tr,
                                    Ptr<QbbNetDevice>,
                                    Ptr<const Packet> p,
@@ -190,6 +219,49 @@ class QbbHelper : public PcapHelperForDevice, public AsciiTraceHelperForDevice
 
     void EnableTracing(FILE* file, NodeContainer node_container);
 
+    // buffered, compressed tracing; only the events enabled in the writer's
+    // EventMask are hooked, so filtered events cost nothing at run time
+    static void PacketEventWriterCallback(Ptr<TraceWriter> writer,
+                                          Ptr<QbbNetDevice>,
+                                          Ptr<const Packet>,
+                                          uint32_t qidx,
+                                          EventEnum event,
+                                          bool hasL2);
+    static void MacRxWriterCallback(Ptr<TraceWriter> writer,
+                                    Ptr<QbbNetDevice>,
+                                    Ptr<const Packet> p);
+    static void EnqueueWriterCallback(Ptr<TraceWriter> writer,
+                                      Ptr<QbbNetDevice>,
+                                      Ptr<const Packet> p,
+                                      uint32_t qidx);
+    static void DequeueWriterCallback(Ptr<TraceWriter> writer,
+                                      Ptr<QbbNetDevice>,
+                                      Ptr<const Packet> p,
+                                      uint32_t qidx);
+    static void DropWriterCallback(Ptr<TraceWriter> writer,
+                                   Ptr<QbbNetDevice>,
+                                   Ptr<const Packet> p,
+                                   uint32_t qidx);
+    static void QpDequeueWriterCallback(Ptr<TraceWriter> writer,
+                                        Ptr<QbbNetDevice>,
+                                        Ptr<const Packet>,
+                                        Ptr<RdmaQueuePair>);
+
+    void EnableTracingDevice(Ptr<TraceWriter> writer, Ptr<QbbNetDevice>);
+
+    void EnableTracing(Ptr<TraceWriter> writer, NodeContainer node_container);
+
+    // give each qbb device of the nodes a QbbTelemetry, with the attributes of
+    // SetTelemetryAttribute
+    void EnableTelemetry(NodeContainer node_container);
+    void SetTelemetryAttribute(std::string name, const AttributeValue& value);
+
+    // give each qbb device of the nodes one shared PfcDeadlockDetector, with
+    // the attributes of SetDeadlockDetectorAttribute, and return it; the
+    // nodes are usually all the nodes of the network
+    Ptr<PfcDeadlockDetector> EnableDeadlockDetection(NodeContainer node_container);
+    void SetDeadlockDetectorAttribute(std::string name, const AttributeValue& value);
+
   private:
     /**
      * \brief Enable pcap output the indicated net device.
@@ -228,6 +300,9 @@ class QbbHelper : public PcapHelperForDevice, public AsciiTraceHelperForDevice
     ObjectFactory m_channelFactory;
     ObjectFactory m_remoteChannelFactory;
     ObjectFactory m_deviceFactory;
+    ObjectFactory m_telemetryFactory;
+    ObjectFactory m_deadlockDetectorFactory;
+    uint32_t m_threads;
 };
 
 } // namespace ns3
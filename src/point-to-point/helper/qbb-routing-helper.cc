@@ -0,0 +1,323 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "qbb-routing-helper.h"
+
+#include "ns3/log.h"
+#include "ns3/node-list.h"
+#include "ns3/nvswitch-node.h"
+#include "ns3/qbb-channel.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/switch-node.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("QbbRoutingHelper");
+
+QbbRoutingHelper::QbbRoutingHelper()
+    : m_threads(0)
+{
+}
+
+void
+QbbRoutingHelper::SetThreads(uint32_t threads)
+{
+    m_threads = threads;
+}
+
+Ipv4Address
+QbbRoutingHelper::GetNodeIp(uint32_t id)
+{
+    return Ipv4Address(0x0b000001 + ((id / 256) * 0x00010000) + ((id % 256) * 0x00000100));
+}
+
+uint32_t
+QbbRoutingHelper::GetNClasses() const
+{
+    return m_rep.size();
+}
+
+void
+QbbRoutingHelper::PopulateRoutingTables()
+{
+    PopulateRoutingTables(NodeContainer::GetGlobal());
+}
+
+void
+QbbRoutingHelper::PopulateRoutingTables(NodeContainer nodes)
+{
+    BuildGraph(nodes);
+    FindClasses();
+    ComputeRoutes();
+    LoadTables();
+    NS_LOG_INFO(m_nodes.size() << " nodes, " << m_hosts.size() << " hosts, " << m_rep.size()
+                               << " classes");
+    m_routes.clear();
+}
+
+void
+QbbRoutingHelper::ParallelFor(uint32_t n, std::function<void(uint32_t, uint32_t)> f)
+{
+    uint32_t threads = m_threads ? m_threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, std::max(n, 1u));
+    std::atomic<uint32_t> next(0);
+    auto worker = [&](uint32_t thread) {
+        for (uint32_t task = next++; task < n; task = next++)
+            f(task, thread);
+    };
+    std::vector<std::thread> pool;
+    for (uint32_t t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : pool)
+        t.join();
+}
+
+void
+QbbRoutingHelper::BuildGraph(NodeContainer nodes)
+{
+    m_nodes.assign(nodes.Begin(), nodes.End());
+    uint32_t n = m_nodes.size();
+    std::unordered_map<uint32_t, uint32_t> index; // node id -> index in m_nodes
+    for (uint32_t v = 0; v < n; v++)
+        index[m_nodes[v]->GetId()] = v;
+
+    m_type.resize(n);
+    m_hosts.clear();
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> adj(n); // (port, peer)
+    for (uint32_t v = 0; v < n; v++)
+    {
+        Ptr<Node> node = m_nodes[v];
+        m_type[v] = node->GetNodeType();
+        if (m_type[v] == 0)
+            m_hosts.push_back(v);
+        for (uint32_t i = 0; i < node->GetNDevices(); i++)
+        {
+            Ptr<QbbNetDevice> dev = DynamicCast<QbbNetDevice>(node->GetDevice(i));
+            if (!dev || !dev->IsLinkUp())
+                continue;
+            Ptr<QbbChannel> channel = DynamicCast<QbbChannel>(dev->GetChannel());
+            if (!channel || channel->GetNDevices() != 2)
+                continue;
+            Ptr<NetDevice> peerDev = channel->GetDevice(0) == dev ? channel->GetDevice(1)
+                                                                  : channel->GetDevice(0);
+            if (!peerDev->IsLinkUp())
+                continue;
+            auto peer = index.find(peerDev->GetNode()->GetId());
+            if (peer == index.end())
+                continue;
+            adj[v].emplace_back(dev->GetIfIndex(), peer->second);
+        }
+        std::sort(adj[v].begin(), adj[v].end());
+    }
+
+    m_adjStart.assign(n + 1, 0);
+    m_adjPeer.clear();
+    m_adjPort.clear();
+    for (uint32_t v = 0; v < n; v++)
+    {
+        for (auto& link : adj[v])
+        {
+            m_adjPort.push_back(link.first);
+            m_adjPeer.push_back(link.second);
+        }
+        m_adjStart[v + 1] = m_adjPeer.size();
+    }
+}
+
+void
+QbbRoutingHelper::FindClasses()
+{
+    uint32_t n = m_nodes.size();
+    // start from (type, degree), every host on its own
+    std::vector<uint32_t> color(n);
+    std::map<std::vector<uint32_t>, uint32_t> colorOf;
+    for (uint32_t v = 0; v < n; v++)
+    {
+        std::vector<uint32_t> key;
+        if (m_type[v] == 0)
+            key = {0, v};
+        else
+            key = {1, m_type[v], m_adjStart[v + 1] - m_adjStart[v]};
+        color[v] = colorOf.emplace(key, colorOf.size()).first->second;
+    }
+
+    // refine by the colors of the peers in port order until no class splits
+    uint32_t nColors = colorOf.size();
+    while (true)
+    {
+        colorOf.clear();
+        std::vector<uint32_t> next(n);
+        for (uint32_t v = 0; v < n; v++)
+        {
+            std::vector<uint32_t> key;
+            key.reserve(1 + 2 * (m_adjStart[v + 1] - m_adjStart[v]));
+            key.push_back(color[v]);
+            for (uint32_t e = m_adjStart[v]; e < m_adjStart[v + 1]; e++)
+            {
+                key.push_back(m_adjPort[e]);
+                key.push_back(color[m_adjPeer[e]]);
+            }
+            next[v] = colorOf.emplace(key, colorOf.size()).first->second;
+        }
+        color.swap(next);
+        if (colorOf.size() == nColors)
+            break;
+        nColors = colorOf.size();
+    }
+
+    std::vector<uint32_t> repOfColor(nColors, n);
+    m_class.resize(n);
+    m_rep.clear();
+    m_repIdx.assign(n, n);
+    for (uint32_t v = 0; v < n; v++)
+    {
+        if (repOfColor[color[v]] == n)
+        {
+            repOfColor[color[v]] = v;
+            m_repIdx[v] = m_rep.size();
+            m_rep.push_back(v);
+        }
+        m_class[v] = repOfColor[color[v]];
+    }
+}
+
+void
+QbbRoutingHelper::ComputeRoutes()
+{
+    uint32_t n = m_nodes.size();
+    uint32_t threads = m_threads ? m_threads : std::max(1u, std::thread::hardware_concurrency());
+    m_routes.assign(threads, std::vector<std::vector<uint32_t>>(m_rep.size()));
+    std::vector<std::vector<int32_t>> dist(threads, std::vector<int32_t>(n));
+    std::vector<std::vector<uint32_t>> queue(threads, std::vector<uint32_t>(n));
+
+    ParallelFor(m_hosts.size(), [&](uint32_t task, uint32_t thread) {
+        uint32_t dst = m_hosts[task];
+        std::vector<int32_t>& d = dist[thread];
+        std::vector<uint32_t>& q = queue[thread];
+        std::fill(d.begin(), d.end(), -1);
+
+        // breadth-first search from the destination, hosts only as end points
+        uint32_t head = 0, tail = 0;
+        d[dst] = 0;
+        q[tail++] = dst;
+        while (head < tail)
+        {
+            uint32_t u = q[head++];
+            if (u != dst && m_type[u] == 0)
+                continue;
+            for (uint32_t e = m_adjStart[u]; e < m_adjStart[u + 1]; e++)
+            {
+                uint32_t w = m_adjPeer[e];
+                if (d[w] < 0)
+                {
+                    d[w] = d[u] + 1;
+                    q[tail++] = w;
+                }
+            }
+        }
+
+        // next hops of the representatives
+        uint32_t dstId = m_nodes[dst]->GetId();
+        for (uint32_t r = 0; r < m_rep.size(); r++)
+        {
+            uint32_t v = m_rep[r];
+            if (v == dst || d[v] <= 0)
+                continue;
+            std::vector<uint32_t>& out = m_routes[thread][r];
+            uint32_t start = out.size();
+            out.push_back(dstId);
+            out.push_back(0);
+            for (uint32_t e = m_adjStart[v]; e < m_adjStart[v + 1]; e++)
+            {
+                uint32_t w = m_adjPeer[e];
+                if (d[w] == d[v] - 1 && (m_type[w] != 0 || w == dst))
+                    out.push_back(m_adjPort[e] | (m_type[w] == 2 ? 0x80000000u : 0));
+            }
+            out[start + 1] = out.size() - start - 2;
+        }
+    });
+}
+
+void
+QbbRoutingHelper::LoadTables()
+{
+    uint32_t n = m_nodes.size();
+    std::vector<std::vector<uint32_t>> members(m_rep.size());
+    for (uint32_t v = 0; v < n; v++)
+        members[m_repIdx[m_class[v]]].push_back(v);
+
+    // raw pointers, so that the workers do not touch reference counts
+    std::vector<SwitchNode*> sw(n, NULL);
+    std::vector<NVSwitchNode*> nvsw(n, NULL);
+    std::vector<RdmaHw*> rdma(n, NULL);
+    for (uint32_t v = 0; v < n; v++)
+    {
+        if (m_type[v] == 1)
+            sw[v] = PeekPointer(DynamicCast<SwitchNode>(m_nodes[v]));
+        else if (m_type[v] == 2)
+            nvsw[v] = PeekPointer(DynamicCast<NVSwitchNode>(m_nodes[v]));
+        else
+        {
+            Ptr<RdmaDriver> driver = m_nodes[v]->GetObject<RdmaDriver>();
+            if (driver)
+                rdma[v] = PeekPointer(driver->m_rdma);
+        }
+    }
+
+    uint32_t threads = m_routes.size();
+    ParallelFor(members.size(), [&](uint32_t r, uint32_t) {
+        for (uint32_t v : members[r])
+        {
+            if (sw[v])
+                sw[v]->ClearTable();
+            else if (nvsw[v])
+                nvsw[v]->ClearTable();
+            else if (rdma[v])
+                rdma[v]->ClearTable();
+            else
+                continue;
+            for (uint32_t t = 0; t < threads; t++)
+            {
+                const std::vector<uint32_t>& in = m_routes[t][r];
+                for (uint32_t i = 0; i < in.size(); i += 2 + in[i + 1])
+                {
+                    Ipv4Address dip = GetNodeIp(in[i]);
+                    for (uint32_t k = 0; k < in[i + 1]; k++)
+                    {
+                        uint32_t port = in[i + 2 + k] & 0x7fffffff;
+                        if (sw[v])
+                            sw[v]->AddTableEntry(dip, port);
+                        else if (nvsw[v])
+                            nvsw[v]->AddTableEntry(dip, port);
+                        else
+                            rdma[v]->AddTableEntry(dip, port, in[i + 2 + k] >> 31);
+                    }
+                }
+            }
+            if (sw[v])
+                sw[v]->Freeze();
+        }
+    });
+}
+
+} // namespace ns3
@@ -0,0 +1,107 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef QBB_ROUTING_HELPER_H
+#define QBB_ROUTING_HELPER_H
+
+#include "ns3/ipv4-address.h"
+#include "ns3/node-container.h"
+
+#include <functional>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \brief Fill the routing tables of a qbb topology.
+ *
+ * The helper builds the node graph from the QbbChannels attached to the
+ * nodes and computes shortest-path ECMP next hops towards every host
+ * (node type 0).  Switches (type 1) and NVSwitches (type 2) forward, hosts
+ * do not.  The next hops of a node towards a host are all its ports whose
+ * peer is one hop closer, in port order.  The tables are then loaded with
+ * SwitchNode::AddTableEntry, NVSwitchNode::AddTableEntry and
+ * RdmaHw::AddTableEntry (is_nvswitch set when the peer is an NVSwitch),
+ * replacing what was there before.
+ *
+ * One breadth-first search per host runs on a pool of threads.  Before
+ * that, nodes are partitioned by color refinement: two nodes of a class
+ * have the same type and, port by port, peers of the same class, with
+ * every host in a class of its own.  Nodes of a class therefore have the
+ * same table, e.g. the core switches of a fat-tree or the aggregation
+ * switches of a pod when ports are numbered alike, and it is computed
+ * once for the whole class.
+ *
+ * Hosts are addressed as 11.x.y.1 with the node id in x.y, see GetNodeIp.
+ */
+class QbbRoutingHelper
+{
+  public:
+    QbbRoutingHelper();
+
+    /**
+     * \param threads number of worker threads, 0 for one per hardware thread
+     */
+    void SetThreads(uint32_t threads);
+
+    /**
+     * Compute and load the routing tables of all nodes.
+     */
+    void PopulateRoutingTables();
+
+    /**
+     * Compute and load the routing tables of the given nodes. Links to
+     * nodes outside the container are ignored.
+     *
+     * \param nodes the nodes of the topology
+     */
+    void PopulateRoutingTables(NodeContainer nodes);
+
+    /**
+     * \return the number of node classes of the last computation
+     */
+    uint32_t GetNClasses() const;
+
+    /**
+     * \param id a node id
+     * \return the address of the host with this id
+     */
+    static Ipv4Address GetNodeIp(uint32_t id);
+
+  private:
+    void BuildGraph(NodeContainer nodes);
+    void FindClasses();
+    void ComputeRoutes();
+    void LoadTables();
+    void ParallelFor(uint32_t n, std::function<void(uint32_t task, uint32_t thread)> f);
+
+    uint32_t m_threads;
+    std::vector<Ptr<Node>> m_nodes;
+    std::vector<uint32_t> m_type;     // node type of each node
+    std::vector<uint32_t> m_adjStart; // adjacency of node v is [m_adjStart[v], m_adjStart[v+1])
+    std::vector<uint32_t> m_adjPeer;
+    std::vector<uint32_t> m_adjPort;  // interface index of the link on node v
+    std::vector<uint32_t> m_hosts;
+    std::vector<uint32_t> m_class;    // class of each node, the index of its representative
+    std::vector<uint32_t> m_rep;      // representatives
+    std::vector<uint32_t> m_repIdx;   // index in m_rep of a representative node
+    // m_routes[thread][rep]: entries {dst, n, port...} found by this thread,
+    // the top bit of a port marks an NVSwitch peer
+    std::vector<std::vector<std::vector<uint32_t>>> m_routes;
+};
+
+} // namespace ns3
+
+#endif /* QBB_ROUTING_HELPER_H */
@@ -0,0 +1,727 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "qbb-snapshot.h"
+
+#include "qbb-helper.h"
+
+#include "ns3/abort.h"
+#include "ns3/boolean.h"
+#include "ns3/ecmp-fib.h"
+#include "ns3/log.h"
+#include "ns3/nstime.h"
+#include "ns3/nvswitch-node.h"
+#include "ns3/qbb-channel.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/switch-mmu.h"
+#include "ns3/switch-node.h"
+#include "ns3/type-id.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("QbbSnapshot");
+
+static const char g_magic[8] = "QBBSNAP";
+static const uint32_t g_version = 2;
+
+// NodeRecord::mmuType
+static const uint32_t MMU_SINGLE_POOL = 0; // SwitchMmu
+static const uint32_t MMU_MULTI_POOL = 1;  // MultiPoolSwitchMmu, with a PoolRecord
+
+struct QbbSnapshot::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nNodes;
+    uint32_t nLinks;
+    uint32_t nPorts;
+    uint32_t nRouteWords;
+    uint32_t nPools;
+    uint64_t nFibBytes;
+    uint64_t configHash;
+    uint64_t checksum; // hash of the bytes after the header
+    uint64_t nodeOffset;
+    uint64_t linkOffset;
+    uint64_t portOffset;
+    uint64_t routeOffset;
+    uint64_t fibOffset;
+    uint64_t poolOffset;
+};
+
+struct QbbSnapshot::NodeRecord
+{
+    uint32_t id;
+    uint32_t type;
+    uint32_t ecnEnabled;
+    uint32_t ccMode;
+    uint32_t ackHighPrio;
+    uint32_t hasMmu;
+    uint32_t mmuType;
+    uint32_t poolIndex; // PoolRecord of a MultiPoolSwitchMmu
+    uint32_t mmuNodeId;
+    uint32_t bufferSize;
+    uint32_t reserve;
+    uint32_t resumeOffset;
+    uint32_t totalHdrm;
+    uint32_t totalRsrv;
+    uint32_t portStart; // ports of the MMU are [portStart, portStart + nPorts)
+    uint32_t nPorts;
+    uint32_t routeSize;
+    // compiled EcmpFib of a switch at fibStart: the groups, the (dip, group)
+    // of the other destinations, the group of each host and the next hops
+    uint32_t fibGroups;
+    uint32_t fibOthers;
+    uint32_t fibHosts;
+    uint32_t fibPorts;
+    uint32_t pad;
+    uint64_t routeStart; // route words are [routeStart, routeStart + routeSize)
+    uint64_t fibStart;   // offset in the fib section
+    uint64_t maxRtt;
+};
+
+struct QbbSnapshot::LinkRecord
+{
+    uint32_t a; // index of the node of device 0 of the channel
+    uint32_t b;
+    uint32_t ifA;
+    uint32_t ifB;
+    uint64_t bps;
+    int64_t delay; // ps
+};
+
+struct QbbSnapshot::PortRecord
+{
+    uint32_t pfcAShift;
+    uint32_t headroom;
+    uint32_t kmin;
+    uint32_t kmax;
+    double pmax;
+};
+
+// service pools and priorities of a MultiPoolSwitchMmu
+struct QbbSnapshot::PoolRecord
+{
+    uint32_t poolSize[MultiPoolSwitchMmu::poolCnt];
+    uint32_t pool0Auto;
+    uint32_t queueReserve;
+    uint32_t prioPool[SwitchMmu::qCnt];
+    uint32_t lossless[SwitchMmu::qCnt];
+    double pgAlpha[SwitchMmu::qCnt];
+    double queueAlpha[SwitchMmu::qCnt];
+};
+
+QbbSnapshot::QbbSnapshot()
+    : m_map(NULL),
+      m_mapSize(0),
+      m_image(NULL),
+      m_size(0)
+{
+}
+
+QbbSnapshot::~QbbSnapshot()
+{
+    Clear();
+}
+
+static uint64_t
+Fnv1a(const uint8_t* data, uint64_t size, uint64_t hash)
+{
+    for (uint64_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// FNV-1a over 64-bit words, then the remaining bytes
+static uint64_t
+Checksum(const uint8_t* data, uint64_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t n = size / 8;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        uint64_t word;
+        memcpy(&word, data + 8 * i, 8);
+        hash ^= word;
+        hash *= 0x100000001b3ULL;
+    }
+    return Fnv1a(data + 8 * n, size - 8 * n, hash);
+}
+
+uint64_t
+QbbSnapshot::Hash(const std::string& data, uint64_t seed)
+{
+    return Fnv1a(reinterpret_cast<const uint8_t*>(data.data()), data.size(), seed);
+}
+
+void
+QbbSnapshot::Clear()
+{
+    if (m_map)
+    {
+        munmap(m_map, m_mapSize);
+    }
+    m_map = NULL;
+    m_mapSize = 0;
+    std::vector<uint8_t>().swap(m_buffer);
+    m_image = NULL;
+    m_size = 0;
+}
+
+const QbbSnapshot::Header*
+QbbSnapshot::GetHeader() const
+{
+    NS_ABORT_MSG_IF(m_image == NULL, "QbbSnapshot: no image");
+    return reinterpret_cast<const Header*>(m_image);
+}
+
+bool
+QbbSnapshot::IsValid() const
+{
+    return m_image != NULL;
+}
+
+uint32_t
+QbbSnapshot::GetNNodes() const
+{
+    return m_image ? GetHeader()->nNodes : 0;
+}
+
+uint32_t
+QbbSnapshot::GetNLinks() const
+{
+    return m_image ? GetHeader()->nLinks : 0;
+}
+
+uint64_t
+QbbSnapshot::GetSize() const
+{
+    return m_size;
+}
+
+// append the records to the image, 8-byte aligned, and return their offset
+template <class T>
+static uint64_t
+Append(std::vector<uint8_t>& image, const std::vector<T>& records)
+{
+    image.resize((image.size() + 7) & ~(size_t)7);
+    uint64_t offset = image.size();
+    image.resize(offset + records.size() * sizeof(T));
+    if (!records.empty())
+    {
+        memcpy(&image[offset], records.data(), records.size() * sizeof(T));
+    }
+    return offset;
+}
+
+// route words of a table: {dip, n, port...}, the top bit of a port marks an NVSwitch peer
+static void
+AppendRoutes(std::vector<uint32_t>& words,
+             const std::unordered_map<uint32_t, std::vector<int>>& table,
+             const std::unordered_map<uint32_t, std::vector<int>>* nvswitchTable)
+{
+    std::vector<uint32_t> dips;
+    for (auto& entry : table)
+        dips.push_back(entry.first);
+    if (nvswitchTable)
+    {
+        for (auto& entry : *nvswitchTable)
+            dips.push_back(entry.first);
+    }
+    std::sort(dips.begin(), dips.end());
+    dips.erase(std::unique(dips.begin(), dips.end()), dips.end());
+    for (uint32_t dip : dips)
+    {
+        uint32_t head = words.size();
+        words.push_back(dip);
+        words.push_back(0);
+        auto it = table.find(dip);
+        if (it != table.end())
+        {
+            words.insert(words.end(), it->second.begin(), it->second.end());
+        }
+        if (nvswitchTable)
+        {
+            it = nvswitchTable->find(dip);
+            if (it != nvswitchTable->end())
+            {
+                for (int port : it->second)
+                    words.push_back(port | 0x80000000u);
+            }
+        }
+        words[head + 1] = words.size() - head - 2;
+    }
+}
+
+void
+QbbSnapshot::Capture(NodeContainer nodes)
+{
+    Clear();
+    std::vector<Ptr<Node>> v(nodes.Begin(), nodes.End());
+    std::unordered_map<uint32_t, uint32_t> index; // node id -> index in v
+    for (uint32_t u = 0; u < v.size(); u++)
+        index[v[u]->GetId()] = u;
+
+    std::vector<NodeRecord> nodeRecords(v.size());
+    std::vector<PortRecord> ports;
+    std::vector<PoolRecord> pools;
+    std::vector<uint32_t> routes;
+    std::vector<uint8_t> fibs;
+    std::vector<std::pair<uint32_t, Ptr<QbbChannel>>> channels; // (channel id, channel)
+    for (uint32_t u = 0; u < v.size(); u++)
+    {
+        Ptr<Node> node = v[u];
+        NodeRecord& rec = nodeRecords[u];
+        memset(&rec, 0, sizeof(rec));
+        rec.id = node->GetId();
+        rec.type = node->GetNodeType();
+
+        // each channel is taken once, from its device 0
+        for (uint32_t i = 0; i < node->GetNDevices(); i++)
+        {
+            Ptr<QbbNetDevice> dev = DynamicCast<QbbNetDevice>(node->GetDevice(i));
+            if (!dev)
+                continue;
+            Ptr<QbbChannel> channel = DynamicCast<QbbChannel>(dev->GetChannel());
+            if (!channel || channel->GetNDevices() != 2 || channel->GetDevice(0) != dev)
+                continue;
+            if (index.count(channel->GetDevice(1)->GetNode()->GetId()))
+                channels.emplace_back(channel->GetId(), channel);
+        }
+
+        Ptr<SwitchMmu> mmu;
+        rec.routeStart = routes.size();
+        if (Ptr<SwitchNode> sw = DynamicCast<SwitchNode>(node))
+        {
+            BooleanValue ecn;
+            UintegerValue value;
+            sw->GetAttribute("EcnEnabled", ecn);
+            rec.ecnEnabled = ecn.Get();
+            sw->GetAttribute("CcMode", value);
+            rec.ccMode = value.Get();
+            sw->GetAttribute("AckHighPrio", value);
+            rec.ackHighPrio = value.Get();
+            sw->GetAttribute("MaxRtt", value);
+            rec.maxRtt = value.Get();
+            mmu = sw->m_mmu;
+            sw->Freeze();
+            const EcmpFib& fib = sw->GetFib();
+            std::vector<uint32_t> others;
+            for (auto& entry : fib.GetOtherGroups())
+            {
+                others.push_back(entry.first);
+                others.push_back(entry.second);
+            }
+            rec.fibGroups = fib.GetGroups().size();
+            rec.fibOthers = others.size() / 2;
+            rec.fibHosts = fib.GetHostGroups().size();
+            rec.fibPorts = fib.GetPorts().size();
+            rec.fibStart = Append(fibs, fib.GetGroups());
+            Append(fibs, others);
+            fibs.insert(fibs.end(),
+                        reinterpret_cast<const uint8_t*>(fib.GetHostGroups().data()),
+                        reinterpret_cast<const uint8_t*>(fib.GetHostGroups().data() +
+                                                         rec.fibHosts));
+            fibs.insert(fibs.end(),
+                        reinterpret_cast<const uint8_t*>(fib.GetPorts().data()),
+                        reinterpret_cast<const uint8_t*>(fib.GetPorts().data() + rec.fibPorts));
+        }
+        else if (Ptr<NVSwitchNode> nvsw = DynamicCast<NVSwitchNode>(node))
+        {
+            UintegerValue value;
+            nvsw->GetAttribute("AckHighPrio", value);
+            rec.ackHighPrio = value.Get();
+            mmu = nvsw->m_mmu;
+            AppendRoutes(routes, nvsw->GetTable(), NULL);
+        }
+        else if (Ptr<RdmaDriver> driver = node->GetObject<RdmaDriver>())
+        {
+            if (driver->m_rdma)
+            {
+                AppendRoutes(routes,
+                             driver->m_rdma->m_rtTable,
+                             &driver->m_rdma->m_rtTable_nxthop_nvswitch);
+            }
+        }
+        rec.routeSize = routes.size() - rec.routeStart;
+
+        if (mmu)
+        {
+            rec.hasMmu = 1;
+            rec.mmuNodeId = mmu->node_id;
+            rec.bufferSize = mmu->buffer_size;
+            rec.reserve = mmu->reserve;
+            rec.resumeOffset = mmu->resume_offset;
+            rec.totalHdrm = mmu->total_hdrm;
+            rec.totalRsrv = mmu->total_rsrv;
+            if (Ptr<MultiPoolSwitchMmu> multi = DynamicCast<MultiPoolSwitchMmu>(mmu))
+            {
+                rec.mmuType = MMU_MULTI_POOL;
+                rec.poolIndex = pools.size();
+                PoolRecord pool;
+                memset(&pool, 0, sizeof(pool));
+                for (uint32_t i = 0; i < MultiPoolSwitchMmu::poolCnt; i++)
+                    pool.poolSize[i] = multi->pool_size[i];
+                pool.pool0Auto = multi->pool0_auto;
+                pool.queueReserve = multi->queue_reserve;
+                for (uint32_t q = 0; q < SwitchMmu::qCnt; q++)
+                {
+                    pool.prioPool[q] = multi->prio_pool[q];
+                    pool.lossless[q] = multi->lossless[q];
+                    pool.pgAlpha[q] = multi->pg_alpha[q];
+                    pool.queueAlpha[q] = multi->queue_alpha[q];
+                }
+                pools.push_back(pool);
+            }
+            else
+            {
+                NS_ABORT_MSG_IF(mmu->GetInstanceTypeId() != SwitchMmu::GetTypeId(),
+                                "QbbSnapshot: cannot save the MMU "
+                                    << mmu->GetInstanceTypeId().GetName());
+                rec.mmuType = MMU_SINGLE_POOL;
+            }
+            rec.portStart = ports.size();
+            uint32_t pCnt = SwitchMmu::pCnt;
+            rec.nPorts = std::min(node->GetNDevices(), pCnt);
+            for (uint32_t p = 0; p < rec.nPorts; p++)
+            {
+                ports.push_back(PortRecord{mmu->pfc_a_shift[p],
+                                           mmu->headroom[p],
+                                           mmu->kmin[p],
+                                           mmu->kmax[p],
+                                           mmu->pmax[p]});
+            }
+        }
+    }
+
+    // links in the order the channels were created
+    std::sort(channels.begin(),
+              channels.end(),
+              [](const std::pair<uint32_t, Ptr<QbbChannel>>& x,
+                 const std::pair<uint32_t, Ptr<QbbChannel>>& y) { return x.first < y.first; });
+    std::vector<LinkRecord> links;
+    links.reserve(channels.size());
+    for (auto& entry : channels)
+    {
+        Ptr<QbbChannel> channel = entry.second;
+        Ptr<QbbNetDevice> devA = DynamicCast<QbbNetDevice>(channel->GetDevice(0));
+        Ptr<QbbNetDevice> devB = DynamicCast<QbbNetDevice>(channel->GetDevice(1));
+        links.push_back(LinkRecord{index[devA->GetNode()->GetId()],
+                                   index[devB->GetNode()->GetId()],
+                                   devA->GetIfIndex(),
+                                   devB->GetIfIndex(),
+                                   devA->GetDataRate().GetBitRate(),
+                                   channel->GetDelay().GetPicoSeconds()});
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, g_magic, sizeof(header.magic));
+    header.version = g_version;
+    header.nNodes = nodeRecords.size();
+    header.nLinks = links.size();
+    header.nPorts = ports.size();
+    header.nRouteWords = routes.size();
+    header.nPools = pools.size();
+    header.nFibBytes = fibs.size();
+    m_buffer.resize(sizeof(Header));
+    header.nodeOffset = Append(m_buffer, nodeRecords);
+    header.linkOffset = Append(m_buffer, links);
+    header.portOffset = Append(m_buffer, ports);
+    header.routeOffset = Append(m_buffer, routes);
+    header.fibOffset = Append(m_buffer, fibs);
+    header.poolOffset = Append(m_buffer, pools);
+    header.checksum = Checksum(m_buffer.data() + sizeof(Header), m_buffer.size() - sizeof(Header));
+    memcpy(m_buffer.data(), &header, sizeof(header));
+    m_image = m_buffer.data();
+    m_size = m_buffer.size();
+    NS_LOG_INFO(header.nNodes << " nodes, " << header.nLinks << " links, " << m_size
+                              << " bytes");
+}
+
+bool
+QbbSnapshot::Save(std::string filename, uint64_t configHash) const
+{
+    if (m_image == NULL)
+        return false;
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+    {
+        NS_LOG_WARN("cannot open " << filename);
+        return false;
+    }
+    Header header = *GetHeader();
+    header.configHash = configHash;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && m_size > sizeof(Header))
+        ok = fwrite(m_image + sizeof(Header), m_size - sizeof(Header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+        NS_LOG_WARN("cannot write " << filename);
+    return ok;
+}
+
+bool
+QbbSnapshot::Load(std::string filename, uint64_t configHash)
+{
+    Clear();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        NS_LOG_WARN("cannot open " << filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(Header))
+    {
+        NS_LOG_WARN(filename << " is not a snapshot");
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        NS_LOG_WARN("cannot map " << filename);
+        return false;
+    }
+    m_map = map;
+    m_mapSize = st.st_size;
+
+    const Header* header = static_cast<const Header*>(map);
+    auto fits = [&](uint64_t offset, uint64_t n, uint64_t size) {
+        return offset % 8 == 0 && offset <= m_mapSize && n <= (m_mapSize - offset) / size;
+    };
+    const char* error = NULL;
+    if (memcmp(header->magic, g_magic, sizeof(header->magic)) != 0)
+        error = "is not a snapshot";
+    else if (header->version != g_version)
+        error = "is a snapshot of another version";
+    else if (header->configHash != configHash)
+        error = "is a snapshot of another configuration";
+    else if (!fits(header->nodeOffset, header->nNodes, sizeof(NodeRecord)) ||
+             !fits(header->linkOffset, header->nLinks, sizeof(LinkRecord)) ||
+             !fits(header->portOffset, header->nPorts, sizeof(PortRecord)) ||
+             !fits(header->routeOffset, header->nRouteWords, sizeof(uint32_t)) ||
+             !fits(header->fibOffset, header->nFibBytes, 1) ||
+             !fits(header->poolOffset, header->nPools, sizeof(PoolRecord)))
+        error = "is truncated";
+    else
+    {
+        const uint8_t* payload = static_cast<const uint8_t*>(map) + sizeof(Header);
+        if (Checksum(payload, m_mapSize - sizeof(Header)) != header->checksum)
+            error = "is corrupted";
+    }
+    if (error)
+    {
+        NS_LOG_WARN(filename << " " << error);
+        Clear();
+        return false;
+    }
+    m_image = static_cast<const uint8_t*>(map);
+    m_size = m_mapSize;
+    return true;
+}
+
+NodeContainer
+QbbSnapshot::RestoreNodes() const
+{
+    const Header* header = GetHeader();
+    const NodeRecord* records = reinterpret_cast<const NodeRecord*>(m_image + header->nodeOffset);
+    NodeContainer nodes;
+    for (uint32_t u = 0; u < header->nNodes; u++)
+    {
+        Ptr<Node> node;
+        if (records[u].type == 1)
+            node = CreateObject<SwitchNode>();
+        else if (records[u].type == 2)
+            node = CreateObject<NVSwitchNode>();
+        else
+            node = CreateObject<Node>();
+        NS_ABORT_MSG_IF(node->GetId() != records[u].id,
+                        "QbbSnapshot: node " << records[u].id << " restored with id "
+                                             << node->GetId());
+        nodes.Add(node);
+    }
+    return nodes;
+}
+
+NetDeviceContainer
+QbbSnapshot::RestoreLinks(NodeContainer nodes, QbbHelper& qbb) const
+{
+    const Header* header = GetHeader();
+    NS_ABORT_MSG_IF(nodes.GetN() != header->nNodes,
+                    "QbbSnapshot: " << nodes.GetN() << " nodes instead of " << header->nNodes);
+    const LinkRecord* records = reinterpret_cast<const LinkRecord*>(m_image + header->linkOffset);
+    std::vector<std::pair<uint32_t, uint32_t>> links(header->nLinks);
+    for (uint32_t i = 0; i < header->nLinks; i++)
+        links[i] = std::make_pair(records[i].a, records[i].b);
+    NetDeviceContainer devices = qbb.Install(nodes, links);
+
+    // the helper sets the same rate and delay on every link
+    for (uint32_t i = 0; i < header->nLinks; i++)
+    {
+        const LinkRecord& rec = records[i];
+        Ptr<QbbNetDevice> devA = DynamicCast<QbbNetDevice>(devices.Get(2 * i));
+        Ptr<QbbNetDevice> devB = DynamicCast<QbbNetDevice>(devices.Get(2 * i + 1));
+        NS_ABORT_MSG_IF(devA->GetIfIndex() != rec.ifA || devB->GetIfIndex() != rec.ifB,
+                        "QbbSnapshot: link " << i << " restored on interfaces "
+                                             << devA->GetIfIndex() << "-" << devB->GetIfIndex()
+                                             << " instead of " << rec.ifA << "-" << rec.ifB);
+        if (devA->GetDataRate().GetBitRate() != rec.bps)
+        {
+            devA->SetDataRate(DataRate(rec.bps));
+            devB->SetDataRate(DataRate(rec.bps));
+        }
+        Ptr<QbbChannel> channel = DynamicCast<QbbChannel>(devA->GetChannel());
+        if (channel->GetDelay().GetPicoSeconds() != rec.delay)
+            channel->SetAttribute("Delay", TimeValue(PicoSeconds(rec.delay)));
+    }
+    return devices;
+}
+
+void
+QbbSnapshot::RestoreState(NodeContainer nodes) const
+{
+    const Header* header = GetHeader();
+    NS_ABORT_MSG_IF(nodes.GetN() != header->nNodes,
+                    "QbbSnapshot: " << nodes.GetN() << " nodes instead of " << header->nNodes);
+    const NodeRecord* records = reinterpret_cast<const NodeRecord*>(m_image + header->nodeOffset);
+    const PortRecord* ports = reinterpret_cast<const PortRecord*>(m_image + header->portOffset);
+    const uint32_t* routes = reinterpret_cast<const uint32_t*>(m_image + header->routeOffset);
+    const uint8_t* fibs = m_image + header->fibOffset;
+    const PoolRecord* pools = reinterpret_cast<const PoolRecord*>(m_image + header->poolOffset);
+    TypeId mmuTypes[] = {SwitchMmu::GetTypeId(), MultiPoolSwitchMmu::GetTypeId()};
+
+    for (uint32_t u = 0; u < header->nNodes; u++)
+    {
+        const NodeRecord& rec = records[u];
+        Ptr<Node> node = nodes.Get(u);
+        Ptr<SwitchNode> sw = DynamicCast<SwitchNode>(node);
+        Ptr<NVSwitchNode> nvsw = DynamicCast<NVSwitchNode>(node);
+        RdmaHw* rdma = NULL;
+        Ptr<SwitchMmu> mmu;
+        if (sw)
+        {
+            sw->SetAttribute("EcnEnabled", BooleanValue(rec.ecnEnabled));
+            sw->SetAttribute("CcMode", UintegerValue(rec.ccMode));
+            sw->SetAttribute("AckHighPrio", UintegerValue(rec.ackHighPrio));
+            sw->SetAttribute("MaxRtt", UintegerValue(rec.maxRtt));
+            const uint8_t* fib = fibs + rec.fibStart;
+            const EcmpFib::Group* groups = reinterpret_cast<const EcmpFib::Group*>(fib);
+            const uint32_t* others = reinterpret_cast<const uint32_t*>(groups + rec.fibGroups);
+            const uint16_t* hosts = reinterpret_cast<const uint16_t*>(others + 2 * rec.fibOthers);
+            sw->GetFib().Load(hosts,
+                              rec.fibHosts,
+                              others,
+                              rec.fibOthers,
+                              groups,
+                              rec.fibGroups,
+                              hosts + rec.fibHosts,
+                              rec.fibPorts);
+            if (rec.hasMmu && sw->GetMmuType() != mmuTypes[rec.mmuType])
+                sw->SetMmuType(mmuTypes[rec.mmuType]);
+            mmu = sw->m_mmu;
+        }
+        else if (nvsw)
+        {
+            nvsw->SetAttribute("AckHighPrio", UintegerValue(rec.ackHighPrio));
+            nvsw->ClearTable();
+            if (rec.hasMmu && nvsw->GetMmuType() != mmuTypes[rec.mmuType])
+                nvsw->SetMmuType(mmuTypes[rec.mmuType]);
+            mmu = nvsw->m_mmu;
+        }
+        else if (Ptr<RdmaDriver> driver = node->GetObject<RdmaDriver>())
+        {
+            rdma = PeekPointer(driver->m_rdma);
+            if (rdma)
+                rdma->ClearTable();
+        }
+
+        if (mmu && rec.hasMmu)
+        {
+            mmu->node_id = rec.mmuNodeId;
+            mmu->buffer_size = rec.bufferSize;
+            mmu->reserve = rec.reserve;
+            mmu->resume_offset = rec.resumeOffset;
+            mmu->total_hdrm = rec.totalHdrm;
+            mmu->total_rsrv = rec.totalRsrv;
+            for (uint32_t p = 0; p < rec.nPorts; p++)
+            {
+                const PortRecord& port = ports[rec.portStart + p];
+                mmu->pfc_a_shift[p] = port.pfcAShift;
+                mmu->headroom[p] = port.headroom;
+                mmu->kmin[p] = port.kmin;
+                mmu->kmax[p] = port.kmax;
+                mmu->pmax[p] = port.pmax;
+            }
+            if (rec.mmuType == MMU_MULTI_POOL)
+            {
+                Ptr<MultiPoolSwitchMmu> multi = DynamicCast<MultiPoolSwitchMmu>(mmu);
+                const PoolRecord& pool = pools[rec.poolIndex];
+                multi->queue_reserve = pool.queueReserve;
+                for (uint32_t q = 0; q < SwitchMmu::qCnt; q++)
+                {
+                    multi->ConfigPriority(q,
+                                          pool.prioPool[q],
+                                          pool.lossless[q],
+                                          pool.pgAlpha[q],
+                                          pool.queueAlpha[q]);
+                }
+                for (uint32_t i = 0; i < MultiPoolSwitchMmu::poolCnt; i++)
+                    multi->pool_size[i] = pool.poolSize[i];
+                multi->pool0_auto = pool.pool0Auto;
+            }
+        }
+
+        if (!nvsw && !rdma)
+            continue;
+        const uint32_t* in = routes + rec.routeStart;
+        if (rdma)
+        {
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < rec.routeSize; i += 2 + in[i + 1])
+                n++;
+            rdma->m_rtTable.reserve(n);
+        }
+        for (uint32_t i = 0; i < rec.routeSize; i += 2 + in[i + 1])
+        {
+            Ipv4Address dip(in[i]);
+            for (uint32_t k = 0; k < in[i + 1]; k++)
+            {
+                uint32_t port = in[i + 2 + k] & 0x7fffffff;
+                if (nvsw)
+                    nvsw->AddTableEntry(dip, port);
+                else
+                    rdma->AddTableEntry(dip, port, in[i + 2 + k] >> 31);
+            }
+        }
+    }
+}
+
+} // namespace ns3
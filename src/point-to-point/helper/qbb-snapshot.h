@@ -0,0 +1,155 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef QBB_SNAPSHOT_H
+#define QBB_SNAPSHOT_H
+
+#include "ns3/net-device-container.h"
+#include "ns3/node-container.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+class QbbHelper;
+
+/**
+ * \brief Image of a built qbb topology, to restore it instead of building it.
+ *
+ * The image holds what the setup of a qbb simulation computes before the
+ * first packet is sent:
+ *  - the nodes, with their type and id;
+ *  - the qbb links between them, with the interface index of both ends,
+ *    the data rate of the devices and the delay of the channel;
+ *  - the SwitchNode attributes EcnEnabled, CcMode, AckHighPrio and MaxRtt,
+ *    and the NVSwitchNode attribute AckHighPrio;
+ *  - the SwitchMmu configuration of the switches (ConfigEcn, ConfigHdrm,
+ *    ConfigBufferSize, ConfigNPort and the PFC parameters), for the ports
+ *    of the node, and the type of the MMU with, for a MultiPoolSwitchMmu,
+ *    its service pools and priorities;
+ *  - the routing tables of the switches, the NVSwitches and the RdmaHw of
+ *    the hosts.  The EcmpFib of a switch is saved compiled and loaded as is.
+ *
+ * The image is a header followed by arrays of fixed size records, so that
+ * Load maps the file and reads the records in place.  It is tagged with a
+ * hash of the configuration given to Save, e.g. Hash of the topology file
+ * and of the parameters of the run, and Load refuses an image of another
+ * configuration or a corrupted one.  Records are in the byte order of the
+ * machine which saved them.
+ *
+ * A topology is restored in the order it was built: RestoreNodes creates
+ * the nodes, which must get the ids they had, so it runs before any other
+ * node is created; RestoreLinks installs the links in bulk with
+ * QbbHelper::Install(nodes, links), where every end must get the interface
+ * index it had; RestoreState loads the switch configuration and the
+ * routing tables, once the RdmaDriver of the hosts is installed.  Anything
+ * else the setup does, e.g. the devices and queues attributes set through
+ * the helper, the IP addresses and the RdmaHw callbacks, is still done by
+ * the program, and belongs in the configuration hash.
+ */
+class QbbSnapshot
+{
+  public:
+    QbbSnapshot();
+    ~QbbSnapshot();
+
+    QbbSnapshot(const QbbSnapshot&) = delete;
+    QbbSnapshot& operator=(const QbbSnapshot&) = delete;
+
+    /**
+     * \param data the bytes to hash
+     * \param seed the hash of the preceding bytes, to hash several strings
+     * \return the 64-bit FNV-1a hash of the bytes
+     */
+    static uint64_t Hash(const std::string& data, uint64_t seed = 0xcbf29ce484222325ULL);
+
+    /**
+     * Take the image of a topology. Links to nodes outside the container
+     * are ignored.  The routing tables of the switches are compiled, see
+     * SwitchNode::Freeze.
+     *
+     * \param nodes the nodes of the topology, in the order they were created
+     */
+    void Capture(NodeContainer nodes);
+
+    /**
+     * \param filename the file to write
+     * \param configHash the hash of the configuration of the topology
+     * \return false if there is no image or the file cannot be written
+     */
+    bool Save(std::string filename, uint64_t configHash) const;
+
+    /**
+     * Map an image saved by Save.
+     *
+     * \param filename the file to read
+     * \param configHash the hash of the configuration of the topology
+     * \return false if the file cannot be read, is not a valid image or was
+     * saved with another configuration hash
+     */
+    bool Load(std::string filename, uint64_t configHash);
+
+    /**
+     * \return the nodes of the image, created with their types and ids
+     */
+    NodeContainer RestoreNodes() const;
+
+    /**
+     * \param nodes the nodes returned by RestoreNodes
+     * \param qbb the helper which installs the devices and channels
+     * \return the devices, two per link, in the order of the links
+     */
+    NetDeviceContainer RestoreLinks(NodeContainer nodes, QbbHelper& qbb) const;
+
+    /**
+     * Load the switch attributes, the MMU configuration and the routing
+     * tables, replacing what was there before.
+     *
+     * \param nodes the nodes returned by RestoreNodes
+     */
+    void RestoreState(NodeContainer nodes) const;
+
+    /// \return whether there is an image, captured or loaded
+    bool IsValid() const;
+    /// \return the number of nodes of the image
+    uint32_t GetNNodes() const;
+    /// \return the number of links of the image
+    uint32_t GetNLinks() const;
+    /// \return the size of the image in bytes
+    uint64_t GetSize() const;
+
+  private:
+    struct Header;
+    struct NodeRecord;
+    struct LinkRecord;
+    struct PortRecord;
+    struct PoolRecord;
+
+    /// Release the image
+    void Clear();
+    const Header* GetHeader() const;
+
+    std::vector<uint8_t> m_buffer; // image taken by Capture
+    void* m_map;                   // mapping of the image read by Load
+    uint64_t m_mapSize;
+    const uint8_t* m_image; // the image, in m_buffer or m_map, NULL if none
+    uint64_t m_size;
+};
+
+} // namespace ns3
+
+#endif /* QBB_SNAPSHOT_H */
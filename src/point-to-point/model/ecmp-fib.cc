@@ -0,0 +1,184 @@
+#include "ecmp-fib.h"
+
+#include "ns3/abort.h"
+
+#include <algorithm>
+#include <map>
+
+namespace ns3
+{
+
+EcmpFib::EcmpFib()
+    : m_frozen(false)
+{
+}
+
+void
+EcmpFib::Add(uint32_t dip, uint32_t port)
+{
+    NS_ABORT_MSG_IF(port > 0xffff, "EcmpFib: port index " << port << " too large");
+    if (m_frozen)
+        Thaw();
+    m_builder[dip].push_back(port);
+}
+
+void
+EcmpFib::Clear()
+{
+    m_frozen = false;
+    std::unordered_map<uint32_t, std::vector<int>>().swap(m_builder);
+    std::vector<uint16_t>().swap(m_hostGroup);
+    std::unordered_map<uint32_t, uint16_t>().swap(m_otherGroup);
+    std::vector<Group>().swap(m_groups);
+    std::vector<uint16_t>().swap(m_ports);
+}
+
+void
+EcmpFib::Freeze()
+{
+    if (m_frozen)
+        return;
+
+    uint32_t nHost = 0;
+    for (auto& entry : m_builder)
+    {
+        if ((entry.first & 0xff0000ff) == 0x0b000001)
+            nHost = std::max(nHost, ((entry.first >> 8) & 0xffff) + 1);
+    }
+    m_hostGroup.assign(nHost, 0);
+    m_otherGroup.clear();
+    m_groups.assign(1, Group{0, 0}); // group 0 means no route
+    m_ports.clear();
+
+    // identical next-hop lists (same ports in the same order) share one group
+    std::map<std::vector<int>, uint16_t> groupOf;
+    for (auto& entry : m_builder)
+    {
+        auto& nexthops = entry.second;
+        if (nexthops.empty())
+            continue;
+        auto it = groupOf.find(nexthops);
+        uint16_t g;
+        if (it != groupOf.end())
+        {
+            g = it->second;
+        }
+        else
+        {
+            NS_ABORT_MSG_IF(m_groups.size() > 0xffff, "EcmpFib: too many ECMP groups");
+            g = m_groups.size();
+            m_groups.push_back(Group{(uint32_t)m_ports.size(), (uint32_t)nexthops.size()});
+            m_ports.insert(m_ports.end(), nexthops.begin(), nexthops.end());
+            groupOf[nexthops] = g;
+        }
+        if ((entry.first & 0xff0000ff) == 0x0b000001)
+            m_hostGroup[(entry.first >> 8) & 0xffff] = g;
+        else
+            m_otherGroup[entry.first] = g;
+    }
+    m_groups.shrink_to_fit();
+    m_ports.shrink_to_fit();
+    std::unordered_map<uint32_t, std::vector<int>>().swap(m_builder);
+    m_frozen = true;
+}
+
+void
+EcmpFib::Thaw()
+{
+    for (uint32_t host = 0; host < m_hostGroup.size(); host++)
+    {
+        if (m_hostGroup[host] == 0)
+            continue;
+        uint32_t dip = 0x0b000001 | (host << 8);
+        m_builder[dip] = GetNextHops(dip);
+    }
+    for (auto& entry : m_otherGroup)
+        m_builder[entry.first] = GetNextHops(entry.first);
+    std::vector<uint16_t>().swap(m_hostGroup);
+    m_otherGroup.clear();
+    std::vector<Group>().swap(m_groups);
+    std::vector<uint16_t>().swap(m_ports);
+    m_frozen = false;
+}
+
+std::vector<int>
+EcmpFib::GetNextHops(uint32_t dip) const
+{
+    if (!m_frozen)
+    {
+        auto it = m_builder.find(dip);
+        return it != m_builder.end() ? it->second : std::vector<int>();
+    }
+    const Group* g = Find(dip);
+    if (g == NULL)
+        return std::vector<int>();
+    return std::vector<int>(m_ports.begin() + g->offset, m_ports.begin() + g->offset + g->size);
+}
+
+const std::vector<uint16_t>&
+EcmpFib::GetHostGroups() const
+{
+    return m_hostGroup;
+}
+
+const std::unordered_map<uint32_t, uint16_t>&
+EcmpFib::GetOtherGroups() const
+{
+    return m_otherGroup;
+}
+
+const std::vector<EcmpFib::Group>&
+EcmpFib::GetGroups() const
+{
+    return m_groups;
+}
+
+const std::vector<uint16_t>&
+EcmpFib::GetPorts() const
+{
+    return m_ports;
+}
+
+void
+EcmpFib::Load(const uint16_t* hostGroup,
+              uint32_t nHost,
+              const uint32_t* otherGroup,
+              uint32_t nOther,
+              const Group* groups,
+              uint32_t nGroups,
+              const uint16_t* ports,
+              uint32_t nPorts)
+{
+    NS_ABORT_MSG_IF(nGroups == 0 || nGroups > 0x10000, "EcmpFib: wrong number of groups");
+    for (uint32_t g = 1; g < nGroups; g++)
+        NS_ABORT_MSG_IF(groups[g].offset + groups[g].size > nPorts, "EcmpFib: wrong group " << g);
+    for (uint32_t host = 0; host < nHost; host++)
+        NS_ABORT_MSG_IF(hostGroup[host] >= nGroups, "EcmpFib: wrong group of host " << host);
+    for (uint32_t i = 0; i < nOther; i++)
+        NS_ABORT_MSG_IF(otherGroup[2 * i + 1] >= nGroups,
+                        "EcmpFib: wrong group of " << otherGroup[2 * i]);
+    Clear();
+    m_hostGroup.assign(hostGroup, hostGroup + nHost);
+    m_otherGroup.reserve(nOther);
+    for (uint32_t i = 0; i < nOther; i++)
+        m_otherGroup[otherGroup[2 * i]] = otherGroup[2 * i + 1];
+    m_groups.assign(groups, groups + nGroups);
+    m_ports.assign(ports, ports + nPorts);
+    m_frozen = true;
+}
+
+uint32_t
+EcmpFib::GetNGroups() const
+{
+    return m_groups.empty() ? 0 : m_groups.size() - 1;
+}
+
+uint64_t
+EcmpFib::GetMemory() const
+{
+    return m_hostGroup.capacity() * sizeof(uint16_t) +
+           m_otherGroup.size() * (sizeof(uint32_t) + sizeof(uint16_t) + 2 * sizeof(void*)) +
+           m_groups.capacity() * sizeof(Group) + m_ports.capacity() * sizeof(uint16_t);
+}
+
+} /* namespace ns3 */
@@ -0,0 +1,125 @@
+#ifndef ECMP_FIB_H
+#define ECMP_FIB_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \brief Compiled next-hop table with shared ECMP groups.
+ *
+ * Add() collects (destination IP, port) entries in a builder map.  Freeze()
+ * compiles them: every distinct set of next hops becomes one group, and a
+ * destination that follows the simulator's host IP encoding (11.x.y.1, node
+ * id in (ip >> 8) & 0xffff) is mapped to its group through a flat array
+ * indexed by node id.  Other destinations stay in a small hash map.
+ *
+ * A next hop is picked from a group with fastrange, i.e. (hash * size) >> 32,
+ * instead of hash % size.
+ *
+ * Add() after Freeze() reopens the table, the next Freeze() compiles it again.
+ */
+class EcmpFib
+{
+  public:
+    struct Group
+    {
+        uint32_t offset; // first port of the group in m_ports
+        uint32_t size;   // number of next hops
+    };
+
+    EcmpFib();
+
+    void Add(uint32_t dip, uint32_t port);
+    void Clear();
+    void Freeze();
+
+    bool IsFrozen() const
+    {
+        return m_frozen;
+    }
+
+    /**
+     * \param dip destination IP
+     * \return the group of dip, or NULL if there is no route. Only valid when frozen.
+     */
+    const Group* Find(uint32_t dip) const
+    {
+        uint32_t g = 0;
+        if ((dip & 0xff0000ff) == 0x0b000001)
+        {
+            uint32_t host = (dip >> 8) & 0xffff;
+            if (host < m_hostGroup.size())
+                g = m_hostGroup[host];
+        }
+        else
+        {
+            auto it = m_otherGroup.find(dip);
+            if (it != m_otherGroup.end())
+                g = it->second;
+        }
+        return g ? &m_groups[g] : NULL;
+    }
+
+    /**
+     * \param g a group returned by Find
+     * \param hash the flow hash
+     * \return the next hop of the flow
+     */
+    uint32_t Select(const Group* g, uint32_t hash) const
+    {
+        return m_ports[g->offset + (uint32_t)(((uint64_t)hash * g->size) >> 32)];
+    }
+
+    /**
+     * \return the next hops of dip in the order they were added
+     */
+    std::vector<int> GetNextHops(uint32_t dip) const;
+
+    // the compiled table, frozen only, to save it and Load it back
+    const std::vector<uint16_t>& GetHostGroups() const;
+    const std::unordered_map<uint32_t, uint16_t>& GetOtherGroups() const;
+    const std::vector<Group>& GetGroups() const;
+    const std::vector<uint16_t>& GetPorts() const;
+
+    /**
+     * Replace the table by a compiled one, which is frozen.
+     * \param hostGroup group of each host, 0 if none
+     * \param nHost number of hosts
+     * \param otherGroup (dip, group) of the other destinations
+     * \param nOther number of other destinations
+     * \param groups the groups, groups[0] is unused
+     * \param nGroups number of groups, at least 1
+     * \param ports next hops of the groups
+     * \param nPorts number of next hops
+     */
+    void Load(const uint16_t* hostGroup,
+              uint32_t nHost,
+              const uint32_t* otherGroup,
+              uint32_t nOther,
+              const Group* groups,
+              uint32_t nGroups,
+              const uint16_t* ports,
+              uint32_t nPorts);
+
+    uint32_t GetNGroups() const; // distinct ECMP groups, frozen only
+    uint64_t GetMemory() const;  // approximate bytes used by the compiled table
+
+  private:
+    void Thaw();
+
+    bool m_frozen;
+    std::unordered_map<uint32_t, std::vector<int>> m_builder; // dip -> next hops, not frozen
+    std::vector<uint16_t> m_hostGroup;                      // node id -> group, 0 if none
+    std::unordered_map<uint32_t, uint16_t> m_otherGroup;    // other dip -> group
+    std::vector<Group> m_groups;                            // m_groups[0] is unused
+    std::vector<uint16_t> m_ports;
+};
+
+} /* namespace ns3 */
+
+#endif /* ECMP_FIB_H */
@@ -0,0 +1,269 @@
+#include "fct-collector.h"
+
+#include "ns3/abort.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <type_traits>
+
+NS_LOG_COMPONENT_DEFINE("FctCollector");
+
+namespace ns3
+{
+
+NS_OBJECT_ENSURE_REGISTERED(FctCollector);
+
+static const uint32_t FCT_FILE_MAGIC = 0x54434651; // "QFCT"
+static const uint32_t FCT_FILE_VERSION = 1;
+
+// relative accuracy of the slowdown quantiles
+static const double FCT_SKETCH_ACCURACY = 0.01;
+
+TypeId
+FctCollector::GetTypeId(void)
+{
+    static TypeId tid =
+        TypeId("ns3::FctCollector")
+            .SetParent<Object>()
+            .AddConstructor<FctCollector>()
+            .AddAttribute("Capacity",
+                          "Number of records reserved in the buffer of each logical process.",
+                          UintegerValue(64 * 1024),
+                          MakeUintegerAccessor(&FctCollector::m_capacity),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("MaxStreams",
+                          "Maximum number of logical processes recording qps.",
+                          UintegerValue(LpStreams<Stream>::DEFAULT_MAX_STREAMS),
+                          MakeUintegerAccessor(&FctCollector::SetMaxStreams,
+                                               &FctCollector::GetMaxStreams),
+                          MakeUintegerChecker<uint32_t>(1));
+    return tid;
+}
+
+FctCollector::FctCollector()
+    : m_bounds({10000, 100000, 1000000, 10000000}),
+      m_streams("FctCollector")
+{
+}
+
+FctCollector::~FctCollector()
+{
+}
+
+void
+FctCollector::SetSizeBuckets(std::vector<uint64_t> bounds)
+{
+    NS_ABORT_MSG_IF(GetNRecords() > 0, "FctCollector: size buckets set after recording");
+    std::sort(bounds.begin(), bounds.end());
+    m_bounds = bounds;
+}
+
+uint32_t
+FctCollector::GetNSizeBuckets(void) const
+{
+    return m_bounds.size() + 1;
+}
+
+uint32_t
+FctCollector::GetSizeBucket(uint64_t size) const
+{
+    return std::lower_bound(m_bounds.begin(), m_bounds.end(), size) - m_bounds.begin();
+}
+
+void
+FctCollector::SetMaxStreams(uint32_t maxStreams)
+{
+    NS_ABORT_MSG_IF(GetNRecords() > 0, "FctCollector: MaxStreams set after recording");
+    m_streams.SetMaxStreams(maxStreams);
+}
+
+uint32_t
+FctCollector::GetMaxStreams(void) const
+{
+    return m_streams.GetMaxStreams();
+}
+
+void
+FctCollector::Install(Ptr<RdmaDriver> driver)
+{
+    driver->TraceConnectWithoutContext("QpComplete", MakeCallback(&FctCollector::Record, this));
+}
+
+void
+FctCollector::Install(NodeContainer nodes)
+{
+    for (auto i = nodes.Begin(); i != nodes.End(); i++)
+    {
+        Ptr<RdmaDriver> driver = (*i)->GetObject<RdmaDriver>();
+        if (driver)
+            Install(driver);
+    }
+}
+
+FctCollector::Stream*
+FctCollector::GetStream(uint32_t id)
+{
+    return m_streams.Get(id, [this]() {
+        Stream* s = new Stream;
+        s->start.reserve(m_capacity);
+        s->finish.reserve(m_capacity);
+        s->size.reserve(m_capacity);
+        s->ideal.reserve(m_capacity);
+        s->sip.reserve(m_capacity);
+        s->dip.reserve(m_capacity);
+        s->sport.reserve(m_capacity);
+        s->dport.reserve(m_capacity);
+        s->pg.reserve(m_capacity);
+        s->slowdowns.resize(GetNSizeBuckets(), QuantileSketch(FCT_SKETCH_ACCURACY));
+        return s;
+    });
+}
+
+void
+FctCollector::Record(Ptr<RdmaQueuePair> qp)
+{
+    Stream* s = GetStream(Simulator::GetSystemId());
+    uint64_t start = qp->startTime.GetNanoSeconds();
+    uint64_t finish = Simulator::Now().GetNanoSeconds();
+    uint64_t ideal = qp->m_baseRtt;
+    if (qp->m_max_rate.GetBitRate() > 0)
+        ideal += qp->m_max_rate.CalculateBytesTxTime(qp->m_size).GetNanoSeconds();
+    s->start.push_back(start);
+    s->finish.push_back(finish);
+    s->size.push_back(qp->m_size);
+    s->ideal.push_back(ideal);
+    s->sip.push_back(qp->sip.Get());
+    s->dip.push_back(qp->dip.Get());
+    s->sport.push_back(qp->sport);
+    s->dport.push_back(qp->dport);
+    s->pg.push_back(qp->m_pg);
+
+    double slowdown = ideal > 0 ? (double)(finish - start) / ideal : 1;
+    s->slowdowns[GetSizeBucket(qp->m_size)].Add(slowdown);
+}
+
+uint64_t
+FctCollector::GetNRecords(void) const
+{
+    uint64_t n = 0;
+    m_streams.ForEach([&n](const Stream* s) { n += s->start.size(); });
+    return n;
+}
+
+QuantileSketch
+FctCollector::MergeSlowdowns(uint32_t bucket) const
+{
+    QuantileSketch merged(FCT_SKETCH_ACCURACY);
+    m_streams.ForEach([&](const Stream* s) {
+        if (bucket < s->slowdowns.size())
+            merged.Merge(s->slowdowns[bucket]);
+    });
+    return merged;
+}
+
+uint64_t
+FctCollector::GetBucketCount(uint32_t bucket) const
+{
+    return MergeSlowdowns(bucket).GetCount();
+}
+
+double
+FctCollector::GetSlowdownQuantile(uint32_t bucket, double q) const
+{
+    return MergeSlowdowns(bucket).GetQuantile(q);
+}
+
+void
+FctCollector::PrintSummary(std::ostream& os) const
+{
+    os << "size count p50 p99 p999\n";
+    for (uint32_t b = 0; b < GetNSizeBuckets(); b++)
+    {
+        if (b < m_bounds.size())
+            os << "<=" << m_bounds[b];
+        else
+            os << ">" << (m_bounds.empty() ? 0 : m_bounds.back());
+        QuantileSketch slowdowns = MergeSlowdowns(b);
+        os << " " << slowdowns.GetCount() << " " << slowdowns.GetQuantile(0.5) << " "
+           << slowdowns.GetQuantile(0.99) << " " << slowdowns.GetQuantile(0.999) << "\n";
+    }
+}
+
+bool
+FctCollector::WriteBinary(std::string filename) const
+{
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+    {
+        NS_LOG_WARN("cannot open fct file " << filename);
+        return false;
+    }
+    std::vector<const Stream*> streams;
+    m_streams.ForEach([&streams](const Stream* s) { streams.push_back(s); });
+    FctFileHeader h;
+    h.magic = FCT_FILE_MAGIC;
+    h.version = FCT_FILE_VERSION;
+    h.records = GetNRecords();
+    fwrite(&h, sizeof(h), 1, file);
+    auto column = [&](auto member) {
+        for (const Stream* s : streams)
+        {
+            auto& v = s->*member;
+            fwrite(v.data(), sizeof(v[0]), v.size(), file);
+        }
+    };
+    column(&Stream::start);
+    column(&Stream::finish);
+    column(&Stream::size);
+    column(&Stream::ideal);
+    column(&Stream::sip);
+    column(&Stream::dip);
+    column(&Stream::sport);
+    column(&Stream::dport);
+    column(&Stream::pg);
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+bool
+FctCollector::ReadBinary(std::string filename, std::vector<FctRecord>& records)
+{
+    records.clear();
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    FctFileHeader h;
+    if (fread(&h, sizeof(h), 1, file) != 1 || h.magic != FCT_FILE_MAGIC ||
+        h.version != FCT_FILE_VERSION)
+    {
+        fclose(file);
+        return false;
+    }
+    records.resize(h.records);
+    bool ok = true;
+    auto column = [&](auto member) {
+        std::vector<std::remove_reference_t<decltype(records[0].*member)>> v(h.records);
+        ok = ok && fread(v.data(), sizeof(v[0]), v.size(), file) == v.size();
+        for (uint64_t i = 0; i < v.size(); i++)
+            records[i].*member = v[i];
+    };
+    column(&FctRecord::start);
+    column(&FctRecord::finish);
+    column(&FctRecord::size);
+    column(&FctRecord::ideal);
+    column(&FctRecord::sip);
+    column(&FctRecord::dip);
+    column(&FctRecord::sport);
+    column(&FctRecord::dport);
+    column(&FctRecord::pg);
+    fclose(file);
+    if (!ok)
+        records.clear();
+    return ok;
+}
+
+} // namespace ns3
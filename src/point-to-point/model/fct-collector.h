@@ -0,0 +1,113 @@
+#ifndef FCT_COLLECTOR_H
+#define FCT_COLLECTOR_H
+
+#include "ns3/lp-streams.h"
+#include "ns3/node-container.h"
+#include "ns3/object.h"
+#include "ns3/quantile-sketch.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/rdma-queue-pair.h"
+
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \brief Flow completion record of a queue pair, as read back by FctCollector::ReadBinary.
+ */
+struct FctRecord
+{
+    uint64_t start;  // start time of the qp, ns
+    uint64_t finish; // completion time, ns
+    uint64_t size;   // bytes
+    uint64_t ideal;  // completion time of the qp alone on the network, ns
+    uint32_t sip, dip;
+    uint16_t sport, dport;
+    uint16_t pg;
+};
+
+/**
+ * \brief Collector of the flow completion times of RDMA queue pairs.
+ *
+ * Install() connects the collector to the QpComplete trace of the RdmaDrivers.
+ * Every completed qp is appended to a columnar buffer, with the capacity
+ * given by the Capacity attribute reserved up front, and its slowdown,
+ * i.e. FCT over the ideal FCT (base RTT plus the time to send the qp at the
+ * NIC rate), is added to the sketch of its size bucket.
+ *
+ * As in TraceWriter, records are kept in one stream per logical process, so
+ * that the threads of a multithreaded simulation never share a buffer.  The
+ * streams are merged when the results are read.
+ *
+ * The slowdowns go to a QuantileSketch with a relative accuracy of 1%, so
+ * p50/p99/p999 cost a few hundred counters per bucket whatever the number
+ * of flows.  WriteBinary dumps the records column by
+ * column: a FctFileHeader, then the start, finish, size, ideal, sip, dip,
+ * sport, dport and pg arrays of header.records entries each.
+ */
+class FctCollector : public Object
+{
+  public:
+    static TypeId GetTypeId(void);
+    FctCollector();
+    ~FctCollector() override;
+
+    // upper bounds (bytes, inclusive) of the size buckets, larger qps go to
+    // a last bucket; must be set before recording
+    void SetSizeBuckets(std::vector<uint64_t> bounds);
+    uint32_t GetNSizeBuckets(void) const;
+    // size bucket of a qp of the given size
+    uint32_t GetSizeBucket(uint64_t size) const;
+
+    // record the qps completing on the given drivers or nodes
+    void Install(Ptr<RdmaDriver> driver);
+    void Install(NodeContainer nodes);
+
+    // QpComplete trace sink
+    void Record(Ptr<RdmaQueuePair> qp);
+
+    uint64_t GetNRecords(void) const;
+    // q-quantile of the slowdowns of a size bucket, 0 if the bucket is empty
+    double GetSlowdownQuantile(uint32_t bucket, double q) const;
+    uint64_t GetBucketCount(uint32_t bucket) const;
+    // one line per bucket: size bound, count, p50, p99 and p999 slowdowns
+    void PrintSummary(std::ostream& os) const;
+
+    bool WriteBinary(std::string filename) const;
+    static bool ReadBinary(std::string filename, std::vector<FctRecord>& records);
+
+  private:
+    // per logical process buffer
+    struct Stream
+    {
+        std::vector<uint64_t> start, finish, size, ideal;
+        std::vector<uint32_t> sip, dip;
+        std::vector<uint16_t> sport, dport, pg;
+        std::vector<QuantileSketch> slowdowns; // per size bucket
+    };
+
+    void SetMaxStreams(uint32_t maxStreams);
+    uint32_t GetMaxStreams(void) const;
+    Stream* GetStream(uint32_t id);
+    // slowdowns of all streams for a bucket
+    QuantileSketch MergeSlowdowns(uint32_t bucket) const;
+
+    std::vector<uint64_t> m_bounds;
+    LpStreams<Stream> m_streams;
+    uint32_t m_capacity;
+};
+
+struct FctFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t records;
+};
+
+} // namespace ns3
+
+#endif /* FCT_COLLECTOR_H */
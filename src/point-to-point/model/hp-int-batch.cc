@@ -0,0 +1,57 @@
+#include "hp-int-batch.h"
+
+namespace ns3
+{
+
+void
+HpIntBatch::Load(IntHeader& ih, IntHop* last, bool skipIdle)
+{
+    const uint32_t timeMask = (1u << IntHop::timeWidth) - 1;
+    const uint32_t bytesMask = (1u << IntHop::bytesWidth) - 1;
+    n = ih.IntHeader_t.nhop;
+    // all lanes are decoded, the ones beyond nhop are masked out by updated[]
+    for (uint32_t i = 0; i < lanes; i++)
+    {
+        IntHop& h = ih.IntHeader_t.hop[i];
+        // the counters wrap, so the delta is taken modulo the field width
+        tau[i] = (uint32_t)(h.IntHop_t.time - last[i].IntHop_t.time) & timeMask;
+        bytes[i] = (uint32_t)(h.IntHop_t.bytes - last[i].IntHop_t.bytes) & bytesMask;
+        uint32_t q = h.GetQlen();
+        uint32_t lq = last[i].GetQlen();
+        qlen[i] = q < lq ? q : lq;
+        lineRate[i] = h.GetLineRate();
+        updated[i] = (i < n) & !(skipIdle & (q == 0));
+    }
+}
+
+void
+HpIntBatch::Compute(uint64_t maxRate, uint32_t win)
+{
+    // bytes * scale is exact up to 2^53, above that it rounds like the integer product
+    const double scale = (uint64_t)IntHop::byteUnit * IntHop::multi * 8;
+    const double rate = maxRate;
+    const double w = win;
+    for (uint32_t i = 0; i < lanes; i++)
+    {
+        double duration = (int32_t)tau[i] * 1e-9;
+        double txRate = (int32_t)bytes[i] * scale / duration;
+        u[i] = txRate / lineRate[i] + qlen[i] * rate / lineRate[i] / w;
+    }
+
+    // the first hop with the largest u wins, as in the per-hop loop
+    double m = 0;
+    uint32_t t = 0;
+    uint8_t any = 0;
+    for (uint32_t i = 0; i < lanes; i++)
+    {
+        bool take = updated[i] & (u[i] > m);
+        m = take ? u[i] : m;
+        t = take ? tau[i] : t;
+        any |= updated[i];
+    }
+    maxU = m;
+    maxTau = t;
+    anyUpdated = any;
+}
+
+} // namespace ns3
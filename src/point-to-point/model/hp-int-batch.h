@@ -0,0 +1,55 @@
+#ifndef HP_INT_BATCH_H
+#define HP_INT_BATCH_H
+
+#include "ns3/int-header.h"
+
+#include <stdint.h>
+
+namespace ns3
+{
+
+/**
+ * \brief Structure-of-arrays view of the INT hops of one HPCC ACK.
+ *
+ * Load() decodes the IntHop bitfields of the ACK and of the last stored
+ * sample once into per-hop deltas; Compute() then evaluates the per-hop
+ * utilization of RdmaHw::UpdateRateHp over all lanes with selects instead
+ * of branches, so the compiler can vectorize it.  Every floating point
+ * result is rounded from the same exact value as in a per-hop loop over
+ * IntHop::GetTimeDelta and IntHop::GetBytesDelta, so u, maxU and maxTau are
+ * bit-identical to it; utils/bench-hpcc-int checks it.
+ */
+class HpIntBatch
+{
+  public:
+    static const uint32_t lanes = IntHeader::maxHop;
+
+    uint32_t n;             // number of hops in the ACK
+    uint32_t tau[lanes];    // ns since the stored sample
+    uint32_t bytes[lanes];  // bytes since the stored sample, in byteUnit * multi
+    double qlen[lanes];     // the smaller of the two queue lengths, in bytes
+    double lineRate[lanes]; // bps
+    uint8_t updated[lanes]; // the hop takes part in this update
+
+    double u[lanes]; // normalized utilization of the hop
+    double maxU;     // the largest u of an updated hop, 0 if none
+    uint32_t maxTau; // tau of that hop
+    bool anyUpdated;
+
+    /**
+     * \param ih the INT header of the ACK, ih.IntHeader_t.nhop <= maxHop
+     * \param last the stored sample of each hop
+     * \param skipIdle leave out hops with an empty queue (sampled fast react)
+     */
+    void Load(IntHeader& ih, IntHop* last, bool skipIdle);
+
+    /**
+     * \param maxRate the max rate of the QP in bps
+     * \param win the window of the QP in bytes
+     */
+    void Compute(uint64_t maxRate, uint32_t win);
+};
+
+} // namespace ns3
+
+#endif /* HP_INT_BATCH_H */
@@ -9,12 +9,15 @@
 #include "ns3/int-header.h"
 #include "ns3/ipv4-header.h"
 #include "ns3/ipv4.h"
+#include "ns3/object-factory.h"
 #include "ns3/packet.h"
 #include "ns3/pause-header.h"
 #include "ns3/simulator.h"
+#include "ns3/type-id.h"
 #include "ns3/uinteger.h"
 
 #include <cmath>
+#include <cstdlib>
 
 namespace ns3
 {
@@ -29,7 +32,13 @@ NVSwitchNode::GetTypeId(void)
                                           "Set high priority for ACK/NACK or not",
                                           UintegerValue(0),
                                           MakeUintegerAccessor(&NVSwitchNode::m_ackHighPrio),
-                                          MakeUintegerChecker<uint32_t>());
+                                          MakeUintegerChecker<uint32_t>())
+                            .AddAttribute("MmuType",
+                                          "The type of the MMU, a SwitchMmu",
+                                          TypeIdValue(SwitchMmu::GetTypeId()),
+                                          MakeTypeIdAccessor(&NVSwitchNode::SetMmuType,
+                                                             &NVSwitchNode::GetMmuType),
+                                          MakeTypeIdChecker());
     return tid;
 }
 
@@ -37,11 +46,7 @@ NVSwitchNode::NVSwitchNode()
 {
     m_ecmpSeed = GetId();
     m_node_type = 2;
-    m_mmu = CreateObject<SwitchMmu>();
-    for (uint32_t i = 0; i < pCnt; i++)
-        for (uint32_t j = 0; j < pCnt; j++)
-            for (uint32_t k = 0; k < qCnt; k++)
-                m_bytes[i][j][k] = 0;
+    m_bytes = static_cast<uint32_t(*)[pCnt][qCnt]>(calloc(pCnt, sizeof(*m_bytes)));
     for (uint32_t i = 0; i < pCnt; i++)
     {
         m_txBytes[i] = 0;
@@ -54,6 +59,25 @@ NVSwitchNode::NVSwitchNode()
         m_u[i] = 0;
 }
 
+NVSwitchNode::~NVSwitchNode()
+{
+    free(m_bytes);
+}
+
+void
+NVSwitchNode::SetMmuType(TypeId tid)
+{
+    ObjectFactory factory;
+    factory.SetTypeId(tid);
+    m_mmu = factory.Create<SwitchMmu>();
+}
+
+TypeId
+NVSwitchNode::GetMmuType() const
+{
+    return m_mmu->GetInstanceTypeId();
+}
+
 int
 NVSwitchNode::GetOutDev(Ptr<const Packet> p, CustomHeader& ch)
 {
@@ -197,6 +221,12 @@ NVSwitchNode::ClearTable()
     m_rtTable.clear();
 }
 
+const std::unordered_map<uint32_t, std::vector<int>>&
+NVSwitchNode::GetTable() const
+{
+    return m_rtTable;
+}
+
 // This function can only be called in switch mode
 bool
 NVSwitchNode::SwitchReceiveFromDevice(Ptr<NetDevice> device, Ptr<Packet> packet, CustomHeader& ch)
@@ -22,8 +22,9 @@ class NVSwitchNode : public Node
     std::unordered_map<uint32_t, std::vector<int>>
         m_rtTable; // map from ip address (u32) to possible ECMP port (index of dev)
 
-    uint32_t m_bytes[pCnt][pCnt][qCnt]; // m_bytes[inDev][outDev][qidx] is the bytes from inDev
-                                        // enqueued for outDev at qidx
+    // m_bytes[inDev][outDev][qidx] is the bytes from inDev enqueued for outDev
+    // at qidx; allocated zeroed, so that the pages of unused ports are never touched
+    uint32_t (*m_bytes)[pCnt][qCnt];
 
     uint64_t m_txBytes[pCnt]; // counter of tx bytes
 
@@ -41,12 +42,17 @@ class NVSwitchNode : public Node
 
   public:
     Ptr<SwitchMmu> m_mmu;
+    // replace m_mmu by a new MMU of the given type, a SwitchMmu
+    void SetMmuType(TypeId tid);
+    TypeId GetMmuType() const;
 
     static TypeId GetTypeId(void);
     NVSwitchNode();
+    ~NVSwitchNode() override;
     void SetEcmpSeed(uint32_t seed);
     void AddTableEntry(Ipv4Address& dstAddr, uint32_t intf_idx);
     void ClearTable();
+    const std::unordered_map<uint32_t, std::vector<int>>& GetTable() const;
     bool SwitchReceiveFromDevice(Ptr<NetDevice> device, Ptr<Packet> packet, CustomHeader& ch);
     void SwitchNotifyDequeue(uint32_t ifIndex, uint32_t qIndex, Ptr<Packet> p);
 
@@ -0,0 +1,263 @@
+#include "pfc-deadlock-detector.h"
+
+#include "ns3/channel.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/simulator.h"
+#include "ns3/switch-node.h"
+#ifdef NS3_MTP
+#include "ns3/mtp-interface.h"
+#endif
+
+#include <iostream>
+
+namespace ns3
+{
+
+NS_OBJECT_ENSURE_REGISTERED(PfcDeadlockDetector);
+
+TypeId
+PfcDeadlockDetector::GetTypeId(void)
+{
+    static TypeId tid =
+        TypeId("ns3::PfcDeadlockDetector")
+            .SetParent<Object>()
+            .AddConstructor<PfcDeadlockDetector>()
+            .AddAttribute("CheckInterval",
+                          "Interval of the deadlock checks while some queues are paused.",
+                          TimeValue(MicroSeconds(100)),
+                          MakeTimeAccessor(&PfcDeadlockDetector::m_checkInterval),
+                          MakeTimeChecker(NanoSeconds(1)));
+    return tid;
+}
+
+PfcDeadlockDetector::PfcDeadlockDetector()
+    : m_unreported(0),
+      m_reported(0),
+      m_checkPending(false)
+{
+}
+
+void
+PfcDeadlockDetector::DoDispose()
+{
+    m_checkEvent.Cancel();
+    m_vertices.clear();
+    m_index.clear();
+    m_deadlockCallback = DeadlockCallback();
+    Object::DoDispose();
+}
+
+uint64_t
+PfcDeadlockDetector::Key(const QbbNetDevice* device, uint32_t qIndex)
+{
+    // the devices are aligned, the low bits of their address are free
+    return (uint64_t)(uintptr_t)device * QbbNetDevice::qCnt + qIndex;
+}
+
+void
+PfcDeadlockDetector::RecordPfc(Ptr<QbbNetDevice> device, uint32_t qIndex, bool pause)
+{
+#ifdef NS3_MTP
+    MtpInterface::CriticalSection cs;
+#endif
+    uint64_t key = Key(PeekPointer(device), qIndex);
+    auto it = m_index.find(key);
+    if (pause)
+    {
+        if (it != m_index.end())
+            return; // a pause refreshing the pause in progress
+        m_index[key] = m_vertices.size();
+        m_vertices.push_back({{device, qIndex, Simulator::Now()}, false});
+        m_unreported++;
+        if (!m_checkPending)
+        {
+            m_checkPending = true;
+#ifdef NS3_MTP
+            // the check reads the state of every switch, so that it runs in the
+            // public LP, between the rounds of the LPs updating it
+            if (MtpInterface::isEnabled())
+                MtpInterface::ScheduleGlobal(&PfcDeadlockDetector::ScheduleCheck, this);
+            else
+#endif
+                ScheduleCheck(this);
+        }
+    }
+    else if (it != m_index.end())
+    {
+        uint32_t i = it->second;
+        if (!m_vertices[i].reported)
+            m_unreported--;
+        m_index.erase(it);
+        if (i + 1 < m_vertices.size())
+        {
+            const PausedQueue& last = m_vertices.back().queue;
+            m_index[Key(PeekPointer(last.device), last.qIndex)] = i;
+            m_vertices[i] = m_vertices.back();
+        }
+        m_vertices.pop_back();
+    }
+}
+
+void
+PfcDeadlockDetector::SetDeadlockCallback(DeadlockCallback cb)
+{
+    m_deadlockCallback = cb;
+}
+
+std::vector<PfcDeadlockDetector::PausedQueue>
+PfcDeadlockDetector::GetPausedQueues() const
+{
+    std::vector<PausedQueue> out;
+    out.reserve(m_vertices.size());
+    for (const Vertex& v : m_vertices)
+        out.push_back(v.queue);
+    return out;
+}
+
+std::vector<PfcDeadlockDetector::PausedQueue>
+PfcDeadlockDetector::FindDeadlock() const
+{
+    std::vector<PausedQueue> out;
+    for (uint32_t i : FindDeadlockIndices())
+        out.push_back(m_vertices[i].queue);
+    return out;
+}
+
+uint64_t
+PfcDeadlockDetector::GetReported() const
+{
+    return m_reported;
+}
+
+std::vector<uint32_t>
+PfcDeadlockDetector::FindDeadlockIndices() const
+{
+    uint32_t n = m_vertices.size();
+    // the paused queues of each (node, priority)
+    std::unordered_map<uint64_t, std::vector<uint32_t>> paused;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const PausedQueue& v = m_vertices[i].queue;
+        uint64_t node = v.device->GetNode()->GetId();
+        paused[node * QbbNetDevice::qCnt + v.qIndex].push_back(i);
+    }
+
+    // a queue may progress if the ingress pausing it holds bytes in an unpaused
+    // queue, or if it waits for a queue which may progress
+    std::vector<std::vector<uint32_t>> waiters(n); // the queues waiting for a queue
+    std::vector<bool> progress(n, false);
+    std::vector<uint32_t> stack;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const PausedQueue& v = m_vertices[i].queue;
+        Ptr<Channel> channel = v.device->GetChannel();
+        Ptr<QbbNetDevice> peer;
+        for (std::size_t j = 0; channel && j < channel->GetNDevices(); j++)
+        {
+            if (channel->GetDevice(j) != v.device)
+                peer = DynamicCast<QbbNetDevice>(channel->GetDevice(j));
+        }
+        Ptr<SwitchNode> sw = peer ? DynamicCast<SwitchNode>(peer->GetNode()) : nullptr;
+        uint32_t in = peer ? peer->GetIfIndex() : 0;
+        if (!sw || !sw->m_mmu->paused[in][v.qIndex])
+        {
+            // a host, or a resume in flight
+            progress[i] = true;
+            stack.push_back(i);
+            continue;
+        }
+        int64_t held = (int64_t)sw->m_mmu->ingress_bytes[in][v.qIndex] +
+                       sw->m_mmu->hdrm_bytes[in][v.qIndex];
+        auto it = paused.find((uint64_t)sw->GetId() * QbbNetDevice::qCnt + v.qIndex);
+        if (it != paused.end())
+        {
+            for (uint32_t u : it->second)
+            {
+                uint32_t bytes =
+                    sw->GetBytes(in, m_vertices[u].queue.device->GetIfIndex(), v.qIndex);
+                if (bytes > 0)
+                {
+                    held -= bytes;
+                    waiters[u].push_back(i);
+                }
+            }
+        }
+        if (held > 0)
+        {
+            progress[i] = true;
+            stack.push_back(i);
+        }
+    }
+    while (!stack.empty())
+    {
+        uint32_t u = stack.back();
+        stack.pop_back();
+        for (uint32_t w : waiters[u])
+        {
+            if (!progress[w])
+            {
+                progress[w] = true;
+                stack.push_back(w);
+            }
+        }
+    }
+
+    std::vector<uint32_t> deadlocked;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (!progress[i])
+            deadlocked.push_back(i);
+    }
+    return deadlocked;
+}
+
+void
+PfcDeadlockDetector::ScheduleCheck(PfcDeadlockDetector* detector)
+{
+    detector->m_checkEvent =
+        Simulator::Schedule(detector->m_checkInterval, &PfcDeadlockDetector::Check, detector);
+}
+
+void
+PfcDeadlockDetector::Check()
+{
+#ifdef NS3_MTP
+    MtpInterface::CriticalSection cs;
+#endif
+    std::vector<PausedQueue> report;
+    for (uint32_t i : FindDeadlockIndices())
+    {
+        if (m_vertices[i].reported)
+            continue;
+        m_vertices[i].reported = true;
+        m_unreported--;
+        report.push_back(m_vertices[i].queue);
+    }
+    if (!report.empty())
+    {
+        m_reported += report.size();
+        if (m_deadlockCallback.IsNull())
+        {
+            std::cerr << "PFC deadlock at " << Simulator::Now().GetNanoSeconds() << "ns:";
+            for (const PausedQueue& q : report)
+            {
+                std::cerr << " (node " << q.device->GetNode()->GetId() << " dev "
+                          << q.device->GetIfIndex() << " q " << q.qIndex << " since "
+                          << q.since.GetNanoSeconds() << "ns)";
+            }
+            std::cerr << std::endl;
+            m_checkPending = false;
+            Simulator::Stop();
+            return;
+        }
+        m_deadlockCallback(report);
+    }
+    // the checks stop once every paused queue is reported, so that a deadlock
+    // does not keep the simulation running
+    if (m_unreported > 0)
+        ScheduleCheck(this);
+    else
+        m_checkPending = false;
+}
+
+} // namespace ns3
@@ -0,0 +1,100 @@
+#ifndef PFC_DEADLOCK_DETECTOR_H
+#define PFC_DEADLOCK_DETECTOR_H
+
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3
+{
+
+class QbbNetDevice;
+
+/**
+ * \brief Online detector of the PFC deadlocks of a qbb network.
+ *
+ * The devices sharing a detector report the PFC pauses and resumes they
+ * receive, i.e. the state of their m_paused.  The paused egress queues form
+ * a wait-for graph: the egress queue (D, q) is paused by the ingress
+ * (P, q) of the peer P of D, a port of switch N, which is paused in the
+ * SwitchMmu of N (SwitchMmu::paused) until the bytes it holds leave N.
+ * (D, q) thus waits for the egress queues (E, q) of N which hold bytes of
+ * P, and it may progress if one of them is not paused, or if the peer is a
+ * host.  A set of paused queues which all wait only for paused queues of
+ * the set can never progress: it is a deadlock, a cycle of the wait-for
+ * graph with every way out paused.
+ *
+ * A pause or a resume updates the set of the paused queues in constant
+ * time.  The graph is checked every CheckInterval while some queues are
+ * paused, in time linear in the paused queues and their edges, since a
+ * deadlock may also close without a pause, when the last unpaused queue
+ * holding bytes of a paused ingress empties.  A deadlock stops the
+ * simulation with a report on stderr, or is passed to the callback of
+ * SetDeadlockCallback, once per deadlocked queue.
+ *
+ * The check reads the state of every switch.  With the multithreaded
+ * simulator it runs in the public LP, whose events run once every LP has
+ * finished its round, so that no switch is updated meanwhile.
+ */
+class PfcDeadlockDetector : public Object
+{
+  public:
+    struct PausedQueue
+    {
+        Ptr<QbbNetDevice> device; // the paused egress device
+        uint32_t qIndex;
+        Time since; // time of the pause
+    };
+
+    typedef Callback<void, const std::vector<PausedQueue>&> DeadlockCallback;
+
+    static TypeId GetTypeId(void);
+    PfcDeadlockDetector();
+
+    // recording, by the devices
+    void RecordPfc(Ptr<QbbNetDevice> device, uint32_t qIndex, bool pause);
+
+    // called with the queues of a deadlock instead of stopping the simulation
+    void SetDeadlockCallback(DeadlockCallback cb);
+    std::vector<PausedQueue> GetPausedQueues() const;
+    // the paused queues which are deadlocked now, in no particular order
+    std::vector<PausedQueue> FindDeadlock() const;
+    // number of deadlocked queues reported so far
+    uint64_t GetReported() const;
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    struct Vertex
+    {
+        PausedQueue queue;
+        bool reported; // part of a deadlock already reported
+    };
+
+    static uint64_t Key(const QbbNetDevice* device, uint32_t qIndex);
+    // indices in m_vertices of the deadlocked queues
+    std::vector<uint32_t> FindDeadlockIndices() const;
+    // schedule the next check of the detector, in the context which calls it
+    static void ScheduleCheck(PfcDeadlockDetector* detector);
+    void Check();
+
+    Time m_checkInterval;
+    DeadlockCallback m_deadlockCallback;
+
+    std::vector<Vertex> m_vertices;                 // the paused queues
+    std::unordered_map<uint64_t, uint32_t> m_index; // Key -> index in m_vertices
+    uint32_t m_unreported;                          // paused queues not reported
+    uint64_t m_reported;
+    bool m_checkPending; // a check is scheduled, or about to be
+    EventId m_checkEvent;
+};
+
+} // namespace ns3
+
+#endif /* PFC_DEADLOCK_DETECTOR_H */
@@ -228,6 +228,12 @@ PointToPointNetDevice::SetInterframeGap(Time t)
     m_tInterframeGap = t;
 }
 
+Time
+PointToPointNetDevice::GetInterframeGap() const
+{
+    return m_tInterframeGap;
+}
+
 bool
 PointToPointNetDevice::TransmitStart(Ptr<Packet> p)
 {
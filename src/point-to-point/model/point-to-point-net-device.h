@@ -103,6 +103,13 @@ class PointToPointNetDevice : public NetDevice
      */
     void SetInterframeGap(Time t);
 
+    /**
+     * Get the interframe gap used to separate packets.
+     *
+     * \return the interframe gap time
+     */
+    Time GetInterframeGap() const;
+
     /**
      * Attach the device to a channel.
      *
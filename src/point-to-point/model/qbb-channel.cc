@@ -110,6 +110,46 @@ QbbChannel::TransmitStart(Ptr<Packet> p, Ptr<QbbNetDevice> src, Time txTime)
     return true;
 }
 
+bool
+QbbChannel::TransmitTrain(Ptr<QbbTrain> train, Ptr<QbbNetDevice> src, Time txTime)
+{
+    NS_LOG_FUNCTION(this << src << train->m_count);
+
+    NS_ASSERT(m_link[0].m_state != INITIALIZING);
+    NS_ASSERT(m_link[1].m_state != INITIALIZING);
+
+    uint32_t wire = src == m_link[0].m_src ? 0 : 1;
+
+    Simulator::ScheduleWithContext(m_link[wire].m_dst->GetNode()->GetId(),
+                                   txTime + m_delay,
+                                   &QbbNetDevice::ReceiveTrain,
+                                   m_link[wire].m_dst,
+                                   train);
+
+    // Call the tx anim callback on the net device for each packet
+    for (uint32_t i = 0; i < train->m_count; i++)
+    {
+        Time rxTime = txTime + train->m_offsets[i] + m_delay;
+        m_txrxQbb(train->m_packets[i], src, m_link[wire].m_dst, txTime, rxTime);
+    }
+    return true;
+}
+
+void
+QbbChannel::TruncateTrain(Ptr<QbbTrain> train, uint32_t count, Ptr<QbbNetDevice> src)
+{
+    NS_LOG_FUNCTION(this << src << count);
+
+    uint32_t wire = src == m_link[0].m_src ? 0 : 1;
+
+    Simulator::ScheduleWithContext(m_link[wire].m_dst->GetNode()->GetId(),
+                                   m_delay,
+                                   &QbbNetDevice::TruncateTrain,
+                                   m_link[wire].m_dst,
+                                   train,
+                                   count);
+}
+
 size_t
 QbbChannel::GetNDevices(void) const
 {
@@ -24,9 +24,11 @@
 #include "ns3/nstime.h"
 #include "ns3/point-to-point-channel.h"
 #include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
 #include "ns3/traced-callback.h"
 
 #include <list>
+#include <vector>
 
 namespace ns3
 {
@@ -34,6 +36,27 @@ namespace ns3
 class QbbNetDevice;
 class Packet;
 
+/**
+ * \ingroup point-to-point
+ * \brief Back-to-back packets of one QP delivered by a single channel event.
+ *
+ * The sender fills the train before handing it to the channel and never
+ * touches it afterwards; m_count is only changed in the context of the
+ * receiving device, see QbbChannel::TruncateTrain.
+ */
+class QbbTrain : public SimpleRefCount<QbbTrain>
+{
+  public:
+    std::vector<Ptr<Packet>> m_packets;
+    std::vector<Time> m_offsets; // arrival of each packet relative to the first one
+    uint32_t m_count;            // number of packets to deliver
+
+    QbbTrain()
+        : m_count(0)
+    {
+    }
+};
+
 /**
  * \ingroup point-to-point
  * \brief Simple Point To Point Channel.
@@ -75,6 +98,27 @@ class QbbChannel : public PointToPointChannel
      */
     virtual bool TransmitStart(Ptr<Packet> p, Ptr<QbbNetDevice> src, Time txTime);
 
+    /**
+     * \brief Transmit a train of packets with a single delivery event
+     * \param train Train to transmit, m_offsets must be filled
+     * \param src Source QbbNetDevice
+     * \param txTime Transmit time of the first packet
+     * \returns true if successful (currently always true)
+     */
+    bool TransmitTrain(Ptr<QbbTrain> train, Ptr<QbbNetDevice> src, Time txTime);
+
+    /**
+     * \brief Withdraw the packets of a train that have not started yet
+     *
+     * The truncation reaches the receiver one channel delay after now, which
+     * is before the arrival of any packet that starts after now.
+     *
+     * \param train Train previously passed to TransmitTrain
+     * \param count Number of packets that stay in the train
+     * \param src Source QbbNetDevice
+     */
+    void TruncateTrain(Ptr<QbbTrain> train, uint32_t count, Ptr<QbbNetDevice> src);
+
     /**
      * \brief Get number of devices on this channel
      * \returns number of devices on this channel
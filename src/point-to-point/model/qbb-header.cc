@@ -73,6 +73,12 @@ qbbHeader::SetCnp()
     flags |= 1 << FLAG_CNP;
 }
 
+void
+qbbHeader::SetSack()
+{
+    flags |= 1 << FLAG_SACK;
+}
+
 void
 qbbHeader::SetIntHeader(const IntHeader& _ih)
 {
@@ -116,6 +122,12 @@ qbbHeader::GetCnp() const
     return (flags >> FLAG_CNP) & 1;
 }
 
+uint8_t
+qbbHeader::GetSack() const
+{
+    return (flags >> FLAG_SACK) & 1;
+}
+
 TypeId
 qbbHeader::GetTypeId(void)
 {
@@ -26,7 +26,8 @@ class qbbHeader : public Header
   public:
     enum
     {
-        FLAG_CNP = 0
+        FLAG_CNP = 0,
+        FLAG_SACK = 1 // a NACK whose seq is a packet received out of order
     };
 
     qbbHeader(uint16_t pg);
@@ -43,6 +44,7 @@ class qbbHeader : public Header
     void SetDport(uint32_t _dport);
     void SetTs(uint64_t ts);
     void SetCnp();
+    void SetSack();
     void SetIntHeader(const IntHeader& _ih);
 
     // Getters
@@ -56,6 +58,7 @@ class qbbHeader : public Header
     uint16_t GetDport() const;
     uint64_t GetTs() const;
     uint8_t GetCnp() const;
+    uint8_t GetSack() const;
 
     static TypeId GetTypeId(void);
     virtual TypeId GetInstanceTypeId(void) const;
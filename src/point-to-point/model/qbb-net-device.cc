@@ -44,10 +44,12 @@
 #include "ns3/seq-ts-header.h"
 #include "ns3/simple-drop-tail-queue.h"
 #include "ns3/simulator.h"
+#include "ns3/string.h"
 #include "ns3/udp-header.h"
 #include "ns3/uinteger.h"
 
 #include <iostream>
+#include <sstream>
 #include <stdint.h>
 #include <stdio.h>
 NS_LOG_COMPONENT_DEFINE("QbbNetDevice");
@@ -58,12 +60,37 @@ namespace ns3
 uint32_t RdmaEgressQueue::ack_q_idx = 3;
 
 // RdmaEgressQueue
+NS_OBJECT_ENSURE_REGISTERED(RdmaEgressQueue);
+
 TypeId
 RdmaEgressQueue::GetTypeId(void)
 {
     static TypeId tid =
         TypeId("ns3::RdmaEgressQueue")
             .SetParent<Object>()
+            .AddAttribute("PgScheduler",
+                          "Schedule the qps per PG: strict PGs first, then DWRR over the "
+                          "other PGs, round robin within a PG.  Otherwise round robin over "
+                          "all the qps.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&RdmaEgressQueue::m_pgScheduler),
+                          MakeBooleanChecker())
+            .AddAttribute("StrictPgs",
+                          "Bitmap of the strict priority PGs of PgScheduler, the highest PG "
+                          "first.",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&RdmaEgressQueue::m_strictPgs),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("PgWeights",
+                          "Comma separated DWRR weights of PGs 0, 1, ..., 1 if missing.",
+                          StringValue(""),
+                          MakeStringAccessor(&RdmaEgressQueue::SetPgWeights),
+                          MakeStringChecker())
+            .AddAttribute("PgQuantum",
+                          "DWRR bytes of a PG per round and unit of weight.",
+                          UintegerValue(1500),
+                          MakeUintegerAccessor(&RdmaEgressQueue::m_pgQuantum),
+                          MakeUintegerChecker<uint32_t>(1))
             .AddTraceSource("RdmaEnqueue",
                             "Enqueue a packet in the RdmaEgressQueue.",
                             MakeTraceSourceAccessor(&RdmaEgressQueue::m_traceRdmaEnqueue),
@@ -79,6 +106,16 @@ RdmaEgressQueue::RdmaEgressQueue()
 {
     m_rrlast = 0;
     m_qlast = 0;
+    for (uint32_t i = 0; i < qCnt; i++)
+    {
+        m_pgs[i].deficit = 0;
+        m_pgs[i].weight = 1;
+    }
+    m_activePgs = 0;
+    m_dwrrPg = 0;
+    m_pacingOrder = 0;
+    m_finished = 0;
+    m_generation = 0;
     m_ackQ = CreateObject<SimpleDropTailQueue>();
     // m_ackQ = CreateObject<RedQueue>();
     m_ackQ->SetAttribute("MaxBytes",
@@ -100,7 +137,10 @@ RdmaEgressQueue::DequeueQindex(int qIndex)
         Ptr<Packet> p = m_rdmaGetNxtPkt(m_qpGrp->Get(qIndex));
         m_rrlast = qIndex;
         m_qlast = qIndex;
-        m_traceRdmaDequeue(p, m_qpGrp->Get(qIndex)->m_pg);
+        uint16_t pg = m_qpGrp->Get(qIndex)->m_pg;
+        if (m_pgScheduler && !(m_strictPgs >> pg & 1))
+            m_pgs[pg].deficit -= p->GetSize();
+        m_traceRdmaDequeue(p, pg);
         return p;
     }
     return 0;
@@ -113,6 +153,8 @@ RdmaEgressQueue::GetNextQindex(bool paused[])
     uint32_t qIndex;
     if (!paused[ack_q_idx] && m_ackQ->GetNPackets() > 0)
         return -1;
+    if (m_pgScheduler)
+        return GetNextQindexPg(paused);
 
     // no pkt in highest priority queue, do rr for each qp
     int res = -1024;
@@ -131,7 +173,8 @@ RdmaEgressQueue::GetNextQindex(bool paused[])
             // int t_count = qp->GetInitialSize();
             // qp transmission finished
         }
-        if (!paused[qp->m_pg] && qp->GetBytesLeft() > 0 && !qp->IsWinBound())
+        if (!paused[qp->m_pg] &&
+            (qp->HasRetransmission() || (qp->GetBytesLeft() > 0 && !qp->IsWinBound())))
         {
             if (m_qpGrp->Get(idx)->m_nextAvail.GetTimeStep() >
                 Simulator::Now().GetTimeStep()) // not available now
@@ -156,6 +199,7 @@ RdmaEgressQueue::GetNextQindex(bool paused[])
                 if (i == (uint32_t)res) // update res to the idx after removing finished qp
                     res = nxt;
                 qps[nxt] = qps[i];
+                qps[nxt]->m_grpIdx = nxt;
                 nxt++;
             }
         qps.resize(nxt);
@@ -163,6 +207,209 @@ RdmaEgressQueue::GetNextQindex(bool paused[])
     return res;
 }
 
+int
+RdmaEgressQueue::GetNextQindexPg(bool paused[])
+{
+    if (m_generation != m_qpGrp->m_generation)
+        ResetPgScheduler();
+    Time now = Simulator::Now();
+    while (!m_pacing.empty() && m_pacing.top().time <= now)
+    {
+        Ptr<RdmaQueuePair> qp = m_pacing.top().qp;
+        bool current = qp->m_schedState == RdmaQueuePair::NIC_PACING &&
+                       qp->m_schedTime == m_pacing.top().time;
+        m_pacing.pop();
+        if (current)
+        {
+            qp->m_schedState = RdmaQueuePair::NIC_ACTIVE;
+            m_pgs[qp->m_pg].qps.push_back(qp);
+            m_activePgs |= 1u << qp->m_pg;
+        }
+    }
+
+    uint32_t unpaused = 0;
+    for (uint32_t i = 0; i < qCnt; i++)
+        unpaused |= (uint32_t)!paused[i] << i;
+    while (true)
+    {
+        uint32_t eligible = m_activePgs & unpaused;
+        if (eligible == 0)
+            return -1024;
+        uint32_t pg;
+        if (eligible & m_strictPgs)
+            pg = 31 - __builtin_clz(eligible & m_strictPgs);
+        else
+        {
+            // the DWRR round moves to the next PG once the current one used its quantum
+            pg = m_dwrrPg;
+            if (!((eligible >> pg) & 1) || m_pgs[pg].deficit <= 0)
+            {
+                uint32_t after = eligible & ~((2u << pg) - 1);
+                pg = __builtin_ctz(after ? after : eligible);
+                m_pgs[pg].deficit += (int64_t)m_pgs[pg].weight * m_pgQuantum;
+                m_dwrrPg = pg;
+            }
+        }
+
+        std::deque<Ptr<RdmaQueuePair>>& qps = m_pgs[pg].qps;
+        while (!qps.empty())
+        {
+            Ptr<RdmaQueuePair> qp = qps.front();
+            qps.pop_front();
+            if (qp->m_grpIdx >= m_qpGrp->GetN() || m_qpGrp->Get(qp->m_grpIdx) != qp)
+                continue; // moved to another NIC
+            if (qp->IsFinished())
+            {
+                Finished(qp);
+                continue;
+            }
+            if (!qp->HasRetransmission() && (qp->GetBytesLeft() == 0 || qp->IsWinBound()))
+            {
+                qp->m_schedState = RdmaQueuePair::NIC_IDLE;
+                continue;
+            }
+            if (qp->m_nextAvail > now)
+            {
+                qp->m_schedState = RdmaQueuePair::NIC_PACING;
+                qp->m_schedTime = qp->m_nextAvail;
+                m_pacing.push({qp->m_nextAvail, m_pacingOrder++, qp});
+                continue;
+            }
+            qps.push_back(qp);
+            return qp->m_grpIdx;
+        }
+        m_activePgs &= ~(1u << pg);
+        if (!(m_strictPgs >> pg & 1))
+            m_pgs[pg].deficit = 0;
+    }
+}
+
+void
+RdmaEgressQueue::ResetPgScheduler()
+{
+    for (uint32_t i = 0; i < qCnt; i++)
+    {
+        m_pgs[i].qps.clear();
+        m_pgs[i].deficit = 0;
+    }
+    m_activePgs = 0;
+    m_pacing = decltype(m_pacing)();
+    m_finished = 0;
+    m_generation = m_qpGrp->m_generation;
+    for (uint32_t i = 0; i < m_qpGrp->GetN(); i++)
+    {
+        Ptr<RdmaQueuePair> qp = m_qpGrp->Get(i);
+        qp->m_schedState = RdmaQueuePair::NIC_IDLE;
+        Activate(qp);
+    }
+}
+
+void
+RdmaEgressQueue::Finished(Ptr<RdmaQueuePair> qp)
+{
+    qp->m_schedState = RdmaQueuePair::NIC_DONE;
+    if (++m_finished * 2 > m_qpGrp->GetN())
+        CompactQps();
+}
+
+void
+RdmaEgressQueue::CompactQps()
+{
+    auto& qps = m_qpGrp->m_qps;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < qps.size(); i++)
+    {
+        if (qps[i]->IsFinished())
+            continue;
+        qps[n] = qps[i];
+        qps[n]->m_grpIdx = n;
+        n++;
+    }
+    qps.resize(n);
+    m_finished = 0;
+}
+
+void
+RdmaEgressQueue::Activate(Ptr<RdmaQueuePair> qp)
+{
+    if (!m_pgScheduler || qp->m_schedState == RdmaQueuePair::NIC_DONE)
+        return;
+    if (qp->IsFinished())
+    {
+        if (m_generation == m_qpGrp->m_generation && qp->m_grpIdx < m_qpGrp->GetN() &&
+            m_qpGrp->Get(qp->m_grpIdx) == qp)
+            Finished(qp);
+        return;
+    }
+    if (qp->m_schedState == RdmaQueuePair::NIC_ACTIVE ||
+        (qp->m_schedState == RdmaQueuePair::NIC_PACING && qp->m_nextAvail >= qp->m_schedTime))
+        return;
+    // an earlier m_nextAvail leaves the pacing entry of the qp stale
+    qp->m_schedState = RdmaQueuePair::NIC_ACTIVE;
+    m_pgs[qp->m_pg].qps.push_back(qp);
+    m_activePgs |= 1u << qp->m_pg;
+}
+
+Time
+RdmaEgressQueue::GetNextAvail()
+{
+    Time t = Simulator::GetMaximumSimulationTime();
+    if (m_pgScheduler)
+    {
+        while (!m_pacing.empty() &&
+               !(m_pacing.top().qp->m_schedState == RdmaQueuePair::NIC_PACING &&
+                 m_pacing.top().qp->m_schedTime == m_pacing.top().time))
+            m_pacing.pop();
+        return m_pacing.empty() ? t : m_pacing.top().time;
+    }
+    for (uint32_t i = 0; i < GetFlowCount(); i++)
+        t = Min(GetQp(i)->m_nextAvail, t);
+    return t;
+}
+
+Time
+RdmaEgressQueue::GetNextAvailOther(Ptr<RdmaQueuePair> qp, bool paused[])
+{
+    auto ready = [qp, paused](Ptr<RdmaQueuePair> q) {
+        return q != qp && !paused[q->m_pg] &&
+               (q->HasRetransmission() || (q->GetBytesLeft() > 0 && !q->IsWinBound()));
+    };
+    Time t = Simulator::GetMaximumSimulationTime();
+    if (!m_pgScheduler || m_generation != m_qpGrp->m_generation)
+    {
+        for (uint32_t i = 0; i < GetFlowCount(); i++)
+        {
+            if (ready(GetQp(i)))
+                t = Min(GetQp(i)->m_nextAvail, t);
+        }
+        return t;
+    }
+    // the qps which may send are in the lists, an idle qp joins them when it
+    // is activated; the pacing qp which comes first may be of a paused PG
+    t = GetNextAvail();
+    for (uint32_t active = m_activePgs; active != 0; active &= active - 1)
+    {
+        uint32_t pg = __builtin_ctz(active);
+        if (paused[pg])
+            continue;
+        for (const Ptr<RdmaQueuePair>& q : m_pgs[pg].qps)
+        {
+            if (ready(q) && q->m_grpIdx < GetFlowCount() && GetQp(q->m_grpIdx) == q)
+                t = Min(q->m_nextAvail, t);
+        }
+    }
+    return t;
+}
+
+void
+RdmaEgressQueue::SetPgWeights(std::string weights)
+{
+    std::istringstream in(weights);
+    std::string w;
+    for (uint32_t i = 0; i < qCnt; i++)
+        m_pgs[i].weight = std::getline(in, w, ',') ? std::stoul(w) : 1;
+}
+
 int
 RdmaEgressQueue::GetLastQueue()
 {
@@ -213,6 +460,19 @@ RdmaEgressQueue::CleanHighPrio(TracedCallback<Ptr<const Packet>, uint32_t> dropC
     }
 }
 
+uint32_t
+RdmaEgressQueue::GetHighPrioTicket()
+{
+    return m_ackQ->GetTotalReceivedPackets();
+}
+
+bool
+RdmaEgressQueue::IsHighPrioQueued(uint32_t ticket)
+{
+    // the queue is FIFO and does not drop, so it holds the last GetNPackets tickets
+    return m_ackQ->GetTotalReceivedPackets() - ticket <= m_ackQ->GetNPackets();
+}
+
 /******************
  * QbbNetDevice
  *****************/
@@ -260,6 +520,23 @@ QbbNetDevice::GetTypeId(void)
                           UintegerValue(0),
                           MakeUintegerAccessor(&QbbNetDevice::nvls_enable),
                           MakeUintegerChecker<uint32_t>())
+            .AddAttribute("TrainSize",
+                          "Max number of back-to-back packets of a QP sent as one channel event. "
+                          "1 sends each packet on its own.",
+                          UintegerValue(1),
+                          MakeUintegerAccessor(&QbbNetDevice::m_trainSize),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("Telemetry",
+                          "Telemetry of the switch queues and of the PFC pauses, none if null.",
+                          PointerValue(),
+                          MakePointerAccessor(&QbbNetDevice::m_telemetry),
+                          MakePointerChecker<QbbTelemetry>())
+            .AddAttribute("DeadlockDetector",
+                          "Detector of the PFC deadlocks, shared by the devices of the network, "
+                          "none if null.",
+                          PointerValue(),
+                          MakePointerAccessor(&QbbNetDevice::m_deadlockDetector),
+                          MakePointerChecker<PfcDeadlockDetector>())
             .AddTraceSource("QbbEnqueue",
                             "Enqueue a packet in the QbbNetDevice.",
                             MakeTraceSourceAccessor(&QbbNetDevice::m_traceEnqueue),
@@ -292,6 +569,7 @@ QbbNetDevice::QbbNetDevice()
     {
         m_paused[i] = false;
     }
+    m_train.active = false;
 
     m_rdmaEQ = CreateObject<RdmaEgressQueue>();
 }
@@ -346,7 +624,12 @@ QbbNetDevice::DequeueAndTransmit(void)
     if (!m_linkUp)
         return; // if link is down, return
     if (m_txMachineState == BUSY)
+    {
+        // whatever woke us up may change what per-packet mode sends next
+        if (m_train.active)
+            TrainRecheck();
         return; // Quit if channel busy
+    }
     Ptr<Packet> p;
     if (m_node->GetNodeType() == 0 || (m_node->GetNodeType() == 2 && nvls_enable == 1))
     {
@@ -365,6 +648,12 @@ QbbNetDevice::DequeueAndTransmit(void)
             }
             // a qp dequeue a packet
             Ptr<RdmaQueuePair> lastQp = m_rdmaEQ->GetQp(qIndex);
+            if (m_trainSize > 1 && m_node->GetNodeType() == 0 && IntHeader::mode != IntHeader::TS &&
+                !lastQp->HasRetransmission())
+            {
+                TransmitTrain(qIndex);
+                return;
+            }
             p = m_rdmaEQ->DequeueQindex(qIndex);
             // update statistics for monitor
             m_rdmaUpdateTxBytes(m_ifIndex, p->GetSize());
@@ -378,12 +667,7 @@ QbbNetDevice::DequeueAndTransmit(void)
         else
         { // no packet to send
             NS_LOG_INFO("PAUSE prohibits send at node " << m_node->GetId());
-            Time t = Simulator::GetMaximumSimulationTime();
-            for (uint32_t i = 0; i < m_rdmaEQ->GetFlowCount(); i++)
-            {
-                Ptr<RdmaQueuePair> qp = m_rdmaEQ->GetQp(i);
-                t = Min(qp->m_nextAvail, t);
-            }
+            Time t = m_rdmaEQ->GetNextAvail();
             if (m_nextSend.IsExpired() && t < Simulator::GetMaximumSimulationTime() &&
                 t > Simulator::Now())
             {
@@ -395,8 +679,8 @@ QbbNetDevice::DequeueAndTransmit(void)
         return;
     }
     else
-    {                                     // switch, doesn't care about qcn, just send
-        p = m_queue->DequeueRR(m_paused); // this is round-robin
+    {                           // switch, doesn't care about qcn, just send
+        p = m_queue->DequeueRR(); // this is round-robin
         if (p != nullptr)
         {
             m_snifferTrace(p);
@@ -418,6 +702,13 @@ QbbNetDevice::DequeueAndTransmit(void)
                 m_node->SwitchNotifyDequeue(m_ifIndex, qIndex, p);
                 p->RemovePacketTag(t);
             }
+            if (m_telemetry)
+            {
+                m_telemetry->RecordDequeue(qIndex,
+                                           p->GetSize(),
+                                           m_queue->GetNBytes(qIndex),
+                                           Simulator::Now() - m_queue->GetLastEnqueueTime());
+            }
             m_traceDequeue(p, qIndex);
             TransmitStart(p);
             return;
@@ -427,12 +718,7 @@ QbbNetDevice::DequeueAndTransmit(void)
             NS_LOG_INFO("PAUSE prohibits send at node " << m_node->GetId());
             if (m_node->GetNodeType() == 0 && m_qcnEnabled)
             { // nothing to send, possibly due to qcn flow control, if so reschedule sending
-                Time t = Simulator::GetMaximumSimulationTime();
-                for (uint32_t i = 0; i < m_rdmaEQ->GetFlowCount(); i++)
-                {
-                    Ptr<RdmaQueuePair> qp = m_rdmaEQ->GetQp(i);
-                    t = Min(qp->m_nextAvail, t);
-                }
+                Time t = m_rdmaEQ->GetNextAvail();
                 if (m_nextSend.IsExpired() && t < Simulator::GetMaximumSimulationTime() &&
                     t > Simulator::Now())
                 {
@@ -484,12 +770,7 @@ QbbNetDevice::SwitchAsHostSend(void)
     else
     { // no packet to send
         NS_LOG_INFO("PAUSE prohibits send at node " << m_node->GetId());
-        Time t = Simulator::GetMaximumSimulationTime();
-        for (uint32_t i = 0; i < m_rdmaEQ->GetFlowCount(); i++)
-        {
-            Ptr<RdmaQueuePair> qp = m_rdmaEQ->GetQp(i);
-            t = Min(qp->m_nextAvail, t);
-        }
+        Time t = m_rdmaEQ->GetNextAvail();
         if (m_nextSend.IsExpired() && t < Simulator::GetMaximumSimulationTime() &&
             t > Simulator::Now())
         {
@@ -511,7 +792,7 @@ QbbNetDevice::SwitchDequeueAndTransmit(void)
     if (m_txMachineState == BUSY)
         return; // Quit if channel busy
     Ptr<Packet> p;
-    p = m_queue->DequeueRR(m_paused); // this is round-robin
+    p = m_queue->DequeueRR(); // this is round-robin
     if (p != nullptr)
     {
         m_snifferTrace(p);
@@ -533,6 +814,13 @@ QbbNetDevice::SwitchDequeueAndTransmit(void)
             m_node->SwitchNotifyDequeue(m_ifIndex, qIndex, p);
             p->RemovePacketTag(t);
         }
+        if (m_telemetry)
+        {
+            m_telemetry->RecordDequeue(qIndex,
+                                       p->GetSize(),
+                                       m_queue->GetNBytes(qIndex),
+                                       Simulator::Now() - m_queue->GetLastEnqueueTime());
+        }
         m_traceDequeue(p, qIndex);
         TransmitStart(p);
         return;
@@ -542,12 +830,7 @@ QbbNetDevice::SwitchDequeueAndTransmit(void)
         NS_LOG_INFO("PAUSE prohibits send at node " << m_node->GetId());
         if (m_node->GetNodeType() == 0 && m_qcnEnabled)
         { // nothing to send, possibly due to qcn flow control, if so reschedule sending
-            Time t = Simulator::GetMaximumSimulationTime();
-            for (uint32_t i = 0; i < m_rdmaEQ->GetFlowCount(); i++)
-            {
-                Ptr<RdmaQueuePair> qp = m_rdmaEQ->GetQp(i);
-                t = Min(qp->m_nextAvail, t);
-            }
+            Time t = m_rdmaEQ->GetNextAvail();
             if (m_nextSend.IsExpired() && t < Simulator::GetMaximumSimulationTime() &&
                 t > Simulator::Now())
             {
@@ -565,10 +848,12 @@ QbbNetDevice::Resume(unsigned qIndex)
     NS_LOG_FUNCTION(this << qIndex);
     NS_ASSERT_MSG(m_paused[qIndex], "Must be PAUSEd");
     m_paused[qIndex] = false;
+    m_queue->SetPaused(qIndex, false);
     NS_LOG_INFO("Node " << m_node->GetId() << " dev " << m_ifIndex << " queue " << qIndex
                         << " resumed at " << Simulator::Now().GetSeconds());
-    Ptr<RdmaQueuePair> lastQp = m_rdmaEQ->GetQp(qIndex);
-    if (lastQp->nvls_enable == 1 && m_node->GetNodeType() == 2)
+    // a host may have fewer qps than the index of the resumed queue
+    if (m_node->GetNodeType() == 2 && qIndex < m_rdmaEQ->GetFlowCount() &&
+        m_rdmaEQ->GetQp(qIndex)->nvls_enable == 1)
         SwitchAsHostSend();
     else
         DequeueAndTransmit();
@@ -606,11 +891,22 @@ QbbNetDevice::Receive(Ptr<Packet> packet)
         if (ch.pfc.time > 0)
         {
             m_tracePfc(1);
+            if (m_telemetry)
+                m_telemetry->RecordPfc(qIndex, true);
+            if (m_deadlockDetector)
+                m_deadlockDetector->RecordPfc(this, qIndex, true);
             m_paused[qIndex] = true;
+            m_queue->SetPaused(qIndex, true);
+            if (m_train.active)
+                TrainRecheck();
         }
         else
         {
             m_tracePfc(0);
+            if (m_telemetry)
+                m_telemetry->RecordPfc(qIndex, false);
+            if (m_deadlockDetector)
+                m_deadlockDetector->RecordPfc(this, qIndex, false);
             Resume(qIndex);
         }
     }
@@ -641,6 +937,35 @@ QbbNetDevice::Receive(Ptr<Packet> packet)
     return;
 }
 
+void
+QbbNetDevice::ReceiveTrain(Ptr<QbbTrain> train)
+{
+    ReplayTrain(train, 0);
+}
+
+void
+QbbNetDevice::ReplayTrain(Ptr<QbbTrain> train, uint32_t idx)
+{
+    if (idx >= train->m_count)
+        return; // withdrawn by the sender
+    if (idx + 1 < train->m_count)
+    {
+        Simulator::Schedule(train->m_offsets[idx + 1] - train->m_offsets[idx],
+                            &QbbNetDevice::ReplayTrain,
+                            this,
+                            train,
+                            idx + 1);
+    }
+    Receive(train->m_packets[idx]);
+}
+
+void
+QbbNetDevice::TruncateTrain(Ptr<QbbTrain> train, uint32_t count)
+{
+    if (count < train->m_count)
+        train->m_count = count;
+}
+
 bool
 QbbNetDevice::Send(Ptr<Packet> packet, const Address& dest, uint16_t protocolNumber)
 {
@@ -654,6 +979,8 @@ QbbNetDevice::SwitchSend(uint32_t qIndex, Ptr<Packet> packet, CustomHeader& ch)
     m_macTxTrace(packet);
     m_traceEnqueue(packet, qIndex);
     m_queue->Enqueue(packet, qIndex);
+    if (m_telemetry)
+        m_telemetry->RecordEnqueue(qIndex, m_queue->GetNBytes(qIndex));
     // DequeueAndTransmit();
     SwitchDequeueAndTransmit();
     return true;
@@ -773,6 +1100,154 @@ QbbNetDevice::TransmitStart(Ptr<Packet> p)
     return result;
 }
 
+void
+QbbNetDevice::TransmitTrain(int qIndex)
+{
+    NS_LOG_FUNCTION(this << qIndex);
+    Ptr<RdmaQueuePair> qp = m_rdmaEQ->GetQp(qIndex);
+    Ptr<QbbTrain> train = Create<QbbTrain>();
+    m_train.train = train;
+    m_train.qp = qp;
+    m_train.start.clear();
+    m_train.txTime.clear();
+    m_train.seq.clear();
+    m_train.nextAvail.clear();
+
+    // build the train as per-packet mode would send it, packet by packet; the
+    // other qps do not change meanwhile
+    Time now = Simulator::Now();
+    Time slot = now;
+    Time other = m_rdmaEQ->GetNextAvailOther(qp, m_paused);
+    while (true)
+    {
+        m_train.seq.push_back(qp->snd_nxt);
+        Ptr<Packet> p = m_rdmaEQ->DequeueQindex(qIndex);
+        Time txTime = m_bps.CalculateBytesTxTime(p->GetSize());
+        train->m_packets.push_back(p);
+        m_train.start.push_back(slot);
+        m_train.txTime.push_back(txTime);
+        // the rate limiter counts from the start of this packet
+        m_rdmaPktSent(qp, p, m_tInterframeGap + (slot - now));
+        m_train.nextAvail.push_back(qp->m_nextAvail);
+        slot += txTime + m_tInterframeGap;
+        if (train->m_packets.size() >= m_trainSize || !TrainCanExtend(qp, slot, other))
+            break;
+    }
+
+    Ptr<Packet> first = train->m_packets[0];
+    m_rdmaUpdateTxBytes(m_ifIndex, first->GetSize());
+    m_traceQpDequeue(first, qp);
+    if (train->m_packets.size() == 1)
+    {
+        m_train.active = false;
+        m_train.train = nullptr;
+        m_train.qp = nullptr;
+        TransmitStart(first);
+        return;
+    }
+
+    uint32_t n = train->m_packets.size();
+    Time firstArrival = m_train.start[0] + m_train.txTime[0];
+    for (uint32_t i = 0; i < n; i++)
+        train->m_offsets.push_back(m_train.start[i] + m_train.txTime[i] - firstArrival);
+    train->m_count = n;
+    m_train.active = true;
+    m_train.rate = qp->m_rate;
+    m_train.endSeq = qp->snd_nxt;
+    m_train.endNextAvail = qp->m_nextAvail;
+
+    m_txMachineState = BUSY;
+    m_currentPkt = train->m_packets[n - 1];
+    m_phyTxBeginTrace(first);
+    m_train.complete = Simulator::Schedule(slot - now, &QbbNetDevice::TrainComplete, this);
+    m_channel->TransmitTrain(train, this, m_train.txTime[0]);
+}
+
+bool
+QbbNetDevice::TrainCanExtend(Ptr<RdmaQueuePair> qp, Time t, Time other)
+{
+    if (m_rdmaEQ->m_ackQ->GetNPackets() > 0 || m_paused[qp->m_pg])
+        return false;
+    if (qp->GetBytesLeft() == 0 || qp->IsWinBound() || qp->HasRetransmission() ||
+        qp->m_nextAvail > t)
+        return false;
+    // with another qp ready, the scheduler may not pick this one again
+    return other > t;
+}
+
+void
+QbbNetDevice::TrainRecheck(void)
+{
+    Time now = Simulator::Now();
+    Ptr<RdmaQueuePair> qp = m_train.qp;
+    uint32_t n = m_train.start.size();
+    uint32_t k = 0;
+    while (k < n && m_train.start[k] <= now)
+        k++;
+    // packets that started are on the wire; a fluid epoch may follow the train
+    if (k == n || qp->fluid.m_active)
+        return;
+    if (m_rdmaEQ->m_ackQ->GetNPackets() == 0 && !m_paused[qp->m_pg] &&
+        qp->m_rate == m_train.rate && qp->snd_nxt == m_train.endSeq && !qp->HasRetransmission())
+    {
+        Time other = m_rdmaEQ->GetNextAvailOther(qp, m_paused);
+        while (k < n && m_train.start[k] < other)
+            k++;
+        if (k == n)
+            return;
+    }
+
+    // split: give the packets from k on back to the qp
+    NS_LOG_LOGIC("split train of " << n << " packets at " << k);
+    const std::vector<Ptr<Packet>>& pkts = m_train.train->m_packets;
+    if (qp->snd_nxt == m_train.endSeq)
+    { // not rewound by a NACK meanwhile
+        qp->snd_nxt = m_train.seq[k];
+        qp->m_ipid -= n - k;
+    }
+    qp->m_nextAvail = m_train.nextAvail[k - 1] + (qp->m_nextAvail - m_train.endNextAvail);
+    qp->lastPktSize = pkts[k - 1]->GetSize();
+    Time end = m_train.start[k - 1] + m_train.txTime[k - 1] + m_tInterframeGap;
+    m_train.start.resize(k);
+    m_train.txTime.resize(k);
+    m_train.seq.resize(k);
+    m_train.nextAvail.resize(k);
+    m_train.endSeq = qp->snd_nxt;
+    m_train.endNextAvail = qp->m_nextAvail;
+    m_currentPkt = pkts[k - 1];
+    Simulator::Cancel(m_train.complete);
+    m_train.complete = Simulator::Schedule(end - now, &QbbNetDevice::TrainComplete, this);
+    m_channel->TruncateTrain(m_train.train, k, this);
+}
+
+void
+QbbNetDevice::TrainComplete(void)
+{
+    NS_LOG_FUNCTION(this);
+    NS_ASSERT_MSG(m_txMachineState == BUSY, "Must be BUSY if transmitting");
+    // per-packet traces and send callbacks of the train fire when it completes
+    const std::vector<Ptr<Packet>>& pkts = m_train.train->m_packets;
+    for (uint32_t i = 0; i < m_train.start.size(); i++)
+    {
+        Ptr<Packet> p = pkts[i];
+        if (i > 0)
+        {
+            m_rdmaUpdateTxBytes(m_ifIndex, p->GetSize());
+            m_traceQpDequeue(p, m_train.qp);
+            m_phyTxBeginTrace(p);
+        }
+        m_phyTxEndTrace(p);
+        if (p->GetSize() < 9000 && p->GetSize() > 60)
+            SendCallback(p);
+    }
+    m_train.active = false;
+    m_train.train = nullptr;
+    m_train.qp = nullptr;
+    m_txMachineState = READY;
+    m_currentPkt = 0;
+    DequeueAndTransmit();
+}
+
 bool
 QbbNetDevice::SwitchAsHostTransmitStart(Ptr<Packet> p)
 {
@@ -843,6 +1318,7 @@ void
 QbbNetDevice::NewQp(Ptr<RdmaQueuePair> qp)
 {
     qp->m_nextAvail = Simulator::Now();
+    m_rdmaEQ->Activate(qp);
     if (qp->nvls_enable == 1 && m_node->GetNodeType() == 2)
         SwitchAsHostSend();
     else
@@ -852,6 +1328,7 @@ QbbNetDevice::NewQp(Ptr<RdmaQueuePair> qp)
 void
 QbbNetDevice::ReassignedQp(Ptr<RdmaQueuePair> qp)
 {
+    m_rdmaEQ->Activate(qp);
     DequeueAndTransmit();
 }
 
@@ -866,6 +1343,8 @@ QbbNetDevice::SetQueue(Ptr<BEgressQueue> q)
 {
     NS_LOG_FUNCTION(this << q);
     m_queue = q;
+    for (uint32_t i = 0; i < qCnt; i++)
+        m_queue->SetPaused(i, m_paused[i]);
 }
 
 Ptr<BEgressQueue>
@@ -874,6 +1353,18 @@ QbbNetDevice::GetQueue()
     return m_queue;
 }
 
+Ptr<QbbTelemetry>
+QbbNetDevice::GetTelemetry()
+{
+    return m_telemetry;
+}
+
+Ptr<PfcDeadlockDetector>
+QbbNetDevice::GetDeadlockDetector()
+{
+    return m_deadlockDetector;
+}
+
 Ptr<RdmaEgressQueue>
 QbbNetDevice::GetRdmaQueue()
 {
@@ -885,6 +1376,8 @@ QbbNetDevice::RdmaEnqueueHighPrioQ(Ptr<Packet> p)
 {
     m_traceEnqueue(p, 0);
     m_rdmaEQ->EnqueueHighPrioQ(p);
+    if (m_train.active)
+        TrainRecheck();
 }
 
 void
@@ -902,10 +1395,15 @@ QbbNetDevice::TakeDown()
     { // switch
         // clean the queue
         for (uint32_t i = 0; i < qCnt; i++)
+        {
+            if (m_paused[i] && m_deadlockDetector)
+                m_deadlockDetector->RecordPfc(this, i, false);
             m_paused[i] = false;
+            m_queue->SetPaused(i, false);
+        }
         while (1)
         {
-            Ptr<Packet> p = m_queue->DequeueRR(m_paused);
+            Ptr<Packet> p = m_queue->DequeueRR();
             if (p == nullptr)
                 break;
             m_traceDrop(p, m_queue->GetLastQueue());
@@ -915,9 +1413,18 @@ QbbNetDevice::TakeDown()
     m_linkUp = false;
 }
 
+void
+QbbNetDevice::RateChanged(void)
+{
+    if (m_train.active)
+        TrainRecheck();
+}
+
 void
 QbbNetDevice::UpdateNextAvail(Time t)
 {
+    if (m_train.active)
+        TrainRecheck();
     if (!m_nextSend.IsExpired() && t < Time(m_nextSend.GetTs()))
     {
         Simulator::Cancel(m_nextSend);
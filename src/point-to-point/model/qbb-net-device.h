@@ -21,6 +21,8 @@
 #define QBB_NET_DEVICE_H
 
 #include "ns3/point-to-point-net-device.h"
+#include "ns3/pfc-deadlock-detector.h"
+#include "ns3/qbb-telemetry.h"
 #include "ns3/qbb-channel.h"
 //#include "ns3/fivetuple.h"
 #include "ns3/broadcom-egress-queue.h"
@@ -31,7 +33,9 @@
 #include "ns3/udp-header.h"
 #include <ns3/rdma.h>
 
+#include <deque>
 #include <map>
+#include <queue>
 #include <vector>
 
 namespace ns3
@@ -63,9 +67,76 @@ class RdmaEgressQueue : public Object
     void RecoverQueue(uint32_t i);
     void EnqueueHighPrioQ(Ptr<Packet> p);
     void CleanHighPrio(TracedCallback<Ptr<const Packet>, uint32_t> dropCb);
+    /// \return the ticket of the next packet enqueued in the high priority queue
+    uint32_t GetHighPrioTicket();
+    /// \return whether the high priority packet of a ticket is still queued
+    bool IsHighPrioQueued(uint32_t ticket);
+    /// \return the earliest time a qp may send, to wake up when none can send now
+    Time GetNextAvail();
+    /**
+     * With PgScheduler, only the qps in the lists of the unpaused PGs and the
+     * first one waiting for its rate limiter are looked at.
+     * \param qp a qp
+     * \param paused the paused PGs
+     * \return the earliest time a qp other than qp may send, not later than
+     * the time per-packet mode would find one
+     */
+    Time GetNextAvailOther(Ptr<RdmaQueuePair> qp, bool paused[]);
+    /**
+     * With PgScheduler, tell the scheduler that a qp may have packets to
+     * send: it is new, was acknowledged, got more data or a higher rate.
+     * A qp the scheduler finds with nothing to send leaves it until then.
+     */
+    void Activate(Ptr<RdmaQueuePair> qp);
+    void SetPgWeights(std::string weights);
 
     TracedCallback<Ptr<const Packet>, uint32_t> m_traceRdmaEnqueue;
     TracedCallback<Ptr<const Packet>, uint32_t> m_traceRdmaDequeue;
+
+  private:
+    // PgScheduler: after the high priority queue, the strict PGs from the
+    // highest, then DWRR over the other PGs, then round robin over the qps
+    // of a PG.  Only the qps which may send are in the lists of their PG,
+    // those waiting for their rate limiter are in m_pacing, so a dequeue
+    // does not depend on the number of qps.
+    int GetNextQindexPg(bool paused[]);
+    // the qp group was rebuilt, see RdmaHw::RedistributeQp
+    void ResetPgScheduler();
+    // count a finished qp of the group, and drop the finished qps from the
+    // group once they are half of it
+    void Finished(Ptr<RdmaQueuePair> qp);
+    void CompactQps();
+
+    struct PgState
+    {
+        std::deque<Ptr<RdmaQueuePair>> qps; // qps which may send, in round robin order
+        int64_t deficit;
+        uint32_t weight;
+    };
+
+    struct PacingEntry
+    {
+        Time time; // the m_nextAvail of the qp when it was pushed
+        uint64_t order;
+        Ptr<RdmaQueuePair> qp;
+
+        bool operator>(const PacingEntry& o) const
+        {
+            return time != o.time ? time > o.time : order > o.order;
+        }
+    };
+
+    bool m_pgScheduler;
+    uint32_t m_strictPgs;   // bitmap of the strict priority PGs
+    uint32_t m_pgQuantum;   // DWRR bytes per unit of weight
+    PgState m_pgs[qCnt];
+    uint32_t m_activePgs;   // bitmap of the PGs with qps in their list
+    uint32_t m_dwrrPg;      // PG of the current DWRR round
+    std::priority_queue<PacingEntry, std::vector<PacingEntry>, std::greater<PacingEntry>>
+        m_pacing;
+    uint64_t m_pacingOrder;
+    uint32_t m_finished;    // finished qps left in the qp group
+    uint32_t m_generation;  // m_generation of the qp group the lists were built for
 };
 
 /**
@@ -94,6 +165,17 @@ class QbbNetDevice : public PointToPointNetDevice
      */
     virtual void Receive(Ptr<Packet> p);
 
+    /**
+     * Receive a train of packets from a connected QbbChannel.
+     *
+     * The packets are handed to Receive at their own arrival times, so the
+     * switch sees the same sequence as with per-packet delivery.
+     *
+     * @param train Ptr to the received train.
+     */
+    void ReceiveTrain(Ptr<QbbTrain> train);
+    void TruncateTrain(Ptr<QbbTrain> train, uint32_t count);
+
     /**
      * Send a packet to the channel by putting it to the queue
      * of the corresponding priority class
@@ -124,6 +206,10 @@ class QbbNetDevice : public PointToPointNetDevice
 
     void SetQueue(Ptr<BEgressQueue> q);
     Ptr<BEgressQueue> GetQueue();
+    /// \return the telemetry of the device, null if disabled
+    Ptr<QbbTelemetry> GetTelemetry();
+    /// \return the PFC deadlock detector of the device, null if disabled
+    Ptr<PfcDeadlockDetector> GetDeadlockDetector();
     virtual bool IsQbb(void) const;
     void NewQp(Ptr<RdmaQueuePair> qp);
     void ReassignedQp(Ptr<RdmaQueuePair> qp);
@@ -156,6 +242,20 @@ class QbbNetDevice : public PointToPointNetDevice
     /// Resume a paused queue and call DequeueAndTransmit()
     virtual void Resume(unsigned qIndex);
 
+    /// Send back-to-back packets of a QP as one train, see TrainSize
+    void TransmitTrain(int qIndex);
+    /**
+     * \param qp the qp of the train
+     * \param t the start of the next packet
+     * \param other the earliest time another qp may send, see RdmaEgressQueue::GetNextAvailOther
+     * \return whether per-packet mode would send the next packet of the train QP at t
+     */
+    bool TrainCanExtend(Ptr<RdmaQueuePair> qp, Time t, Time other);
+    /// Withdraw the packets of the running train that per-packet mode would no longer send
+    void TrainRecheck(void);
+    void TrainComplete(void);
+    void ReplayTrain(Ptr<QbbTrain> train, uint32_t idx);
+
     /**
      * The queues for each priority class.
      * @see class Queue
@@ -165,6 +265,9 @@ class QbbNetDevice : public PointToPointNetDevice
 
     Ptr<QbbChannel> m_channel;
 
+    Ptr<QbbTelemetry> m_telemetry;               //< Telemetry of the queues and PFC, if set
+    Ptr<PfcDeadlockDetector> m_deadlockDetector; //< Detector of the PFC deadlocks, if set
+
     // pfc
     bool m_qbbEnabled; //< PFC behaviour enabled
     bool m_qcnEnabled;
@@ -174,6 +277,24 @@ class QbbNetDevice : public PointToPointNetDevice
 
     uint32_t nvls_enable;
 
+    // packet train
+    uint32_t m_trainSize; //< Max packets per train, 1 disables trains
+
+    struct
+    {
+        bool active;
+        Ptr<QbbTrain> train;
+        Ptr<RdmaQueuePair> qp;
+        std::vector<Time> start;     // start of transmission of each packet
+        std::vector<Time> txTime;    // transmission time of each packet
+        std::vector<uint64_t> seq;   // snd_nxt before each packet
+        std::vector<Time> nextAvail; // qp->m_nextAvail after each packet
+        DataRate rate;               // qp->m_rate when the train was built
+        uint64_t endSeq;             // snd_nxt after the train
+        Time endNextAvail;           // qp->m_nextAvail after the train
+        EventId complete;
+    } m_train;
+
     // qcn
 
     /* RP parameters */
@@ -216,6 +337,8 @@ class QbbNetDevice : public PointToPointNetDevice
     Ptr<RdmaEgressQueue> GetRdmaQueue();
     void TakeDown(); // take down this device
     void UpdateNextAvail(Time t);
+    /// The rate of a qp changed without UpdateNextAvail, a train of the qp is rechecked
+    void RateChanged(void);
 
     TracedCallback<Ptr<const Packet>, Ptr<RdmaQueuePair>>
         m_traceQpDequeue; // the trace for printing dequeue
@@ -0,0 +1,187 @@
+#include "qbb-telemetry.h"
+
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+
+namespace ns3
+{
+
+NS_OBJECT_ENSURE_REGISTERED(QbbTelemetry);
+
+TypeId
+QbbTelemetry::GetTypeId(void)
+{
+    static TypeId tid =
+        TypeId("ns3::QbbTelemetry")
+            .SetParent<Object>()
+            .AddConstructor<QbbTelemetry>()
+            .AddAttribute("SampleInterval",
+                          "Number of dequeued packets per queue sample.",
+                          UintegerValue(64),
+                          MakeUintegerAccessor(&QbbTelemetry::m_sampleInterval),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("SampleRingSize",
+                          "Number of queue samples kept, the oldest are overwritten.",
+                          UintegerValue(4096),
+                          MakeUintegerAccessor(&QbbTelemetry::m_sampleRingSize),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("PauseRingSize",
+                          "Number of PFC pause intervals kept, the oldest are overwritten.",
+                          UintegerValue(1024),
+                          MakeUintegerAccessor(&QbbTelemetry::m_pauseRingSize),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("SnapshotInterval",
+                          "Interval of the Snapshot trace while the device records, "
+                          "0 for none.",
+                          TimeValue(Time(0)),
+                          MakeTimeAccessor(&QbbTelemetry::m_snapshotInterval),
+                          MakeTimeChecker())
+            .AddTraceSource("Snapshot",
+                            "Periodic snapshot of the telemetry, to read its counters.",
+                            MakeTraceSourceAccessor(&QbbTelemetry::m_snapshotTrace),
+                            "ns3::QbbTelemetry::Snapshot");
+    return tid;
+}
+
+QbbTelemetry::QbbTelemetry()
+    : m_paused(0)
+{
+    Reset();
+}
+
+void
+QbbTelemetry::DoDispose()
+{
+    m_snapshotEvent.Cancel();
+    Object::DoDispose();
+}
+
+template <typename T>
+void
+QbbTelemetry::Ring<T>::Push(const T& v, uint32_t capacity)
+{
+    if (buf.empty())
+        buf.resize(capacity);
+    buf[pushed % buf.size()] = v;
+    pushed++;
+}
+
+template <typename T>
+std::vector<T>
+QbbTelemetry::Ring<T>::Get() const
+{
+    std::vector<T> out;
+    uint64_t n = std::min<uint64_t>(pushed, buf.size());
+    out.reserve(n);
+    for (uint64_t i = pushed - n; i < pushed; i++)
+        out.push_back(buf[i % buf.size()]);
+    return out;
+}
+
+void
+QbbTelemetry::RecordEnqueue(uint32_t qIndex, uint32_t qlen)
+{
+    QueueCounters& c = m_counters[qIndex];
+    c.maxQlen = std::max(c.maxQlen, qlen);
+}
+
+void
+QbbTelemetry::RecordDequeue(uint32_t qIndex, uint32_t size, uint32_t qlen, Time sojourn)
+{
+    QueueCounters& c = m_counters[qIndex];
+    c.packets++;
+    c.bytes += size;
+    c.maxSojourn = std::max(c.maxSojourn, sojourn);
+    if (--m_toSample == 0)
+    {
+        m_toSample = m_sampleInterval;
+        m_samples.Push({Simulator::Now(), qIndex, qlen, sojourn}, m_sampleRingSize);
+        Touch();
+    }
+}
+
+void
+QbbTelemetry::RecordPfc(uint32_t qIndex, bool pause)
+{
+    uint32_t bit = 1u << qIndex;
+    if (pause == bool(m_paused & bit))
+        return; // a pause refreshing the pause in progress
+    m_paused ^= bit;
+    if (pause)
+    {
+        m_pauseStart[qIndex] = Simulator::Now();
+        m_counters[qIndex].pauses++;
+    }
+    else
+    {
+        m_counters[qIndex].pauseTime += Simulator::Now() - m_pauseStart[qIndex];
+        m_pauses.Push({m_pauseStart[qIndex], Simulator::Now(), qIndex}, m_pauseRingSize);
+    }
+    Touch();
+}
+
+void
+QbbTelemetry::RecordEcnMark(uint32_t qIndex)
+{
+    m_counters[qIndex].ecnMarks++;
+}
+
+std::vector<QbbTelemetry::QueueSample>
+QbbTelemetry::GetSamples() const
+{
+    return m_samples.Get();
+}
+
+std::vector<QbbTelemetry::PauseInterval>
+QbbTelemetry::GetPauses() const
+{
+    return m_pauses.Get();
+}
+
+QbbTelemetry::QueueCounters
+QbbTelemetry::GetCounters(uint32_t qIndex) const
+{
+    QueueCounters c = m_counters[qIndex];
+    if (IsPaused(qIndex))
+        c.pauseTime += Simulator::Now() - m_pauseStart[qIndex];
+    return c;
+}
+
+bool
+QbbTelemetry::IsPaused(uint32_t qIndex) const
+{
+    return m_paused & (1u << qIndex);
+}
+
+void
+QbbTelemetry::Reset()
+{
+    m_samples.pushed = 0;
+    m_pauses.pushed = 0;
+    for (uint32_t i = 0; i < qCnt; i++)
+    {
+        m_counters[i] = QueueCounters{Time(0), 0, 0, Time(0), 0, 0, 0};
+        // the pause state is kept, a pause in progress is counted from now
+        m_pauseStart[i] = Simulator::Now();
+    }
+    m_toSample = 1;
+}
+
+void
+QbbTelemetry::Touch()
+{
+    // the snapshots stop while the device is idle, so that they do not keep
+    // the simulation running
+    if (m_snapshotInterval.IsStrictlyPositive() && !m_snapshotEvent.IsPending())
+        m_snapshotEvent = Simulator::Schedule(m_snapshotInterval, &QbbTelemetry::Snapshot, this);
+}
+
+void
+QbbTelemetry::Snapshot()
+{
+    m_snapshotTrace(this);
+}
+
+} // namespace ns3
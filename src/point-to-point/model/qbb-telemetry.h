@@ -0,0 +1,118 @@
+#ifndef QBB_TELEMETRY_H
+#define QBB_TELEMETRY_H
+
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+#include "ns3/traced-callback.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \brief Always-on telemetry of the egress queues of a QbbNetDevice.
+ *
+ * The device reports the packets of its switch queues, the PFC frames it
+ * receives, and its switch the ECN marks.  The telemetry keeps, in rings of
+ * fixed size which overwrite their oldest entries:
+ *  - one sample (time, queue, queue length, sojourn time) every
+ *    SampleInterval dequeued packets;
+ *  - the PFC pause intervals of the queues of the device;
+ * and per queue counters: the pause time, the pauses, the maximum queue
+ * length and sojourn time, the ECN marks and the packets and bytes
+ * dequeued.
+ *
+ * Recording updates a few counters, plus a ring slot for a sampled packet,
+ * so that it can stay enabled in long runs instead of the per packet traces
+ * of QbbHelper::EnableTracing.  The results are read at the end of a run,
+ * or from the Snapshot trace, which fires every SnapshotInterval while the
+ * device records.
+ */
+class QbbTelemetry : public Object
+{
+  public:
+    static const uint32_t qCnt = 8; // Number of queues/priorities used
+
+    struct QueueSample
+    {
+        Time time;
+        uint32_t qIndex;
+        uint32_t qlen; // bytes left in the queue
+        Time sojourn;  // time the packet spent in the queue
+    };
+
+    struct PauseInterval
+    {
+        Time start;
+        Time end;
+        uint32_t qIndex;
+    };
+
+    struct QueueCounters
+    {
+        Time pauseTime; // includes the pause in progress
+        uint64_t pauses;
+        uint32_t maxQlen; // bytes
+        Time maxSojourn;
+        uint64_t ecnMarks;
+        uint64_t packets; // dequeued
+        uint64_t bytes;   // dequeued
+    };
+
+    static TypeId GetTypeId(void);
+    QbbTelemetry();
+
+    // recording, by the device and its switch
+    void RecordEnqueue(uint32_t qIndex, uint32_t qlen);
+    void RecordDequeue(uint32_t qIndex, uint32_t size, uint32_t qlen, Time sojourn);
+    void RecordPfc(uint32_t qIndex, bool pause);
+    void RecordEcnMark(uint32_t qIndex);
+
+    // the samples and the pause intervals in the rings, oldest first
+    std::vector<QueueSample> GetSamples() const;
+    std::vector<PauseInterval> GetPauses() const;
+    QueueCounters GetCounters(uint32_t qIndex) const;
+    bool IsPaused(uint32_t qIndex) const;
+    // clear the rings and the counters, e.g. after a warm up
+    void Reset();
+
+    TracedCallback<Ptr<const QbbTelemetry>> m_snapshotTrace;
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    // fixed size ring, allocated on the first push
+    template <typename T>
+    struct Ring
+    {
+        std::vector<T> buf;
+        uint64_t pushed = 0; // entries pushed since the last reset
+
+        void Push(const T& v, uint32_t capacity);
+        std::vector<T> Get() const;
+    };
+
+    void Touch();
+    void Snapshot();
+
+    uint32_t m_sampleInterval;
+    uint32_t m_sampleRingSize;
+    uint32_t m_pauseRingSize;
+    Time m_snapshotInterval;
+
+    Ring<QueueSample> m_samples;
+    Ring<PauseInterval> m_pauses;
+    QueueCounters m_counters[qCnt];
+    Time m_pauseStart[qCnt]; // start of the pause in progress, if paused
+    uint32_t m_paused;       // bitmap of the paused queues
+    uint32_t m_toSample;     // dequeues left before the next sample
+    EventId m_snapshotEvent;
+};
+
+} // namespace ns3
+
+#endif /* QBB_TELEMETRY_H */
@@ -19,7 +19,11 @@ RdmaDriver::GetTypeId(void)
             .AddTraceSource("SendComplete",
                             "A qp Send completes.",
                             MakeTraceSourceAccessor(&RdmaDriver::m_traceSendComplete),
-                            "ns3::RdmaDriver::SendComplete");
+                            "ns3::RdmaDriver::SendComplete")
+            .AddTraceSource("MessageComplete",
+                            "A message posted on a persistent qp completes.",
+                            MakeTraceSourceAccessor(&RdmaDriver::m_traceMessageComplete),
+                            "ns3::RdmaDriver::MessageComplete");
     return tid;
 }
 
@@ -62,7 +66,8 @@ RdmaDriver::Init(void)
     // RdmaHw do setup
     m_rdma->SetNode(m_node);
     m_rdma->Setup(MakeCallback(&RdmaDriver::QpComplete, this),
-                  MakeCallback(&RdmaDriver::SendComplete, this));
+                  MakeCallback(&RdmaDriver::SendComplete, this),
+                  MakeCallback(&RdmaDriver::MessageComplete, this));
 }
 
 void
@@ -107,6 +112,47 @@ RdmaDriver::AddQueuePair(uint32_t src,
                          notifyAppSent);
 }
 
+Ptr<RdmaQueuePair>
+RdmaDriver::CreateQueuePair(uint32_t src,
+                            uint32_t dest,
+                            uint64_t tag,
+                            uint16_t pg,
+                            Ipv4Address sip,
+                            Ipv4Address dip,
+                            uint16_t sport,
+                            uint16_t dport,
+                            uint32_t win,
+                            uint64_t baseRtt,
+                            Callback<void> notifyAppFinish)
+{
+    return m_rdma->CreateQueuePair(src,
+                                   dest,
+                                   tag,
+                                   pg,
+                                   sip,
+                                   dip,
+                                   sport,
+                                   dport,
+                                   win,
+                                   baseRtt,
+                                   notifyAppFinish);
+}
+
+uint64_t
+RdmaDriver::PostMessage(Ptr<RdmaQueuePair> qp,
+                        RdmaMessage::Verb verb,
+                        uint64_t size,
+                        Callback<void> notifyComplete)
+{
+    return m_rdma->PostMessage(qp, verb, size, notifyComplete);
+}
+
+void
+RdmaDriver::CloseQueuePair(Ptr<RdmaQueuePair> qp)
+{
+    m_rdma->CloseQueuePair(qp);
+}
+
 void
 RdmaDriver::EnbaleNVLS()
 {
@@ -130,4 +176,10 @@ RdmaDriver::SendComplete(Ptr<RdmaQueuePair> q)
 {
     m_traceSendComplete(q);
 }
+
+void
+RdmaDriver::MessageComplete(Ptr<RdmaQueuePair> q, const RdmaMessage& msg)
+{
+    m_traceMessageComplete(q, msg);
+}
 } // namespace ns3
@@ -22,6 +22,7 @@ class RdmaDriver : public Object
     // trace
     TracedCallback<Ptr<RdmaQueuePair>> m_traceQpComplete;
     TracedCallback<Ptr<RdmaQueuePair>> m_traceSendComplete;
+    TracedCallback<Ptr<RdmaQueuePair>, const RdmaMessage&> m_traceMessageComplete;
 
     static TypeId GetTypeId(void);
     RdmaDriver();
@@ -51,6 +52,24 @@ class RdmaDriver : public Object
                       Callback<void> notifyAppFinish,
                       Callback<void> notifyAppSent);
 
+    // open a persistent qp, and post messages on it, see RdmaHw::CreateQueuePair
+    Ptr<RdmaQueuePair> CreateQueuePair(uint32_t src,
+                                       uint32_t dest,
+                                       uint64_t tag,
+                                       uint16_t pg,
+                                       Ipv4Address _sip,
+                                       Ipv4Address _dip,
+                                       uint16_t _sport,
+                                       uint16_t _dport,
+                                       uint32_t win,
+                                       uint64_t baseRtt,
+                                       Callback<void> notifyAppFinish);
+    uint64_t PostMessage(Ptr<RdmaQueuePair> qp,
+                         RdmaMessage::Verb verb,
+                         uint64_t size,
+                         Callback<void> notifyComplete);
+    void CloseQueuePair(Ptr<RdmaQueuePair> qp);
+
     // enable NVLS
     void EnbaleNVLS();
     void DisableNVLS();
@@ -58,6 +77,7 @@ class RdmaDriver : public Object
     // callback when qp completes
     void QpComplete(Ptr<RdmaQueuePair> q);
     void SendComplete(Ptr<RdmaQueuePair> q);
+    void MessageComplete(Ptr<RdmaQueuePair> q, const RdmaMessage& msg);
 };
 
 } // namespace ns3
@@ -1,12 +1,15 @@
 #include "rdma-hw.h"
 
 #include "cn-header.h"
+#include "hp-int-batch.h"
 #include "ppp-header.h"
 #include "qbb-header.h"
+#include "rdma-driver.h"
 
 #include "ns3/boolean.h"
 #include "ns3/data-rate.h"
 #include "ns3/double.h"
+#include "ns3/node-list.h"
 #include "ns3/pointer.h"
 #include "ns3/ppp-header.h"
 #include "ns3/uinteger.h"
@@ -17,11 +20,116 @@
 #ifdef NS3_MTP
 #include "ns3/mtp-interface.h"
 #endif
+#include <cmath>
 #include <iostream> // debug
 
 namespace ns3
 {
 
+// Mellanox's version of DCQCN
+struct MlxCc : public RdmaCcPolicy
+{
+    typedef MlxCcState State;
+
+    static void SetRate(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate)
+    {
+        qp.Cc<MlxCcState>().m_targetRate = rate;
+    }
+
+    static void OnAck(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp)
+    {
+        if (cnp)
+            hw.cnp_received_mlx(qp);
+    }
+
+    static void OnComplete(RdmaHw& hw, RdmaQueuePair& qp)
+    {
+        MlxCcState& mlx = qp.Cc<MlxCcState>();
+        Simulator::Cancel(mlx.m_eventUpdateAlpha);
+        Simulator::Cancel(mlx.m_eventDecreaseRate);
+        Simulator::Cancel(mlx.m_rpTimer);
+    }
+};
+
+// HPCC
+struct HpCc : public RdmaCcPolicy
+{
+    typedef HpCcState State;
+
+    static void SetRate(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate)
+    {
+        HpCcState& hp = qp.Cc<HpCcState>();
+        hp.m_curRate = rate;
+        if (hw.m_multipleRate)
+        {
+            for (uint32_t i = 0; i < IntHeader::maxHop; i++)
+                hp.hopState[i].Rc = rate;
+        }
+    }
+
+    static void OnAck(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp)
+    {
+        hw.HandleAckHp(qp, p, ch);
+    }
+};
+
+// TIMELY
+struct TimelyCc : public RdmaCcPolicy
+{
+    typedef TimelyCcState State;
+
+    static void SetRate(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate)
+    {
+        qp.Cc<TimelyCcState>().m_curRate = rate;
+    }
+
+    static void OnAck(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp)
+    {
+        hw.HandleAckTimely(qp, p, ch);
+    }
+};
+
+// DCTCP
+struct DctcpCc : public RdmaCcPolicy
+{
+    typedef DctcpCcState State;
+
+    static void OnAck(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp)
+    {
+        hw.HandleAckDctcp(qp, p, ch);
+    }
+};
+
+// HPCC-PINT
+struct HpccPintCc : public RdmaCcPolicy
+{
+    typedef HpccPintCcState State;
+
+    static void SetRate(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate)
+    {
+        qp.Cc<HpccPintCcState>().m_curRate = rate;
+    }
+
+    static void OnAck(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp)
+    {
+        hw.HandleAckHpPint(qp, p, ch);
+    }
+};
+
+// congestion control of each CcMode
+static std::unordered_map<uint32_t, RdmaCcOps>&
+GetCcRegistry()
+{
+    static std::unordered_map<uint32_t, RdmaCcOps> registry = {
+        {1, RdmaCcOps::Of<MlxCc>()},
+        {3, RdmaCcOps::Of<HpCc>()},
+        {7, RdmaCcOps::Of<TimelyCc>()},
+        {8, RdmaCcOps::Of<DctcpCc>()},
+        {10, RdmaCcOps::Of<HpccPintCc>()},
+    };
+    return registry;
+}
+
 TypeId
 RdmaHw::GetTypeId(void)
 {
@@ -41,7 +149,7 @@ RdmaHw::GetTypeId(void)
             .AddAttribute("CcMode",
                           "which mode of DCQCN is running",
                           UintegerValue(0),
-                          MakeUintegerAccessor(&RdmaHw::m_cc_mode),
+                          MakeUintegerAccessor(&RdmaHw::SetCcMode, &RdmaHw::GetCcMode),
                           MakeUintegerChecker<uint32_t>())
             .AddAttribute("NACKGenerationInterval",
                           "The NACK Generation interval",
@@ -58,6 +166,32 @@ RdmaHw::GetTypeId(void)
                           UintegerValue(0),
                           MakeUintegerAccessor(&RdmaHw::m_ack_interval),
                           MakeUintegerChecker<uint32_t>())
+            .AddAttribute("AckCoalesceInterval",
+                          "Coalesce the ACKs of a rx qp into one cumulative ACK, sent at most "
+                          "this many microseconds after the first packet it acknowledges. "
+                          "Disable ACK coalescing if equals to 0.",
+                          DoubleValue(0.0),
+                          MakeDoubleAccessor(&RdmaHw::m_ackCoalesceInterval),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("AckCoalesceBytes",
+                          "Send a coalesced ACK once it acknowledges this many bytes. No limit "
+                          "if equals to 0.",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&RdmaHw::m_ackCoalesceBytes),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("AckMergeQueued",
+                          "Merge an ACK into the previous ACK of the same rx qp while that one "
+                          "is still queued in the NIC, so that the sender processes them once.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&RdmaHw::m_ackMergeQueued),
+                          MakeBooleanChecker())
+            .AddAttribute("SelectiveRepeat",
+                          "Recover losses by selective repeat instead of go-back-N: the "
+                          "receiver keeps the packets received out of order and SACKs them, "
+                          "the sender retransmits the packets not SACKed.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&RdmaHw::m_selectiveRepeat),
+                          MakeBooleanChecker())
             .AddAttribute("L2BackToZero",
                           "Layer 2 go back to zero transmission.",
                           BooleanValue(false),
@@ -98,6 +232,12 @@ RdmaHw::GetTypeId(void)
                           DoubleValue(55.0),
                           MakeDoubleAccessor(&RdmaHw::m_alpha_resume_interval),
                           MakeDoubleChecker<double>())
+            .AddAttribute("DcqcnLazyTimers",
+                          "Evaluate the alpha update and the rate decrease check of DCQCN when "
+                          "they matter instead of on every timer expiration.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&RdmaHw::m_dcqcnLazy),
+                          MakeBooleanChecker())
             .AddAttribute("RateAI",
                           "Rate increment unit in AI period",
                           DataRateValue(DataRate("5Mb/s")),
@@ -198,13 +338,66 @@ RdmaHw::GetTypeId(void)
                           "NVLS enable info",
                           UintegerValue(0),
                           MakeUintegerAccessor(&RdmaHw::nvls_enable),
-                          MakeUintegerChecker<uint32_t>());
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("FluidMode",
+                          "Fast-forward converged DCQCN/HPCC flows analytically",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&RdmaHw::m_fluidMode),
+                          MakeBooleanChecker())
+            .AddAttribute("FluidEpoch",
+                          "Max length of a fluid epoch in microseconds, also the bound of the FCT "
+                          "error per undetected contention change",
+                          DoubleValue(200.0),
+                          MakeDoubleAccessor(&RdmaHw::m_fluidEpoch),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("FluidStableTime",
+                          "How long the rate must be stable before a fluid epoch, in microseconds",
+                          DoubleValue(50.0),
+                          MakeDoubleAccessor(&RdmaHw::m_fluidStableTime),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("FluidRateTolerance",
+                          "Relative rate change that is not considered as a rate change",
+                          DoubleValue(0.01),
+                          MakeDoubleAccessor(&RdmaHw::m_fluidRateTolerance),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("FluidQueueThreshold",
+                          "INT queue length in bytes that ends a fluid epoch, keep it below kmin",
+                          UintegerValue(8000),
+                          MakeUintegerAccessor(&RdmaHw::m_fluidQueueThreshold),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("FctSketch",
+                          "Calculator of the FCT quantiles (ns) of the completed qps, none if null",
+                          PointerValue(),
+                          MakePointerAccessor(&RdmaHw::m_fctSketch),
+                          MakePointerChecker<QuantileSketchCalculator>());
     ;
     return tid;
 }
 
 RdmaHw::RdmaHw()
 {
+    m_fluidEpochs = 0;
+    m_fluidBytes = 0;
+}
+
+void
+RdmaHw::SetCcMode(uint32_t mode)
+{
+    m_cc_mode = mode;
+    auto it = GetCcRegistry().find(mode);
+    m_cc = it != GetCcRegistry().end() ? it->second : RdmaCcOps::Of<RdmaCcPolicy>();
+}
+
+uint32_t
+RdmaHw::GetCcMode() const
+{
+    return m_cc_mode;
+}
+
+void
+RdmaHw::RegisterCc(uint32_t mode, RdmaCcOps ops)
+{
+    GetCcRegistry()[mode] = ops;
 }
 
 void
@@ -232,7 +425,9 @@ RdmaHw::SetNode(Ptr<Node> node)
 }
 
 void
-RdmaHw::Setup(QpCompleteCallback cb, SendCompleteCallback send_cb)
+RdmaHw::Setup(QpCompleteCallback cb,
+              SendCompleteCallback send_cb,
+              MessageCompleteCallback message_cb)
 {
     tx_bytes.resize(m_nic.size());
     last_tx_bytes.resize(m_nic.size());
@@ -257,6 +452,7 @@ RdmaHw::Setup(QpCompleteCallback cb, SendCompleteCallback send_cb)
     // setup qp complete callback
     m_qpCompleteCallback = cb;
     m_sendCompleteCallback = send_cb;
+    m_messageCompleteCallback = message_cb;
 }
 
 uint32_t
@@ -340,13 +536,92 @@ RdmaHw::AddQueuePair(uint32_t src,
     qp->SetVarWin(m_var_win);
     qp->SetAppNotifyCallback(notifyAppFinish);
     qp->SetAppSentCallback(notifyAppSent);
-    // add qp
+    InstallQueuePair(qp);
+}
+
+Ptr<RdmaQueuePair>
+RdmaHw::CreateQueuePair(uint32_t src,
+                        uint32_t dest,
+                        uint64_t tag,
+                        uint16_t pg,
+                        Ipv4Address sip,
+                        Ipv4Address dip,
+                        uint16_t sport,
+                        uint16_t dport,
+                        uint32_t win,
+                        uint64_t baseRtt,
+                        Callback<void> notifyAppFinish)
+{
+    Ptr<RdmaQueuePair> qp = CreateObject<RdmaQueuePair>(pg, sip, dip, sport, dport);
+    qp->m_persistent = true;
+    qp->SetSrc(src);
+    qp->SetDest(dest);
+    qp->SetTag(tag);
+    qp->SetWin(win);
+    qp->SetBaseRtt(baseRtt);
+    qp->SetVarWin(m_var_win);
+    qp->SetAppNotifyCallback(notifyAppFinish);
+    InstallQueuePair(qp);
+    return qp;
+}
+
+uint64_t
+RdmaHw::PostMessage(Ptr<RdmaQueuePair> qp,
+                    RdmaMessage::Verb verb,
+                    uint64_t size,
+                    Callback<void> notifyComplete)
+{
+    NS_ASSERT_MSG(qp->m_persistent, "messages are posted on an open persistent qp");
+    RdmaMessage msg;
+    msg.id = qp->m_nextMessageId++;
+    msg.verb = verb;
+    msg.size = size;
+    msg.end = qp->m_size + size;
+    msg.startTime = Simulator::Now();
+    msg.notifyComplete = notifyComplete;
+    qp->m_messages.push_back(msg);
+    qp->SetSize(msg.end);
+    qp->SetInitialSize(qp->GetInitialSize() + size);
+    uint32_t nic_idx = GetNicIdxOfQp(qp);
+    // more bytes to send end the fluid epochs on the NIC, as a new flow does
+    if (m_fluidMode)
+        FluidCongestion(nic_idx);
+    m_nic[nic_idx].dev->GetRdmaQueue()->Activate(qp);
+    m_nic[nic_idx].dev->TriggerTransmit();
+    return msg.id;
+}
+
+void
+RdmaHw::CloseQueuePair(Ptr<RdmaQueuePair> qp)
+{
+    qp->m_persistent = false;
+    if (qp->IsFinished())
+        QpComplete(qp);
+}
+
+void
+RdmaHw::MessageComplete(Ptr<RdmaQueuePair> qp)
+{
+    while (!qp->m_messages.empty() && qp->m_messages.front().end <= qp->snd_una)
+    {
+        RdmaMessage msg = qp->m_messages.front();
+        qp->m_messages.pop_front();
+        if (!m_messageCompleteCallback.IsNull())
+            m_messageCompleteCallback(qp, msg);
+        if (!msg.notifyComplete.IsNull())
+            msg.notifyComplete();
+    }
+}
+
+void
+RdmaHw::InstallQueuePair(Ptr<RdmaQueuePair> qp)
+{
     uint32_t nic_idx = GetNicIdxOfQp(qp);
 
     // std::cout << "src is: " << src << ", dst is: " << dest <<  ", nic_idx: " << nic_idx << ", and
     // the m_nic size is: " << m_nic.size() << std::endl; Assign the qp to specific qbbnetdevice
     m_nic[nic_idx].qpGrp->AddQp(qp);
-    uint64_t key = GetQpKey(dip.Get(), sport, pg);
+    uint64_t key = GetQpKey(qp->dip.Get(), qp->sport, qp->m_pg);
     m_qpMap[key] = qp;
     qp_cnp[key] = 0;
     last_qp_cnp[key] = 0;
@@ -356,32 +631,15 @@ RdmaHw::AddQueuePair(uint32_t src,
     DataRate m_bps = m_nic[nic_idx].dev->GetDataRate();
     qp->m_rate = m_bps;
     qp->m_max_rate = m_bps;
-    if (m_cc_mode == 1)
-    {
-        qp->mlx.m_targetRate = m_bps;
-    }
-    else if (m_cc_mode == 3)
-    {
-        qp->hp.m_curRate = m_bps;
-        if (m_multipleRate)
-        {
-            for (uint32_t i = 0; i < IntHeader::maxHop; i++)
-                qp->hp.hopState[i].Rc = m_bps;
-        }
-    }
-    else if (m_cc_mode == 7)
-    {
-        qp->tmly.m_curRate = m_bps;
-    }
-    else if (m_cc_mode == 10)
-    {
-        qp->hpccPint.m_curRate = m_bps;
-    }
+    m_cc.init(*this, *qp, m_bps);
     // NVLS settings
     if (nvls_enable == 1)
         qp->nvls_enable = 1;
     else
         qp->nvls_enable = 0;
+    // a new flow on the NIC ends running fluid epochs
+    if (m_fluidMode)
+        FluidCongestion(nic_idx);
     // Notify Nic
     m_nic[nic_idx].dev->NewQp(qp);
 }
@@ -468,7 +726,11 @@ void
 RdmaHw::DeleteRxQp(uint32_t dip, uint16_t pg, uint16_t dport)
 {
     uint64_t key = ((uint64_t)dip << 32) | ((uint64_t)pg << 16) | (uint64_t)dport;
-    m_rxQpMap.erase(key);
+    auto it = m_rxQpMap.find(key);
+    if (it == m_rxQpMap.end())
+        return;
+    it->second->m_ackTimer.Cancel();
+    m_rxQpMap.erase(it);
 }
 
 int
@@ -514,50 +776,131 @@ RdmaHw::ReceiveUdp(Ptr<Packet> p, CustomHeader& ch)
     }
     rxQp->m_ecn_source.total++;
     rxQp->m_milestone_rx = m_ack_interval;
+    if (!m_fluidRx.empty())
+    {
+        // data of another flow shares the last hop with running fluid epochs
+        uint64_t key = ((uint64_t)ch.sip << 32) | ((uint64_t)ch.udp.pg << 16) | ch.udp.sport;
+        if (m_fluidRx.find(key) == m_fluidRx.end())
+        {
+            for (auto& it : m_fluidRx)
+            {
+                FluidRxEntry& e = it.second;
+                Simulator::ScheduleWithContext(e.sender->m_node->GetId(),
+                                               e.delay,
+                                               &RdmaHw::FluidAbortQp,
+                                               e.sender,
+                                               e.qpKey);
+            }
+            m_fluidRx.clear();
+        }
+    }
 
     int x = ReceiverCheckSeq(ch.udp.seq, rxQp, payload_size);
-    if (x == 1 || x == 2)
+    bool coalesce = m_ackCoalesceInterval > 0 && (x == 1 || x == 5);
+    if (coalesce || x == 1 || x == 2 || x == 6)
+    { // feedback of the next ACK
+        rxQp->m_ackCnp |= ecnbits != 0;
+        rxQp->m_ackIh = ch.udp.ih;
+        rxQp->m_ackTos = ch.m_tos;
+    }
+    if (coalesce)
+    { // one cumulative ACK per AckCoalesceInterval or AckCoalesceBytes
+        if (x == 5)
+            return 0;
+        if (m_ackCoalesceBytes > 0 &&
+            rxQp->ReceiverNextExpectedSeq - rxQp->m_ackedSeq >= m_ackCoalesceBytes)
+            SendAck(rxQp, 0xFC);
+        else if (!rxQp->m_ackTimer.IsPending())
+            rxQp->m_ackTimer = Simulator::Schedule(MicroSeconds(m_ackCoalesceInterval),
+                                                   &RdmaHw::SendAck,
+                                                   this,
+                                                   rxQp,
+                                                   0xFC,
+                                                   0);
+    }
+    else if (x == 1 || x == 2)
     { // generate ACK or NACK
+        SendAck(rxQp, x == 1 ? 0xFC : 0xFD);
+    }
+    else if (x == 6)
+    { // SACK
+        SendAck(rxQp, 0xFD, ch.udp.seq);
+    }
+    return 0;
+}
+
+void
+RdmaHw::SendAck(Ptr<RdmaRxQueuePair> q, uint8_t l3Prot, uint64_t sack)
+{
+    if (sack == 0)
+    { // a NACK also acknowledges ReceiverNextExpectedSeq, it ends the coalescing window
+        q->m_ackTimer.Cancel();
+        q->m_ackedSeq = q->ReceiverNextExpectedSeq;
+    }
+    bool cnp = q->m_ackCnp;
+    q->m_ackCnp = false;
+    uint32_t nic_idx = GetNicIdxOfRxQp(q);
+    Ptr<QbbNetDevice> dev = m_nic[nic_idx].dev;
+
+    if (m_ackMergeQueued && l3Prot == 0xFC && q->m_ackPkt && q->m_ackNic == nic_idx &&
+        dev->GetRdmaQueue()->IsHighPrioQueued(q->m_ackTicket))
+    {
+        // the last ACK of the qp waits in the NIC, make it acknowledge this one too
+        Ptr<Packet> p = q->m_ackPkt;
+        PppHeader ppp;
+        Ipv4Header head;
         qbbHeader seqh;
-        seqh.SetSeq(rxQp->ReceiverNextExpectedSeq);
-        seqh.SetPG(ch.udp.pg);
-        seqh.SetSport(ch.udp.dport);
-        seqh.SetDport(ch.udp.sport);
-        seqh.SetIntHeader(ch.udp.ih);
-        if (ecnbits)
+        p->RemoveHeader(ppp);
+        p->RemoveHeader(head);
+        p->RemoveHeader(seqh);
+        seqh.SetSeq(q->ReceiverNextExpectedSeq);
+        seqh.SetIntHeader(q->m_ackIh);
+        if (cnp)
             seqh.SetCnp();
-
-        Ptr<Packet> newp =
-            Create<Packet>(std::max(60 - 14 - 20 - (int)seqh.GetSerializedSize(), 0));
-        newp->AddHeader(seqh);
-
-        Ipv4Header head; // Prepare IPv4 header
-        head.SetDestination(Ipv4Address(ch.sip));
-        head.SetSource(Ipv4Address(ch.dip));
-        head.SetProtocol(x == 1 ? 0xFC : 0xFD); // ack=0xFC nack=0xFD
-        head.SetTtl(64);
-        head.SetPayloadSize(newp->GetSize());
-        head.SetIdentification(rxQp->m_ipid++);
-        // GPU receives the packet and generate ACK with NVLS tag
-        if (ch.m_tos == 4)
-            head.SetTos(4);
-
-        newp->AddHeader(head);
-        AddHeader(newp, 0x800); // Attach PPP header
-        // uint32_t sip = ch.sip;
-        // uint32_t sid = (sip >> 8) & 0xffff;
-        uint32_t dip = ch.dip;
-        uint32_t did = (dip >> 8) & 0xffff;
-        // send
-        uint32_t nic_idx = GetNicIdxOfRxQp(rxQp);
-        m_nic[nic_idx].dev->RdmaEnqueueHighPrioQ(newp);
-        // 发送给目标 NVSwitch 的报文
-        if (did == m_node->GetId() && m_node->GetNodeType() == 2 && ch.m_tos == 4)
-            m_nic[nic_idx].dev->SwitchAsHostSend();
-        else
-            m_nic[nic_idx].dev->TriggerTransmit();
+        p->AddHeader(seqh);
+        p->AddHeader(head);
+        p->AddHeader(ppp);
+        return;
     }
-    return 0;
+
+    qbbHeader seqh;
+    seqh.SetSeq(sack ? sack : q->ReceiverNextExpectedSeq);
+    if (sack)
+        seqh.SetSack();
+    seqh.SetPG(q->m_ecn_source.qIndex);
+    seqh.SetSport(q->sport);
+    seqh.SetDport(q->dport);
+    seqh.SetIntHeader(q->m_ackIh);
+    if (cnp)
+        seqh.SetCnp();
+
+    Ptr<Packet> newp = Create<Packet>(std::max(60 - 14 - 20 - (int)seqh.GetSerializedSize(), 0));
+    newp->AddHeader(seqh);
+
+    Ipv4Header head; // Prepare IPv4 header
+    head.SetDestination(Ipv4Address(q->dip));
+    head.SetSource(Ipv4Address(q->sip));
+    head.SetProtocol(l3Prot); // ack=0xFC nack=0xFD
+    head.SetTtl(64);
+    head.SetPayloadSize(newp->GetSize());
+    head.SetIdentification(q->m_ipid++);
+    // GPU receives the packet and generate ACK with NVLS tag
+    if (q->m_ackTos == 4)
+        head.SetTos(4);
+
+    newp->AddHeader(head);
+    AddHeader(newp, 0x800); // Attach PPP header
+    uint32_t did = (q->sip >> 8) & 0xffff;
+    // send
+    q->m_ackPkt = m_ackMergeQueued && l3Prot == 0xFC ? newp : nullptr;
+    q->m_ackNic = nic_idx;
+    q->m_ackTicket = dev->GetRdmaQueue()->GetHighPrioTicket();
+    dev->RdmaEnqueueHighPrioQ(newp);
+    // 发送给目标 NVSwitch 的报文
+    if (did == m_node->GetId() && m_node->GetNodeType() == 2 && q->m_ackTos == 4)
+        dev->SwitchAsHostSend();
+    else
+        dev->TriggerTransmit();
 }
 
 int
@@ -589,27 +932,7 @@ RdmaHw::ReceiveCnp(Ptr<Packet> p, CustomHeader& ch)
     if (qp->m_rate == 0) // lazy initialization
     {
         qp->m_rate = dev->GetDataRate();
-        if (m_cc_mode == 1)
-        {
-            qp->mlx.m_targetRate = dev->GetDataRate();
-        }
-        else if (m_cc_mode == 3)
-        {
-            qp->hp.m_curRate = dev->GetDataRate();
-            if (m_multipleRate)
-            {
-                for (uint32_t i = 0; i < IntHeader::maxHop; i++)
-                    qp->hp.hopState[i].Rc = dev->GetDataRate();
-            }
-        }
-        else if (m_cc_mode == 7)
-        {
-            qp->tmly.m_curRate = dev->GetDataRate();
-        }
-        else if (m_cc_mode == 10)
-        {
-            qp->hpccPint.m_curRate = dev->GetDataRate();
-        }
+        m_cc.setRate(*this, *qp, dev->GetDataRate());
     }
     return 0;
 }
@@ -621,6 +944,7 @@ RdmaHw::ReceiveAck(Ptr<Packet> p, CustomHeader& ch)
     uint16_t port = ch.ack.dport;
     uint64_t seq = ch.ack.seq;
     uint8_t cnp = (ch.ack.flags >> qbbHeader::FLAG_CNP) & 1;
+    uint8_t sack = (ch.ack.flags >> qbbHeader::FLAG_SACK) & 1;
 
     // int i;
     Ptr<RdmaQueuePair> qp = GetQp(ch.sip, port, qIndex);
@@ -635,7 +959,13 @@ RdmaHw::ReceiveAck(Ptr<Packet> p, CustomHeader& ch)
         std::cout << "ERROR: shouldn't receive ack\n";
     else
     {
-        if (!m_backto0)
+        if (sack || m_selectiveRepeat)
+        {
+            SelectiveAcknowledge(qp, seq, sack);
+            if (sack) // the CC sees the cumulative ACK of a SACK
+                ch.ack.seq = qp->snd_una;
+        }
+        else if (!m_backto0)
         {
             qp->Acknowledge(seq);
         }
@@ -644,12 +974,27 @@ RdmaHw::ReceiveAck(Ptr<Packet> p, CustomHeader& ch)
             uint64_t goback_seq = seq / m_chunk * m_chunk;
             qp->Acknowledge(goback_seq);
         }
+        if (!qp->m_messages.empty())
+            MessageComplete(qp);
         if (qp->IsFinished())
         {
             QpComplete(qp);
         }
     }
-    if (ch.l3Prot == 0xFD) // NACK
+    if (m_fluidMode)
+    {
+        bool congested = cnp || ch.l3Prot == 0xFD;
+        if (m_cc_mode == 3)
+        {
+            IntHeader& ih = ch.ack.ih;
+            for (uint32_t i = 0; i < ih.IntHeader_t.nhop && i < IntHeader::maxHop; i++)
+                if (ih.IntHeader_t.hop[i].GetQlen() >= m_fluidQueueThreshold)
+                    congested = true;
+        }
+        if (congested)
+            FluidCongestion(nic_idx);
+    }
+    if (ch.l3Prot == 0xFD && !sack) // NACK
         RecoverQueue(qp);
 
     // handle cnp
@@ -657,33 +1002,14 @@ RdmaHw::ReceiveAck(Ptr<Packet> p, CustomHeader& ch)
     {
         uint64_t key = GetQpKey(qp->dip.Get(), qp->sport, qp->m_pg);
         qp_cnp[key]++; // update for the number of cnp this qp has received
-        if (m_cc_mode == 1)
-        { // mlx version
-            cnp_received_mlx(qp);
-        }
-    }
-
-    if (m_cc_mode == 3)
-    {
-        HandleAckHp(qp, p, ch);
-    }
-    else if (m_cc_mode == 7)
-    {
-        HandleAckTimely(qp, p, ch);
-    }
-    else if (m_cc_mode == 8)
-    {
-        HandleAckDctcp(qp, p, ch);
-    }
-    else if (m_cc_mode == 10)
-    {
-        HandleAckHpPint(qp, p, ch);
     }
+    m_cc.ack(*this, qp, p, ch, cnp);
     // uint32_t sip = ch.sip;
     // uint32_t sid = (sip >> 8) & 0xffff;
     uint32_t dip = ch.dip;
     uint32_t did = (dip >> 8) & 0xffff;
     // ACK may advance the on-the-fly window, allowing more packets to send
+    m_nic[nic_idx].dev->GetRdmaQueue()->Activate(qp);
     if (did == m_node->GetId() && m_node->GetNodeType() == 2)
         m_nic[nic_idx].dev->SwitchAsHostSend();
     else
@@ -721,6 +1047,14 @@ RdmaHw::ReceiverCheckSeq(uint64_t seq, Ptr<RdmaRxQueuePair> q, uint32_t size)
     if (seq == expected)
     {
         q->ReceiverNextExpectedSeq = expected + size;
+        if (!q->m_received.IsEmpty())
+        { // the packets received out of order which follow this one
+            q->m_received.Shift(1);
+            uint32_t k = q->m_received.NextClear(0);
+            q->m_received.Shift(k);
+            q->ReceiverNextExpectedSeq =
+                std::min(q->ReceiverNextExpectedSeq + (uint64_t)k * m_mtu, q->m_receivedEnd);
+        }
         if (q->ReceiverNextExpectedSeq >= (uint64_t)q->m_milestone_rx)
         {
             q->m_milestone_rx += m_ack_interval;
@@ -735,6 +1069,24 @@ RdmaHw::ReceiverCheckSeq(uint64_t seq, Ptr<RdmaRxQueuePair> q, uint32_t size)
             return 5;
         }
     }
+    else if (seq > expected && m_selectiveRepeat && (seq - expected) % m_mtu == 0)
+    {
+        uint64_t i = (seq - expected) / m_mtu;
+        if (q->m_received.Test(i))
+            return 3;
+        q->m_received.Set(i);
+        q->m_receivedEnd = std::max(q->m_receivedEnd, seq + size);
+        if (q->m_lastNACK != expected || Simulator::Now() >= q->m_nackTimer)
+        {
+            // the hole outlived a NACK interval, the retransmission may be lost too
+            bool again = q->m_lastNACK == expected && q->m_nackTimer.IsStrictlyPositive();
+            q->m_nackTimer = Simulator::Now() + MicroSeconds(m_nack_interval);
+            q->m_lastNACK = expected;
+            if (again)
+                return 2;
+        }
+        return 6; // Generate SACK
+    }
     else if (seq > expected)
     {
         // Generate NACK
@@ -784,25 +1136,56 @@ RdmaHw::EtherToPpp(uint16_t proto)
 void
 RdmaHw::RecoverQueue(Ptr<RdmaQueuePair> qp)
 {
+    if (qp->InRecovery())
+    { // selective repeat: retransmit again what is not SACKed
+        SetRtxNext(qp, qp->snd_una);
+        return;
+    }
     qp->snd_nxt = qp->snd_una;
 }
 
 void
-RdmaHw::QpComplete(Ptr<RdmaQueuePair> qp)
+RdmaHw::SelectiveAcknowledge(Ptr<RdmaQueuePair> qp, uint64_t seq, bool sack)
 {
-    NS_ASSERT(!m_qpCompleteCallback.IsNull());
-    if (m_cc_mode == 1)
+    if (sack)
     {
-        Simulator::Cancel(qp->mlx.m_eventUpdateAlpha);
-        Simulator::Cancel(qp->mlx.m_eventDecreaseRate);
-        Simulator::Cancel(qp->mlx.m_rpTimer);
+        if (seq < qp->snd_una || (seq - qp->snd_una) % m_mtu != 0)
+            return; // already acknowledged
+        if (!qp->InRecovery())
+            qp->m_rtxNext = qp->snd_una; // a new loss
+        qp->m_sacked.Set((seq - qp->snd_una) / m_mtu);
+        qp->m_sackHigh = std::max(qp->m_sackHigh, std::min(seq + m_mtu, qp->m_size));
     }
+    else if (seq > qp->snd_una)
+    {
+        qp->m_sacked.Shift((seq - qp->snd_una + m_mtu - 1) / m_mtu);
+        qp->Acknowledge(seq);
+    }
+    SetRtxNext(qp, std::max(qp->m_rtxNext, qp->snd_una));
+}
+
+void
+RdmaHw::SetRtxNext(Ptr<RdmaQueuePair> qp, uint64_t seq)
+{
+    uint32_t i = qp->m_sacked.NextClear((seq - qp->snd_una) / m_mtu);
+    qp->m_rtxNext = qp->snd_una + (uint64_t)i * m_mtu;
+}
+
+void
+RdmaHw::QpComplete(Ptr<RdmaQueuePair> qp)
+{
+    NS_ASSERT(!m_qpCompleteCallback.IsNull());
+    m_cc.complete(*this, *qp);
+    Simulator::Cancel(qp->fluid.m_eventEnd);
+    if (m_fctSketch)
+        m_fctSketch->Update((Simulator::Now() - qp->startTime).GetNanoSeconds());
 
     // This callback will log info
     // It may also delete the rxQp on the receiver
     m_qpCompleteCallback(qp);
 
-    qp->m_notifyAppFinish();
+    if (!qp->m_notifyAppFinish.IsNull())
+        qp->m_notifyAppFinish();
 
     // delete the qp
     DeleteQueuePair(qp);
@@ -858,13 +1241,16 @@ RdmaHw::RedistributeQp()
 Ptr<Packet>
 RdmaHw::GetNxtPacket(Ptr<RdmaQueuePair> qp)
 {
-    uint64_t payload_size = qp->GetBytesLeft();
+    // selective repeat sends the lost packets first
+    bool rtx = qp->HasRetransmission();
+    uint64_t seq = rtx ? qp->m_rtxNext : qp->snd_nxt;
+    uint64_t payload_size = rtx ? qp->m_size - seq : qp->GetBytesLeft();
     if ((uint64_t)m_mtu < payload_size)
         payload_size = m_mtu;
     Ptr<Packet> p = Create<Packet>((uint32_t)payload_size);
     // add SimpleSeqTsHeader
     SimpleSeqTsHeader seqTs;
-    seqTs.SetSeq(qp->snd_nxt);
+    seqTs.SetSeq(seq);
     seqTs.SetPG(qp->m_pg);
     p->AddHeader(seqTs);
     // add udp header
@@ -892,7 +1278,10 @@ RdmaHw::GetNxtPacket(Ptr<RdmaQueuePair> qp)
     p->AddHeader(ppp);
 
     // update state
-    qp->snd_nxt += payload_size;
+    if (rtx)
+        SetRtxNext(qp, seq + m_mtu);
+    else
+        qp->snd_nxt += payload_size;
     // std::cout << "current snd_nxt is: " << qp->snd_nxt << ", the window is: " << qp->m_win <<
     // std::endl;
     qp->m_ipid++;
@@ -906,6 +1295,8 @@ RdmaHw::PktSent(Ptr<RdmaQueuePair> qp, Ptr<Packet> pkt, Time interframeGap)
 {
     qp->lastPktSize = pkt->GetSize();
     UpdateNextAvail(qp, interframeGap, pkt->GetSize());
+    if (m_fluidMode)
+        FluidCheck(qp);
 }
 
 void
@@ -926,13 +1317,282 @@ RdmaHw::ChangeRate(Ptr<RdmaQueuePair> qp, DataRate new_rate)
     Time sendingTime = qp->m_rate.CalculateBytesTxTime(qp->lastPktSize);
     Time new_sendintTime = new_rate.CalculateBytesTxTime(qp->lastPktSize);
     qp->m_nextAvail = qp->m_nextAvail + new_sendintTime - sendingTime;
+    // change to new rate, before the NIC rechecks a train of the qp against it
+    qp->m_rate = new_rate;
     // update nic's next avail event
     uint32_t nic_idx = GetNicIdxOfQp(qp);
+    m_nic[nic_idx].dev->GetRdmaQueue()->Activate(qp);
     m_nic[nic_idx].dev->UpdateNextAvail(qp->m_nextAvail);
 #endif
 
-    // change to new rate
-    qp->m_rate = new_rate;
+    FluidRateChanged(qp);
+}
+
+/******************************
+ * Fluid fast-forward
+ *****************************/
+static Ptr<RdmaHw>
+GetRdmaHwOfIp(Ipv4Address ip)
+{
+    Ptr<RdmaDriver> driver = NodeList::GetNode(ip_to_node_id(ip))->GetObject<RdmaDriver>();
+    return driver == nullptr ? nullptr : driver->m_rdma;
+}
+
+void
+RdmaHw::FluidCheck(Ptr<RdmaQueuePair> qp)
+{
+    if (qp->fluid.m_active || (m_cc_mode != 1 && m_cc_mode != 3) || qp->m_baseRtt == 0 ||
+        qp->nvls_enable || qp->InRecovery())
+        return;
+    Time now = Simulator::Now();
+    DataRate rate = m_rateBound ? qp->m_rate : qp->m_max_rate;
+
+    // an epoch sends at the rate, so the window must neither bind now nor over
+    // the bytes in flight at the rate during a base RTT
+    uint64_t win = qp->GetWin();
+    if (win != 0 &&
+        (qp->IsWinBound() || win * 8 < rate.GetBitRate() * 1e-9 * qp->m_baseRtt))
+        return;
+
+    // the CC state has converged once the rate stays within tolerance for a while
+    double last = qp->fluid.m_lastRate.GetBitRate();
+    if (last == 0 || std::fabs(rate.GetBitRate() - last) > m_fluidRateTolerance * last)
+    {
+        qp->fluid.m_lastRate = rate;
+        qp->fluid.m_stableSince = now;
+        return;
+    }
+    if (now < qp->fluid.m_resume || now - qp->fluid.m_stableSince < MicroSeconds(m_fluidStableTime))
+        return;
+
+    // the flows of the NIC must not contend for it
+    uint32_t nic_idx = GetNicIdxOfQp(qp);
+    Ptr<QbbNetDevice> dev = m_nic[nic_idx].dev;
+    Ptr<RdmaQueuePairGroup> grp = m_nic[nic_idx].qpGrp;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < grp->GetN(); i++)
+    {
+        Ptr<RdmaQueuePair> q = grp->Get(i);
+        if (q->GetBytesLeft() > 0 || q->fluid.m_active)
+            sum += m_rateBound ? q->m_rate.GetBitRate() : q->m_max_rate.GetBitRate();
+    }
+    if (sum > dev->GetDataRate().GetBitRate())
+        return;
+
+    // nothing to fast-forward once all bytes are sent
+    uint64_t left = qp->GetBytesLeft();
+    if (left == 0)
+        return;
+    // PktSent gets a larger gap for the later packets of a train, see QbbNetDevice
+    Time interframeGap = dev->GetInterframeGap();
+    // the packet just sent may be a short retransmission, so the packet time is the
+    // one of a full packet with the headers of GetNxtPacket
+    uint32_t hdr = PppHeader().GetSerializedSize() + Ipv4Header().GetSerializedSize() +
+                   UdpHeader().GetSerializedSize() + SimpleSeqTsHeader::GetHeaderSize();
+    int64_t pktTime = (interframeGap + rate.CalculateBytesTxTime(m_mtu + hdr)).GetTimeStep();
+    uint64_t maxPkts = MicroSeconds(m_fluidEpoch).GetTimeStep() / pktTime;
+    uint64_t bytes;
+    int64_t duration;
+    if (left / m_mtu <= maxPkts)
+    { // the epoch finishes the flow, including a short last packet
+        bytes = left;
+        duration = left / m_mtu * pktTime;
+        if (left % m_mtu)
+        {
+            Time tail = interframeGap + rate.CalculateBytesTxTime(left % m_mtu + hdr);
+            duration += tail.GetTimeStep();
+        }
+    }
+    else
+    {
+        bytes = maxPkts * m_mtu;
+        duration = maxPkts * pktTime;
+    }
+    // shorter epochs do not pay off, and the receiver update relies on it
+    if (duration < (int64_t)NanoSeconds(qp->m_baseRtt).GetTimeStep())
+        return;
+    Ptr<RdmaHw> rx = GetRdmaHwOfIp(qp->dip);
+    if (rx == nullptr)
+        return;
+
+    // start the epoch at the next send slot; snd_nxt is reserved up front so
+    // that the NIC never sends the bytes covered by the epoch
+    qp->fluid.m_active = true;
+    qp->fluid.m_start = qp->m_nextAvail;
+    qp->fluid.m_pktTime = TimeStep(pktTime);
+    qp->fluid.m_startSeq = qp->snd_nxt;
+    qp->fluid.m_bytes = bytes;
+    qp->snd_nxt += bytes;
+    qp->m_ipid += (bytes + m_mtu - 1) / m_mtu;
+    qp->m_nextAvail = qp->fluid.m_start + TimeStep(duration);
+    qp->fluid.m_eventEnd =
+        Simulator::Schedule(qp->m_nextAvail - now, &RdmaHw::FluidEpochEnd, this, qp);
+    m_fluidEpochs++;
+
+    // let the receiver watch for other flows; half of the base RTT is not
+    // shorter than the path delay, which is also the lookahead under MTP
+    FluidRxEntry e;
+    e.sender = this;
+    e.qpKey = GetQpKey(qp->dip.Get(), qp->sport, qp->m_pg);
+    e.delay = NanoSeconds(qp->m_baseRtt / 2);
+    uint64_t rxKey = ((uint64_t)qp->sip.Get() << 32) | ((uint64_t)qp->m_pg << 16) | qp->sport;
+    Simulator::ScheduleWithContext(rx->m_node->GetId(),
+                                   e.delay,
+                                   &RdmaHw::FluidRxStart,
+                                   rx,
+                                   rxKey,
+                                   e);
+}
+
+uint64_t
+RdmaHw::FluidPackets(Ptr<RdmaQueuePair> qp, Time t)
+{
+    uint64_t total = (qp->fluid.m_bytes + m_mtu - 1) / m_mtu;
+    if (t < qp->fluid.m_start)
+        return 0;
+    uint64_t n = (t - qp->fluid.m_start).GetTimeStep() / qp->fluid.m_pktTime.GetTimeStep() + 1;
+    return std::min(n, total);
+}
+
+void
+RdmaHw::FluidEpochEnd(Ptr<RdmaQueuePair> qp)
+{
+    FluidFinish(qp, (qp->fluid.m_bytes + m_mtu - 1) / m_mtu);
+}
+
+void
+RdmaHw::FluidAbort(Ptr<RdmaQueuePair> qp)
+{
+    if (!qp->fluid.m_active)
+        return;
+    Simulator::Cancel(qp->fluid.m_eventEnd);
+    // packets that started before now are on the wire, the others are sent for real
+    uint64_t pkts = FluidPackets(qp, Simulator::Now());
+    if (pkts * m_mtu < qp->fluid.m_bytes)
+    {
+        qp->snd_nxt = qp->fluid.m_startSeq + pkts * m_mtu;
+        qp->m_nextAvail = qp->fluid.m_start + TimeStep(pkts * qp->fluid.m_pktTime.GetTimeStep());
+        m_nic[GetNicIdxOfQp(qp)].dev->UpdateNextAvail(qp->m_nextAvail);
+    }
+    FluidFinish(qp, pkts);
+}
+
+void
+RdmaHw::FluidAbortQp(uint64_t key)
+{
+    auto it = m_qpMap.find(key);
+    if (it != m_qpMap.end())
+    {
+        it->second->fluid.m_stableSince = Simulator::Now();
+        FluidAbort(it->second);
+    }
+}
+
+void
+RdmaHw::FluidCongestion(uint32_t nic_idx)
+{
+    Ptr<RdmaQueuePairGroup> grp = m_nic[nic_idx].qpGrp;
+    for (uint32_t i = 0; i < grp->GetN(); i++)
+    {
+        Ptr<RdmaQueuePair> qp = grp->Get(i);
+        qp->fluid.m_stableSince = Simulator::Now();
+        FluidAbort(qp);
+    }
+}
+
+void
+RdmaHw::FluidRateChanged(Ptr<RdmaQueuePair> qp)
+{
+    // a moving rate ends the fluid epoch
+    double last = qp->fluid.m_lastRate.GetBitRate();
+    if (qp->fluid.m_active &&
+        std::fabs(qp->m_rate.GetBitRate() - last) > m_fluidRateTolerance * last)
+    {
+        qp->fluid.m_stableSince = Simulator::Now();
+        FluidAbort(qp);
+    }
+}
+
+void
+RdmaHw::FluidFinish(Ptr<RdmaQueuePair> qp, uint64_t pkts)
+{
+    Time now = Simulator::Now();
+    Time baseRtt = NanoSeconds(qp->m_baseRtt);
+    uint64_t seq = qp->fluid.m_startSeq + std::min(pkts * m_mtu, qp->fluid.m_bytes);
+    qp->fluid.m_active = false;
+    qp->fluid.m_resume = now + baseRtt;
+    m_fluidBytes += seq - qp->fluid.m_startSeq;
+
+    // the receiver has got everything before the first resumed packet arrives
+    Ptr<RdmaHw> rx = GetRdmaHwOfIp(qp->dip);
+    if (rx != nullptr)
+    {
+        Simulator::ScheduleWithContext(rx->m_node->GetId(),
+                                       NanoSeconds(qp->m_baseRtt / 2),
+                                       &RdmaHw::FluidRxEnd,
+                                       rx,
+                                       qp->dip.Get(),
+                                       qp->sip.Get(),
+                                       qp->dport,
+                                       qp->sport,
+                                       qp->m_pg,
+                                       seq);
+    }
+    if (pkts == 0)
+        return;
+    SendComplete(qp);
+
+    // ACKs of the packets that would have been sent one base RTT ago are back
+    // already, the last one comes back one base RTT after its packet
+    Time lastAck =
+        qp->fluid.m_start + TimeStep((pkts - 1) * qp->fluid.m_pktTime.GetTimeStep()) + baseRtt;
+    if (lastAck <= now)
+    {
+        FluidAck(qp, seq);
+        return;
+    }
+    uint64_t acked = FluidPackets(qp, now - baseRtt);
+    if (acked > 0)
+        FluidAck(qp, qp->fluid.m_startSeq + std::min(acked * m_mtu, qp->fluid.m_bytes));
+    Simulator::Schedule(lastAck - now, &RdmaHw::FluidAck, this, qp, seq);
+}
+
+void
+RdmaHw::FluidAck(Ptr<RdmaQueuePair> qp, uint64_t seq)
+{
+    if (qp->IsFinished())
+        return; // completed by a real ACK
+    qp->Acknowledge(seq);
+    if (!qp->m_messages.empty())
+        MessageComplete(qp);
+    if (qp->IsFinished())
+    {
+        QpComplete(qp);
+        return;
+    }
+    Ptr<QbbNetDevice> dev = m_nic[GetNicIdxOfQp(qp)].dev;
+    dev->GetRdmaQueue()->Activate(qp);
+    dev->TriggerTransmit();
+}
+
+void
+RdmaHw::FluidRxStart(uint64_t rxKey, FluidRxEntry e)
+{
+    m_fluidRx[rxKey] = e;
+}
+
+void
+RdmaHw::FluidRxEnd(uint32_t sip,
+                   uint32_t dip,
+                   uint16_t sport,
+                   uint16_t dport,
+                   uint16_t pg,
+                   uint64_t seq)
+{
+    m_fluidRx.erase(((uint64_t)dip << 32) | ((uint64_t)pg << 16) | (uint64_t)dport);
+    Ptr<RdmaRxQueuePair> rxQp = GetRxQp(sip, dip, sport, dport, pg, false);
+    if (rxQp != nullptr && rxQp->ReceiverNextExpectedSeq < seq)
+        rxQp->ReceiverNextExpectedSeq = seq;
 }
 
 /**
@@ -1037,60 +1697,77 @@ RdmaHw::PrintQPCnpNumber(FILE* cnp_output)
 void
 RdmaHw::UpdateAlphaMlx(Ptr<RdmaQueuePair> q)
 {
+    MlxCcState& mlx = q->Cc<MlxCcState>();
 #if PRINT_LOG
 // printf("%lu alpha update: %08x %08x %u %u %.6lf->", Simulator::Now().GetTimeStep(), q->sip.Get(),
-// q->dip.Get(), q->sport, q->dport, q->mlx.m_alpha);
+// q->dip.Get(), q->sport, q->dport, mlx.m_alpha);
 #endif
-    if (q->mlx.m_alpha_cnp_arrived)
+    if (mlx.m_alpha_cnp_arrived)
     {
-        q->mlx.m_alpha = (1 - m_g) * q->mlx.m_alpha + m_g; // binary feedback
+        mlx.m_alpha = (1 - m_g) * mlx.m_alpha + m_g; // binary feedback
     }
     else
     {
-        q->mlx.m_alpha = (1 - m_g) * q->mlx.m_alpha; // binary feedback
+        mlx.m_alpha = (1 - m_g) * mlx.m_alpha; // binary feedback
     }
 #if PRINT_LOG
-// printf("%.6lf\n", q->mlx.m_alpha);
+// printf("%.6lf\n", mlx.m_alpha);
 #endif
-    q->mlx.m_alpha_cnp_arrived = false; // clear the CNP_arrived bit
+    mlx.m_alpha_cnp_arrived = false; // clear the CNP_arrived bit
     ScheduleUpdateAlphaMlx(q);
 }
 
 void
 RdmaHw::ScheduleUpdateAlphaMlx(Ptr<RdmaQueuePair> q)
 {
-    q->mlx.m_eventUpdateAlpha = Simulator::Schedule(MicroSeconds(m_alpha_resume_interval),
-                                                    &RdmaHw::UpdateAlphaMlx,
-                                                    this,
-                                                    q);
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    mlx.m_eventUpdateAlpha = Simulator::Schedule(MicroSeconds(m_alpha_resume_interval),
+                                               &RdmaHw::UpdateAlphaMlx,
+                                               this,
+                                               q);
 }
 
 void
 RdmaHw::cnp_received_mlx(Ptr<RdmaQueuePair> q)
 {
-    q->mlx.m_alpha_cnp_arrived = true;    // set CNP_arrived bit for alpha update
-    q->mlx.m_decrease_cnp_arrived = true; // set CNP_arrived bit for rate decrease
-    if (q->mlx.m_first_cnp)
+    if (m_dcqcnLazy)
+    {
+        CnpReceivedLazyMlx(q);
+        return;
+    }
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    mlx.m_alpha_cnp_arrived = true;    // set CNP_arrived bit for alpha update
+    mlx.m_decrease_cnp_arrived = true; // set CNP_arrived bit for rate decrease
+    if (mlx.m_first_cnp)
     {
         // init alpha
-        q->mlx.m_alpha = 1;
-        q->mlx.m_alpha_cnp_arrived = false;
+        mlx.m_alpha = 1;
+        mlx.m_alpha_cnp_arrived = false;
         // schedule alpha update
         ScheduleUpdateAlphaMlx(q);
         // schedule rate decrease
         ScheduleDecreaseRateMlx(q, 1); // add 1 ns to make sure rate decrease is after alpha update
         // set rate on first CNP
         double bps = m_rateOnFirstCNP * q->m_rate.GetBitRate();
-        q->mlx.m_targetRate = q->m_rate = DataRate((uint64_t)bps);
-        q->mlx.m_first_cnp = false;
+        mlx.m_targetRate = q->m_rate = DataRate((uint64_t)bps);
+        mlx.m_first_cnp = false;
+        RateChangedMlx(q);
     }
 }
 
 void
 RdmaHw::CheckRateDecreaseMlx(Ptr<RdmaQueuePair> q)
 {
-    ScheduleDecreaseRateMlx(q, 0);
-    if (q->mlx.m_decrease_cnp_arrived)
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    if (m_dcqcnLazy)
+    {
+        // the decrease checks are 1ns off the alpha update slots
+        UpdateAlphaLazyMlx(q, Simulator::Now(), false);
+        mlx.m_decreaseNext = Simulator::Now() + MicroSeconds(m_rateDecreaseInterval);
+    }
+    else
+        ScheduleDecreaseRateMlx(q, 0);
+    if (mlx.m_decrease_cnp_arrived)
     {
 #if PRINT_LOG
         printf("%lu rate dec: %08x %08x %u %u (%0.3lf %.3lf)->",
@@ -1099,29 +1776,30 @@ RdmaHw::CheckRateDecreaseMlx(Ptr<RdmaQueuePair> q)
                q->dip.Get(),
                q->sport,
                q->dport,
-               q->mlx.m_targetRate.GetBitRate() * 1e-9,
+               mlx.m_targetRate.GetBitRate() * 1e-9,
                q->m_rate.GetBitRate() * 1e-9);
 #endif
         bool clamp = true;
         if (!m_EcnClampTgtRate)
         {
-            if (q->mlx.m_rpTimeStage == 0)
+            if (mlx.m_rpTimeStage == 0)
                 clamp = false;
         }
         if (clamp)
-            q->mlx.m_targetRate = q->m_rate;
-        q->m_rate = std::max(m_minRate, q->m_rate * (1 - q->mlx.m_alpha / 2));
+            mlx.m_targetRate = q->m_rate;
+        q->m_rate = std::max(m_minRate, q->m_rate * (1 - mlx.m_alpha / 2));
         // reset rate increase related things
-        q->mlx.m_rpTimeStage = 0;
-        q->mlx.m_decrease_cnp_arrived = false;
-        Simulator::Cancel(q->mlx.m_rpTimer);
-        q->mlx.m_rpTimer = Simulator::Schedule(MicroSeconds(m_rpgTimeReset),
-                                               &RdmaHw::RateIncEventTimerMlx,
-                                               this,
-                                               q);
+        mlx.m_rpTimeStage = 0;
+        mlx.m_decrease_cnp_arrived = false;
+        Simulator::Cancel(mlx.m_rpTimer);
+        mlx.m_rpTimer = Simulator::Schedule(MicroSeconds(m_rpgTimeReset),
+                                          &RdmaHw::RateIncEventTimerMlx,
+                                          this,
+                                          q);
+        RateChangedMlx(q);
 #if PRINT_LOG
         printf("(%.3lf %.3lf)\n",
-               q->mlx.m_targetRate.GetBitRate() * 1e-9,
+               mlx.m_targetRate.GetBitRate() * 1e-9,
                q->m_rate.GetBitRate() * 1e-9);
 #endif
     }
@@ -1130,7 +1808,8 @@ RdmaHw::CheckRateDecreaseMlx(Ptr<RdmaQueuePair> q)
 void
 RdmaHw::ScheduleDecreaseRateMlx(Ptr<RdmaQueuePair> q, uint32_t delta)
 {
-    q->mlx.m_eventDecreaseRate =
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    mlx.m_eventDecreaseRate =
         Simulator::Schedule(MicroSeconds(m_rateDecreaseInterval) + NanoSeconds(delta),
                             &RdmaHw::CheckRateDecreaseMlx,
                             this,
@@ -1140,21 +1819,28 @@ RdmaHw::ScheduleDecreaseRateMlx(Ptr<RdmaQueuePair> q, uint32_t delta)
 void
 RdmaHw::RateIncEventTimerMlx(Ptr<RdmaQueuePair> q)
 {
-    q->mlx.m_rpTimer =
+    if (m_dcqcnLazy)
+    {
+        RateIncEventTimerLazyMlx(q);
+        return;
+    }
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    mlx.m_rpTimer =
         Simulator::Schedule(MicroSeconds(m_rpgTimeReset), &RdmaHw::RateIncEventTimerMlx, this, q);
     RateIncEventMlx(q);
-    q->mlx.m_rpTimeStage++;
+    mlx.m_rpTimeStage++;
 }
 
 void
 RdmaHw::RateIncEventMlx(Ptr<RdmaQueuePair> q)
 {
+    MlxCcState& mlx = q->Cc<MlxCcState>();
     // check which increase phase: fast recovery, active increase, hyper increase
-    if (q->mlx.m_rpTimeStage < m_rpgThreshold)
+    if (mlx.m_rpTimeStage < m_rpgThreshold)
     { // fast recovery
         FastRecoveryMlx(q);
     }
-    else if (q->mlx.m_rpTimeStage == m_rpgThreshold)
+    else if (mlx.m_rpTimeStage == m_rpgThreshold)
     { // active increase
         ActiveIncreaseMlx(q);
     }
@@ -1162,11 +1848,13 @@ RdmaHw::RateIncEventMlx(Ptr<RdmaQueuePair> q)
     { // hyper increase
         HyperIncreaseMlx(q);
     }
+    RateChangedMlx(q);
 }
 
 void
 RdmaHw::FastRecoveryMlx(Ptr<RdmaQueuePair> q)
 {
+    MlxCcState& mlx = q->Cc<MlxCcState>();
 #if PRINT_LOG
     printf("%lu fast recovery: %08x %08x %u %u (%0.3lf %.3lf)->",
            Simulator::Now().GetTimeStep(),
@@ -1174,14 +1862,14 @@ RdmaHw::FastRecoveryMlx(Ptr<RdmaQueuePair> q)
            q->dip.Get(),
            q->sport,
            q->dport,
-           q->mlx.m_targetRate.GetBitRate() * 1e-9,
+           mlx.m_targetRate.GetBitRate() * 1e-9,
            q->m_rate.GetBitRate() * 1e-9);
 #endif
-    double bps = (q->m_rate.GetBitRate() / 2) + (q->mlx.m_targetRate.GetBitRate() / 2);
+    double bps = (q->m_rate.GetBitRate() / 2) + (mlx.m_targetRate.GetBitRate() / 2);
     q->m_rate = DataRate((uint64_t)bps);
 #if PRINT_LOG
     printf("(%.3lf %.3lf)\n",
-           q->mlx.m_targetRate.GetBitRate() * 1e-9,
+           mlx.m_targetRate.GetBitRate() * 1e-9,
            q->m_rate.GetBitRate() * 1e-9);
 #endif
 }
@@ -1189,6 +1877,7 @@ RdmaHw::FastRecoveryMlx(Ptr<RdmaQueuePair> q)
 void
 RdmaHw::ActiveIncreaseMlx(Ptr<RdmaQueuePair> q)
 {
+    MlxCcState& mlx = q->Cc<MlxCcState>();
 #if PRINT_LOG
     printf("%lu active inc: %08x %08x %u %u (%0.3lf %.3lf)->",
            Simulator::Now().GetTimeStep(),
@@ -1196,21 +1885,21 @@ RdmaHw::ActiveIncreaseMlx(Ptr<RdmaQueuePair> q)
            q->dip.Get(),
            q->sport,
            q->dport,
-           q->mlx.m_targetRate.GetBitRate() * 1e-9,
+           mlx.m_targetRate.GetBitRate() * 1e-9,
            q->m_rate.GetBitRate() * 1e-9);
 #endif
     // get NIC
     uint32_t nic_idx = GetNicIdxOfQp(q);
     Ptr<QbbNetDevice> dev = m_nic[nic_idx].dev;
     // increate rate
-    q->mlx.m_targetRate += m_rai;
-    if (q->mlx.m_targetRate > dev->GetDataRate())
-        q->mlx.m_targetRate = dev->GetDataRate();
-    double bps = (q->m_rate.GetBitRate() / 2) + (q->mlx.m_targetRate.GetBitRate() / 2);
+    mlx.m_targetRate += m_rai;
+    if (mlx.m_targetRate > dev->GetDataRate())
+        mlx.m_targetRate = dev->GetDataRate();
+    double bps = (q->m_rate.GetBitRate() / 2) + (mlx.m_targetRate.GetBitRate() / 2);
     q->m_rate = DataRate((uint64_t)bps);
 #if PRINT_LOG
     printf("(%.3lf %.3lf)\n",
-           q->mlx.m_targetRate.GetBitRate() * 1e-9,
+           mlx.m_targetRate.GetBitRate() * 1e-9,
            q->m_rate.GetBitRate() * 1e-9);
 #endif
 }
@@ -1218,6 +1907,7 @@ RdmaHw::ActiveIncreaseMlx(Ptr<RdmaQueuePair> q)
 void
 RdmaHw::HyperIncreaseMlx(Ptr<RdmaQueuePair> q)
 {
+    MlxCcState& mlx = q->Cc<MlxCcState>();
 #if PRINT_LOG
     printf("%lu hyper inc: %08x %08x %u %u (%0.3lf %.3lf)->",
            Simulator::Now().GetTimeStep(),
@@ -1225,34 +1915,140 @@ RdmaHw::HyperIncreaseMlx(Ptr<RdmaQueuePair> q)
            q->dip.Get(),
            q->sport,
            q->dport,
-           q->mlx.m_targetRate.GetBitRate() * 1e-9,
+           mlx.m_targetRate.GetBitRate() * 1e-9,
            q->m_rate.GetBitRate() * 1e-9);
 #endif
     // get NIC
     uint32_t nic_idx = GetNicIdxOfQp(q);
     Ptr<QbbNetDevice> dev = m_nic[nic_idx].dev;
     // increate rate
-    q->mlx.m_targetRate += m_rhai;
-    if (q->mlx.m_targetRate > dev->GetDataRate())
-        q->mlx.m_targetRate = dev->GetDataRate();
-    double bps = (q->m_rate.GetBitRate() / 2) + (q->mlx.m_targetRate.GetBitRate() / 2);
+    mlx.m_targetRate += m_rhai;
+    if (mlx.m_targetRate > dev->GetDataRate())
+        mlx.m_targetRate = dev->GetDataRate();
+    double bps = (q->m_rate.GetBitRate() / 2) + (mlx.m_targetRate.GetBitRate() / 2);
     q->m_rate = DataRate((uint64_t)bps);
 #if PRINT_LOG
     printf("(%.3lf %.3lf)\n",
-           q->mlx.m_targetRate.GetBitRate() * 1e-9,
+           mlx.m_targetRate.GetBitRate() * 1e-9,
            q->m_rate.GetBitRate() * 1e-9);
 #endif
 }
 
+void
+RdmaHw::RateChangedMlx(Ptr<RdmaQueuePair> q)
+{
+    m_nic[GetNicIdxOfQp(q)].dev->RateChanged();
+    FluidRateChanged(q);
+}
+
+/******************************
+ * DCQCN with lazy timers
+ *****************************/
+void
+RdmaHw::UpdateAlphaLazyMlx(Ptr<RdmaQueuePair> q, Time t, bool inclusive)
+{
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    Time step = MicroSeconds(m_alpha_resume_interval);
+    while (mlx.m_alphaNext < t || (inclusive && mlx.m_alphaNext == t))
+    {
+        if (mlx.m_alpha_cnp_arrived)
+            mlx.m_alpha = (1 - m_g) * mlx.m_alpha + m_g;
+        else
+            mlx.m_alpha = (1 - m_g) * mlx.m_alpha;
+        mlx.m_alpha_cnp_arrived = false;
+        mlx.m_alphaNext += step;
+        if (mlx.m_alpha == 0 && mlx.m_alphaNext < t)
+        {
+            // alpha stays 0 until the next CNP, skip the remaining slots
+            int64_t n = (t - mlx.m_alphaNext).GetTimeStep() / step.GetTimeStep();
+            mlx.m_alphaNext += TimeStep(n * step.GetTimeStep());
+        }
+    }
+}
+
+void
+RdmaHw::CnpReceivedLazyMlx(Ptr<RdmaQueuePair> q)
+{
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    Time now = Simulator::Now();
+    if (mlx.m_first_cnp)
+    {
+        // same as the first CNP with timers, the timers are started on the grid
+        mlx.m_alpha = 1;
+        mlx.m_alpha_cnp_arrived = false;
+        mlx.m_decrease_cnp_arrived = true;
+        mlx.m_alphaNext = now + MicroSeconds(m_alpha_resume_interval);
+        mlx.m_decreaseNext = now + MicroSeconds(m_rateDecreaseInterval) + NanoSeconds(1);
+        mlx.m_eventDecreaseRate =
+            Simulator::Schedule(mlx.m_decreaseNext - now, &RdmaHw::CheckRateDecreaseMlx, this, q);
+        double bps = m_rateOnFirstCNP * q->m_rate.GetBitRate();
+        mlx.m_targetRate = q->m_rate = DataRate((uint64_t)bps);
+        mlx.m_first_cnp = false;
+        RateChangedMlx(q);
+        return;
+    }
+
+    // timers expiring now run before the CNP
+    if (mlx.m_eventDecreaseRate.IsPending() && mlx.m_decreaseNext == now)
+    {
+        Simulator::Cancel(mlx.m_eventDecreaseRate);
+        CheckRateDecreaseMlx(q);
+    }
+    UpdateAlphaLazyMlx(q, now, true);
+    mlx.m_alpha_cnp_arrived = true;
+    mlx.m_decrease_cnp_arrived = true;
+    if (!mlx.m_eventDecreaseRate.IsPending())
+    {
+        // the checks since the last decrease found no CNP, wake up at the next one
+        Time step = MicroSeconds(m_rateDecreaseInterval);
+        if (mlx.m_decreaseNext <= now)
+        {
+            int64_t n = (now - mlx.m_decreaseNext).GetTimeStep() / step.GetTimeStep() + 1;
+            mlx.m_decreaseNext += TimeStep(n * step.GetTimeStep());
+        }
+        mlx.m_eventDecreaseRate =
+            Simulator::Schedule(mlx.m_decreaseNext - now, &RdmaHw::CheckRateDecreaseMlx, this, q);
+    }
+}
+
+void
+RdmaHw::RateIncEventTimerLazyMlx(Ptr<RdmaQueuePair> q)
+{
+    MlxCcState& mlx = q->Cc<MlxCcState>();
+    // with timers, a rate decrease check of the same time runs first if it was
+    // scheduled first, and then cancels this increase
+    if (m_rpgTimeReset <= m_rateDecreaseInterval && mlx.m_eventDecreaseRate.IsPending() &&
+        mlx.m_decreaseNext == Simulator::Now())
+    {
+        Simulator::Cancel(mlx.m_eventDecreaseRate);
+        CheckRateDecreaseMlx(q);
+        return;
+    }
+    DataRate rate = q->m_rate;
+    DataRate targetRate = mlx.m_targetRate;
+    bool hyper = mlx.m_rpTimeStage > m_rpgThreshold;
+    RateIncEventMlx(q);
+    mlx.m_rpTimeStage++;
+    // once a hyper increase changes nothing, neither do the next ones
+    if (!hyper || q->m_rate != rate || mlx.m_targetRate != targetRate)
+    {
+        mlx.m_rpTimer = Simulator::Schedule(MicroSeconds(m_rpgTimeReset),
+                                          &RdmaHw::RateIncEventTimerMlx,
+                                          this,
+                                          q);
+    }
+}
+
 /***********************
  * High Precision CC
  ***********************/
 void
 RdmaHw::HandleAckHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 {
+    HpCcState& hp = qp->Cc<HpCcState>();
     uint64_t ack_seq = ch.ack.seq;
     // update rate
-    if (ack_seq > qp->hp.m_lastUpdateSeq)
+    if (ack_seq > hp.m_lastUpdateSeq)
     { // if full RTT feedback is ready, do full update
         UpdateRateHp(qp, p, ch, false);
     }
@@ -1265,18 +2061,19 @@ RdmaHw::HandleAckHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 void
 RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool fast_react)
 {
+    HpCcState& hp = qp->Cc<HpCcState>();
     uint64_t next_seq = qp->snd_nxt;
 #if PRINT_LOG
     bool print = !fast_react || true;
 #endif
-    if (qp->hp.m_lastUpdateSeq == 0)
+    if (hp.m_lastUpdateSeq == 0)
     { // first RTT
-        qp->hp.m_lastUpdateSeq = next_seq;
+        hp.m_lastUpdateSeq = next_seq;
         // store INT
         IntHeader& ih = ch.ack.ih;
         NS_ASSERT(ih.IntHeader_t.nhop <= IntHeader::maxHop);
         for (uint32_t i = 0; i < ih.IntHeader_t.nhop; i++)
-            qp->hp.hop[i] = ih.IntHeader_t.hop[i];
+            hp.hop[i] = ih.IntHeader_t.hop[i];
 #if PRINT_LOG
         if (print)
         {
@@ -1287,7 +2084,7 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                    qp->dip.Get(),
                    qp->sport,
                    qp->dport,
-                   qp->hp.m_lastUpdateSeq,
+                   hp.m_lastUpdateSeq,
                    ch.ack.seq,
                    next_seq);
             for (uint32_t i = 0; i < ih.nhop; i++)
@@ -1316,65 +2113,49 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                        qp->dip.Get(),
                        qp->sport,
                        qp->dport,
-                       qp->hp.m_lastUpdateSeq,
+                       hp.m_lastUpdateSeq,
                        ch.ack.seq,
                        next_seq);
 #endif
-            // check each hop
-            double U = 0;
-            uint64_t dt = 0;
-            bool updated[IntHeader::maxHop] = {false}, updated_any = false;
-            NS_ASSERT(ih.IntHeader_t.nhop <= IntHeader::maxHop);
+            // check each hop: the utilization of all hops at once, then the
+            // per hop state of the updated ones
+            HpIntBatch batch;
+            batch.Load(ih, hp.hop, m_sampleFeedback && fast_react);
+            batch.Compute(qp->m_max_rate.GetBitRate(), qp->m_win);
+            double U = batch.maxU;
+            uint64_t dt = batch.maxTau;
+            const uint8_t* updated = batch.updated;
+            bool updated_any = batch.anyUpdated;
             for (uint32_t i = 0; i < ih.IntHeader_t.nhop; i++)
             {
-                if (m_sampleFeedback)
-                {
-                    if (ih.IntHeader_t.hop[i].GetQlen() == 0 && fast_react)
-                        continue;
-                }
-                updated[i] = updated_any = true;
+                if (!updated[i])
+                    continue;
 #if PRINT_LOG
                 if (print)
                     printf(" %u(%u) %lu(%lu) %lu(%lu)",
                            ih.hop[i].GetQlen(),
-                           qp->hp.hop[i].GetQlen(),
+                           hp.hop[i].GetQlen(),
                            ih.hop[i].GetBytes(),
-                           qp->hp.hop[i].GetBytes(),
+                           hp.hop[i].GetBytes(),
                            ih.hop[i].GetTime(),
-                           qp->hp.hop[i].GetTime());
+                           hp.hop[i].GetTime());
 #endif
-                uint64_t tau = ih.IntHeader_t.hop[i].GetTimeDelta(qp->hp.hop[i]);
-                ;
-                double duration = tau * 1e-9;
-                double txRate = (ih.IntHeader_t.hop[i].GetBytesDelta(qp->hp.hop[i])) * 8 / duration;
-                double u =
-                    txRate / ih.IntHeader_t.hop[i].GetLineRate() +
-                    (double)std::min(ih.IntHeader_t.hop[i].GetQlen(), qp->hp.hop[i].GetQlen()) *
-                        qp->m_max_rate.GetBitRate() / ih.IntHeader_t.hop[i].GetLineRate() /
-                        qp->m_win;
+                double u = batch.u[i];
 #if PRINT_LOG
                 if (print)
-                    printf(" %.3lf %.3lf", txRate, u);
+                    printf(" %.3lf", u);
 #endif
-                if (!m_multipleRate)
-                {
-                    // for aggregate (single R)
-                    if (u > U)
-                    {
-                        U = u;
-                        dt = tau;
-                    }
-                }
-                else
+                if (m_multipleRate)
                 {
                     // for per hop (per hop R)
+                    uint64_t tau = batch.tau[i];
                     if (tau > qp->m_baseRtt)
                         tau = qp->m_baseRtt;
-                    qp->hp.hopState[i].u =
-                        (qp->hp.hopState[i].u * (qp->m_baseRtt - tau) + u * tau) /
+                    hp.hopState[i].u =
+                        (hp.hopState[i].u * (qp->m_baseRtt - tau) + u * tau) /
                         double(qp->m_baseRtt);
                 }
-                qp->hp.hop[i] = ih.IntHeader_t.hop[i];
+                hp.hop[i] = ih.IntHeader_t.hop[i];
             }
 
             DataRate new_rate;
@@ -1388,19 +2169,19 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                 {
                     if (dt > qp->m_baseRtt)
                         dt = qp->m_baseRtt;
-                    qp->hp.u = (qp->hp.u * (qp->m_baseRtt - dt) + U * dt) / double(qp->m_baseRtt);
-                    max_c = qp->hp.u / m_targetUtil;
+                    hp.u = (hp.u * (qp->m_baseRtt - dt) + U * dt) / double(qp->m_baseRtt);
+                    max_c = hp.u / m_targetUtil;
 
-                    if (max_c >= 1 || qp->hp.m_incStage >= m_miThresh)
+                    if (max_c >= 1 || hp.m_incStage >= m_miThresh)
                     {
-                        double bps = qp->hp.m_curRate.GetBitRate() / max_c + m_rai.GetBitRate();
+                        double bps = hp.m_curRate.GetBitRate() / max_c + m_rai.GetBitRate();
                         new_rate = DataRate((uint64_t)bps);
                         new_incStage = 0;
                     }
                     else
                     {
-                        new_rate = qp->hp.m_curRate + m_rai;
-                        new_incStage = qp->hp.m_incStage + 1;
+                        new_rate = hp.m_curRate + m_rai;
+                        new_incStage = hp.m_incStage + 1;
                     }
                     if (new_rate < m_minRate)
                         new_rate = m_minRate;
@@ -1408,12 +2189,12 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                         new_rate = qp->m_max_rate;
 #if PRINT_LOG
                     if (print)
-                        printf(" u=%.6lf U=%.3lf dt=%u max_c=%.3lf", qp->hp.u, U, dt, max_c);
+                        printf(" u=%.6lf U=%.3lf dt=%u max_c=%.3lf", hp.u, U, dt, max_c);
 #endif
 #if PRINT_LOG
                     if (print)
                         printf(" rate:%.3lf->%.3lf\n",
-                               qp->hp.m_curRate.GetBitRate() * 1e-9,
+                               hp.m_curRate.GetBitRate() * 1e-9,
                                new_rate.GetBitRate() * 1e-9);
 #endif
                 }
@@ -1426,18 +2207,17 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                 {
                     if (updated[i])
                     {
-                        double c = qp->hp.hopState[i].u / m_targetUtil;
-                        if (c >= 1 || qp->hp.hopState[i].incStage >= m_miThresh)
+                        double c = hp.hopState[i].u / m_targetUtil;
+                        if (c >= 1 || hp.hopState[i].incStage >= m_miThresh)
                         {
-                            double bps =
-                                qp->hp.hopState[i].Rc.GetBitRate() / c + m_rai.GetBitRate();
+                            double bps = hp.hopState[i].Rc.GetBitRate() / c + m_rai.GetBitRate();
                             new_rate_per_hop[i] = DataRate((uint64_t)bps);
                             new_incStage_per_hop[i] = 0;
                         }
                         else
                         {
-                            new_rate_per_hop[i] = qp->hp.hopState[i].Rc + m_rai;
-                            new_incStage_per_hop[i] = qp->hp.hopState[i].incStage + 1;
+                            new_rate_per_hop[i] = hp.hopState[i].Rc + m_rai;
+                            new_incStage_per_hop[i] = hp.hopState[i].incStage + 1;
                         }
                         // bound rate
                         if (new_rate_per_hop[i] < m_minRate)
@@ -1449,19 +2229,19 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                             new_rate = new_rate_per_hop[i];
 #if PRINT_LOG
                         if (print)
-                            printf(" [%u]u=%.6lf c=%.3lf", i, qp->hp.hopState[i].u, c);
+                            printf(" [%u]u=%.6lf c=%.3lf", i, hp.hopState[i].u, c);
 #endif
 #if PRINT_LOG
                         if (print)
                             printf(" %.3lf->%.3lf",
-                                   qp->hp.hopState[i].Rc.GetBitRate() * 1e-9,
+                                   hp.hopState[i].Rc.GetBitRate() * 1e-9,
                                    new_rate.GetBitRate() * 1e-9);
 #endif
                     }
                     else
                     {
-                        if (qp->hp.hopState[i].Rc < new_rate)
-                            new_rate = qp->hp.hopState[i].Rc;
+                        if (hp.hopState[i].Rc < new_rate)
+                            new_rate = hp.hopState[i].Rc;
                     }
                 }
 #if PRINT_LOG
@@ -1474,8 +2254,8 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
             {
                 if (updated_any)
                 {
-                    qp->hp.m_curRate = new_rate;
-                    qp->hp.m_incStage = new_incStage;
+                    hp.m_curRate = new_rate;
+                    hp.m_incStage = new_incStage;
                 }
                 if (m_multipleRate)
                 {
@@ -1484,8 +2264,8 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
                     {
                         if (updated[i])
                         {
-                            qp->hp.hopState[i].Rc = new_rate_per_hop[i];
-                            qp->hp.hopState[i].incStage = new_incStage_per_hop[i];
+                            hp.hopState[i].Rc = new_rate_per_hop[i];
+                            hp.hopState[i].incStage = new_incStage_per_hop[i];
                         }
                     }
                 }
@@ -1493,8 +2273,8 @@ RdmaHw::UpdateRateHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, boo
         }
         if (!fast_react)
         {
-            if (next_seq > qp->hp.m_lastUpdateSeq)
-                qp->hp.m_lastUpdateSeq = next_seq; //+ rand() % 2 * m_mtu;
+            if (next_seq > hp.m_lastUpdateSeq)
+                hp.m_lastUpdateSeq = next_seq; //+ rand() % 2 * m_mtu;
         }
     }
 }
@@ -1512,9 +2292,10 @@ RdmaHw::FastReactHp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 void
 RdmaHw::HandleAckTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 {
+    TimelyCcState& tmly = qp->Cc<TimelyCcState>();
     uint64_t ack_seq = ch.ack.seq;
     // update rate
-    if (ack_seq > qp->tmly.m_lastUpdateSeq)
+    if (ack_seq > tmly.m_lastUpdateSeq)
     { // if full RTT feedback is ready, do full update
         UpdateRateTimely(qp, p, ch, false);
     }
@@ -1527,15 +2308,16 @@ RdmaHw::HandleAckTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 void
 RdmaHw::UpdateRateTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool us)
 {
+    TimelyCcState& tmly = qp->Cc<TimelyCcState>();
     uint64_t next_seq = qp->snd_nxt;
     uint64_t rtt = Simulator::Now().GetTimeStep() - ch.ack.ih.ts;
 #if PRINT_LOG
     bool print = !us;
 #endif
-    if (qp->tmly.m_lastUpdateSeq != 0)
+    if (tmly.m_lastUpdateSeq != 0)
     { // not first RTT
-        int64_t new_rtt_diff = (int64_t)rtt - (int64_t)qp->tmly.lastRtt;
-        double rtt_diff = (1 - m_tmly_alpha) * qp->tmly.rttDiff + m_tmly_alpha * new_rtt_diff;
+        int64_t new_rtt_diff = (int64_t)rtt - (int64_t)tmly.lastRtt;
+        double rtt_diff = (1 - m_tmly_alpha) * tmly.rttDiff + m_tmly_alpha * new_rtt_diff;
         double gradient = rtt_diff / m_tmly_minRtt;
         bool inc = false;
         double c = 0;
@@ -1547,7 +2329,7 @@ RdmaHw::UpdateRateTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch,
                    rtt,
                    rtt_diff,
                    gradient,
-                   qp->tmly.m_curRate.GetBitRate() * 1e-9);
+                   tmly.m_curRate.GetBitRate() * 1e-9);
 #endif
         if (rtt < m_tmly_TLow)
         {
@@ -1571,31 +2353,31 @@ RdmaHw::UpdateRateTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch,
         }
         if (inc)
         {
-            if (qp->tmly.m_incStage < 5)
+            if (tmly.m_incStage < 5)
             {
-                qp->m_rate = qp->tmly.m_curRate + m_rai;
+                qp->m_rate = tmly.m_curRate + m_rai;
             }
             else
             {
-                qp->m_rate = qp->tmly.m_curRate + m_rhai;
+                qp->m_rate = tmly.m_curRate + m_rhai;
             }
             if (qp->m_rate > qp->m_max_rate)
                 qp->m_rate = qp->m_max_rate;
             if (!us)
             {
-                qp->tmly.m_curRate = qp->m_rate;
-                qp->tmly.m_incStage++;
-                qp->tmly.rttDiff = rtt_diff;
+                tmly.m_curRate = qp->m_rate;
+                tmly.m_incStage++;
+                tmly.rttDiff = rtt_diff;
             }
         }
         else
         {
-            qp->m_rate = std::max(m_minRate, qp->tmly.m_curRate * c);
+            qp->m_rate = std::max(m_minRate, tmly.m_curRate * c);
             if (!us)
             {
-                qp->tmly.m_curRate = qp->m_rate;
-                qp->tmly.m_incStage = 0;
-                qp->tmly.rttDiff = rtt_diff;
+                tmly.m_curRate = qp->m_rate;
+                tmly.m_incStage = 0;
+                tmly.rttDiff = rtt_diff;
             }
         }
 #if PRINT_LOG
@@ -1605,11 +2387,11 @@ RdmaHw::UpdateRateTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch,
         }
 #endif
     }
-    if (!us && next_seq > qp->tmly.m_lastUpdateSeq)
+    if (!us && next_seq > tmly.m_lastUpdateSeq)
     {
-        qp->tmly.m_lastUpdateSeq = next_seq;
+        tmly.m_lastUpdateSeq = next_seq;
         // update
-        qp->tmly.lastRtt = rtt;
+        tmly.lastRtt = rtt;
     }
 }
 
@@ -1624,13 +2406,14 @@ RdmaHw::FastReactTimely(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 void
 RdmaHw::HandleAckDctcp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 {
+    DctcpCcState& dctcp = qp->Cc<DctcpCcState>();
     uint64_t ack_seq = ch.ack.seq;
     uint8_t cnp = (ch.ack.flags >> qbbHeader::FLAG_CNP) & 1;
     bool new_batch = false;
 
     // update alpha
-    qp->dctcp.m_ecnCnt += (cnp > 0);
-    if (ack_seq > qp->dctcp.m_lastUpdateSeq)
+    dctcp.m_ecnCnt += (cnp > 0);
+    if (ack_seq > dctcp.m_lastUpdateSeq)
     { // if full RTT feedback is ready, do alpha update
 #if PRINT_LOG
         printf("%lu %s %08x %08x %u %u [%u,%u,%u] %.3lf->",
@@ -1640,26 +2423,26 @@ RdmaHw::HandleAckDctcp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
                qp->dip.Get(),
                qp->sport,
                qp->dport,
-               qp->dctcp.m_lastUpdateSeq,
+               dctcp.m_lastUpdateSeq,
                ch.ack.seq,
                qp->snd_nxt,
-               qp->dctcp.m_alpha);
+               dctcp.m_alpha);
 #endif
         new_batch = true;
-        if (qp->dctcp.m_lastUpdateSeq == 0)
+        if (dctcp.m_lastUpdateSeq == 0)
         { // first RTT
-            qp->dctcp.m_lastUpdateSeq = qp->snd_nxt;
-            qp->dctcp.m_batchSizeOfAlpha = qp->snd_nxt / m_mtu + 1;
+            dctcp.m_lastUpdateSeq = qp->snd_nxt;
+            dctcp.m_batchSizeOfAlpha = qp->snd_nxt / m_mtu + 1;
         }
         else
         {
-            double frac = std::min(1.0, double(qp->dctcp.m_ecnCnt) / qp->dctcp.m_batchSizeOfAlpha);
-            qp->dctcp.m_alpha = (1 - m_g) * qp->dctcp.m_alpha + m_g * frac;
-            qp->dctcp.m_lastUpdateSeq = qp->snd_nxt;
-            qp->dctcp.m_ecnCnt = 0;
-            qp->dctcp.m_batchSizeOfAlpha = (qp->snd_nxt - ack_seq) / m_mtu + 1;
+            double frac = std::min(1.0, double(dctcp.m_ecnCnt) / dctcp.m_batchSizeOfAlpha);
+            dctcp.m_alpha = (1 - m_g) * dctcp.m_alpha + m_g * frac;
+            dctcp.m_lastUpdateSeq = qp->snd_nxt;
+            dctcp.m_ecnCnt = 0;
+            dctcp.m_batchSizeOfAlpha = (qp->snd_nxt - ack_seq) / m_mtu + 1;
 #if PRINT_LOG
-            printf("%.3lf F:%.3lf", qp->dctcp.m_alpha, frac);
+            printf("%.3lf F:%.3lf", dctcp.m_alpha, frac);
 #endif
         }
 #if PRINT_LOG
@@ -1668,14 +2451,14 @@ RdmaHw::HandleAckDctcp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
     }
 
     // check cwr exit
-    if (qp->dctcp.m_caState == 1)
+    if (dctcp.m_caState == 1)
     {
-        if (ack_seq > qp->dctcp.m_highSeq)
-            qp->dctcp.m_caState = 0;
+        if (ack_seq > dctcp.m_highSeq)
+            dctcp.m_caState = 0;
     }
 
     // check if need to reduce rate: ECN and not in CWR
-    if (cnp && qp->dctcp.m_caState == 0)
+    if (cnp && dctcp.m_caState == 0)
     {
 #if PRINT_LOG
         printf("%lu %s %08x %08x %u %u %.3lf->",
@@ -1687,16 +2470,16 @@ RdmaHw::HandleAckDctcp(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
                qp->dport,
                qp->m_rate.GetBitRate() * 1e-9);
 #endif
-        qp->m_rate = std::max(m_minRate, qp->m_rate * (1 - qp->dctcp.m_alpha / 2));
+        qp->m_rate = std::max(m_minRate, qp->m_rate * (1 - dctcp.m_alpha / 2));
 #if PRINT_LOG
         printf("%.3lf\n", qp->m_rate.GetBitRate() * 1e-9);
 #endif
-        qp->dctcp.m_caState = 1;
-        qp->dctcp.m_highSeq = qp->snd_nxt;
+        dctcp.m_caState = 1;
+        dctcp.m_highSeq = qp->snd_nxt;
     }
 
     // additive inc
-    if (qp->dctcp.m_caState == 0 && new_batch)
+    if (dctcp.m_caState == 0 && new_batch)
         qp->m_rate = std::min(qp->m_max_rate, qp->m_rate + m_dctcp_rai);
 }
 
@@ -1712,11 +2495,12 @@ RdmaHw::SetPintSmplThresh(double p)
 void
 RdmaHw::HandleAckHpPint(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 {
+    HpccPintCcState& hpccPint = qp->Cc<HpccPintCcState>();
     uint64_t ack_seq = ch.ack.seq;
     if ((uint32_t)rand() % 65536 >= pint_smpl_thresh)
         return;
     // update rate
-    if (ack_seq > qp->hpccPint.m_lastUpdateSeq)
+    if (ack_seq > hpccPint.m_lastUpdateSeq)
     { // if full RTT feedback is ready, do full update
         UpdateRateHpPint(qp, p, ch, false);
     }
@@ -1729,10 +2513,11 @@ RdmaHw::HandleAckHpPint(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch)
 void
 RdmaHw::UpdateRateHpPint(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool fast_react)
 {
+    HpccPintCcState& hpccPint = qp->Cc<HpccPintCcState>();
     uint64_t next_seq = qp->snd_nxt;
-    if (qp->hpccPint.m_lastUpdateSeq == 0)
+    if (hpccPint.m_lastUpdateSeq == 0)
     { // first RTT
-        qp->hpccPint.m_lastUpdateSeq = next_seq;
+        hpccPint.m_lastUpdateSeq = next_seq;
     }
     else
     {
@@ -1744,16 +2529,16 @@ RdmaHw::UpdateRateHpPint(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch,
         int32_t new_incStage = 0;
         double max_c = U / m_targetUtil;
 
-        if (max_c >= 1 || qp->hpccPint.m_incStage >= m_miThresh)
+        if (max_c >= 1 || hpccPint.m_incStage >= m_miThresh)
         {
-            double bps = qp->hpccPint.m_curRate.GetBitRate() / max_c + m_rai.GetBitRate();
+            double bps = hpccPint.m_curRate.GetBitRate() / max_c + m_rai.GetBitRate();
             new_rate = DataRate((uint64_t)bps);
             new_incStage = 0;
         }
         else
         {
-            new_rate = qp->hpccPint.m_curRate + m_rai;
-            new_incStage = qp->hpccPint.m_incStage + 1;
+            new_rate = hpccPint.m_curRate + m_rai;
+            new_incStage = hpccPint.m_incStage + 1;
         }
         if (new_rate < m_minRate)
             new_rate = m_minRate;
@@ -1762,13 +2547,13 @@ RdmaHw::UpdateRateHpPint(Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch,
         ChangeRate(qp, new_rate);
         if (!fast_react)
         {
-            qp->hpccPint.m_curRate = new_rate;
-            qp->hpccPint.m_incStage = new_incStage;
+            hpccPint.m_curRate = new_rate;
+            hpccPint.m_incStage = new_incStage;
         }
         if (!fast_react)
         {
-            if (next_seq > qp->hpccPint.m_lastUpdateSeq)
-                qp->hpccPint.m_lastUpdateSeq = next_seq; //+ rand() % 2 * m_mtu;
+            if (next_seq > hpccPint.m_lastUpdateSeq)
+                hpccPint.m_lastUpdateSeq = next_seq; //+ rand() % 2 * m_mtu;
         }
     }
 }
@@ -6,10 +6,13 @@
 
 #include <ns3/custom-header.h>
 #include <ns3/node.h>
+#include <ns3/quantile-sketch.h>
 #include <ns3/rdma-queue-pair.h>
 #include <ns3/rdma.h>
 
+#include <memory>
 #include <set>
+#include <type_traits>
 #include <unordered_map>
 
 namespace ns3
@@ -33,6 +36,56 @@ struct RdmaInterfaceMgr
     }
 };
 
+class RdmaHw;
+
+// A congestion control algorithm, as a policy class of static hooks which
+// derives from RdmaCcPolicy and redefines what it uses:
+//   State       the qp state block, derived from RdmaCcState
+//   SetRate     set the rates of a qp to the line rate
+//   OnAck       an ACK or NACK of a qp, after the sequence and CNP accounting
+//   OnComplete  a qp completes
+// RdmaCcOps::Of<Cc>() turns it into the hooks an RdmaHw calls, selected once
+// by its CcMode; RdmaHw::RegisterCc adds a CcMode.
+struct RdmaCcPolicy
+{
+    typedef RdmaCcState State; // no state
+
+    static void SetRate(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate)
+    {
+    }
+
+    static void OnAck(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp)
+    {
+    }
+
+    static void OnComplete(RdmaHw& hw, RdmaQueuePair& qp)
+    {
+    }
+};
+
+struct RdmaCcOps
+{
+    void (*init)(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate); // allocate the state, SetRate
+    void (*setRate)(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate);
+    void (*ack)(RdmaHw& hw, Ptr<RdmaQueuePair> qp, Ptr<Packet> p, CustomHeader& ch, bool cnp);
+    void (*complete)(RdmaHw& hw, RdmaQueuePair& qp);
+
+    template <class Cc>
+    static RdmaCcOps Of()
+    {
+        RdmaCcOps ops;
+        ops.init = [](RdmaHw& hw, RdmaQueuePair& qp, DataRate rate) {
+            if constexpr (!std::is_same_v<typename Cc::State, RdmaCcState>)
+                qp.m_cc = std::make_unique<typename Cc::State>();
+            Cc::SetRate(hw, qp, rate);
+        };
+        ops.setRate = &Cc::SetRate;
+        ops.ack = &Cc::OnAck;
+        ops.complete = &Cc::OnComplete;
+        return ops;
+    }
+};
+
 class RdmaHw : public Object
 {
   public:
@@ -43,9 +96,14 @@ class RdmaHw : public Object
     DataRate m_minRate; //< Min sending rate
     uint32_t m_mtu;
     uint32_t m_cc_mode;
+    RdmaCcOps m_cc; // congestion control of the CcMode
     double m_nack_interval;
     uint32_t m_chunk;
     uint32_t m_ack_interval;
+    double m_ackCoalesceInterval; // us, 0 sends the ACKs decided by ReceiverCheckSeq at once
+    uint32_t m_ackCoalesceBytes;
+    bool m_ackMergeQueued;
+    bool m_selectiveRepeat;
     bool m_backto0;
     bool m_var_win, m_fast_react;
     bool m_rateBound;
@@ -69,8 +127,11 @@ class RdmaHw : public Object
     QpCompleteCallback m_qpCompleteCallback;
     typedef Callback<void, Ptr<RdmaQueuePair>> SendCompleteCallback;
     SendCompleteCallback m_sendCompleteCallback;
+    typedef Callback<void, Ptr<RdmaQueuePair>, const RdmaMessage&> MessageCompleteCallback;
+    MessageCompleteCallback m_messageCompleteCallback;
 
     // for monitor
+    Ptr<QuantileSketchCalculator> m_fctSketch; // FCT (ns) of the completed qps, if set
     std::vector<uint64_t> tx_bytes;                // <port_id, tx_bytes>
     std::unordered_map<uint64_t, uint32_t> qp_cnp; // key of qp ---> received cnp number
     std::vector<uint64_t> last_tx_bytes;           // last sampling value <port_id, tx_bytes>
@@ -89,9 +150,15 @@ class RdmaHw : public Object
     void add_nvswitch(uint32_t nvswitch_id);
 
     void SetNode(Ptr<Node> node);
-    void Setup(
-        QpCompleteCallback cb,
-        SendCompleteCallback send_cb); // setup shared data and callbacks with the QbbNetDevice
+    void SetCcMode(uint32_t mode);
+    uint32_t GetCcMode() const;
+    // set the congestion control of a CcMode, before the RdmaHws with this mode
+    // are created; unknown modes run without congestion control
+    static void RegisterCc(uint32_t mode, RdmaCcOps ops);
+    void Setup(QpCompleteCallback cb,
+               SendCompleteCallback send_cb,
+               MessageCompleteCallback message_cb); // setup shared data and callbacks with the
+                                                    // QbbNetDevice
     static uint64_t GetQpKey(uint32_t dip,
                              uint16_t sport,
                              uint16_t pg); // get the lookup key for m_qpMap
@@ -110,6 +177,37 @@ class RdmaHw : public Object
                       uint64_t baseRtt,
                       Callback<void> notifyAppFinish,
                       Callback<void> notifyAppSent); // add a new qp (new send)
+    /**
+     * Open a persistent qp, which sends the messages posted on it with
+     * PostMessage.  Its CC state is kept across messages, and it stays open
+     * until CloseQueuePair, even when it has nothing to send.
+     * notifyAppFinish is called when the qp completes after CloseQueuePair.
+     */
+    Ptr<RdmaQueuePair> CreateQueuePair(uint32_t src,
+                                       uint32_t dest,
+                                       uint64_t tag,
+                                       uint16_t pg,
+                                       Ipv4Address _sip,
+                                       Ipv4Address _dip,
+                                       uint16_t _sport,
+                                       uint16_t _dport,
+                                       uint32_t win,
+                                       uint64_t baseRtt,
+                                       Callback<void> notifyAppFinish);
+    /**
+     * Post a message on a persistent qp, sent after the messages posted
+     * before it.  notifyComplete is called, and the message completion
+     * callback of Setup, when the last byte of the message is acknowledged.
+     * \return the id of the message on the qp
+     */
+    uint64_t PostMessage(Ptr<RdmaQueuePair> qp,
+                         RdmaMessage::Verb verb,
+                         uint64_t size,
+                         Callback<void> notifyComplete);
+    /// Close a persistent qp: it completes once its messages are acknowledged
+    void CloseQueuePair(Ptr<RdmaQueuePair> qp);
+    // assign a new qp to its NIC and initialize its rate and CC state
+    void InstallQueuePair(Ptr<RdmaQueuePair> qp);
     void DeleteQueuePair(Ptr<RdmaQueuePair> qp);
 
     Ptr<RdmaRxQueuePair> GetRxQp(uint32_t sip,
@@ -136,11 +234,27 @@ class RdmaHw : public Object
 
     void CheckandSendQCN(Ptr<RdmaRxQueuePair> q);
     int ReceiverCheckSeq(uint64_t seq, Ptr<RdmaRxQueuePair> q, uint32_t size);
+    /**
+     * Send the ACK (0xFC) or NACK (0xFD) of ReceiverNextExpectedSeq of a rx qp,
+     * with the feedback aggregated since its last ACK.  With sack, the NACK
+     * SACKs the packet of that seq instead, see SelectiveRepeat.
+     */
+    void SendAck(Ptr<RdmaRxQueuePair> q, uint8_t l3Prot, uint64_t sack = 0);
     void AddHeader(Ptr<Packet> p, uint16_t protocolNumber);
     static uint16_t EtherToPpp(uint16_t protocol);
 
     void RecoverQueue(Ptr<RdmaQueuePair> qp);
+    /**
+     * Selective repeat: process a cumulative ACK, or the SACK of a packet
+     * received out of order.  The packets not SACKed below the highest SACK
+     * are lost, GetNxtPacket retransmits them before new data.
+     */
+    void SelectiveAcknowledge(Ptr<RdmaQueuePair> qp, uint64_t seq, bool sack);
+    /// Set m_rtxNext to the first packet not SACKed from seq on
+    void SetRtxNext(Ptr<RdmaQueuePair> qp, uint64_t seq);
     void QpComplete(Ptr<RdmaQueuePair> qp);
+    /// Complete the messages of a qp acknowledged up to snd_una
+    void MessageComplete(Ptr<RdmaQueuePair> qp);
     void SetLinkDown(Ptr<QbbNetDevice> dev);
 
     int SendPacketComplete(Ptr<Packet> p, CustomHeader& ch);
@@ -155,6 +269,58 @@ class RdmaHw : public Object
     void PktSent(Ptr<RdmaQueuePair> qp, Ptr<Packet> pkt, Time interframeGap);
     void UpdateNextAvail(Ptr<RdmaQueuePair> qp, Time interframeGap, uint32_t pkt_size);
     void ChangeRate(Ptr<RdmaQueuePair> qp, DataRate new_rate);
+
+    /******************************
+     * Fluid fast-forward
+     *****************************/
+    // With FluidMode on, a QP whose rate (DCQCN mlx or HPCC) has stayed within
+    // FluidRateTolerance for FluidStableTime without any congestion signal stops
+    // emitting packets for up to FluidEpoch: snd_nxt jumps over the bytes the
+    // paced packets would have carried, the receiver's expected seq and the
+    // sender's snd_una are advanced at the times the last packet would arrive
+    // and be acknowledged, and packet-level sending resumes afterwards for at
+    // least one base RTT so that the CC loop sees real feedback again.
+    //
+    // An epoch ends early, at the packet boundary, when a CNP or an INT queue
+    // length of at least FluidQueueThreshold is seen on the NIC, when a new QP
+    // starts on the NIC, or when data of another flow reaches the receiver.
+    // Without such an event the FCT equals the packet-level one, up to the ACK
+    // granularity of L2AckInterval. Contention that only appears on a switch
+    // link in the middle of the path is seen when packets resume, so each such
+    // change adds at most FluidEpoch to the FCT error of a flow. PFC pauses
+    // during an epoch are not modelled; keep the threshold below the ECN kmin
+    // so that an epoch never starts with a queue that can trigger them.
+    bool m_fluidMode;
+    double m_fluidEpoch;             // max length of an epoch (us)
+    double m_fluidStableTime;        // how long the CC state must be stable (us)
+    double m_fluidRateTolerance;     // relative rate change that counts as moving
+    uint32_t m_fluidQueueThreshold;  // INT queue length (bytes) that counts as congestion
+    uint64_t m_fluidEpochs;          // for monitor
+    uint64_t m_fluidBytes;           // for monitor
+
+    // receiver side view of a running epoch
+    struct FluidRxEntry
+    {
+        Ptr<RdmaHw> sender;
+        uint64_t qpKey; // key of the qp in the sender's m_qpMap
+        Time delay;     // half of the base RTT
+    };
+
+    std::unordered_map<uint64_t, FluidRxEntry> m_fluidRx; // rx qp key ---> running epoch
+
+    void FluidCheck(Ptr<RdmaQueuePair> qp); // start an epoch if possible
+    void FluidEpochEnd(Ptr<RdmaQueuePair> qp);
+    void FluidAbort(Ptr<RdmaQueuePair> qp); // end an epoch at the next packet boundary
+    void FluidAbortQp(uint64_t key);        // FluidAbort by m_qpMap key, sent by the receiver
+    void FluidCongestion(uint32_t nic_idx); // congestion signal or new qp on a NIC
+    void FluidRateChanged(Ptr<RdmaQueuePair> qp); // end the epoch of a qp whose rate moved
+    void FluidFinish(Ptr<RdmaQueuePair> qp, uint64_t pkts);
+    void FluidAck(Ptr<RdmaQueuePair> qp, uint64_t seq);
+    uint64_t FluidPackets(Ptr<RdmaQueuePair> qp, Time t); // epoch packets started by time t
+    void FluidRxStart(uint64_t rxKey, FluidRxEntry e);
+    void FluidRxEnd(uint32_t sip, uint32_t dip, uint16_t sport, uint16_t dport, uint16_t pg,
+                    uint64_t seq);
+
     /******************************
      * Mellanox's version of DCQCN
      *****************************/
@@ -167,6 +333,7 @@ class RdmaHw : public Object
     double m_alpha_resume_interval;
     DataRate m_rai;  //< Rate of additive increase
     DataRate m_rhai; //< Rate of hyper-additive increase
+    bool m_dcqcnLazy;
 
     // the Mellanox's version of alpha update:
     // every fixed time slot, update alpha.
@@ -188,6 +355,21 @@ class RdmaHw : public Object
     void FastRecoveryMlx(Ptr<RdmaQueuePair> q);
     void ActiveIncreaseMlx(Ptr<RdmaQueuePair> q);
     void HyperIncreaseMlx(Ptr<RdmaQueuePair> q);
+    // the rates are set without ChangeRate: the NIC rechecks a train of the qp,
+    // see QbbNetDevice::RateChanged, and a fluid epoch of the qp ends
+    void RateChangedMlx(Ptr<RdmaQueuePair> q);
+
+    // DCQCN with lazy timers (DcqcnLazyTimers): the same state changes at the
+    // same times, without the events that change nothing. The alpha update
+    // slots are replayed (UpdateAlphaLazyMlx) when a CNP arrives or the rate
+    // decreases, since nothing else reads alpha; the rate decrease check is only
+    // scheduled, on its grid, when a CNP has arrived since the last decrease;
+    // the rate increase timer stops once a hyper increase leaves the rate and
+    // the target rate unchanged, until the next decrease restarts it. Timers
+    // expiring at the time of a CNP are taken to run before it.
+    void UpdateAlphaLazyMlx(Ptr<RdmaQueuePair> q, Time t, bool inclusive); // slots before t
+    void CnpReceivedLazyMlx(Ptr<RdmaQueuePair> q);
+    void RateIncEventTimerLazyMlx(Ptr<RdmaQueuePair> q);
 
     /***********************
      * High Precision CC
@@ -8,9 +8,76 @@
 #include <ns3/udp-header.h>
 #include <ns3/uinteger.h>
 
+#include <algorithm>
+
 namespace ns3
 {
 
+/**************************
+ * RdmaPacketBitmap
+ *************************/
+bool
+RdmaPacketBitmap::Test(uint32_t i) const
+{
+    return i / 64 < m_words.size() && (m_words[i / 64] >> (i % 64) & 1);
+}
+
+void
+RdmaPacketBitmap::Set(uint32_t i)
+{
+    if (i / 64 >= m_words.size())
+        m_words.resize(i / 64 + 1, 0);
+    m_words[i / 64] |= 1ULL << (i % 64);
+}
+
+void
+RdmaPacketBitmap::Shift(uint64_t k)
+{
+    if (k >= m_words.size() * 64)
+    {
+        m_words.clear();
+        return;
+    }
+    uint32_t w = k / 64;
+    uint32_t b = k % 64;
+    uint32_t n = m_words.size() - w;
+    for (uint32_t j = 0; j < n; j++)
+    {
+        uint64_t hi = (j + w + 1 < m_words.size() && b) ? m_words[j + w + 1] << (64 - b) : 0;
+        m_words[j] = (m_words[j + w] >> b) | hi;
+    }
+    m_words.resize(n);
+    while (!m_words.empty() && m_words.back() == 0)
+        m_words.pop_back();
+}
+
+uint32_t
+RdmaPacketBitmap::NextClear(uint32_t i) const
+{
+    for (uint32_t j = i / 64; j < m_words.size(); j++)
+    {
+        // the clear bits of the word from i on
+        uint64_t clear = ~m_words[j];
+        if (j == i / 64)
+            clear &= ~0ULL << (i % 64);
+        if (clear)
+            return j * 64 + __builtin_ctzll(clear);
+    }
+    return std::max<uint32_t>(i, m_words.size() * 64);
+}
+
+bool
+RdmaPacketBitmap::IsEmpty() const
+{
+    return m_words.empty();
+}
+
+void
+RdmaPacketBitmap::Clear()
+{
+    m_words.clear();
+}
+
 /**************************
  * RdmaQueuePair
  *************************/
@@ -46,37 +113,17 @@ RdmaQueuePair::RdmaQueuePair(uint16_t pg,
     m_var_win = false;
     m_rate = 0;
     m_nextAvail = Time(0);
-    mlx.m_alpha = 1;
-    mlx.m_alpha_cnp_arrived = false;
-    mlx.m_first_cnp = true;
-    mlx.m_decrease_cnp_arrived = false;
-    mlx.m_rpTimeStage = 0;
-    hp.m_lastUpdateSeq = 0;
-    for (uint32_t i = 0; i < sizeof(hp.keep) / sizeof(hp.keep[0]); i++)
-        hp.keep[i] = 0;
-    hp.m_incStage = 0;
-    hp.m_lastGap = 0;
-    hp.u = 1;
-    for (uint32_t i = 0; i < IntHeader::maxHop; i++)
-    {
-        hp.hopState[i].u = 1;
-        hp.hopState[i].incStage = 0;
-    }
-
-    tmly.m_lastUpdateSeq = 0;
-    tmly.m_incStage = 0;
-    tmly.lastRtt = 0;
-    tmly.rttDiff = 0;
-
-    dctcp.m_lastUpdateSeq = 0;
-    dctcp.m_caState = 0;
-    dctcp.m_highSeq = 0;
-    dctcp.m_alpha = 1;
-    dctcp.m_ecnCnt = 0;
-    dctcp.m_batchSizeOfAlpha = 0;
-
-    hpccPint.m_lastUpdateSeq = 0;
-    hpccPint.m_incStage = 0;
+    fluid.m_active = false;
+    fluid.m_startSeq = 0;
+    fluid.m_bytes = 0;
+    fluid.m_lastRate = 0;
+    fluid.m_stableSince = Simulator::Now();
+    m_sackHigh = 0;
+    m_rtxNext = 0;
+    m_persistent = false;
+    m_nextMessageId = 0;
+    m_schedState = NIC_IDLE;
+    m_grpIdx = 0;
 }
 
 void
@@ -239,7 +286,7 @@ RdmaQueuePair::HpGetCurWin()
     uint64_t w;
     if (m_var_win)
     {
-        w = m_win * hp.m_curRate.GetBitRate() / m_max_rate.GetBitRate();
+        w = m_win * Cc<HpCcState>().m_curRate.GetBitRate() / m_max_rate.GetBitRate();
         if (w == 0)
             w = 1; // must > 0
     }
@@ -253,7 +300,19 @@ RdmaQueuePair::HpGetCurWin()
 bool
 RdmaQueuePair::IsFinished()
 {
-    return snd_una >= m_size;
+    return snd_una >= m_size && !m_persistent;
+}
+
+bool
+RdmaQueuePair::HasRetransmission()
+{
+    return m_rtxNext < m_sackHigh;
+}
+
+bool
+RdmaQueuePair::InRecovery()
+{
+    return m_sackHigh > snd_una;
 }
 
 /*********************
@@ -274,6 +333,12 @@ RdmaRxQueuePair::RdmaRxQueuePair()
     m_nackTimer = Time(0);
     m_milestone_rx = 0;
     m_lastNACK = 0;
+    m_ackedSeq = 0;
+    m_ackCnp = false;
+    m_ackTos = 0;
+    m_ackNic = 0;
+    m_ackTicket = 0;
+    m_receivedEnd = 0;
 }
 
 uint32_t
@@ -308,6 +373,7 @@ RdmaQueuePairGroup::GetTypeId(void)
 
 RdmaQueuePairGroup::RdmaQueuePairGroup(void)
 {
+    m_generation = 0;
 }
 
 uint32_t
@@ -331,6 +397,7 @@ RdmaQueuePairGroup::operator[](uint32_t idx)
 void
 RdmaQueuePairGroup::AddQp(Ptr<RdmaQueuePair> qp)
 {
+    qp->m_grpIdx = m_qps.size();
     m_qps.push_back(qp);
 }
 
@@ -344,6 +411,7 @@ void
 RdmaQueuePairGroup::Clear(void)
 {
     m_qps.clear();
+    m_generation++;
 }
 
 } // namespace ns3
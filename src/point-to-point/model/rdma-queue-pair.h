@@ -9,11 +9,120 @@
 #include <ns3/object.h>
 #include <ns3/packet.h>
 
+#include <deque>
+#include <memory>
 #include <vector>
 
 namespace ns3
 {
 
+// Congestion control state of a qp, one derived block per algorithm
+struct RdmaCcState
+{
+    virtual ~RdmaCcState() = default;
+};
+
+// Mellanox's version of DCQCN, CcMode 1
+struct MlxCcState : public RdmaCcState
+{
+    DataRate m_targetRate; //< Target rate
+    EventId m_eventUpdateAlpha;
+    double m_alpha = 1;
+    bool m_alpha_cnp_arrived = false; // indicate if CNP arrived in the last slot
+    bool m_first_cnp = true;          // indicate if the current CNP is the first CNP
+    EventId m_eventDecreaseRate;
+    bool m_decrease_cnp_arrived = false; // indicate if CNP arrived in the last slot
+    uint32_t m_rpTimeStage = 0;
+    EventId m_rpTimer;
+    Time m_alphaNext;    // next alpha update slot, with lazy timers
+    Time m_decreaseNext; // next rate decrease check, with lazy timers
+};
+
+// HPCC, CcMode 3
+struct HpCcState : public RdmaCcState
+{
+    uint64_t m_lastUpdateSeq = 0;
+    DataRate m_curRate;
+    IntHop hop[IntHeader::maxHop];
+    uint32_t keep[IntHeader::maxHop] = {};
+    uint32_t m_incStage = 0;
+    double m_lastGap = 0;
+    double u = 1;
+
+    struct
+    {
+        double u = 1;
+        DataRate Rc;
+        uint32_t incStage = 0;
+    } hopState[IntHeader::maxHop];
+};
+
+// TIMELY, CcMode 7
+struct TimelyCcState : public RdmaCcState
+{
+    uint64_t m_lastUpdateSeq = 0;
+    DataRate m_curRate;
+    uint32_t m_incStage = 0;
+    uint64_t lastRtt = 0;
+    double rttDiff = 0;
+};
+
+// DCTCP, CcMode 8
+struct DctcpCcState : public RdmaCcState
+{
+    uint64_t m_lastUpdateSeq = 0;
+    uint32_t m_caState = 0;
+    uint64_t m_highSeq = 0; // when to exit cwr
+    double m_alpha = 1;
+    uint32_t m_ecnCnt = 0;
+    uint32_t m_batchSizeOfAlpha = 0;
+};
+
+// HPCC-PINT, CcMode 10
+struct HpccPintCcState : public RdmaCcState
+{
+    uint64_t m_lastUpdateSeq = 0;
+    DataRate m_curRate;
+    uint32_t m_incStage = 0;
+};
+
+// A work request posted on a persistent qp, see RdmaHw::PostMessage.  Its
+// bytes follow those of the messages posted before it on the qp.
+struct RdmaMessage
+{
+    enum Verb
+    {
+        WRITE,
+        READ, // posted on the qp of the responder, which sends the data
+        SEND,
+    };
+
+    uint64_t id; // index of the message on its qp
+    Verb verb;
+    uint64_t size;
+    uint64_t end;   // seq after the last byte of the message
+    Time startTime; // when the message was posted
+    Callback<void> notifyComplete;
+};
+
+// Packets received from a base seq on, one bit per MTU, for selective repeat.
+// Bit i is the packet at base + i * mtu; the owner moves the base with Shift.
+class RdmaPacketBitmap
+{
+  public:
+    bool Test(uint32_t i) const;
+    void Set(uint32_t i);
+    // move the base k packets forward
+    void Shift(uint64_t k);
+    // index of the first clear bit from i on
+    uint32_t NextClear(uint32_t i) const;
+    bool IsEmpty() const;
+    void Clear();
+
+  private:
+    std::vector<uint64_t> m_words; // no trailing zero word
+};
+
 class RdmaQueuePair : public Object
 {
   public:
@@ -40,62 +149,44 @@ class RdmaQueuePair : public Object
     uint32_t nvls_enable;
     DataRate m_rate; //< Current rate
 
-    struct
-    {
-        DataRate m_targetRate; //< Target rate
-        EventId m_eventUpdateAlpha;
-        double m_alpha;
-        bool m_alpha_cnp_arrived; // indicate if CNP arrived in the last slot
-        bool m_first_cnp;         // indicate if the current CNP is the first CNP
-        EventId m_eventDecreaseRate;
-        bool m_decrease_cnp_arrived; // indicate if CNP arrived in the last slot
-        uint32_t m_rpTimeStage;
-        EventId m_rpTimer;
-    } mlx;
+    // selective repeat, see RdmaHw SelectiveRepeat
+    RdmaPacketBitmap m_sacked; // packets SACKed from snd_una on
+    uint64_t m_sackHigh;       // end of the highest packet SACKed
+    uint64_t m_rtxNext;        // next packet to retransmit, none if >= m_sackHigh
 
-    struct
-    {
-        uint64_t m_lastUpdateSeq;
-        DataRate m_curRate;
-        IntHop hop[IntHeader::maxHop];
-        uint32_t keep[IntHeader::maxHop];
-        uint32_t m_incStage;
-        double m_lastGap;
-        double u;
-
-        struct
-        {
-            double u;
-            DataRate Rc;
-            uint32_t incStage;
-        } hopState[IntHeader::maxHop];
-    } hp;
+    // persistent qp: it carries the messages posted on it and stays open,
+    // with its CC state, until RdmaHw::CloseQueuePair
+    bool m_persistent;
+    std::deque<RdmaMessage> m_messages; // not yet acknowledged, in order
+    uint64_t m_nextMessageId;
 
-    struct
+    // state of the qp in the PgScheduler of its NIC, see RdmaEgressQueue
+    enum
     {
-        uint64_t m_lastUpdateSeq;
-        DataRate m_curRate;
-        uint32_t m_incStage;
-        uint64_t lastRtt;
-        double rttDiff;
-    } tmly;
+        NIC_IDLE,   // nothing to send, out of the scheduler
+        NIC_ACTIVE, // in the list of its PG
+        NIC_PACING, // waiting for m_nextAvail
+        NIC_DONE,   // finished, left in the group until it is compacted
+    } m_schedState;
+    Time m_schedTime; // m_nextAvail when the qp started pacing
+    uint32_t m_grpIdx; // index of the qp in its RdmaQueuePairGroup
 
-    struct
-    {
-        uint64_t m_lastUpdateSeq;
-        uint32_t m_caState;
-        uint64_t m_highSeq; // when to exit cwr
-        double m_alpha;
-        uint32_t m_ecnCnt;
-        uint32_t m_batchSizeOfAlpha;
-    } dctcp;
+    // state of the congestion control of the qp: only the block of the CC mode
+    // of the RdmaHw is allocated, by RdmaHw::AddQueuePair (see RdmaCcOps)
+    std::unique_ptr<RdmaCcState> m_cc;
 
     struct
     {
-        uint64_t m_lastUpdateSeq;
-        DataRate m_curRate;
-        uint32_t m_incStage;
-    } hpccPint;
+        bool m_active;       // a fluid epoch is running, see RdmaHw::FluidCheck
+        Time m_start;        // send time of the first packet of the epoch
+        Time m_pktTime;      // time to send one full packet at the epoch rate
+        uint64_t m_startSeq; // snd_nxt when the epoch started
+        uint64_t m_bytes;    // bytes covered by the epoch
+        DataRate m_lastRate; // rate when the CC state was last seen moving
+        Time m_stableSince;  // last time the rate moved or congestion was seen
+        Time m_resume;       // no new epoch before this time
+        EventId m_eventEnd;
+    } fluid;
 
     /***********
      * methods
@@ -129,6 +220,15 @@ class RdmaQueuePair : public Object
     uint64_t GetWin(); // window size calculated from m_rate
     bool IsFinished();
     uint64_t HpGetCurWin(); // window size calculated from hp.m_curRate, used by HPCC
+    bool HasRetransmission(); // a lost packet waits to be sent again
+    bool InRecovery();        // packets are SACKed beyond snd_una
+
+    // the congestion control state, of the type allocated for the CC mode
+    template <class T>
+    T& Cc()
+    {
+        return static_cast<T&>(*m_cc);
+    }
 };
 
 class RdmaRxQueuePair : public Object
@@ -157,6 +257,20 @@ class RdmaRxQueuePair : public Object
     uint32_t m_lastNACK;
     EventId QcnTimerEvent; // if destroy this rxQp, remember to cancel this timer
 
+    // feedback of the next ACK, aggregated over the packets it acknowledges
+    uint64_t m_ackedSeq; // ReceiverNextExpectedSeq when the last ACK was sent
+    bool m_ackCnp;       // a packet since the last ACK was ECN marked
+    uint8_t m_ackTos;    // tos of the last packet
+    IntHeader m_ackIh;   // INT header of the last packet
+    EventId m_ackTimer;  // end of the ACK coalescing window
+    // selective repeat: packets received from ReceiverNextExpectedSeq on
+    RdmaPacketBitmap m_received;
+    uint64_t m_receivedEnd; // end of the highest packet received
+    // last ACK sent, merged with the next one while it is queued in the NIC
+    Ptr<Packet> m_ackPkt;
+    uint32_t m_ackNic;
+    uint32_t m_ackTicket; // see RdmaEgressQueue::GetHighPrioTicket
+
     static TypeId GetTypeId(void);
     RdmaRxQueuePair();
     uint32_t GetHash(void);
@@ -176,6 +290,8 @@ class RdmaQueuePairGroup : public Object
     void AddQp(Ptr<RdmaQueuePair> qp);
     // void AddRxQp(Ptr<RdmaRxQueuePair> rxQp);
     void Clear(void);
+
+    uint32_t m_generation; // incremented by Clear
 };
 
 } // namespace ns3
@@ -17,6 +17,9 @@ NS_LOG_COMPONENT_DEFINE("SwitchMmu");
 
 namespace ns3
 {
+NS_OBJECT_ENSURE_REGISTERED(SwitchMmu);
+NS_OBJECT_ENSURE_REGISTERED(MultiPoolSwitchMmu);
+
 TypeId
 SwitchMmu::GetTypeId(void)
 {
@@ -29,6 +32,8 @@ SwitchMmu::SwitchMmu(void)
     buffer_size = 12 * 1024 * 1024;
     reserve = 4 * 1024;
     resume_offset = 3 * 1024;
+    total_hdrm = 0;
+    total_rsrv = 0;
 
     // headroom
     shared_used_bytes = 0;
@@ -163,7 +168,7 @@ SwitchMmu::ShouldSendCN(uint32_t ifindex, uint32_t qIndex)
     {
         double p = pmax[ifindex] * double(egress_bytes[ifindex][qIndex] - kmin[ifindex]) /
                    (kmax[ifindex] - kmin[ifindex]);
-        if (UniformVariable(0, 1).GetValue() < p)
+        if (ecn_random.GetValue() < p)
             return true;
     }
     return false;
@@ -200,4 +205,176 @@ SwitchMmu::ConfigBufferSize(uint32_t size)
 {
     buffer_size = size;
 }
+
+TypeId
+MultiPoolSwitchMmu::GetTypeId(void)
+{
+    static TypeId tid = TypeId("ns3::MultiPoolSwitchMmu")
+                            .SetParent<SwitchMmu>()
+                            .AddConstructor<MultiPoolSwitchMmu>();
+    return tid;
+}
+
+MultiPoolSwitchMmu::MultiPoolSwitchMmu(void)
+{
+    queue_reserve = reserve;
+    pool0_auto = true;
+    for (uint32_t i = 0; i < poolCnt; i++)
+    {
+        pool_size[i] = 0;
+        pg_pool_used[i] = 0;
+        queue_pool_used[i] = 0;
+    }
+    for (uint32_t q = 0; q < qCnt; q++)
+        ConfigPriority(q, 0, true, 1.0 / 8, 1.0 / 8);
+}
+
+bool
+MultiPoolSwitchMmu::CheckIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize)
+{
+    bool admit;
+    if (lossless[qIndex])
+        admit = psize + hdrm_bytes[port][qIndex] <= headroom[port] ||
+                psize + GetSharedUsed(port, qIndex) <= GetPgThreshold(qIndex);
+    else
+        admit = psize + ingress_bytes[port][qIndex] <= reserve ||
+                psize + GetSharedUsed(port, qIndex) <= GetPgThreshold(qIndex);
+    if (!admit)
+        NS_LOG_INFO("Node " << node_id << " drop: PG " << port << "," << qIndex << " full");
+    return admit;
+}
+
+bool
+MultiPoolSwitchMmu::CheckEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize)
+{
+    // lossless queues are bounded by PFC
+    if (lossless[qIndex] || egress_bytes[port][qIndex] + psize <= queue_reserve)
+        return true;
+    uint64_t shared = egress_bytes[port][qIndex] > queue_reserve
+                          ? egress_bytes[port][qIndex] - queue_reserve
+                          : 0;
+    if (shared + psize <= GetQueueThreshold(qIndex))
+        return true;
+    NS_LOG_INFO("Node " << node_id << " drop: queue " << port << "," << qIndex << " full");
+    return false;
+}
+
+void
+MultiPoolSwitchMmu::UpdateIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize)
+{
+    uint32_t new_bytes = ingress_bytes[port][qIndex] + psize;
+    if (new_bytes <= reserve)
+    {
+        ingress_bytes[port][qIndex] += psize;
+    }
+    else if (lossless[qIndex] && new_bytes - reserve > GetPgThreshold(qIndex))
+    {
+        hdrm_bytes[port][qIndex] += psize;
+    }
+    else
+    {
+        ingress_bytes[port][qIndex] += psize;
+        pg_pool_used[prio_pool[qIndex]] += std::min(psize, new_bytes - reserve);
+    }
+}
+
+void
+MultiPoolSwitchMmu::UpdateEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize)
+{
+    uint64_t new_bytes = egress_bytes[port][qIndex] + psize;
+    if (new_bytes > queue_reserve)
+        queue_pool_used[prio_pool[qIndex]] += std::min<uint64_t>(psize, new_bytes - queue_reserve);
+    egress_bytes[port][qIndex] = new_bytes;
+}
+
+void
+MultiPoolSwitchMmu::RemoveFromIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize)
+{
+    uint32_t from_hdrm = std::min(hdrm_bytes[port][qIndex], psize);
+    uint32_t from_shared =
+        std::min(psize - from_hdrm,
+                 ingress_bytes[port][qIndex] > reserve ? ingress_bytes[port][qIndex] - reserve : 0);
+    hdrm_bytes[port][qIndex] -= from_hdrm;
+    ingress_bytes[port][qIndex] -= psize - from_hdrm;
+    pg_pool_used[prio_pool[qIndex]] -= from_shared;
+}
+
+void
+MultiPoolSwitchMmu::RemoveFromEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize)
+{
+    uint64_t old_bytes = egress_bytes[port][qIndex];
+    if (old_bytes > queue_reserve)
+        queue_pool_used[prio_pool[qIndex]] -= std::min<uint64_t>(psize, old_bytes - queue_reserve);
+    egress_bytes[port][qIndex] = old_bytes - psize;
+}
+
+bool
+MultiPoolSwitchMmu::CheckShouldPause(uint32_t port, uint32_t qIndex)
+{
+    return lossless[qIndex] && !paused[port][qIndex] &&
+           (hdrm_bytes[port][qIndex] > 0 || GetSharedUsed(port, qIndex) >= GetPgThreshold(qIndex));
+}
+
+bool
+MultiPoolSwitchMmu::CheckShouldResume(uint32_t port, uint32_t qIndex)
+{
+    if (!paused[port][qIndex])
+        return false;
+    uint32_t shared_used = GetSharedUsed(port, qIndex);
+    return hdrm_bytes[port][qIndex] == 0 &&
+           (shared_used == 0 || shared_used + resume_offset <= GetPgThreshold(qIndex));
+}
+
+void
+MultiPoolSwitchMmu::ConfigNPort(uint32_t n_port)
+{
+    SwitchMmu::ConfigNPort(n_port);
+    if (pool0_auto)
+        pool_size[0] = buffer_size - total_hdrm - total_rsrv;
+}
+
+void
+MultiPoolSwitchMmu::ConfigBufferSize(uint32_t size)
+{
+    SwitchMmu::ConfigBufferSize(size);
+    if (pool0_auto)
+        pool_size[0] = buffer_size - total_hdrm - total_rsrv;
+}
+
+void
+MultiPoolSwitchMmu::ConfigPool(uint32_t pool, uint32_t size)
+{
+    pool_size[pool] = size;
+    if (pool == 0)
+        pool0_auto = false;
+}
+
+void
+MultiPoolSwitchMmu::ConfigPriority(uint32_t qIndex,
+                                   uint32_t pool,
+                                   bool isLossless,
+                                   double pgAlpha,
+                                   double queueAlpha)
+{
+    prio_pool[qIndex] = pool;
+    lossless[qIndex] = isLossless;
+    pg_alpha[qIndex] = pgAlpha;
+    queue_alpha[qIndex] = queueAlpha;
+}
+
+uint32_t
+MultiPoolSwitchMmu::GetPgThreshold(uint32_t qIndex)
+{
+    uint32_t pool = prio_pool[qIndex];
+    uint32_t used = pg_pool_used[pool];
+    return used < pool_size[pool] ? pg_alpha[qIndex] * (pool_size[pool] - used) : 0;
+}
+
+uint32_t
+MultiPoolSwitchMmu::GetQueueThreshold(uint32_t qIndex)
+{
+    uint32_t pool = prio_pool[qIndex];
+    uint32_t used = queue_pool_used[pool];
+    return used < pool_size[pool] ? queue_alpha[qIndex] * (pool_size[pool] - used) : 0;
+}
 } // namespace ns3
@@ -2,6 +2,7 @@
 #define SWITCH_MMU_H
 
 #include <ns3/node.h>
+#include <ns3/random-variable.h>
 
 #include <unordered_map>
 
@@ -10,6 +11,14 @@ namespace ns3
 
 class Packet;
 
+/**
+ * The MMU of a switch: the admission of the packets to the shared buffer,
+ * PFC and ECN.  This default model has one shared pool with the dynamic
+ * threshold of pfc_a_shift and a static headroom per port.  Other models
+ * derive from it and redefine the virtual methods; SwitchNode picks one with
+ * its MmuType attribute.  Every method must run in constant time, it is
+ * called for each packet.
+ */
 class SwitchMmu : public Object
 {
   public:
@@ -20,15 +29,15 @@ class SwitchMmu : public Object
 
     SwitchMmu(void);
 
-    bool CheckIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
-    bool CheckEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
-    void UpdateIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
-    void UpdateEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
-    void RemoveFromIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
-    void RemoveFromEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
+    virtual bool CheckIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
+    virtual bool CheckEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
+    virtual void UpdateIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
+    virtual void UpdateEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
+    virtual void RemoveFromIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
+    virtual void RemoveFromEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize);
 
-    bool CheckShouldPause(uint32_t port, uint32_t qIndex);
-    bool CheckShouldResume(uint32_t port, uint32_t qIndex);
+    virtual bool CheckShouldPause(uint32_t port, uint32_t qIndex);
+    virtual bool CheckShouldResume(uint32_t port, uint32_t qIndex);
     void SetPause(uint32_t port, uint32_t qIndex);
     void SetResume(uint32_t port, uint32_t qIndex);
     // void GetPauseClasses(uint32_t port, uint32_t qIndex);
@@ -37,12 +46,12 @@ class SwitchMmu : public Object
     uint32_t GetPfcThreshold(uint32_t port);
     uint32_t GetSharedUsed(uint32_t port, uint32_t qIndex);
 
-    bool ShouldSendCN(uint32_t ifindex, uint32_t qIndex);
+    virtual bool ShouldSendCN(uint32_t ifindex, uint32_t qIndex);
 
     void ConfigEcn(uint32_t port, uint32_t _kmin, uint32_t _kmax, double _pmax);
     void ConfigHdrm(uint32_t port, uint32_t size);
-    void ConfigNPort(uint32_t n_port);
-    void ConfigBufferSize(uint32_t size);
+    virtual void ConfigNPort(uint32_t n_port);
+    virtual void ConfigBufferSize(uint32_t size);
 
     // config
     uint32_t node_id;
@@ -55,6 +64,7 @@ class SwitchMmu : public Object
     double pmax[pCnt];
     uint32_t total_hdrm;
     uint32_t total_rsrv;
+    UniformVariable ecn_random; // draws of the ECN marking probability
 
     // runtime
     uint32_t shared_used_bytes;
@@ -64,6 +74,70 @@ class SwitchMmu : public Object
     uint64_t egress_bytes[pCnt][qCnt];
 };
 
+/**
+ * A shared buffer MMU with several service pools, as in the switches of the
+ * Tomahawk/Spectrum class.  Each priority maps to a pool, and is lossless or
+ * lossy:
+ *  - the PGs (ingress port, priority) and the egress queues first use their
+ *    reserve, then the shared part of their pool, up to a dynamic threshold
+ *    of alpha times the free bytes of the pool, with an alpha per priority
+ *    for the PGs and another for the queues;
+ *  - a lossless PG goes on into the headroom of its port and sends PFC, its
+ *    egress queues are not limited;
+ *  - a lossy PG or queue drops the packets beyond its threshold, it never
+ *    sends PFC.
+ * The PGs and the queues of a pool are accounted apart, as the ingress and
+ * egress limits of a real MMU.  By default every priority is lossless in
+ * pool 0, and alpha is 1/8.  Until ConfigPool sets it, pool 0 holds the
+ * buffer left by the headroom and the reserves, resized by ConfigNPort and
+ * ConfigBufferSize whichever order they are called in.
+ */
+class MultiPoolSwitchMmu : public SwitchMmu
+{
+  public:
+    static const uint32_t poolCnt = 4; // Number of service pools
+
+    static TypeId GetTypeId(void);
+
+    MultiPoolSwitchMmu(void);
+
+    bool CheckIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize) override;
+    bool CheckEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize) override;
+    void UpdateIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize) override;
+    void UpdateEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize) override;
+    void RemoveFromIngressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize) override;
+    void RemoveFromEgressAdmission(uint32_t port, uint32_t qIndex, uint32_t psize) override;
+
+    bool CheckShouldPause(uint32_t port, uint32_t qIndex) override;
+    bool CheckShouldResume(uint32_t port, uint32_t qIndex) override;
+
+    void ConfigNPort(uint32_t n_port) override;
+    void ConfigBufferSize(uint32_t size) override;
+    void ConfigPool(uint32_t pool, uint32_t size);
+    void ConfigPriority(uint32_t qIndex,
+                        uint32_t pool,
+                        bool isLossless,
+                        double pgAlpha,
+                        double queueAlpha);
+
+    // the dynamic thresholds of the shared bytes of a PG and of a queue
+    uint32_t GetPgThreshold(uint32_t qIndex);
+    uint32_t GetQueueThreshold(uint32_t qIndex);
+
+    // config
+    uint32_t pool_size[poolCnt];
+    bool pool0_auto; // pool 0 holds the buffer left by the headroom and the reserves
+    uint32_t prio_pool[qCnt]; // service pool of a priority
+    bool lossless[qCnt];
+    double pg_alpha[qCnt];
+    double queue_alpha[qCnt];
+    uint32_t queue_reserve; // bytes of an egress queue out of the shared pool
+
+    // runtime
+    uint32_t pg_pool_used[poolCnt];    // shared bytes of the PGs of a pool
+    uint32_t queue_pool_used[poolCnt]; // shared bytes of the egress queues of a pool
+};
+
 } /* namespace ns3 */
 
 #endif /* SWITCH_MMU_H */
@@ -9,12 +9,16 @@
 #include "ns3/int-header.h"
 #include "ns3/ipv4-header.h"
 #include "ns3/ipv4.h"
+#include "ns3/object-factory.h"
 #include "ns3/packet.h"
 #include "ns3/pause-header.h"
+#include "ns3/pointer.h"
 #include "ns3/simulator.h"
+#include "ns3/type-id.h"
 #include "ns3/uinteger.h"
 
 #include <cmath>
+#include <cstdlib>
 
 namespace ns3
 {
@@ -44,7 +48,19 @@ SwitchNode::GetTypeId(void)
                                           "Max Rtt of the network",
                                           UintegerValue(9000),
                                           MakeUintegerAccessor(&SwitchNode::m_maxRtt),
-                                          MakeUintegerChecker<uint32_t>());
+                                          MakeUintegerChecker<uint32_t>())
+                            .AddAttribute("QueueDelaySketch",
+                                          "Calculator of the queueing delay quantiles (ns) of "
+                                          "the admitted packets, none if null",
+                                          PointerValue(),
+                                          MakePointerAccessor(&SwitchNode::m_queueDelaySketch),
+                                          MakePointerChecker<QuantileSketchCalculator>())
+                            .AddAttribute("MmuType",
+                                          "The type of the MMU, a SwitchMmu",
+                                          TypeIdValue(SwitchMmu::GetTypeId()),
+                                          MakeTypeIdAccessor(&SwitchNode::SetMmuType,
+                                                             &SwitchNode::GetMmuType),
+                                          MakeTypeIdChecker());
     return tid;
 }
 
@@ -52,31 +68,52 @@ SwitchNode::SwitchNode()
 {
     m_ecmpSeed = GetId();
     m_node_type = 1;
-    m_mmu = CreateObject<SwitchMmu>();
-    for (uint32_t i = 0; i < pCnt; i++)
-        for (uint32_t j = 0; j < pCnt; j++)
-            for (uint32_t k = 0; k < qCnt; k++)
-                m_bytes[i][j][k] = 0;
+    m_bytes = static_cast<uint32_t(*)[pCnt][qCnt]>(calloc(pCnt, sizeof(*m_bytes)));
     for (uint32_t i = 0; i < pCnt; i++)
         m_txBytes[i] = 0;
     for (uint32_t i = 0; i < pCnt; i++)
         m_lastPktSize[i] = m_lastPktTs[i] = 0;
     for (uint32_t i = 0; i < pCnt; i++)
         m_u[i] = 0;
+    for (uint32_t i = 0; i < pCnt; i++)
+        m_portRate[i] = 0;
+}
+
+SwitchNode::~SwitchNode()
+{
+    free(m_bytes);
+}
+
+void
+SwitchNode::SetMmuType(TypeId tid)
+{
+    ObjectFactory factory;
+    factory.SetTypeId(tid);
+    m_mmu = factory.Create<SwitchMmu>();
+}
+
+TypeId
+SwitchNode::GetMmuType() const
+{
+    return m_mmu->GetInstanceTypeId();
 }
 
 int
 SwitchNode::GetOutDev(Ptr<const Packet> p, CustomHeader& ch)
 {
+    if (!m_fib.IsFrozen())
+        m_fib.Freeze();
+
     // look up entries
-    auto entry = m_rtTable.find(ch.dip);
+    const EcmpFib::Group* nexthops = m_fib.Find(ch.dip);
 
     // no matching entry
-    if (entry == m_rtTable.end())
+    if (nexthops == NULL)
         return -1;
 
-    // entry found
-    auto& nexthops = entry->second;
+    // single next hop, no need to hash
+    if (nexthops->size == 1)
+        return m_fib.Select(nexthops, 0);
 
     // pick one next hop based on hash
     union {
@@ -93,8 +130,7 @@ SwitchNode::GetOutDev(Ptr<const Packet> p, CustomHeader& ch)
     else if (ch.l3Prot == 0xFC || ch.l3Prot == 0xFD)
         buf.u32[2] = ch.ack.sport | ((uint32_t)ch.ack.dport << 16);
 
-    uint32_t idx = EcmpHash(buf.u8, 12, m_ecmpSeed) % nexthops.size();
-    return nexthops[idx];
+    return m_fib.Select(nexthops, EcmpHash(buf.u8, 12, m_ecmpSeed));
 }
 
 void
@@ -150,6 +186,16 @@ SwitchNode::SendToDev(Ptr<Packet> p, CustomHeader& ch)
             if (m_mmu->CheckIngressAdmission(inDev, qIndex, p->GetSize()) &&
                 m_mmu->CheckEgressAdmission(idx, qIndex, p->GetSize()))
             { // Admission control
+                if (m_queueDelaySketch)
+                {
+                    if (m_portRate[idx] == 0)
+                    {
+                        Ptr<QbbNetDevice> device = DynamicCast<QbbNetDevice>(GetDevice(idx));
+                        m_portRate[idx] = device->GetDataRate().GetBitRate();
+                    }
+                    m_queueDelaySketch->Update(m_mmu->egress_bytes[idx][qIndex] * 8e9 /
+                                               m_portRate[idx]);
+                }
                 m_mmu->UpdateIngressAdmission(inDev, qIndex, p->GetSize());
                 m_mmu->UpdateEgressAdmission(idx, qIndex, p->GetSize());
             }
@@ -222,14 +268,31 @@ SwitchNode::SetEcmpSeed(uint32_t seed)
 void
 SwitchNode::AddTableEntry(Ipv4Address& dstAddr, uint32_t intf_idx)
 {
-    uint32_t dip = dstAddr.Get();
-    m_rtTable[dip].push_back(intf_idx);
+    m_fib.Add(dstAddr.Get(), intf_idx);
 }
 
 void
 SwitchNode::ClearTable()
 {
-    m_rtTable.clear();
+    m_fib.Clear();
+}
+
+void
+SwitchNode::Freeze()
+{
+    m_fib.Freeze();
+}
+
+const EcmpFib&
+SwitchNode::GetFib() const
+{
+    return m_fib;
+}
+
+EcmpFib&
+SwitchNode::GetFib()
+{
+    return m_fib;
 }
 
 // This function can only be called in switch mode
@@ -240,6 +303,12 @@ SwitchNode::SwitchReceiveFromDevice(Ptr<NetDevice> device, Ptr<Packet> packet, C
     return true;
 }
 
+uint32_t
+SwitchNode::GetBytes(uint32_t inDev, uint32_t outDev, uint32_t qIndex) const
+{
+    return m_bytes[inDev][outDev][qIndex];
+}
+
 void
 SwitchNode::SwitchNotifyDequeue(uint32_t ifIndex, uint32_t qIndex, Ptr<Packet> p)
 {
@@ -256,6 +325,10 @@ SwitchNode::SwitchNotifyDequeue(uint32_t ifIndex, uint32_t qIndex, Ptr<Packet> p
             bool egressCongested = m_mmu->ShouldSendCN(ifIndex, qIndex);
             if (egressCongested)
             {
+                Ptr<QbbTelemetry> telemetry =
+                    DynamicCast<QbbNetDevice>(GetDevice(ifIndex))->GetTelemetry();
+                if (telemetry)
+                    telemetry->RecordEcnMark(qIndex);
                 PppHeader ppp;
                 Ipv4Header h;
                 p->RemoveHeader(ppp);
@@ -1,11 +1,13 @@
 #ifndef SWITCH_NODE_H
 #define SWITCH_NODE_H
 
+#include "ecmp-fib.h"
 #include "pint.h"
 #include "qbb-net-device.h"
 #include "switch-mmu.h"
 
 #include <ns3/node.h>
+#include <ns3/quantile-sketch.h>
 
 #include <unordered_map>
 
@@ -19,13 +21,13 @@ class SwitchNode : public Node
     static const uint32_t pCnt = 1025; // Number of ports used
     static const uint32_t qCnt = 8;    // Number of queues/priorities used
     uint32_t m_ecmpSeed;
-    std::unordered_map<uint32_t, std::vector<int>>
-        m_rtTable; // map from ip address (u32) to possible ECMP port (index of dev)
+    EcmpFib m_fib; // map from ip address (u32) to possible ECMP port (index of dev)
     std::set<uint32_t> active_ports; // record active ports in switch
 
     // monitor of PFC
-    uint32_t m_bytes[pCnt][pCnt][qCnt]; // m_bytes[inDev][outDev][qidx] is the bytes from inDev
-                                        // enqueued for outDev at qidx
+    // m_bytes[inDev][outDev][qidx] is the bytes from inDev enqueued for outDev
+    // at qidx; allocated zeroed, so that the pages of unused ports are never touched
+    uint32_t (*m_bytes)[pCnt][qCnt];
 
     uint64_t m_txBytes[pCnt]; // counter of tx bytes
 
@@ -33,6 +35,11 @@ class SwitchNode : public Node
     uint64_t m_lastPktTs[pCnt]; // ns
     double m_u[pCnt];
 
+    // queueing delay (ns) of the admitted packets, estimated from the egress
+    // queue length at the port rate, if set
+    Ptr<QuantileSketchCalculator> m_queueDelaySketch;
+    uint64_t m_portRate[pCnt]; // bps, read from the device on the first sketched packet
+
   protected:
     bool m_ecnEnabled;
     uint32_t m_ccMode;
@@ -49,14 +56,24 @@ class SwitchNode : public Node
 
   public:
     Ptr<SwitchMmu> m_mmu;
+    // replace m_mmu by a new MMU of the given type, a SwitchMmu
+    void SetMmuType(TypeId tid);
+    TypeId GetMmuType() const;
 
     static TypeId GetTypeId(void);
     SwitchNode();
+    ~SwitchNode() override;
     void SetEcmpSeed(uint32_t seed);
     void AddTableEntry(Ipv4Address& dstAddr, uint32_t intf_idx);
     void ClearTable();
+    // compile the routing table, otherwise done on the first lookup after AddTableEntry
+    void Freeze();
+    const EcmpFib& GetFib() const;
+    EcmpFib& GetFib();
     bool SwitchReceiveFromDevice(Ptr<NetDevice> device, Ptr<Packet> packet, CustomHeader& ch);
     void SwitchNotifyDequeue(uint32_t ifIndex, uint32_t qIndex, Ptr<Packet> p);
+    // the bytes from inDev enqueued for outDev at qIndex
+    uint32_t GetBytes(uint32_t inDev, uint32_t outDev, uint32_t qIndex) const;
 
     // for approximate calc in PINT
     int logres_shift(int b, int l);
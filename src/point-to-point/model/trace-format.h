@@ -29,7 +29,7 @@ struct TraceFormat
     uint8_t l3Prot;
     uint8_t event;
     uint8_t ecn;      // this is the ip ECN bits
-    uint8_t nodeType; // 0: host, 1: switch
+    uint8_t nodeType; // 0: host, 1: switch, 2: nvswitch
 
     union {
         struct
@@ -0,0 +1,698 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "trace-writer.h"
+
+#include "ns3/boolean.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cstring>
+
+NS_LOG_COMPONENT_DEFINE("TraceWriter");
+
+namespace ns3
+{
+
+/// Magic number of trace files, "QTRC"
+static const uint32_t TRACE_FILE_MAGIC = 0x43525451;
+/// Version of the trace file format
+static const uint32_t TRACE_FILE_VERSION = 1;
+
+/***********************
+ * Record encoding
+ **********************/
+/**
+ * Append an unsigned integer in LEB128 varint encoding.
+ *
+ * \param out the output buffer
+ * \param v the value
+ */
+static inline void
+PutVarint(std::vector<uint8_t>& out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+/**
+ * Append a signed integer in zigzag varint encoding.
+ *
+ * \param out the output buffer
+ * \param v the value
+ */
+static inline void
+PutZigzag(std::vector<uint8_t>& out, int64_t v)
+{
+    PutVarint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+/**
+ * Read a varint.
+ *
+ * \param p the read position, advanced past the varint
+ * \param end the end of the input
+ * \param v the value read
+ * \return false if the input ends within the varint
+ */
+static inline bool
+GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+{
+    v = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end)
+            return false;
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Read a zigzag varint.
+ *
+ * \param p the read position, advanced past the varint
+ * \param end the end of the input
+ * \param v the value read
+ * \return false if the input ends within the varint
+ */
+static inline bool
+GetZigzag(const uint8_t*& p, const uint8_t* end, int64_t& v)
+{
+    uint64_t u;
+    if (!GetVarint(p, end, u))
+        return false;
+    v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return true;
+}
+
+/**
+ * Read a byte.
+ *
+ * \param p the read position, advanced past the byte
+ * \param end the end of the input
+ * \param v the value read
+ * \return false at the end of the input
+ */
+static inline bool
+GetByte(const uint8_t*& p, const uint8_t* end, uint8_t& v)
+{
+    if (p == end)
+        return false;
+    v = *p++;
+    return true;
+}
+
+void
+TraceEncode(std::vector<uint8_t>& out, const TraceFormat& tr, TraceFormat& last)
+{
+    PutZigzag(out, (int64_t)(tr.time - last.time));
+    // bit 2 holds the low bit of the node type and bit 5 its high bit, so that
+    // the records of hosts and switches read as before
+    out.push_back((tr.event & 0x3) | ((tr.nodeType & 0x1) << 2) | ((tr.ecn & 0x3) << 3) |
+                  ((tr.nodeType & 0x2) << 4));
+    PutVarint(out, tr.node);
+    out.push_back(tr.intf);
+    out.push_back(tr.qidx);
+    PutVarint(out, tr.qlen);
+    PutZigzag(out, (int32_t)(tr.sip - last.sip));
+    PutZigzag(out, (int32_t)(tr.dip - last.dip));
+    PutVarint(out, tr.size);
+    out.push_back(tr.l3Prot);
+    switch (tr.l3Prot)
+    {
+    case 0x6:
+        PutVarint(out, tr.data.sport);
+        PutVarint(out, tr.data.dport);
+        break;
+    case 0x11:
+        PutVarint(out, tr.data.sport);
+        PutVarint(out, tr.data.dport);
+        PutVarint(out, tr.data.seq);
+        PutVarint(out, tr.data.ts);
+        PutVarint(out, tr.data.pg);
+        PutVarint(out, tr.data.payload);
+        break;
+    case 0xFC:
+    case 0xFD:
+        PutVarint(out, tr.ack.sport);
+        PutVarint(out, tr.ack.dport);
+        PutVarint(out, tr.ack.flags);
+        PutVarint(out, tr.ack.pg);
+        PutVarint(out, tr.ack.seq);
+        PutVarint(out, tr.ack.ts);
+        break;
+    case 0xFE:
+        PutVarint(out, tr.pfc.time);
+        PutVarint(out, tr.pfc.qlen);
+        out.push_back(tr.pfc.qIndex);
+        break;
+    case 0xFF:
+        PutVarint(out, tr.cnp.fid);
+        out.push_back(tr.cnp.qIndex);
+        out.push_back(tr.cnp.ecnBits);
+        PutVarint(out, tr.cnp.TraceFormat_t.qfb);
+        PutVarint(out, tr.cnp.TraceFormat_t.total);
+        break;
+    default:
+        break;
+    }
+    last.time = tr.time;
+    last.sip = tr.sip;
+    last.dip = tr.dip;
+}
+
+uint32_t
+TraceDecode(const uint8_t* in, uint32_t len, TraceFormat& tr, TraceFormat& last)
+{
+    const uint8_t* p = in;
+    const uint8_t* end = in + len;
+    uint64_t v[6];
+    int64_t d;
+    uint8_t b;
+    memset(&tr, 0, sizeof(tr));
+
+    if (!GetZigzag(p, end, d))
+        return 0;
+    tr.time = last.time + d;
+    if (!GetByte(p, end, b))
+        return 0;
+    tr.event = b & 0x3;
+    tr.nodeType = ((b >> 2) & 0x1) | ((b >> 4) & 0x2);
+    tr.ecn = (b >> 3) & 0x3;
+    if (!GetVarint(p, end, v[0]) || !GetByte(p, end, tr.intf) || !GetByte(p, end, tr.qidx) ||
+        !GetVarint(p, end, v[1]))
+        return 0;
+    tr.node = v[0];
+    tr.qlen = v[1];
+    if (!GetZigzag(p, end, d))
+        return 0;
+    tr.sip = last.sip + (int32_t)d;
+    if (!GetZigzag(p, end, d))
+        return 0;
+    tr.dip = last.dip + (int32_t)d;
+    if (!GetVarint(p, end, v[0]) || !GetByte(p, end, tr.l3Prot))
+        return 0;
+    tr.size = v[0];
+    switch (tr.l3Prot)
+    {
+    case 0x6:
+        if (!GetVarint(p, end, v[0]) || !GetVarint(p, end, v[1]))
+            return 0;
+        tr.data.sport = v[0];
+        tr.data.dport = v[1];
+        break;
+    case 0x11:
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            if (!GetVarint(p, end, v[i]))
+                return 0;
+        }
+        tr.data.sport = v[0];
+        tr.data.dport = v[1];
+        tr.data.seq = v[2];
+        tr.data.ts = v[3];
+        tr.data.pg = v[4];
+        tr.data.payload = v[5];
+        break;
+    case 0xFC:
+    case 0xFD:
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            if (!GetVarint(p, end, v[i]))
+                return 0;
+        }
+        tr.ack.sport = v[0];
+        tr.ack.dport = v[1];
+        tr.ack.flags = v[2];
+        tr.ack.pg = v[3];
+        tr.ack.seq = v[4];
+        tr.ack.ts = v[5];
+        break;
+    case 0xFE:
+        if (!GetVarint(p, end, v[0]) || !GetVarint(p, end, v[1]) ||
+            !GetByte(p, end, tr.pfc.qIndex))
+            return 0;
+        tr.pfc.time = v[0];
+        tr.pfc.qlen = v[1];
+        break;
+    case 0xFF:
+        if (!GetVarint(p, end, v[0]) || !GetByte(p, end, tr.cnp.qIndex) ||
+            !GetByte(p, end, tr.cnp.ecnBits) || !GetVarint(p, end, v[1]) ||
+            !GetVarint(p, end, v[2]))
+            return 0;
+        tr.cnp.fid = v[0];
+        tr.cnp.TraceFormat_t.qfb = v[1];
+        tr.cnp.TraceFormat_t.total = v[2];
+        break;
+    default:
+        break;
+    }
+    last.time = tr.time;
+    last.sip = tr.sip;
+    last.dip = tr.dip;
+    return p - in;
+}
+
+/***********************
+ * Block compression
+ **********************/
+static const uint32_t LZ_MIN_MATCH = 4;      //!< shortest encoded match
+static const uint32_t LZ_MAX_OFFSET = 65535; //!< farthest match, to fit 16 bits
+static const uint32_t LZ_HASH_BITS = 12;     //!< log2 of the match finder table size
+
+/**
+ * \param p an unaligned pointer
+ * \return the 32-bit word at p
+ */
+static inline uint32_t
+Read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Append the continuation bytes of a literal or match length.
+ *
+ * \param op the write position, advanced past the bytes
+ * \param len the part of the length which does not fit the token
+ */
+static inline void
+PutLength(uint8_t*& op, uint32_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+}
+
+/**
+ * Append a sequence: a token, the literals, and the match if any.
+ *
+ * \param op the write position
+ * \param lit the literals
+ * \param litLen the number of literals
+ * \param offset the distance back to the match
+ * \param matchLen the length of the match, 0 for the last literals
+ * \return the write position after the sequence
+ */
+static inline uint8_t*
+PutSequence(uint8_t* op, const uint8_t* lit, uint32_t litLen, uint32_t offset, uint32_t matchLen)
+{
+    uint8_t* token = op++;
+    *token = (std::min(litLen, 15u) << 4);
+    if (litLen >= 15)
+        PutLength(op, litLen - 15);
+    memcpy(op, lit, litLen);
+    op += litLen;
+    if (matchLen == 0) // last literals
+        return op;
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    matchLen -= LZ_MIN_MATCH;
+    *token |= std::min(matchLen, 15u);
+    if (matchLen >= 15)
+        PutLength(op, matchLen - 15);
+    return op;
+}
+
+uint32_t
+TraceCompress(const uint8_t* in, uint32_t len, std::vector<uint8_t>& out)
+{
+    out.resize(len + len / 255 + 16);
+    uint8_t* op = out.data();
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xff, sizeof(table));
+    uint32_t ip = 0, anchor = 0;
+    while (ip + LZ_MIN_MATCH <= len)
+    {
+        uint32_t seq = Read32(in + ip);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        uint32_t ref = table[h];
+        table[h] = ip;
+        if (ref == 0xffffffff || ip - ref > LZ_MAX_OFFSET || Read32(in + ref) != seq)
+        {
+            ip++;
+            continue;
+        }
+        uint32_t matchLen = LZ_MIN_MATCH;
+        while (ip + matchLen < len && in[ref + matchLen] == in[ip + matchLen])
+            matchLen++;
+        op = PutSequence(op, in + anchor, ip - anchor, ip - ref, matchLen);
+        ip += matchLen;
+        anchor = ip;
+    }
+    op = PutSequence(op, in + anchor, len - anchor, 0, 0);
+    uint32_t size = op - out.data();
+    if (size >= len)
+        return 0;
+    out.resize(size);
+    return size;
+}
+
+/**
+ * Read the continuation bytes of a literal or match length.
+ *
+ * \param ip the read position, advanced past the bytes
+ * \param end the end of the input
+ * \param len the length, incremented by the bytes read
+ * \return false if the input ends within the length
+ */
+static inline bool
+GetLength(const uint8_t*& ip, const uint8_t* end, uint32_t& len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip == end)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool
+TraceDecompress(const uint8_t* in, uint32_t inLen, uint8_t* out, uint32_t len)
+{
+    const uint8_t* ip = in;
+    const uint8_t* iend = in + inLen;
+    uint8_t* op = out;
+    uint8_t* oend = out + len;
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+        uint32_t litLen = token >> 4;
+        if (litLen == 15 && !GetLength(ip, iend, litLen))
+            return false;
+        if ((uint32_t)(iend - ip) < litLen || (uint32_t)(oend - op) < litLen)
+            return false;
+        memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == iend) // last literals
+            break;
+        if (iend - ip < 2)
+            return false;
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - out))
+            return false;
+        uint32_t matchLen = token & 0xf;
+        if (matchLen == 15 && !GetLength(ip, iend, matchLen))
+            return false;
+        matchLen += LZ_MIN_MATCH;
+        if ((uint32_t)(oend - op) < matchLen)
+            return false;
+        const uint8_t* ref = op - offset;
+        for (uint32_t i = 0; i < matchLen; i++) // may overlap
+            op[i] = ref[i];
+        op += matchLen;
+    }
+    return op == oend;
+}
+
+/***********************
+ * TraceWriter
+ **********************/
+NS_OBJECT_ENSURE_REGISTERED(TraceWriter);
+
+TypeId
+TraceWriter::GetTypeId(void)
+{
+    static TypeId tid =
+        TypeId("ns3::TraceWriter")
+            .SetParent<Object>()
+            .AddConstructor<TraceWriter>()
+            .AddAttribute("BlockSize",
+                          "Size in bytes of the per-stream buffer flushed as one block.",
+                          UintegerValue(64 * 1024),
+                          MakeUintegerAccessor(&TraceWriter::m_blockSize),
+                          MakeUintegerChecker<uint32_t>(256))
+            .AddAttribute("MaxStreams",
+                          "Maximum number of logical processes writing to this trace.",
+                          UintegerValue(LpStreams<Stream>::DEFAULT_MAX_STREAMS),
+                          MakeUintegerAccessor(&TraceWriter::m_maxStreams),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("EventMask",
+                          "Bit mask of recorded events, indexed by EventEnum.",
+                          UintegerValue((1 << Recv) | (1 << Enqu) | (1 << Dequ) | (1 << Drop)),
+                          MakeUintegerAccessor(&TraceWriter::m_eventMask),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("Compress",
+                          "Compress blocks before writing them.",
+                          BooleanValue(true),
+                          MakeBooleanAccessor(&TraceWriter::m_compress),
+                          MakeBooleanChecker());
+    return tid;
+}
+
+TraceWriter::TraceWriter()
+    : m_file(NULL),
+      m_streams("TraceWriter"),
+      m_records(0),
+      m_rawBytes(0),
+      m_fileBytes(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+    Close();
+}
+
+void
+TraceWriter::DoDispose(void)
+{
+    Close();
+    Object::DoDispose();
+}
+
+bool
+TraceWriter::Open(std::string filename)
+{
+    Close();
+    m_file = fopen(filename.c_str(), "wb");
+    if (m_file == NULL)
+    {
+        NS_LOG_WARN("cannot open trace file " << filename);
+        return false;
+    }
+    m_filename = filename;
+    TraceFileHeader h;
+    h.magic = TRACE_FILE_MAGIC;
+    h.version = TRACE_FILE_VERSION;
+    fwrite(&h, sizeof(h), 1, m_file);
+    m_fileBytes = sizeof(h);
+    m_streams.SetMaxStreams(m_maxStreams);
+    Simulator::ScheduleDestroy(&TraceWriter::Close, Ptr<TraceWriter>(this));
+    return true;
+}
+
+void
+TraceWriter::Close(void)
+{
+    if (m_file == NULL)
+        return;
+    m_streams.ForEach([this](Stream* s) { Flush(s); });
+    m_streams.Clear();
+    fclose(m_file);
+    m_file = NULL;
+    NS_LOG_INFO("trace " << m_filename << ": " << m_records << " records, " << m_rawBytes
+                         << " encoded bytes, " << m_fileBytes << " file bytes");
+}
+
+TraceWriter::Stream*
+TraceWriter::GetStream(uint32_t id)
+{
+    return m_streams.Get(id, [this, id]() {
+        Stream* s = new Stream;
+        s->id = id;
+        s->buf.reserve(m_blockSize + sizeof(TraceFormat) * 2);
+        s->records = 0;
+        memset(&s->last, 0, sizeof(s->last));
+        return s;
+    });
+}
+
+void
+TraceWriter::Write(const TraceFormat& tr)
+{
+    if (m_file == NULL)
+        return;
+    Stream* s = GetStream(Simulator::GetSystemId());
+    TraceEncode(s->buf, tr, s->last);
+    s->records++;
+    if (s->buf.size() >= m_blockSize)
+        Flush(s);
+}
+
+void
+TraceWriter::Flush(Stream* s)
+{
+    if (s->records == 0)
+        return;
+    TraceBlockHeader h;
+    h.stream = s->id;
+    h.records = s->records;
+    h.rawSize = s->buf.size();
+    // compress outside of the lock so that threads only serialize on fwrite
+    std::vector<uint8_t> compressed;
+    uint32_t n = m_compress ? TraceCompress(s->buf.data(), h.rawSize, compressed) : 0;
+    h.fileSize = n ? n : h.rawSize;
+    {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        fwrite(&h, sizeof(h), 1, m_file);
+        fwrite(n ? compressed.data() : s->buf.data(), 1, h.fileSize, m_file);
+        m_records += h.records;
+        m_rawBytes += h.rawSize;
+        m_fileBytes += sizeof(h) + h.fileSize;
+    }
+    // every block is decodable on its own
+    s->buf.clear();
+    s->records = 0;
+    memset(&s->last, 0, sizeof(s->last));
+}
+
+uint64_t
+TraceWriter::GetRecords(void) const
+{
+    return m_records;
+}
+
+uint64_t
+TraceWriter::GetRawBytes(void) const
+{
+    return m_rawBytes;
+}
+
+uint64_t
+TraceWriter::GetFileBytes(void) const
+{
+    return m_fileBytes;
+}
+
+/***********************
+ * TraceReader
+ **********************/
+TraceReader::TraceReader()
+    : m_file(NULL)
+{
+}
+
+TraceReader::~TraceReader()
+{
+    Close();
+}
+
+bool
+TraceReader::Open(std::string filename)
+{
+    Close();
+    m_file = fopen(filename.c_str(), "rb");
+    if (m_file == NULL)
+        return false;
+    TraceFileHeader fh;
+    if (fread(&fh, sizeof(fh), 1, m_file) != 1 || fh.magic != TRACE_FILE_MAGIC ||
+        fh.version != TRACE_FILE_VERSION)
+    {
+        Close();
+        return false;
+    }
+    TraceBlockHeader h;
+    while (fread(&h, sizeof(h), 1, m_file) == 1)
+    {
+        auto it = std::lower_bound(m_ids.begin(), m_ids.end(), h.stream);
+        uint32_t idx = it - m_ids.begin();
+        if (it == m_ids.end() || *it != h.stream)
+        {
+            m_ids.insert(it, h.stream);
+            m_cursors.insert(m_cursors.begin() + idx, Cursor());
+            m_cursors[idx].next = 0;
+            m_cursors[idx].pos = 0;
+            m_cursors[idx].remaining = 0;
+        }
+        Block b;
+        b.offset = ftell(m_file);
+        b.rawSize = h.rawSize;
+        b.fileSize = h.fileSize;
+        b.records = h.records;
+        m_cursors[idx].blocks.push_back(b);
+        if (fseek(m_file, h.fileSize, SEEK_CUR) != 0)
+            break;
+    }
+    return true;
+}
+
+void
+TraceReader::Close(void)
+{
+    if (m_file != NULL)
+        fclose(m_file);
+    m_file = NULL;
+    m_ids.clear();
+    m_cursors.clear();
+}
+
+uint32_t
+TraceReader::GetNStreams(void) const
+{
+    return m_cursors.size();
+}
+
+bool
+TraceReader::Load(Cursor& c)
+{
+    if (c.next >= c.blocks.size())
+        return false;
+    const Block& b = c.blocks[c.next++];
+    c.buf.resize(b.rawSize);
+    if (fseek(m_file, b.offset, SEEK_SET) != 0)
+        return false;
+    if (b.fileSize == b.rawSize)
+    {
+        if (fread(c.buf.data(), 1, b.rawSize, m_file) != b.rawSize)
+            return false;
+    }
+    else
+    {
+        m_compressed.resize(b.fileSize);
+        if (fread(m_compressed.data(), 1, b.fileSize, m_file) != b.fileSize ||
+            !TraceDecompress(m_compressed.data(), b.fileSize, c.buf.data(), b.rawSize))
+            return false;
+    }
+    c.pos = 0;
+    c.remaining = b.records;
+    memset(&c.last, 0, sizeof(c.last));
+    return true;
+}
+
+bool
+TraceReader::Read(uint32_t stream, TraceFormat& tr)
+{
+    Cursor& c = m_cursors[stream];
+    while (c.remaining == 0)
+    {
+        if (!Load(c))
+            return false;
+    }
+    uint32_t n = TraceDecode(c.buf.data() + c.pos, c.buf.size() - c.pos, tr, c.last);
+    if (n == 0)
+        return false;
+    c.pos += n;
+    c.remaining--;
+    return true;
+}
+
+} // namespace ns3
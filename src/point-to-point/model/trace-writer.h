@@ -0,0 +1,272 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef TRACE_WRITER_H
+#define TRACE_WRITER_H
+
+#include "ns3/lp-streams.h"
+#include "ns3/object.h"
+#include "ns3/trace-format.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \brief Buffered, compressed writer of qbb packet events.
+ *
+ * Records are kept in one stream per logical process (the value of
+ * Simulator::GetSystemId ()).  Under multithreaded simulation a logical
+ * process is only run by one thread at a time and its events are in
+ * timestamp order, so a stream needs no locking and its records can be
+ * delta-encoded against the previous record of the same stream.
+ *
+ * When the buffer of a stream is full, the block is compressed and appended
+ * to the shared output file; this is the only place where threads
+ * synchronize.  Use utils/qbb-trace-merge to turn the file back into a
+ * time-ordered sequence of TraceFormat records.
+ *
+ * File layout: a TraceFileHeader, followed by blocks each made of a
+ * TraceBlockHeader and its (possibly compressed) payload.
+ */
+class TraceWriter : public Object
+{
+  public:
+    /**
+     * \brief Get the type ID.
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId(void);
+    TraceWriter();
+    ~TraceWriter() override;
+
+    /**
+     * Open the output file and write its header.  The writer is flushed
+     * and closed on Simulator::Destroy.
+     *
+     * \param filename the name of the output file
+     * \return false if the file cannot be opened
+     */
+    bool Open(std::string filename);
+
+    /**
+     * Flush all streams and close the output file.
+     */
+    void Close(void);
+
+    /**
+     * \param event an event type
+     * \return whether events of the given type are recorded
+     */
+    inline bool IsEnabled(EventEnum event) const
+    {
+        return (m_eventMask >> event) & 1;
+    }
+
+    /**
+     * Record an event in the stream of the calling logical process.
+     *
+     * \param tr the event record
+     */
+    void Write(const TraceFormat& tr);
+
+    /**
+     * \return the number of records flushed to the file so far
+     */
+    uint64_t GetRecords(void) const;
+    /**
+     * \return the number of encoded bytes flushed so far, before compression
+     */
+    uint64_t GetRawBytes(void) const;
+    /**
+     * \return the number of bytes written to the file so far
+     */
+    uint64_t GetFileBytes(void) const;
+
+  protected:
+    void DoDispose(void) override;
+
+  private:
+    /// Record buffer of a logical process
+    struct Stream
+    {
+        uint32_t id;              //!< logical process of the stream
+        std::vector<uint8_t> buf; //!< encoded records not yet flushed
+        uint32_t records;         //!< number of records in buf
+        TraceFormat last;         //!< previous record, for delta encoding
+    };
+
+    /**
+     * Get the stream of a logical process, creating it on first use.
+     *
+     * \param id the logical process
+     * \return the stream
+     */
+    Stream* GetStream(uint32_t id);
+
+    /**
+     * Compress the buffer of a stream and append it to the file as a block.
+     *
+     * \param s the stream
+     */
+    void Flush(Stream* s);
+
+    std::string m_filename;      //!< name of the output file
+    FILE* m_file;                //!< output file, NULL when closed
+    std::mutex m_fileMutex;      //!< serializes block writes
+    LpStreams<Stream> m_streams; //!< streams of the logical processes
+
+    uint32_t m_blockSize;  //!< size of the buffer flushed as one block
+    uint32_t m_maxStreams; //!< maximum number of logical processes
+    uint32_t m_eventMask;  //!< recorded events, indexed by EventEnum
+    bool m_compress;       //!< whether blocks are compressed
+
+    std::atomic<uint64_t> m_records;   //!< records flushed so far
+    std::atomic<uint64_t> m_rawBytes;  //!< encoded bytes flushed so far
+    std::atomic<uint64_t> m_fileBytes; //!< bytes written to the file so far
+};
+
+/**
+ * \brief Reader of files produced by TraceWriter.
+ *
+ * The reader indexes all blocks on Open, so that the records of each stream
+ * can be read in order independently of how blocks of different streams
+ * are interleaved in the file.
+ */
+class TraceReader
+{
+  public:
+    TraceReader();
+    ~TraceReader();
+
+    /**
+     * Open a trace file and index its blocks.
+     *
+     * \param filename the name of the trace file
+     * \return false if the file cannot be opened or is not a trace file
+     */
+    bool Open(std::string filename);
+
+    /**
+     * Close the trace file.
+     */
+    void Close(void);
+
+    /**
+     * \return the number of streams of the trace file
+     */
+    uint32_t GetNStreams(void) const;
+
+    /**
+     * Read the next record of a stream.
+     *
+     * \param stream the index of the stream, below GetNStreams ()
+     * \param tr the record read
+     * \return false at the end of the stream or on a malformed block
+     */
+    bool Read(uint32_t stream, TraceFormat& tr);
+
+  private:
+    /// Location of a block in the file
+    struct Block
+    {
+        long offset;       //!< file offset of the payload
+        uint32_t rawSize;  //!< size of the decompressed payload
+        uint32_t fileSize; //!< size of the payload in the file
+        uint32_t records;  //!< number of records of the block
+    };
+
+    /// Read state of a stream
+    struct Cursor
+    {
+        std::vector<Block> blocks; //!< blocks of the stream, in file order
+        uint32_t next;             //!< next block to load
+        std::vector<uint8_t> buf;  //!< decompressed payload of the current block
+        uint32_t pos;              //!< read position in buf
+        uint32_t remaining;        //!< records left in buf
+        TraceFormat last;          //!< previous record, for delta decoding
+    };
+
+    /**
+     * Load the next block of a stream.
+     *
+     * \param c the cursor of the stream
+     * \return false if the stream has no more blocks or the block is malformed
+     */
+    bool Load(Cursor& c);
+
+    FILE* m_file;                      //!< trace file, NULL when closed
+    std::vector<uint32_t> m_ids;       //!< sorted stream ids
+    std::vector<Cursor> m_cursors;     //!< cursors, in the order of m_ids
+    std::vector<uint8_t> m_compressed; //!< scratch buffer of compressed payloads
+};
+
+/// Header at the start of a trace file
+struct TraceFileHeader
+{
+    uint32_t magic;   //!< TRACE_FILE_MAGIC
+    uint32_t version; //!< TRACE_FILE_VERSION
+};
+
+/// Header of a block of a trace file
+struct TraceBlockHeader
+{
+    uint32_t stream;   //!< logical process of the block
+    uint32_t records;  //!< number of records
+    uint32_t rawSize;  //!< size of the encoded records
+    uint32_t fileSize; //!< size of the payload; rawSize when stored uncompressed
+};
+
+/**
+ * Encode a record as a delta against the previous one of the same stream.
+ *
+ * \param out the buffer the record is appended to
+ * \param tr the record
+ * \param last the previous record, updated to tr
+ */
+void TraceEncode(std::vector<uint8_t>& out, const TraceFormat& tr, TraceFormat& last);
+
+/**
+ * Decode a record encoded by TraceEncode.
+ *
+ * \param in the encoded record
+ * \param len the number of bytes available at in
+ * \param tr the decoded record
+ * \param last the previous record, updated to tr
+ * \return the number of bytes consumed, or 0 on error
+ */
+uint32_t TraceDecode(const uint8_t* in, uint32_t len, TraceFormat& tr, TraceFormat& last);
+
+/**
+ * Compress a block with an LZ77 codec in the spirit of LZ4: a token byte
+ * holds the literal and match lengths, followed by the literals and a
+ * 16-bit match offset.
+ *
+ * \param in the block
+ * \param len the size of the block
+ * \param out the compressed block
+ * \return the compressed size, or 0 if the block does not compress
+ */
+uint32_t TraceCompress(const uint8_t* in, uint32_t len, std::vector<uint8_t>& out);
+
+/**
+ * Decompress a block compressed by TraceCompress.
+ *
+ * \param in the compressed block
+ * \param inLen the size of the compressed block
+ * \param out the decompressed block
+ * \param len the size of the decompressed block
+ * \return false if the input is malformed or does not decompress to len bytes
+ */
+bool TraceDecompress(const uint8_t* in, uint32_t inLen, uint8_t* out, uint32_t len);
+
+} // namespace ns3
+
+#endif /* TRACE_WRITER_H */
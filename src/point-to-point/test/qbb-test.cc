@@ -0,0 +1,2422 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "ns3/boolean.h"
+#include "ns3/data-rate.h"
+#include "ns3/double.h"
+#include "ns3/ecmp-fib.h"
+#include "ns3/fct-collector.h"
+#include "ns3/flow-id-tag.h"
+#include "ns3/pause-header.h"
+#include "ns3/pfc-deadlock-detector.h"
+#include "ns3/ppp-header.h"
+#include "ns3/qbb-channel.h"
+#include "ns3/qbb-header.h"
+#include "ns3/qbb-helper.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/qbb-routing-helper.h"
+#include "ns3/qbb-snapshot.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/simple-seq-ts-header.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/switch-node.h"
+#include "ns3/test.h"
+#include "ns3/trace-writer.h"
+#include "ns3/udp-header.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \brief Round trip of qbb trace records through TraceWriter and TraceReader.
+ */
+class QbbTraceWriterTest : public TestCase
+{
+  public:
+    QbbTraceWriterTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbTraceWriterTest::QbbTraceWriterTest()
+    : TestCase("TraceWriter round trip")
+{
+}
+
+void
+QbbTraceWriterTest::DoRun()
+{
+    std::vector<TraceFormat> records;
+    for (uint32_t i = 0; i < 5000; i++)
+    {
+        TraceFormat tr;
+        memset(&tr, 0, sizeof(tr));
+        tr.time = 1000000 + i * 80;
+        tr.node = i % 7;
+        tr.intf = 1 + i % 3;
+        tr.qidx = 3;
+        tr.qlen = (i * 1048) % 100000;
+        tr.sip = 0x0b000001 + ((i % 7) << 8);
+        tr.dip = 0x0b000001 + (((i + 3) % 7) << 8);
+        tr.size = 1048;
+        tr.event = i % 4;
+        tr.nodeType = i % 3; // host, switch and nvswitch
+        tr.l3Prot = (i % 5) ? 0x11 : 0xFC;
+        if (tr.l3Prot == 0x11)
+        {
+            tr.data.sport = 10000 + i % 7;
+            tr.data.dport = 100;
+            tr.data.seq = i * 1000;
+            tr.data.ts = tr.time / 1000;
+            tr.data.pg = 3;
+            tr.data.payload = 1000;
+        }
+        else
+        {
+            tr.ack.sport = 100;
+            tr.ack.dport = 10000 + i % 7;
+            tr.ack.flags = 1;
+            tr.ack.pg = 3;
+            tr.ack.seq = i * 1000;
+            tr.ack.ts = tr.time / 1000;
+        }
+        records.push_back(tr);
+    }
+
+    std::string filename = CreateTempDirFilename("qbb-trace.bin");
+    Ptr<TraceWriter> writer = CreateObject<TraceWriter>();
+    writer->SetAttribute("BlockSize", UintegerValue(4096));
+    NS_TEST_ASSERT_MSG_EQ(writer->Open(filename), true, "cannot open trace file");
+    for (auto& tr : records)
+    {
+        writer->Write(tr);
+    }
+    writer->Close();
+    NS_TEST_EXPECT_MSG_EQ(writer->GetRecords(), records.size(), "records lost");
+    NS_TEST_EXPECT_MSG_LT(writer->GetFileBytes(),
+                          records.size() * sizeof(TraceFormat) / 3,
+                          "trace not compressed");
+
+    TraceReader reader;
+    NS_TEST_ASSERT_MSG_EQ(reader.Open(filename), true, "cannot read trace file");
+    NS_TEST_ASSERT_MSG_EQ(reader.GetNStreams(), 1, "unexpected number of streams");
+    TraceFormat tr;
+    for (auto& expected : records)
+    {
+        NS_TEST_ASSERT_MSG_EQ(reader.Read(0, tr), true, "trace truncated");
+        NS_TEST_ASSERT_MSG_EQ(memcmp(&tr, &expected, sizeof(tr)), 0, "record mismatch");
+    }
+    NS_TEST_EXPECT_MSG_EQ(reader.Read(0, tr), false, "trailing records");
+
+    // the node type shares its byte with the event and the ECN bits
+    TraceFormat nvswitch = records[0];
+    nvswitch.nodeType = 2;
+    nvswitch.event = Drop;
+    nvswitch.ecn = 3;
+    std::vector<uint8_t> encoded;
+    TraceFormat encodeLast;
+    TraceFormat decodeLast;
+    memset(&encodeLast, 0, sizeof(encodeLast));
+    memset(&decodeLast, 0, sizeof(decodeLast));
+    TraceEncode(encoded, nvswitch, encodeLast);
+    NS_TEST_ASSERT_MSG_EQ(TraceDecode(encoded.data(), encoded.size(), tr, decodeLast),
+                          encoded.size(),
+                          "record not decoded");
+    NS_TEST_EXPECT_MSG_EQ((uint32_t)tr.nodeType, 2, "nvswitch node type lost");
+    NS_TEST_EXPECT_MSG_EQ((uint32_t)tr.event, (uint32_t)Drop, "event lost");
+    NS_TEST_EXPECT_MSG_EQ((uint32_t)tr.ecn, 3, "ECN bits lost");
+    Simulator::Destroy();
+}
+
+/**
+ * \brief EcmpFib lookups against the next-hop lists they were built from.
+ */
+class QbbEcmpFibTest : public TestCase
+{
+  public:
+    QbbEcmpFibTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbEcmpFibTest::QbbEcmpFibTest()
+    : TestCase("EcmpFib compiles shared ECMP groups")
+{
+}
+
+void
+QbbEcmpFibTest::DoRun()
+{
+    EcmpFib fib;
+    std::vector<std::vector<int>> expected(600);
+    for (uint32_t host = 0; host < 600; host++)
+    {
+        // a few distinct groups for many destinations, like a fat-tree switch
+        if (host % 50 == 7)
+            continue;
+        uint32_t dip = 0x0b000001 | (host << 8);
+        if (host < 16)
+            expected[host] = {int(host + 1)};
+        else
+            expected[host] = {17 + int(host % 3), 20, 21, 22 + int(host % 2)};
+        for (int port : expected[host])
+            fib.Add(dip, port);
+    }
+    fib.Add(0x0a000002, 5); // not a host address
+    fib.Add(0x0a000002, 6);
+    fib.Freeze();
+
+    NS_TEST_ASSERT_MSG_EQ(fib.IsFrozen(), true, "not frozen");
+    NS_TEST_EXPECT_MSG_EQ(fib.GetNGroups(), 15 + 6 + 1, "ECMP groups not shared");
+    for (uint32_t host = 0; host < 600; host++)
+    {
+        uint32_t dip = 0x0b000001 | (host << 8);
+        const EcmpFib::Group* g = fib.Find(dip);
+        if (expected[host].empty())
+        {
+            NS_TEST_EXPECT_MSG_EQ((g == NULL), true, "route to a missing destination");
+            continue;
+        }
+        NS_TEST_ASSERT_MSG_EQ((g != NULL), true, "missing route");
+        NS_TEST_ASSERT_MSG_EQ((fib.GetNextHops(dip) == expected[host]), true, "wrong next hops");
+        for (uint32_t h = 0; h < 64; h++)
+        {
+            uint32_t hash = h * 0x9e3779b9u;
+            uint32_t idx = ((uint64_t)hash * expected[host].size()) >> 32;
+            NS_TEST_ASSERT_MSG_EQ((int)fib.Select(g, hash), expected[host][idx], "wrong next hop");
+        }
+    }
+    NS_TEST_EXPECT_MSG_EQ((fib.Find(0x0b000002) == NULL), true, "route to a non-host address");
+    NS_TEST_EXPECT_MSG_EQ((fib.Find(0x0b000001 | (600 << 8)) == NULL), true, "route past the end");
+    NS_TEST_EXPECT_MSG_EQ((fib.GetNextHops(0x0a000002) == std::vector<int>{5, 6}),
+                          true,
+                          "wrong next hops of a non-host address");
+
+    // adding to a frozen table keeps the compiled entries
+    fib.Add(0x0b000001 | (7 << 8), 3);
+    NS_TEST_EXPECT_MSG_EQ(fib.IsFrozen(), false, "still frozen after Add");
+    fib.Freeze();
+    NS_TEST_EXPECT_MSG_EQ((fib.GetNextHops(0x0b000001 | (7 << 8)) == std::vector<int>{3}),
+                          true,
+                          "entry added after Freeze lost");
+    NS_TEST_EXPECT_MSG_EQ((fib.GetNextHops(0x0b000001 | (300 << 8)) == expected[300]),
+                          true,
+                          "compiled entry lost after Add");
+
+    fib.Clear();
+    fib.Freeze();
+    NS_TEST_EXPECT_MSG_EQ((fib.Find(0x0b000001 | (300 << 8)) == NULL), true, "entry after Clear");
+}
+
+/**
+ * \brief QbbRoutingHelper on a leaf-spine topology.
+ */
+class QbbRoutingHelperTest : public TestCase
+{
+  public:
+    QbbRoutingHelperTest();
+
+  private:
+    void DoRun() override;
+    void Link(Ptr<Node> a, Ptr<Node> b);
+};
+
+QbbRoutingHelperTest::QbbRoutingHelperTest()
+    : TestCase("QbbRoutingHelper computes ECMP routes")
+{
+}
+
+void
+QbbRoutingHelperTest::Link(Ptr<Node> a, Ptr<Node> b)
+{
+    Ptr<QbbNetDevice> devA = CreateObject<QbbNetDevice>();
+    a->AddDevice(devA);
+    devA->SetQueue(CreateObject<BEgressQueue>());
+    Ptr<QbbNetDevice> devB = CreateObject<QbbNetDevice>();
+    b->AddDevice(devB);
+    devB->SetQueue(CreateObject<BEgressQueue>());
+    Ptr<QbbChannel> channel = CreateObject<QbbChannel>();
+    devA->Attach(channel);
+    devB->Attach(channel);
+}
+
+void
+QbbRoutingHelperTest::DoRun()
+{
+    // two leaves with two hosts each, both leaves connected to two spines
+    NodeContainer hosts;
+    hosts.Create(4);
+    NodeContainer leaves;
+    NodeContainer spines;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        leaves.Add(CreateObject<SwitchNode>());
+        spines.Add(CreateObject<SwitchNode>());
+    }
+    for (uint32_t l = 0; l < 2; l++)
+    {
+        Link(leaves.Get(l), hosts.Get(2 * l));
+        Link(leaves.Get(l), hosts.Get(2 * l + 1));
+        Link(leaves.Get(l), spines.Get(0));
+        Link(leaves.Get(l), spines.Get(1));
+    }
+
+    QbbRoutingHelper routing;
+    routing.SetThreads(2);
+    routing.PopulateRoutingTables(NodeContainer(hosts, leaves, spines));
+    // every host on its own, the leaves differ by their hosts, the spines are alike
+    NS_TEST_EXPECT_MSG_EQ(routing.GetNClasses(), 4 + 2 + 1, "wrong node classes");
+
+    auto nextHops = [&](Ptr<Node> sw, uint32_t host) {
+        Ptr<SwitchNode> s = DynamicCast<SwitchNode>(sw);
+        uint32_t dip = QbbRoutingHelper::GetNodeIp(hosts.Get(host)->GetId()).Get();
+        return s->GetFib().GetNextHops(dip);
+    };
+    NS_TEST_EXPECT_MSG_EQ((nextHops(leaves.Get(0), 0) == std::vector<int>{0}),
+                          true,
+                          "wrong route to a local host");
+    NS_TEST_EXPECT_MSG_EQ((nextHops(leaves.Get(0), 1) == std::vector<int>{1}),
+                          true,
+                          "wrong route to a local host");
+    NS_TEST_EXPECT_MSG_EQ((nextHops(leaves.Get(0), 2) == std::vector<int>{2, 3}),
+                          true,
+                          "wrong ECMP route to a remote host");
+    NS_TEST_EXPECT_MSG_EQ((nextHops(leaves.Get(1), 1) == std::vector<int>{2, 3}),
+                          true,
+                          "wrong ECMP route to a remote host");
+    for (uint32_t s = 0; s < 2; s++)
+    {
+        for (uint32_t h = 0; h < 4; h++)
+        {
+            NS_TEST_EXPECT_MSG_EQ((nextHops(spines.Get(s), h) == std::vector<int>{int(h / 2)}),
+                                  true,
+                                  "wrong route of a spine");
+        }
+    }
+
+    Simulator::Destroy();
+}
+
+/**
+ * \brief FctCollector slowdown quantiles and binary dump.
+ */
+class QbbFctCollectorTest : public TestCase
+{
+  public:
+    QbbFctCollectorTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbFctCollectorTest::QbbFctCollectorTest()
+    : TestCase("FctCollector records completed qps")
+{
+}
+
+void
+QbbFctCollectorTest::DoRun()
+{
+    Ptr<FctCollector> collector = CreateObject<FctCollector>();
+    collector->SetSizeBuckets({1000});
+
+    // 1000 qps of 500 bytes with slowdowns 1, 1.01, ..., 10.99 and one large qp;
+    // at 8Gbps a byte takes 1ns, so the ideal FCT of the small qps is 1500ns
+    std::vector<double> slowdowns;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        Ptr<RdmaQueuePair> qp =
+            CreateObject<RdmaQueuePair>(3, Ipv4Address(0x0b000001), Ipv4Address(0x0b000101), i, 100);
+        qp->SetSize(500);
+        qp->SetBaseRtt(1000);
+        qp->m_max_rate = DataRate("8Gbps");
+        slowdowns.push_back(1 + (i * 7 % 1000) / 100.0);
+        Simulator::Schedule(NanoSeconds(1500 * slowdowns.back()),
+                            &FctCollector::Record,
+                            collector,
+                            qp);
+    }
+    Ptr<RdmaQueuePair> large =
+        CreateObject<RdmaQueuePair>(1, Ipv4Address(0x0b000101), Ipv4Address(0x0b000001), 7, 100);
+    large->SetSize(1000000);
+    large->SetBaseRtt(1000);
+    large->m_max_rate = DataRate("8Gbps");
+    Simulator::Schedule(MicroSeconds(2002), &FctCollector::Record, collector, large);
+    Simulator::Run();
+
+    NS_TEST_ASSERT_MSG_EQ(collector->GetNRecords(), 1001, "records lost");
+    NS_TEST_EXPECT_MSG_EQ(collector->GetBucketCount(0), 1000, "wrong small qp count");
+    NS_TEST_EXPECT_MSG_EQ(collector->GetBucketCount(1), 1, "wrong large qp count");
+    std::sort(slowdowns.begin(), slowdowns.end());
+    for (double q : {0.0, 0.5, 0.99, 0.999, 1.0})
+    {
+        double exact = slowdowns[(uint32_t)(q * 999)];
+        NS_TEST_EXPECT_MSG_EQ_TOL(collector->GetSlowdownQuantile(0, q),
+                                  exact,
+                                  exact * 0.02,
+                                  "slowdown quantile " << q);
+    }
+    NS_TEST_EXPECT_MSG_EQ_TOL(collector->GetSlowdownQuantile(1, 0.5), 2, 0.04, "large qp");
+    NS_TEST_EXPECT_MSG_EQ(collector->GetSlowdownQuantile(2, 0.5), 0, "empty bucket");
+
+    std::string filename = CreateTempDirFilename("qbb-fct.bin");
+    NS_TEST_ASSERT_MSG_EQ(collector->WriteBinary(filename), true, "cannot write fct file");
+    std::vector<FctRecord> records;
+    NS_TEST_ASSERT_MSG_EQ(FctCollector::ReadBinary(filename, records), true, "cannot read");
+    NS_TEST_ASSERT_MSG_EQ(records.size(), 1001, "wrong number of records");
+    std::sort(records.begin(), records.end(), [](const FctRecord& a, const FctRecord& b) {
+        return a.finish < b.finish;
+    });
+    NS_TEST_EXPECT_MSG_EQ(records[0].start, 0, "wrong start");
+    NS_TEST_EXPECT_MSG_EQ(records[0].finish, 1500, "wrong finish");
+    NS_TEST_EXPECT_MSG_EQ(records[0].size, 500, "wrong size");
+    NS_TEST_EXPECT_MSG_EQ(records[0].ideal, 1500, "wrong ideal FCT");
+    NS_TEST_EXPECT_MSG_EQ(records[0].sip, 0x0b000001, "wrong sip");
+    NS_TEST_EXPECT_MSG_EQ(records[0].dip, 0x0b000101, "wrong dip");
+    NS_TEST_EXPECT_MSG_EQ(records[0].sport, 0, "wrong sport");
+    NS_TEST_EXPECT_MSG_EQ(records[0].dport, 100, "wrong dport");
+    NS_TEST_EXPECT_MSG_EQ(records[0].pg, 3, "wrong pg");
+    NS_TEST_EXPECT_MSG_EQ(records[1000].size, 1000000, "wrong size of the large qp");
+    NS_TEST_EXPECT_MSG_EQ(records[1000].pg, 1, "wrong pg of the large qp");
+    Simulator::Destroy();
+}
+
+/**
+ * \brief QbbHelper bulk install matches installing the links one by one.
+ */
+class QbbHelperBulkInstallTest : public TestCase
+{
+  public:
+    QbbHelperBulkInstallTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbHelperBulkInstallTest::QbbHelperBulkInstallTest()
+    : TestCase("QbbHelper bulk install")
+{
+}
+
+void
+QbbHelperBulkInstallTest::DoRun()
+{
+    // enough links for several tasks of the thread pool
+    const uint32_t nNodes = 64;
+    std::vector<std::pair<uint32_t, uint32_t>> links;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        uint32_t a = (i * 7) % nNodes;
+        links.emplace_back(a, (a + 1 + i % 13) % nNodes);
+    }
+
+    QbbHelper qbb;
+    NodeContainer serialNodes;
+    serialNodes.Create(nNodes);
+    NetDeviceContainer serial;
+    for (const auto& link : links)
+    {
+        serial.Add(qbb.Install(serialNodes.Get(link.first), serialNodes.Get(link.second)));
+    }
+    NodeContainer bulkNodes;
+    bulkNodes.Create(nNodes);
+    qbb.SetThreads(4);
+    NetDeviceContainer bulk = qbb.Install(bulkNodes, links);
+
+    NS_TEST_ASSERT_MSG_EQ(bulk.GetN(), serial.GetN(), "wrong number of devices");
+    uint8_t mac[6];
+    auto macIndex = [&mac](Ptr<NetDevice> dev) {
+        Mac48Address::ConvertFrom(dev->GetAddress()).CopyTo(mac);
+        uint64_t index = 0;
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            index = (index << 8) | mac[k];
+        }
+        return index;
+    };
+    uint32_t channelOffset = bulk.Get(0)->GetChannel()->GetId() -
+                             serial.Get(0)->GetChannel()->GetId();
+    uint64_t macOffset = macIndex(bulk.Get(0)) - macIndex(serial.Get(0));
+    for (uint32_t j = 0; j < bulk.GetN(); j++)
+    {
+        Ptr<NetDevice> s = serial.Get(j);
+        Ptr<NetDevice> b = bulk.Get(j);
+        NS_TEST_EXPECT_MSG_EQ(b->GetNode()->GetId() - bulkNodes.Get(0)->GetId(),
+                              s->GetNode()->GetId() - serialNodes.Get(0)->GetId(),
+                              "wrong node of device " << j);
+        NS_TEST_EXPECT_MSG_EQ(b->GetIfIndex(), s->GetIfIndex(), "wrong ifindex of device " << j);
+        NS_TEST_EXPECT_MSG_EQ((b->GetNode()->GetDevice(b->GetIfIndex()) == b),
+                              true,
+                              "device " << j << " not on its node");
+        NS_TEST_EXPECT_MSG_EQ(macIndex(b) - macIndex(s), macOffset, "wrong MAC of device " << j);
+        NS_TEST_EXPECT_MSG_EQ(b->GetChannel()->GetId() - s->GetChannel()->GetId(),
+                              channelOffset,
+                              "wrong channel of device " << j);
+        Ptr<QbbChannel> channel = DynamicCast<QbbChannel>(b->GetChannel());
+        NS_TEST_EXPECT_MSG_EQ((channel->GetDevice(j % 2) == b),
+                              true,
+                              "device " << j << " not attached");
+        NS_TEST_EXPECT_MSG_EQ((DynamicCast<QbbNetDevice>(b)->GetQueue() != nullptr),
+                              true,
+                              "no queue on device " << j);
+    }
+
+    Simulator::Destroy();
+}
+
+/**
+ * \brief QbbSnapshot restores a leaf-spine topology, with multi-pool MMUs on
+ * the leaves.
+ */
+class QbbSnapshotTest : public TestCase
+{
+  public:
+    QbbSnapshotTest();
+
+  private:
+    void DoRun() override;
+
+    /// Setup state of a node
+    struct NodeState
+    {
+        uint32_t type;
+        uint32_t nDevices;
+        std::vector<uint64_t> rates;          // data rate of each qbb device
+        std::vector<int64_t> delays;          // delay of the channel of each qbb device
+        std::vector<std::vector<int>> routes; // next hops towards each host
+        uint32_t bufferSize;
+        std::vector<uint32_t> kmin;
+        std::vector<uint32_t> headroom;
+        uint32_t totalHdrm;
+        uint32_t ccMode;
+        std::string mmuType;
+        std::vector<uint32_t> poolSize; // service pools of a MultiPoolSwitchMmu
+        std::vector<uint32_t> prioPool;
+        std::vector<bool> lossless;
+    };
+
+    /**
+     * \param nodes the nodes of the topology, hosts first
+     * \param nHosts the number of hosts
+     * \return the state of the nodes
+     */
+    std::vector<NodeState> GetState(NodeContainer nodes, uint32_t nHosts);
+
+    /// Aggregate an RdmaDriver with an RdmaHw to the hosts
+    void AddDrivers(NodeContainer nodes, uint32_t nHosts);
+};
+
+QbbSnapshotTest::QbbSnapshotTest()
+    : TestCase("QbbSnapshot save and restore")
+{
+}
+
+void
+QbbSnapshotTest::AddDrivers(NodeContainer nodes, uint32_t nHosts)
+{
+    for (uint32_t i = 0; i < nHosts; i++)
+    {
+        Ptr<RdmaDriver> driver = CreateObject<RdmaDriver>();
+        driver->SetRdmaHw(CreateObject<RdmaHw>());
+        nodes.Get(i)->AggregateObject(driver);
+    }
+}
+
+std::vector<QbbSnapshotTest::NodeState>
+QbbSnapshotTest::GetState(NodeContainer nodes, uint32_t nHosts)
+{
+    std::vector<NodeState> state(nodes.GetN());
+    for (uint32_t u = 0; u < nodes.GetN(); u++)
+    {
+        Ptr<Node> node = nodes.Get(u);
+        NodeState& s = state[u];
+        s.type = node->GetNodeType();
+        s.nDevices = node->GetNDevices();
+        for (uint32_t i = 0; i < node->GetNDevices(); i++)
+        {
+            Ptr<QbbNetDevice> dev = DynamicCast<QbbNetDevice>(node->GetDevice(i));
+            s.rates.push_back(dev->GetDataRate().GetBitRate());
+            s.delays.push_back(
+                DynamicCast<QbbChannel>(dev->GetChannel())->GetDelay().GetPicoSeconds());
+        }
+        for (uint32_t h = 0; h < nHosts; h++)
+        {
+            uint32_t dip = QbbRoutingHelper::GetNodeIp(nodes.Get(h)->GetId()).Get();
+            Ptr<SwitchNode> sw = DynamicCast<SwitchNode>(node);
+            if (sw)
+            {
+                s.routes.push_back(sw->GetFib().GetNextHops(dip));
+            }
+            else
+            {
+                auto& table = node->GetObject<RdmaDriver>()->m_rdma->m_rtTable;
+                s.routes.push_back(table.count(dip) ? table[dip] : std::vector<int>());
+            }
+        }
+        Ptr<SwitchNode> sw = DynamicCast<SwitchNode>(node);
+        if (sw)
+        {
+            s.bufferSize = sw->m_mmu->buffer_size;
+            s.kmin.assign(sw->m_mmu->kmin, sw->m_mmu->kmin + s.nDevices);
+            s.headroom.assign(sw->m_mmu->headroom, sw->m_mmu->headroom + s.nDevices);
+            s.totalHdrm = sw->m_mmu->total_hdrm;
+            UintegerValue ccMode;
+            sw->GetAttribute("CcMode", ccMode);
+            s.ccMode = ccMode.Get();
+            s.mmuType = sw->GetMmuType().GetName();
+            Ptr<MultiPoolSwitchMmu> mmu = DynamicCast<MultiPoolSwitchMmu>(sw->m_mmu);
+            if (mmu)
+            {
+                s.poolSize.assign(mmu->pool_size, mmu->pool_size + MultiPoolSwitchMmu::poolCnt);
+                s.prioPool.assign(mmu->prio_pool, mmu->prio_pool + SwitchMmu::qCnt);
+                s.lossless.assign(mmu->lossless, mmu->lossless + SwitchMmu::qCnt);
+            }
+        }
+    }
+    return state;
+}
+
+void
+QbbSnapshotTest::DoRun()
+{
+    // four hosts on two leaves, both leaves connected to two spines at a higher rate
+    const uint32_t nHosts = 4;
+    std::vector<std::pair<uint32_t, uint32_t>> links = {{4, 0}, {4, 1}, {5, 2}, {5, 3}};
+    std::vector<std::pair<uint32_t, uint32_t>> fabric = {{4, 6}, {4, 7}, {5, 6}, {5, 7}};
+    std::string filename = CreateTempDirFilename("qbb-snapshot.bin");
+    std::string config = "leaf-spine 4 hosts";
+    std::vector<NodeState> built;
+    {
+        NodeContainer nodes;
+        nodes.Create(nHosts);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            nodes.Add(CreateObject<SwitchNode>());
+        }
+        QbbHelper qbb;
+        qbb.Install(nodes, links);
+        qbb.SetDeviceAttribute("DataRate", DataRateValue(DataRate("400Gbps")));
+        qbb.SetChannelAttribute("Delay", TimeValue(NanoSeconds(1500)));
+        for (const auto& link : fabric)
+        {
+            qbb.Install(nodes.Get(link.first), nodes.Get(link.second));
+        }
+        AddDrivers(nodes, nHosts);
+        QbbRoutingHelper routing;
+        routing.SetThreads(1);
+        routing.PopulateRoutingTables(nodes);
+        for (uint32_t u = nHosts; u < nodes.GetN(); u++)
+        {
+            Ptr<SwitchNode> sw = DynamicCast<SwitchNode>(nodes.Get(u));
+            sw->SetAttribute("CcMode", UintegerValue(3));
+            if (u < 6)
+            {
+                // leaves: priority 1 lossy in its own pool, pool 0 left to its default
+                sw->SetAttribute("MmuType", TypeIdValue(MultiPoolSwitchMmu::GetTypeId()));
+                Ptr<MultiPoolSwitchMmu> mmu = DynamicCast<MultiPoolSwitchMmu>(sw->m_mmu);
+                mmu->ConfigPool(1, 100000 + u);
+                mmu->ConfigPriority(1, 1, false, 1, 0.5);
+            }
+            sw->m_mmu->ConfigBufferSize(12 * 1024 * 1024 + u);
+            for (uint32_t p = 0; p < sw->GetNDevices(); p++)
+            {
+                sw->m_mmu->ConfigEcn(p, 100 + u, 400 + p, 0.2);
+                sw->m_mmu->ConfigHdrm(p, 1000 * u + p);
+            }
+            sw->m_mmu->ConfigNPort(sw->GetNDevices() - 1);
+        }
+        built = GetState(nodes, nHosts);
+
+        QbbSnapshot snapshot;
+        snapshot.Capture(nodes);
+        NS_TEST_ASSERT_MSG_EQ(snapshot.GetNNodes(), 8, "wrong number of nodes");
+        NS_TEST_ASSERT_MSG_EQ(snapshot.GetNLinks(), 8, "wrong number of links");
+        NS_TEST_ASSERT_MSG_EQ(snapshot.Save(filename, QbbSnapshot::Hash(config)),
+                              true,
+                              "cannot save");
+        Simulator::Destroy();
+    }
+
+    QbbSnapshot snapshot;
+    NS_TEST_EXPECT_MSG_EQ(snapshot.Load(filename, QbbSnapshot::Hash(config + " changed")),
+                          false,
+                          "loaded with another configuration");
+    NS_TEST_EXPECT_MSG_EQ(snapshot.IsValid(), false, "image of another configuration");
+    NS_TEST_ASSERT_MSG_EQ(snapshot.Load(filename, QbbSnapshot::Hash(config)), true, "cannot load");
+    NodeContainer nodes = snapshot.RestoreNodes();
+    QbbHelper qbb;
+    snapshot.RestoreLinks(nodes, qbb);
+    AddDrivers(nodes, nHosts);
+    snapshot.RestoreState(nodes);
+    std::vector<NodeState> restored = GetState(nodes, nHosts);
+    NS_TEST_ASSERT_MSG_EQ(restored.size(), built.size(), "wrong number of nodes");
+    for (uint32_t u = 0; u < built.size(); u++)
+    {
+        NS_TEST_EXPECT_MSG_EQ(restored[u].type, built[u].type, "wrong type of node " << u);
+        NS_TEST_EXPECT_MSG_EQ(restored[u].nDevices, built[u].nDevices, "wrong devices of " << u);
+        NS_TEST_EXPECT_MSG_EQ((restored[u].rates == built[u].rates), true, "wrong rates " << u);
+        NS_TEST_EXPECT_MSG_EQ((restored[u].delays == built[u].delays), true, "wrong delay " << u);
+        NS_TEST_EXPECT_MSG_EQ((restored[u].routes == built[u].routes), true, "wrong routes " << u);
+        if (built[u].type == 1)
+        {
+            NS_TEST_EXPECT_MSG_EQ(restored[u].bufferSize, built[u].bufferSize, "buffer " << u);
+            NS_TEST_EXPECT_MSG_EQ((restored[u].kmin == built[u].kmin), true, "ECN of " << u);
+            NS_TEST_EXPECT_MSG_EQ((restored[u].headroom == built[u].headroom),
+                                  true,
+                                  "headroom of " << u);
+            NS_TEST_EXPECT_MSG_EQ(restored[u].totalHdrm, built[u].totalHdrm, "hdrm of " << u);
+            NS_TEST_EXPECT_MSG_EQ(restored[u].ccMode, built[u].ccMode, "CC mode of " << u);
+            NS_TEST_EXPECT_MSG_EQ(restored[u].mmuType, built[u].mmuType, "MMU of " << u);
+            NS_TEST_EXPECT_MSG_EQ((restored[u].poolSize == built[u].poolSize),
+                                  true,
+                                  "pools of " << u);
+            NS_TEST_EXPECT_MSG_EQ((restored[u].prioPool == built[u].prioPool),
+                                  true,
+                                  "priority pools of " << u);
+            NS_TEST_EXPECT_MSG_EQ((restored[u].lossless == built[u].lossless),
+                                  true,
+                                  "lossless priorities of " << u);
+        }
+    }
+    NS_TEST_EXPECT_MSG_EQ(built[4].mmuType, "ns3::MultiPoolSwitchMmu", "multi-pool leaf");
+    NS_TEST_EXPECT_MSG_EQ(built[6].mmuType, "ns3::SwitchMmu", "single pool spine");
+    NS_TEST_EXPECT_MSG_GT(built[4].poolSize[0], 0, "pool 0 sized");
+    // a packet on a lossless PG of a restored leaf fits its pool, without PFC
+    Ptr<SwitchMmu> leaf = DynamicCast<SwitchNode>(nodes.Get(4))->m_mmu;
+    NS_TEST_EXPECT_MSG_EQ(leaf->CheckIngressAdmission(1, 3, 1000), true, "lossless admission");
+    leaf->UpdateIngressAdmission(1, 3, 10000);
+    NS_TEST_EXPECT_MSG_EQ(leaf->CheckShouldPause(1, 3), false, "restored pool 0 empty");
+    leaf->RemoveFromIngressAdmission(1, 3, 10000);
+    NS_TEST_EXPECT_MSG_EQ((built[0].routes[2] == std::vector<int>{0}), true, "host route");
+    NS_TEST_EXPECT_MSG_EQ((built[4].routes[2] == std::vector<int>{2, 3}), true, "ECMP route");
+
+    // a corrupted image is refused
+    FILE* file = fopen(filename.c_str(), "r+b");
+    fseek(file, -1, SEEK_END);
+    fputc(0x5a, file);
+    fclose(file);
+    QbbSnapshot corrupted;
+    NS_TEST_EXPECT_MSG_EQ(corrupted.Load(filename, QbbSnapshot::Hash(config)),
+                          false,
+                          "loaded a corrupted image");
+
+    Simulator::Destroy();
+}
+
+/**
+ * \brief DCQCN gives the same rates with lazy timers as with timers.
+ */
+class QbbDcqcnLazyTimersTest : public TestCase
+{
+  public:
+    QbbDcqcnLazyTimersTest();
+
+  private:
+    void DoRun() override;
+
+    /// DCQCN parameters of a run
+    struct Config
+    {
+        double alphaInterval;    // AlphaResumInterval, us
+        double decreaseInterval; // RateDecreaseInterval, us
+        double rpTimer;          // RPTimer, us
+        std::string rai;
+        std::string rhai;
+    };
+
+    /**
+     * Run 4 qps receiving bursts of CNPs on a 100Gbps NIC.
+     * \param config the DCQCN parameters
+     * \param lazy the value of DcqcnLazyTimers
+     * \param trace the rate and the target rate of the qps every 2us
+     * \return the number of events executed
+     */
+    uint64_t Run(const Config& config, bool lazy, std::vector<uint64_t>& trace);
+
+    /// Deliver a CNP in 1ns, after the timers expiring then
+    static void Cnp(Ptr<RdmaHw> hw, Ptr<RdmaQueuePair> qp);
+    /// Sample the rates of a qp in 1ns, after the timers expiring then
+    static void Sample(Ptr<RdmaQueuePair> qp, std::vector<uint64_t>* trace);
+};
+
+QbbDcqcnLazyTimersTest::QbbDcqcnLazyTimersTest()
+    : TestCase("DCQCN with lazy timers")
+{
+}
+
+void
+QbbDcqcnLazyTimersTest::Cnp(Ptr<RdmaHw> hw, Ptr<RdmaQueuePair> qp)
+{
+    Simulator::Schedule(NanoSeconds(1), &RdmaHw::cnp_received_mlx, hw, qp);
+}
+
+void
+QbbDcqcnLazyTimersTest::Sample(Ptr<RdmaQueuePair> qp, std::vector<uint64_t>* trace)
+{
+    Simulator::Schedule(NanoSeconds(1), [qp, trace]() {
+        trace->push_back(qp->m_rate.GetBitRate());
+        trace->push_back(qp->Cc<MlxCcState>().m_targetRate.GetBitRate());
+    });
+}
+
+uint64_t
+QbbDcqcnLazyTimersTest::Run(const Config& config, bool lazy, std::vector<uint64_t>& trace)
+{
+    Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+    hw->SetAttribute("AlphaResumInterval", DoubleValue(config.alphaInterval));
+    hw->SetAttribute("RateDecreaseInterval", DoubleValue(config.decreaseInterval));
+    hw->SetAttribute("RPTimer", DoubleValue(config.rpTimer));
+    hw->SetAttribute("RateAI", DataRateValue(DataRate(config.rai)));
+    hw->SetAttribute("RateHAI", DataRateValue(DataRate(config.rhai)));
+    hw->SetAttribute("MinRate", DataRateValue(DataRate("100Mbps")));
+    hw->SetAttribute("CcMode", UintegerValue(1));
+    hw->SetAttribute("DcqcnLazyTimers", BooleanValue(lazy));
+    Ptr<QbbNetDevice> dev = CreateObject<QbbNetDevice>();
+    dev->SetDataRate(DataRate("100Gbps"));
+    hw->m_nic.push_back(RdmaInterfaceMgr(dev));
+
+    std::vector<Ptr<RdmaQueuePair>> qps;
+    for (uint16_t i = 0; i < 4; i++)
+    {
+        Ptr<RdmaQueuePair> qp =
+            CreateObject<RdmaQueuePair>(3, Ipv4Address(0x0b000001), Ipv4Address(0x0b000101), i, 100);
+        qp->SetSrc(0);
+        qp->SetDest(1);
+        qp->m_rate = qp->m_max_rate = dev->GetDataRate();
+        hw->m_cc.init(*hw, *qp, dev->GetDataRate());
+        qps.push_back(qp);
+    }
+    hw->m_rtTable[0x0b000101] = {0};
+
+    // congestion episodes of 100 to 400us with a CNP every 1 to 20us on average,
+    // then quiet periods of up to 3ms; some CNPs fall on the timers
+    uint32_t seed = 12345;
+    auto next = [&seed](uint32_t n) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % n;
+    };
+    const int64_t end = 20000000;
+    for (uint32_t i = 0; i < qps.size(); i++)
+    {
+        int64_t t = next(50000);
+        while (t < end)
+        {
+            int64_t episodeEnd = t + 100000 + next(300000);
+            uint32_t gap = 1000 + next(19000);
+            for (; t < episodeEnd && t < end; t += 1 + next(2 * gap))
+            {
+                Simulator::Schedule(NanoSeconds(t), &QbbDcqcnLazyTimersTest::Cnp, hw, qps[i]);
+            }
+            t += next(3000000);
+        }
+    }
+    for (int64_t t = 1000; t < end; t += 2000)
+    {
+        for (auto qp : qps)
+        {
+            Simulator::Schedule(NanoSeconds(t), &QbbDcqcnLazyTimersTest::Sample, qp, &trace);
+        }
+    }
+    Simulator::Stop(NanoSeconds(end));
+    uint64_t events = Simulator::GetEventCount();
+    Simulator::Run();
+    events = Simulator::GetEventCount() - events;
+    Simulator::Destroy();
+    return events;
+}
+
+void
+QbbDcqcnLazyTimersTest::DoRun()
+{
+    std::vector<Config> configs = {
+        {55, 4, 1500, "5Mb/s", "50Mb/s"},    // defaults
+        {55, 4, 8, "1Gb/s", "5Gb/s"},        // increase after decrease checks of the same time
+        {55, 8, 4, "1Gb/s", "5Gb/s"},        // increase before decrease checks of the same time
+        {4, 4, 4, "500Mb/s", "10Gb/s"},      // all timers together
+        {3, 5, 12, "500Mb/s", "10Gb/s"},     // alpha updates more often than decrease checks
+    };
+    for (uint32_t c = 0; c < configs.size(); c++)
+    {
+        std::vector<uint64_t> timers;
+        std::vector<uint64_t> lazy;
+        uint64_t timerEvents = Run(configs[c], false, timers);
+        uint64_t lazyEvents = Run(configs[c], true, lazy);
+        NS_TEST_ASSERT_MSG_EQ(lazy.size(), timers.size(), "config " << c << ": samples lost");
+        uint32_t i = 0;
+        while (i < timers.size() && timers[i] == lazy[i])
+            i++;
+        NS_TEST_EXPECT_MSG_EQ(i,
+                              timers.size(),
+                              "config " << c << ": rates differ at sample " << i / 8);
+        // the rates do change
+        NS_TEST_EXPECT_MSG_LT(*std::min_element(timers.begin(), timers.end()),
+                              50000000000ULL,
+                              "config " << c << ": no rate decrease");
+        NS_TEST_EXPECT_MSG_LT(lazyEvents, timerEvents, "config " << c << ": no event saved");
+    }
+}
+
+/**
+ * \brief RdmaHw allocates the qp state of its CcMode and calls its hooks.
+ */
+class QbbCcPolicyTest : public TestCase
+{
+  public:
+    QbbCcPolicyTest();
+
+  private:
+    void DoRun() override;
+
+    /// qp state of TestCc
+    struct TestCcState : public RdmaCcState
+    {
+        DataRate rate;
+        uint32_t acks = 0;
+        uint32_t cnps = 0;
+    };
+
+    /// congestion control counting its hooks
+    struct TestCc : public RdmaCcPolicy
+    {
+        typedef TestCcState State;
+
+        static void SetRate(RdmaHw& hw, RdmaQueuePair& qp, DataRate rate)
+        {
+            qp.Cc<TestCcState>().rate = rate;
+        }
+
+        static void OnAck(RdmaHw& hw,
+                          Ptr<RdmaQueuePair> qp,
+                          Ptr<Packet> p,
+                          CustomHeader& ch,
+                          bool cnp)
+        {
+            qp->Cc<TestCcState>().acks++;
+            qp->Cc<TestCcState>().cnps += cnp;
+        }
+    };
+};
+
+QbbCcPolicyTest::QbbCcPolicyTest()
+    : TestCase("RdmaHw congestion control policies")
+{
+}
+
+void
+QbbCcPolicyTest::DoRun()
+{
+    RdmaHw::RegisterCc(42, RdmaCcOps::Of<TestCc>());
+    DataRate rate("100Gbps");
+    auto makeQp = [&rate](uint32_t ccMode) {
+        Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+        hw->SetAttribute("CcMode", UintegerValue(ccMode));
+        hw->SetAttribute("MultiRate", BooleanValue(true));
+        Ptr<RdmaQueuePair> qp = CreateObject<RdmaQueuePair>(3,
+                                                            Ipv4Address(0x0b000001),
+                                                            Ipv4Address(0x0b000101),
+                                                            1,
+                                                            100);
+        hw->m_cc.init(*hw, *qp, rate);
+        return std::make_pair(hw, qp);
+    };
+
+    // only the state of the algorithm of the mode is allocated
+    NS_TEST_EXPECT_MSG_EQ((makeQp(0).second->m_cc == nullptr), true, "state without CC");
+    Ptr<RdmaQueuePair> mlx = makeQp(1).second;
+    NS_TEST_ASSERT_MSG_EQ((dynamic_cast<MlxCcState*>(mlx->m_cc.get()) != nullptr), true, "DCQCN");
+    NS_TEST_EXPECT_MSG_EQ(mlx->Cc<MlxCcState>().m_targetRate, rate, "DCQCN target rate");
+    NS_TEST_EXPECT_MSG_EQ(mlx->Cc<MlxCcState>().m_alpha, 1, "DCQCN alpha");
+    Ptr<RdmaQueuePair> hp = makeQp(3).second;
+    NS_TEST_ASSERT_MSG_EQ((dynamic_cast<HpCcState*>(hp->m_cc.get()) != nullptr), true, "HPCC");
+    NS_TEST_EXPECT_MSG_EQ(hp->Cc<HpCcState>().m_curRate, rate, "HPCC rate");
+    NS_TEST_EXPECT_MSG_EQ(hp->Cc<HpCcState>().hopState[IntHeader::maxHop - 1].Rc,
+                          rate,
+                          "HPCC per hop rate");
+    NS_TEST_EXPECT_MSG_EQ((dynamic_cast<TimelyCcState*>(makeQp(7).second->m_cc.get()) != nullptr),
+                          true,
+                          "TIMELY");
+    NS_TEST_EXPECT_MSG_EQ((dynamic_cast<DctcpCcState*>(makeQp(8).second->m_cc.get()) != nullptr),
+                          true,
+                          "DCTCP");
+    NS_TEST_EXPECT_MSG_EQ(
+        (dynamic_cast<HpccPintCcState*>(makeQp(10).second->m_cc.get()) != nullptr),
+        true,
+        "HPCC-PINT");
+
+    // a registered mode gets its own state and hooks
+    auto [hw, qp] = makeQp(42);
+    NS_TEST_ASSERT_MSG_EQ((dynamic_cast<TestCcState*>(qp->m_cc.get()) != nullptr), true, "mode 42");
+    NS_TEST_EXPECT_MSG_EQ(qp->Cc<TestCcState>().rate, rate, "rate of mode 42");
+    CustomHeader ch;
+    hw->m_cc.ack(*hw, qp, Create<Packet>(), ch, false);
+    hw->m_cc.ack(*hw, qp, Create<Packet>(), ch, true);
+    hw->m_cc.setRate(*hw, *qp, DataRate("25Gbps"));
+    hw->m_cc.complete(*hw, *qp);
+    NS_TEST_EXPECT_MSG_EQ(qp->Cc<TestCcState>().acks, 2, "ACK hook");
+    NS_TEST_EXPECT_MSG_EQ(qp->Cc<TestCcState>().cnps, 1, "CNP flag");
+    NS_TEST_EXPECT_MSG_EQ(qp->Cc<TestCcState>().rate, DataRate("25Gbps"), "rate hook");
+    UintegerValue mode;
+    hw->GetAttribute("CcMode", mode);
+    NS_TEST_EXPECT_MSG_EQ(mode.Get(), 42, "CcMode");
+}
+
+/**
+ * \brief RdmaHw coalesces the ACKs of a rx qp and merges the ACKs queued in the NIC.
+ */
+class QbbAckCoalescingTest : public TestCase
+{
+  public:
+    QbbAckCoalescingTest();
+
+  private:
+    void DoRun() override;
+
+    /// An ACK or NACK read from the NIC
+    struct Ack
+    {
+        uint8_t l3Prot;
+        uint64_t seq;
+        bool cnp;
+    };
+
+    /**
+     * \param coalesceInterval the value of AckCoalesceInterval
+     * \param coalesceBytes the value of AckCoalesceBytes
+     * \param merge the value of AckMergeQueued
+     * \return the receiver RdmaHw, with an unconnected NIC which keeps the ACKs queued
+     */
+    static Ptr<RdmaHw> CreateReceiver(double coalesceInterval, uint32_t coalesceBytes, bool merge);
+    /// Deliver a 1000 byte data packet of seq, ECN marked if ce, at t in ns
+    static void Data(Ptr<RdmaHw> hw, int64_t t, uint64_t seq, bool ce = false);
+    /// \return the ACKs queued in the NIC of the receiver, removed from the queue
+    static std::vector<Ack> TakeAcks(Ptr<RdmaHw> hw);
+};
+
+QbbAckCoalescingTest::QbbAckCoalescingTest()
+    : TestCase("RdmaHw ACK coalescing")
+{
+}
+
+Ptr<RdmaHw>
+QbbAckCoalescingTest::CreateReceiver(double coalesceInterval, uint32_t coalesceBytes, bool merge)
+{
+    Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+    hw->SetAttribute("L2AckInterval", UintegerValue(1));
+    hw->SetAttribute("AckCoalesceInterval", DoubleValue(coalesceInterval));
+    hw->SetAttribute("AckCoalesceBytes", UintegerValue(coalesceBytes));
+    hw->SetAttribute("AckMergeQueued", BooleanValue(merge));
+    hw->SetNode(CreateObject<Node>());
+    hw->m_nic.push_back(RdmaInterfaceMgr(CreateObject<QbbNetDevice>()));
+    hw->m_rtTable[0x0b000001] = {0};
+    return hw;
+}
+
+void
+QbbAckCoalescingTest::Data(Ptr<RdmaHw> hw, int64_t t, uint64_t seq, bool ce)
+{
+    Simulator::Schedule(NanoSeconds(t), [hw, seq, ce]() {
+        Ptr<Packet> p = Create<Packet>(1000);
+        SimpleSeqTsHeader seqTs;
+        seqTs.SetSeq(seq);
+        seqTs.SetPG(3);
+        p->AddHeader(seqTs);
+        UdpHeader udp;
+        udp.SetSourcePort(100);
+        udp.SetDestinationPort(200);
+        p->AddHeader(udp);
+        Ipv4Header ip;
+        ip.SetSource(Ipv4Address(0x0b000001));
+        ip.SetDestination(Ipv4Address(0x0b000101));
+        ip.SetProtocol(0x11);
+        ip.SetPayloadSize(p->GetSize());
+        ip.SetEcn(ce ? Ipv4Header::ECN_CE : Ipv4Header::ECN_NotECT);
+        p->AddHeader(ip);
+        CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+        ch.getInt = 1;
+        p->PeekHeader(ch);
+        hw->Receive(p, ch);
+    });
+}
+
+std::vector<QbbAckCoalescingTest::Ack>
+QbbAckCoalescingTest::TakeAcks(Ptr<RdmaHw> hw)
+{
+    std::vector<Ack> acks;
+    Ptr<RdmaEgressQueue> queue = hw->m_nic[0].dev->GetRdmaQueue();
+    while (queue->m_ackQ->GetNPackets() > 0)
+    {
+        Ptr<Packet> p = queue->m_ackQ->Dequeue();
+        PppHeader ppp;
+        p->RemoveHeader(ppp);
+        CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+        p->PeekHeader(ch);
+        acks.push_back({(uint8_t)ch.l3Prot,
+                        ch.ack.seq,
+                        bool((ch.ack.flags >> qbbHeader::FLAG_CNP) & 1)});
+    }
+    return acks;
+}
+
+void
+QbbAckCoalescingTest::DoRun()
+{
+    // without coalescing, every packet is acknowledged with its own ECN mark
+    {
+        Ptr<RdmaHw> hw = CreateReceiver(0, 0, false);
+        for (uint32_t i = 0; i < 10; i++)
+            Data(hw, i * 100, i * 1000, i == 3);
+        Simulator::Run();
+        std::vector<Ack> acks = TakeAcks(hw);
+        NS_TEST_ASSERT_MSG_EQ(acks.size(), 10, "one ACK per packet");
+        for (uint32_t i = 0; i < 10; i++)
+        {
+            NS_TEST_EXPECT_MSG_EQ(acks[i].seq, (i + 1) * 1000, "seq of ACK " << i);
+            NS_TEST_EXPECT_MSG_EQ(acks[i].cnp, (i == 3), "CNP of ACK " << i);
+        }
+        Simulator::Destroy();
+    }
+
+    // one ACK per 1us window, with the ECN marks of the window
+    {
+        Ptr<RdmaHw> hw = CreateReceiver(1, 0, false);
+        for (uint32_t i = 0; i < 10; i++)
+            Data(hw, i * 100, i * 1000, i == 3);
+        for (uint32_t i = 10; i < 15; i++)
+            Data(hw, 2000 + i * 100, i * 1000);
+        std::vector<Ack> acks;
+        Simulator::Schedule(NanoSeconds(999), [&]() { acks = TakeAcks(hw); });
+        Simulator::Run();
+        NS_TEST_EXPECT_MSG_EQ(acks.size(), 0, "ACK before the end of the window");
+        acks = TakeAcks(hw);
+        NS_TEST_ASSERT_MSG_EQ(acks.size(), 2, "one ACK per window");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].seq, 10000, "first window");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].cnp, true, "ECN mark in the first window");
+        NS_TEST_EXPECT_MSG_EQ(acks[1].seq, 15000, "second window");
+        NS_TEST_EXPECT_MSG_EQ(acks[1].cnp, false, "no ECN mark in the second window");
+        Simulator::Destroy();
+    }
+
+    // the byte count ends a window early
+    {
+        Ptr<RdmaHw> hw = CreateReceiver(1, 4000, false);
+        for (uint32_t i = 0; i < 10; i++)
+            Data(hw, i * 100, i * 1000);
+        Simulator::Run();
+        std::vector<Ack> acks = TakeAcks(hw);
+        NS_TEST_ASSERT_MSG_EQ(acks.size(), 3, "ACKs per 4000 bytes");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].seq, 4000, "first ACK");
+        NS_TEST_EXPECT_MSG_EQ(acks[1].seq, 8000, "second ACK");
+        NS_TEST_EXPECT_MSG_EQ(acks[2].seq, 10000, "ACK at the end of the window");
+        Simulator::Destroy();
+    }
+
+    // a NACK is sent at once and ends the window
+    {
+        Ptr<RdmaHw> hw = CreateReceiver(1, 0, false);
+        Data(hw, 0, 0, true);
+        Data(hw, 100, 1000);
+        Data(hw, 200, 3000);
+        Simulator::Run();
+        std::vector<Ack> acks = TakeAcks(hw);
+        NS_TEST_ASSERT_MSG_EQ(acks.size(), 1, "NACK only");
+        NS_TEST_EXPECT_MSG_EQ((uint32_t)acks[0].l3Prot, 0xFD, "NACK");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].seq, 2000, "seq of the NACK");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].cnp, true, "ECN mark of the window in the NACK");
+        Simulator::Destroy();
+    }
+
+    // the ACKs of a qp queued in the NIC are merged, not across a NACK
+    {
+        Ptr<RdmaHw> hw = CreateReceiver(0, 0, true);
+        std::vector<Ack> first;
+        for (uint32_t i = 0; i < 5; i++)
+            Data(hw, i * 100, i * 1000, i == 1);
+        Simulator::Schedule(NanoSeconds(450), [&]() { first = TakeAcks(hw); });
+        for (uint32_t i = 5; i < 8; i++)
+            Data(hw, i * 100, i * 1000);
+        Data(hw, 800, 9000);
+        Data(hw, 900, 8000);
+        Data(hw, 1000, 9000);
+        Simulator::Run();
+        NS_TEST_ASSERT_MSG_EQ(first.size(), 1, "merged ACKs");
+        NS_TEST_EXPECT_MSG_EQ(first[0].seq, 5000, "seq of the merged ACK");
+        NS_TEST_EXPECT_MSG_EQ(first[0].cnp, true, "ECN mark of the merged ACKs");
+        std::vector<Ack> acks = TakeAcks(hw);
+        NS_TEST_ASSERT_MSG_EQ(acks.size(), 3, "ACKs around a NACK");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].seq, 8000, "ACK after the queue was drained");
+        NS_TEST_EXPECT_MSG_EQ(acks[0].cnp, false, "no ECN mark after the queue was drained");
+        NS_TEST_EXPECT_MSG_EQ((uint32_t)acks[1].l3Prot, 0xFD, "NACK not merged");
+        NS_TEST_EXPECT_MSG_EQ((uint32_t)acks[2].l3Prot, 0xFC, "ACK not merged into a NACK");
+        NS_TEST_EXPECT_MSG_EQ(acks[2].seq, 10000, "ACK after the NACK");
+        Simulator::Destroy();
+    }
+}
+
+/**
+ * \brief RdmaHw selective repeat: the receiver buffers and SACKs the packets
+ * after a loss, the sender retransmits the packets which were not SACKed.
+ */
+class QbbSelectiveRepeatTest : public TestCase
+{
+  public:
+    QbbSelectiveRepeatTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbSelectiveRepeatTest::QbbSelectiveRepeatTest()
+    : TestCase("RdmaHw selective repeat")
+{
+}
+
+void
+QbbSelectiveRepeatTest::DoRun()
+{
+    // bitmap across word boundaries
+    RdmaPacketBitmap bitmap;
+    NS_TEST_EXPECT_MSG_EQ(bitmap.IsEmpty(), true, "empty bitmap");
+    NS_TEST_EXPECT_MSG_EQ(bitmap.NextClear(5), 5, "clear bit of an empty bitmap");
+    for (uint32_t i = 1; i < 130; i++)
+        bitmap.Set(i);
+    NS_TEST_EXPECT_MSG_EQ(bitmap.Test(0), false, "bit 0");
+    NS_TEST_EXPECT_MSG_EQ(bitmap.Test(64), true, "bit 64");
+    NS_TEST_EXPECT_MSG_EQ(bitmap.NextClear(0), 0, "first clear bit");
+    NS_TEST_EXPECT_MSG_EQ(bitmap.NextClear(1), 130, "clear bit after the run");
+    bitmap.Shift(70);
+    NS_TEST_EXPECT_MSG_EQ(bitmap.Test(0), true, "bit 70 shifted to 0");
+    NS_TEST_EXPECT_MSG_EQ(bitmap.NextClear(0), 60, "clear bit 130 shifted to 60");
+    bitmap.Shift(60);
+    NS_TEST_EXPECT_MSG_EQ(bitmap.IsEmpty(), true, "bitmap shifted past its bits");
+
+    // the receiver SACKs the packets after a hole, and ACKs them once it is filled
+    Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+    hw->SetAttribute("L2AckInterval", UintegerValue(1));
+    hw->SetAttribute("SelectiveRepeat", BooleanValue(true));
+    hw->SetNode(CreateObject<Node>());
+    hw->m_nic.push_back(RdmaInterfaceMgr(CreateObject<QbbNetDevice>()));
+    hw->m_rtTable[0x0b000001] = {0};
+    auto data = [hw](uint64_t seq) {
+        Ptr<Packet> p = Create<Packet>(1000);
+        SimpleSeqTsHeader seqTs;
+        seqTs.SetSeq(seq);
+        seqTs.SetPG(3);
+        p->AddHeader(seqTs);
+        UdpHeader udp;
+        udp.SetSourcePort(100);
+        udp.SetDestinationPort(200);
+        p->AddHeader(udp);
+        Ipv4Header ip;
+        ip.SetSource(Ipv4Address(0x0b000001));
+        ip.SetDestination(Ipv4Address(0x0b000101));
+        ip.SetProtocol(0x11);
+        ip.SetPayloadSize(p->GetSize());
+        p->AddHeader(ip);
+        CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+        ch.getInt = 1;
+        p->PeekHeader(ch);
+        hw->Receive(p, ch);
+    };
+    for (uint64_t seq : {0, 1000, 3000, 4000, 3000, 6000, 2000})
+        data(seq);
+    struct Ack
+    {
+        uint32_t l3Prot;
+        uint64_t seq;
+        bool sack;
+    };
+
+    std::vector<Ack> acks;
+    Ptr<RdmaEgressQueue> queue = hw->m_nic[0].dev->GetRdmaQueue();
+    while (queue->m_ackQ->GetNPackets() > 0)
+    {
+        Ptr<Packet> p = queue->m_ackQ->Dequeue();
+        PppHeader ppp;
+        p->RemoveHeader(ppp);
+        CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+        p->PeekHeader(ch);
+        acks.push_back({ch.l3Prot, ch.ack.seq, bool((ch.ack.flags >> qbbHeader::FLAG_SACK) & 1)});
+    }
+    Ack expected[] = {
+        {0xFC, 1000, false},
+        {0xFC, 2000, false},
+        {0xFD, 3000, true},
+        {0xFD, 4000, true},
+        {0xFD, 6000, true},
+        {0xFC, 5000, false},
+    };
+    NS_TEST_ASSERT_MSG_EQ(acks.size(), 6, "one ACK or SACK per new packet");
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        NS_TEST_EXPECT_MSG_EQ(acks[i].l3Prot, expected[i].l3Prot, "ACK or NACK " << i);
+        NS_TEST_EXPECT_MSG_EQ(acks[i].seq, expected[i].seq, "seq of ACK " << i);
+        NS_TEST_EXPECT_MSG_EQ(acks[i].sack, expected[i].sack, "SACK flag of ACK " << i);
+    }
+    Simulator::Destroy();
+
+    // the sender retransmits the packets which were not SACKed, then sends new data
+    hw = CreateObject<RdmaHw>();
+    hw->SetAttribute("SelectiveRepeat", BooleanValue(true));
+    Ptr<RdmaQueuePair> qp = CreateObject<RdmaQueuePair>(3,
+                                                        Ipv4Address(0x0b000001),
+                                                        Ipv4Address(0x0b000101),
+                                                        100,
+                                                        200);
+    qp->SetSize(12000);
+    auto next = [hw, qp]() {
+        Ptr<Packet> p = hw->GetNxtPacket(qp);
+        PppHeader ppp;
+        p->RemoveHeader(ppp);
+        CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+        p->PeekHeader(ch);
+        return (uint64_t)ch.udp.seq;
+    };
+    for (uint32_t i = 0; i < 10; i++)
+        next();
+    hw->SelectiveAcknowledge(qp, 2000, false);
+    for (uint64_t seq : {3000, 4000, 6000, 7000, 8000, 9000})
+        hw->SelectiveAcknowledge(qp, seq, true);
+    NS_TEST_EXPECT_MSG_EQ(qp->InRecovery(), true, "recovery after a SACK");
+    NS_TEST_ASSERT_MSG_EQ(qp->HasRetransmission(), true, "holes to retransmit");
+    NS_TEST_EXPECT_MSG_EQ(next(), 2000, "first hole");
+    NS_TEST_EXPECT_MSG_EQ(next(), 5000, "second hole");
+    NS_TEST_EXPECT_MSG_EQ(qp->HasRetransmission(), false, "all holes retransmitted");
+    NS_TEST_EXPECT_MSG_EQ(next(), 10000, "new data after the holes");
+    // the retransmission of 5000 was lost too: a NACK restarts from the first hole
+    hw->SelectiveAcknowledge(qp, 5000, false);
+    hw->RecoverQueue(qp);
+    NS_TEST_ASSERT_MSG_EQ(qp->HasRetransmission(), true, "hole to retransmit again");
+    NS_TEST_EXPECT_MSG_EQ(next(), 5000, "hole retransmitted again");
+    NS_TEST_EXPECT_MSG_EQ(qp->HasRetransmission(), false, "hole retransmitted");
+    hw->SelectiveAcknowledge(qp, 11000, false);
+    NS_TEST_EXPECT_MSG_EQ(qp->InRecovery(), false, "recovery over");
+    NS_TEST_EXPECT_MSG_EQ(qp->snd_una, 11000, "cumulative ACK");
+    NS_TEST_EXPECT_MSG_EQ(next(), 11000, "last packet");
+}
+
+/**
+ * \brief RdmaHw sends the messages posted on a persistent qp, in order, and
+ * keeps the qp and its CC state until it is closed.
+ */
+class QbbMessageVerbsTest : public TestCase
+{
+  public:
+    QbbMessageVerbsTest();
+
+  private:
+    void DoRun() override;
+
+    /// Hand a packet received by a device to the RdmaHw of its host
+    static void Deliver(Ptr<RdmaHw> hw, Ptr<const Packet> packet);
+};
+
+QbbMessageVerbsTest::QbbMessageVerbsTest()
+    : TestCase("RdmaHw messages on persistent qps")
+{
+}
+
+void
+QbbMessageVerbsTest::Deliver(Ptr<RdmaHw> hw, Ptr<const Packet> packet)
+{
+    Ptr<Packet> p = packet->Copy();
+    PppHeader ppp;
+    p->RemoveHeader(ppp);
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    hw->Receive(p, ch);
+}
+
+void
+QbbMessageVerbsTest::DoRun()
+{
+    NodeContainer hosts;
+    hosts.Create(2);
+    QbbHelper qbb;
+    qbb.SetDeviceAttribute("DataRate", StringValue("8Gbps"));
+    qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(1)));
+    NetDeviceContainer devices = qbb.Install(hosts.Get(0), hosts.Get(1));
+    Ptr<RdmaDriver> drivers[2];
+    Ipv4Address ip[2];
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+        hw->SetAttribute("CcMode", UintegerValue(1));
+        hw->SetAttribute("L2AckInterval", UintegerValue(1));
+        drivers[i] = CreateObject<RdmaDriver>();
+        drivers[i]->SetNode(hosts.Get(i));
+        drivers[i]->SetRdmaHw(hw);
+        hosts.Get(i)->AggregateObject(drivers[i]);
+        drivers[i]->Init();
+        devices.Get(i)->TraceConnectWithoutContext("MacRx", MakeBoundCallback(&Deliver, hw));
+        ip[i] = Ipv4Address(0x0b000001 + (hosts.Get(i)->GetId() << 8));
+    }
+    for (uint32_t i = 0; i < 2; i++)
+        drivers[i]->m_rdma->AddTableEntry(ip[1 - i], 0, false);
+
+    std::vector<std::pair<uint64_t, Time>> completed;
+    drivers[0]->TraceConnectWithoutContext(
+        "MessageComplete",
+        Callback<void, Ptr<RdmaQueuePair>, const RdmaMessage&>(
+            [&completed](Ptr<RdmaQueuePair> qp, const RdmaMessage& msg) {
+                completed.emplace_back(msg.id, Simulator::Now());
+            }));
+    uint32_t qpCompletions = 0;
+    drivers[0]->TraceConnectWithoutContext(
+        "QpComplete",
+        Callback<void, Ptr<RdmaQueuePair>>(
+            [&qpCompletions](Ptr<RdmaQueuePair> qp) { qpCompletions++; }));
+
+    Ptr<RdmaQueuePair> qp = drivers[0]->CreateQueuePair(hosts.Get(0)->GetId(),
+                                                        hosts.Get(1)->GetId(),
+                                                        0,
+                                                        3,
+                                                        ip[0],
+                                                        ip[1],
+                                                        100,
+                                                        200,
+                                                        0,
+                                                        0,
+                                                        Callback<void>());
+    RdmaCcState* cc = qp->m_cc.get();
+    uint32_t notified = 0;
+    Callback<void> notify([&notified]() { notified++; });
+    NS_TEST_EXPECT_MSG_EQ(drivers[0]->PostMessage(qp, RdmaMessage::WRITE, 10000, notify),
+                          0,
+                          "first message id");
+    drivers[0]->PostMessage(qp, RdmaMessage::SEND, 5000, notify);
+    drivers[0]->PostMessage(qp, RdmaMessage::READ, 3000, notify);
+    // a message posted once the qp is idle
+    Simulator::Schedule(MicroSeconds(100), [&]() {
+        NS_TEST_EXPECT_MSG_EQ(qp->m_messages.size(), 0, "messages completed");
+        NS_TEST_EXPECT_MSG_EQ(qpCompletions, 0, "idle persistent qp closed");
+        NS_TEST_EXPECT_MSG_EQ(
+            (drivers[0]->m_rdma->GetQp(ip[1].Get(), 100, 3) == qp),
+            true,
+            "idle persistent qp removed");
+        drivers[0]->PostMessage(qp, RdmaMessage::WRITE, 2000, notify);
+        drivers[0]->CloseQueuePair(qp);
+    });
+    Simulator::Run();
+
+    NS_TEST_ASSERT_MSG_EQ(completed.size(), 4, "message completions");
+    for (uint64_t i = 0; i < 4; i++)
+        NS_TEST_EXPECT_MSG_EQ(completed[i].first, i, "message completions in order");
+    NS_TEST_EXPECT_MSG_EQ((completed[0].second < completed[1].second), true, "first message");
+    NS_TEST_EXPECT_MSG_EQ((completed[3].second > MicroSeconds(100)), true, "message of idle qp");
+    NS_TEST_EXPECT_MSG_EQ(notified, 4, "message callbacks");
+    NS_TEST_EXPECT_MSG_EQ(qpCompletions, 1, "qp completes once closed");
+    NS_TEST_EXPECT_MSG_EQ(qp->snd_una, 20000, "bytes of the messages");
+    NS_TEST_EXPECT_MSG_EQ((qp->m_cc.get() == cc), true, "CC state kept across messages");
+    Simulator::Destroy();
+}
+
+/**
+ * \brief RdmaHw FluidMode gives the FCTs of the packet level runs with fewer
+ * events, and a CNP, a NACK or a new qp ends the running fluid epoch.
+ */
+class QbbFluidModeTest : public TestCase
+{
+  public:
+    QbbFluidModeTest();
+
+  private:
+    void DoRun() override;
+
+    /// Event during the flow
+    enum Event
+    {
+        NONE,
+        CNP,
+        NACK,
+        NEW_QP,
+    };
+
+    /// Result of a run
+    struct Result
+    {
+        std::vector<Time> fct; // completion times of the qps, in order of their sport
+        uint64_t events;       // events executed
+        uint64_t epochs;       // fluid epochs started
+        bool aborted;          // the event ended a running fluid epoch
+    };
+
+    /**
+     * Run a 4MB flow between two hosts linked at 10Gbps.
+     * \param fluid the value of FluidMode
+     * \param event the event during the flow
+     * \param t the time of the event: in a fluid run, set to the first
+     * microsecond after 300us with a running epoch, given otherwise
+     * \param win the window of the qp in bytes, 0 for none
+     * \return the result of the run
+     */
+    Result Run(bool fluid, Event event, Time& t, uint32_t win = 0);
+
+    /// Hand a packet received by a device to the RdmaHw of its host
+    static void Deliver(Ptr<RdmaHw> hw, Ptr<const Packet> packet);
+    /// Hand an ACK or a NACK of snd_una of a qp, with a CNP or not, to its sender
+    static void Feedback(Ptr<RdmaHw> hw, Ptr<RdmaQueuePair> qp, uint8_t l3Prot, bool cnp);
+};
+
+QbbFluidModeTest::QbbFluidModeTest()
+    : TestCase("RdmaHw fluid mode")
+{
+}
+
+void
+QbbFluidModeTest::Deliver(Ptr<RdmaHw> hw, Ptr<const Packet> packet)
+{
+    Ptr<Packet> p = packet->Copy();
+    PppHeader ppp;
+    p->RemoveHeader(ppp);
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    hw->Receive(p, ch);
+}
+
+void
+QbbFluidModeTest::Feedback(Ptr<RdmaHw> hw, Ptr<RdmaQueuePair> qp, uint8_t l3Prot, bool cnp)
+{
+    qbbHeader seqh;
+    seqh.SetSeq(qp->snd_una);
+    seqh.SetPG(qp->m_pg);
+    seqh.SetSport(qp->dport);
+    seqh.SetDport(qp->sport);
+    if (cnp)
+        seqh.SetCnp();
+    Ptr<Packet> p = Create<Packet>(0);
+    p->AddHeader(seqh);
+    Ipv4Header ip;
+    ip.SetSource(qp->dip);
+    ip.SetDestination(qp->sip);
+    ip.SetProtocol(l3Prot);
+    ip.SetPayloadSize(p->GetSize());
+    p->AddHeader(ip);
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    hw->Receive(p, ch);
+}
+
+QbbFluidModeTest::Result
+QbbFluidModeTest::Run(bool fluid, Event event, Time& t, uint32_t win)
+{
+    NodeContainer hosts;
+    hosts.Create(2);
+    QbbHelper qbb;
+    qbb.SetDeviceAttribute("DataRate", StringValue("10Gbps"));
+    qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(1)));
+    NetDeviceContainer devices = qbb.Install(hosts.Get(0), hosts.Get(1));
+    Ptr<RdmaDriver> drivers[2];
+    Ipv4Address ip[2];
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+        hw->SetAttribute("CcMode", UintegerValue(1));
+        hw->SetAttribute("L2AckInterval", UintegerValue(1));
+        hw->SetAttribute("FluidMode", BooleanValue(fluid));
+        drivers[i] = CreateObject<RdmaDriver>();
+        drivers[i]->SetNode(hosts.Get(i));
+        drivers[i]->SetRdmaHw(hw);
+        hosts.Get(i)->AggregateObject(drivers[i]);
+        drivers[i]->Init();
+        devices.Get(i)->TraceConnectWithoutContext("MacRx", MakeBoundCallback(&Deliver, hw));
+        ip[i] = Ipv4Address(0x0b000001 + (hosts.Get(i)->GetId() << 8));
+    }
+    for (uint32_t i = 0; i < 2; i++)
+        drivers[i]->m_rdma->AddTableEntry(ip[1 - i], 0, false);
+    Ptr<RdmaHw> hw = drivers[0]->m_rdma;
+
+    Result result;
+    result.fct.resize(event == NEW_QP ? 2 : 1);
+    result.aborted = false;
+    drivers[0]->TraceConnectWithoutContext(
+        "QpComplete",
+        Callback<void, Ptr<RdmaQueuePair>>([&result](Ptr<RdmaQueuePair> qp) {
+            result.fct[qp->sport - 100] = Simulator::Now();
+        }));
+    // 2 x 1us of propagation, the 1048 bytes of a packet and the ACK at 10Gbps
+    const uint64_t baseRtt = 2900;
+    auto addQp = [&](uint16_t sport, uint64_t size) {
+        drivers[0]->AddQueuePair(hosts.Get(0)->GetId(),
+                                 hosts.Get(1)->GetId(),
+                                 sport,
+                                 size,
+                                 3,
+                                 ip[0],
+                                 ip[1],
+                                 sport,
+                                 200,
+                                 win,
+                                 baseRtt,
+                                 Callback<void>(),
+                                 Callback<void>());
+    };
+    addQp(100, 4000000);
+
+    auto fire = [&]() {
+        Ptr<RdmaQueuePair> qp = hw->GetQp(ip[1].Get(), 100, 3);
+        bool active = qp->fluid.m_active;
+        if (event == CNP)
+            Feedback(hw, qp, 0xFC, true);
+        else if (event == NACK)
+            Feedback(hw, qp, 0xFD, false);
+        else
+            addQp(101, 500000);
+        result.aborted = active && !qp->fluid.m_active;
+    };
+    std::function<void()> poll = [&]() {
+        Ptr<RdmaQueuePair> qp = hw->GetQp(ip[1].Get(), 100, 3);
+        if (qp == nullptr)
+            return;
+        if (!qp->fluid.m_active)
+        {
+            Simulator::Schedule(MicroSeconds(1), poll);
+            return;
+        }
+        t = Simulator::Now();
+        fire();
+    };
+    if (event != NONE)
+    {
+        if (fluid)
+            Simulator::Schedule(MicroSeconds(300), poll);
+        else
+            Simulator::Schedule(t, fire);
+    }
+
+    result.events = Simulator::GetEventCount();
+    Simulator::Run();
+    result.events = Simulator::GetEventCount() - result.events;
+    result.epochs = hw->m_fluidEpochs;
+    Simulator::Destroy();
+    return result;
+}
+
+void
+QbbFluidModeTest::DoRun()
+{
+    const char* names[] = {"no event", "CNP", "NACK", "new qp"};
+    for (Event event : {NONE, CNP, NACK, NEW_QP})
+    {
+        Time t;
+        Result fluid = Run(true, event, t);
+        Result packets = Run(false, event, t);
+        NS_TEST_EXPECT_MSG_GT(fluid.epochs, 1, names[event] << ": fluid epochs");
+        NS_TEST_EXPECT_MSG_EQ(packets.epochs, 0, names[event] << ": fluid epochs off");
+        if (event != NONE)
+            NS_TEST_EXPECT_MSG_EQ(fluid.aborted, true, names[event] << ": epoch not ended");
+        for (uint32_t i = 0; i < packets.fct.size(); i++)
+        {
+            NS_TEST_ASSERT_MSG_GT(packets.fct[i], Time(0), names[event] << ": qp " << i);
+            NS_TEST_ASSERT_MSG_GT(fluid.fct[i], Time(0), names[event] << ": fluid qp " << i);
+            // within 0.1% of the FCT
+            NS_TEST_EXPECT_MSG_EQ_TOL(fluid.fct[i].GetNanoSeconds(),
+                                      packets.fct[i].GetNanoSeconds(),
+                                      packets.fct[i].GetNanoSeconds() / 1000,
+                                      names[event] << ": FCT of qp " << i);
+        }
+        NS_TEST_EXPECT_MSG_LT(fluid.events * 2,
+                              packets.events,
+                              names[event] << ": events of the fluid run");
+    }
+
+    // a window of two packets binds at 10Gbps, the flow never goes fluid;
+    // a window of the base RTT at 10Gbps (3625 bytes) with room to spare does
+    Time t;
+    Result bound = Run(true, NONE, t, 2000);
+    Result boundPackets = Run(false, NONE, t, 2000);
+    NS_TEST_EXPECT_MSG_EQ(bound.epochs, 0, "fluid epochs of a window-bound qp");
+    NS_TEST_EXPECT_MSG_EQ(bound.fct[0], boundPackets.fct[0], "FCT of a window-bound qp");
+    Result open = Run(true, NONE, t, 100000);
+    Result openPackets = Run(false, NONE, t, 100000);
+    NS_TEST_EXPECT_MSG_GT(open.epochs, 1, "fluid epochs of a large window");
+    NS_TEST_EXPECT_MSG_EQ_TOL(open.fct[0].GetNanoSeconds(),
+                              openPackets.fct[0].GetNanoSeconds(),
+                              openPackets.fct[0].GetNanoSeconds() / 1000,
+                              "FCT of a large window");
+}
+
+/**
+ * \brief QbbNetDevice delivers the packets of a train at the times and in the
+ * order it delivers them one by one, also when a PFC pause, an ACK queued in
+ * the NIC or a rate change splits the train.
+ */
+class QbbTrainTest : public TestCase
+{
+  public:
+    QbbTrainTest();
+
+  private:
+    void DoRun() override;
+
+    /// Event during the flow of the first host
+    enum Event
+    {
+        NONE,
+        PAUSE,
+        ACK,
+        RATE,
+    };
+
+    /**
+     * Run a 300KB flow from the first host to the second, on a 10Gbps link.
+     * \param trainSize the value of TrainSize
+     * \param pgScheduler the value of RdmaEgressQueue::PgScheduler
+     * \param event the event during the flow
+     * \param trace the time, the receiving host, the protocol and the
+     * sequence number of every packet delivered
+     * \return the number of events executed
+     */
+    uint64_t Run(uint32_t trainSize, bool pgScheduler, Event event, std::vector<uint64_t>& trace);
+
+    /// Record a packet received by a device, and hand it to the RdmaHw of its host
+    static void Deliver(Ptr<RdmaHw> hw, std::vector<uint64_t>* trace, Ptr<const Packet> packet);
+    /// Receive a PFC pause of PG 3, or its resume, on a device
+    static void Pfc(Ptr<QbbNetDevice> dev, bool pause);
+};
+
+QbbTrainTest::QbbTrainTest()
+    : TestCase("QbbNetDevice packet trains")
+{
+}
+
+void
+QbbTrainTest::Deliver(Ptr<RdmaHw> hw, std::vector<uint64_t>* trace, Ptr<const Packet> packet)
+{
+    Ptr<Packet> p = packet->Copy();
+    PppHeader ppp;
+    p->RemoveHeader(ppp);
+    if (ppp.GetProtocol() != 0x0021)
+        return; // a PFC frame of the test
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    trace->push_back(Simulator::Now().GetTimeStep());
+    trace->push_back(hw->m_node->GetId());
+    trace->push_back(ch.l3Prot);
+    trace->push_back(ch.l3Prot == 0x11 ? ch.udp.seq : ch.ack.seq);
+    hw->Receive(p, ch);
+}
+
+void
+QbbTrainTest::Pfc(Ptr<QbbNetDevice> dev, bool pause)
+{
+    // QbbNetDevice::Receive parses 14 bytes of L2 header, see CustomHeader
+    Ptr<Packet> p = Create<Packet>(0);
+    PauseHeader pauseh(pause ? 0xffff : 0, 0, 3);
+    p->AddHeader(pauseh);
+    Ipv4Header ip;
+    ip.SetProtocol(0xFE);
+    ip.SetDestination(Ipv4Address("255.255.255.255"));
+    ip.SetPayloadSize(p->GetSize());
+    p->AddHeader(ip);
+    uint8_t l2[14] = {0x88, 0x08};
+    Ptr<Packet> frame = Create<Packet>(l2, 14);
+    frame->AddAtEnd(p);
+    dev->Receive(frame);
+}
+
+uint64_t
+QbbTrainTest::Run(uint32_t trainSize, bool pgScheduler, Event event, std::vector<uint64_t>& trace)
+{
+    NodeContainer hosts;
+    hosts.Create(2);
+    QbbHelper qbb;
+    qbb.SetDeviceAttribute("DataRate", StringValue("10Gbps"));
+    qbb.SetDeviceAttribute("TrainSize", UintegerValue(trainSize));
+    qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(1)));
+    NetDeviceContainer devices = qbb.Install(hosts.Get(0), hosts.Get(1));
+    Ptr<RdmaDriver> drivers[2];
+    Ipv4Address ip[2];
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+        hw->SetAttribute("CcMode", UintegerValue(1));
+        hw->SetAttribute("L2AckInterval", UintegerValue(1));
+        drivers[i] = CreateObject<RdmaDriver>();
+        drivers[i]->SetNode(hosts.Get(i));
+        drivers[i]->SetRdmaHw(hw);
+        hosts.Get(i)->AggregateObject(drivers[i]);
+        drivers[i]->Init();
+        devices.Get(i)->TraceConnectWithoutContext("MacRx",
+                                                   MakeBoundCallback(&Deliver, hw, &trace));
+        DynamicCast<QbbNetDevice>(devices.Get(i))
+            ->GetRdmaQueue()
+            ->SetAttribute("PgScheduler", BooleanValue(pgScheduler));
+        ip[i] = Ipv4Address(0x0b000001 + (hosts.Get(i)->GetId() << 8));
+    }
+    for (uint32_t i = 0; i < 2; i++)
+        drivers[i]->m_rdma->AddTableEntry(ip[1 - i], 0, false);
+
+    auto addQp = [&](uint32_t i, uint64_t size) {
+        drivers[i]->AddQueuePair(hosts.Get(i)->GetId(),
+                                 hosts.Get(1 - i)->GetId(),
+                                 0,
+                                 size,
+                                 3,
+                                 ip[i],
+                                 ip[1 - i],
+                                 100,
+                                 200,
+                                 0,
+                                 2900,
+                                 Callback<void>(),
+                                 Callback<void>());
+    };
+    addQp(0, 300000);
+    // the events fall within a train, not on a packet boundary
+    Ptr<QbbNetDevice> dev = DynamicCast<QbbNetDevice>(devices.Get(0));
+    if (event == PAUSE)
+    {
+        Simulator::Schedule(NanoSeconds(50300), &QbbTrainTest::Pfc, dev, true);
+        Simulator::Schedule(NanoSeconds(61700), &QbbTrainTest::Pfc, dev, false);
+    }
+    else if (event == ACK)
+    {
+        // the data of the second host makes the first one queue ACKs
+        Simulator::Schedule(NanoSeconds(50300), [&]() { addQp(1, 20000); });
+    }
+    else if (event == RATE)
+    {
+        Simulator::Schedule(NanoSeconds(50300), [&]() {
+            Ptr<RdmaHw> hw = drivers[0]->m_rdma;
+            hw->ChangeRate(hw->GetQp(ip[1].Get(), 100, 3), DataRate("4Gbps"));
+        });
+    }
+
+    uint64_t events = Simulator::GetEventCount();
+    Simulator::Run();
+    events = Simulator::GetEventCount() - events;
+    Simulator::Destroy();
+    return events;
+}
+
+void
+QbbTrainTest::DoRun()
+{
+    const char* names[] = {"no event", "PFC pause", "ACK", "rate change"};
+    for (bool pg : {false, true})
+    {
+        for (Event event : {NONE, PAUSE, ACK, RATE})
+        {
+            std::string name = std::string(names[event]) + (pg ? ", PgScheduler" : "");
+            std::vector<uint64_t> single;
+            std::vector<uint64_t> trains;
+            uint64_t singleEvents = Run(1, pg, event, single);
+            uint64_t trainEvents = Run(16, pg, event, trains);
+            NS_TEST_EXPECT_MSG_GT(single.size(), 300 * 4, name << ": packets delivered");
+            NS_TEST_ASSERT_MSG_EQ(trains.size(), single.size(), name << ": packets lost");
+            uint32_t i = 0;
+            while (i < single.size() && trains[i] == single[i])
+                i++;
+            NS_TEST_EXPECT_MSG_EQ(i, single.size(), name << ": packet " << i / 4 << " differs");
+            NS_TEST_EXPECT_MSG_LT(trainEvents, singleEvents, name << ": no event saved");
+        }
+    }
+}
+
+/**
+ * \brief The PgScheduler of RdmaEgressQueue serves the strict PGs first, then
+ * the other PGs by DWRR, and the qps of a PG in round robin.
+ */
+class QbbPgSchedulerTest : public TestCase
+{
+  public:
+    QbbPgSchedulerTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbPgSchedulerTest::QbbPgSchedulerTest()
+    : TestCase("RdmaEgressQueue PG scheduler")
+{
+}
+
+void
+QbbPgSchedulerTest::DoRun()
+{
+    Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+    Ptr<RdmaEgressQueue> eq = CreateObject<RdmaEgressQueue>();
+    eq->SetAttribute("PgScheduler", BooleanValue(true));
+    eq->SetAttribute("StrictPgs", UintegerValue(1 << 7));
+    eq->SetAttribute("PgWeights", StringValue("1,1,3"));
+    eq->SetAttribute("PgQuantum", UintegerValue(1000));
+    eq->m_qpGrp = CreateObject<RdmaQueuePairGroup>();
+    eq->m_rdmaGetNxtPkt = MakeCallback(&RdmaHw::GetNxtPacket, hw);
+    // pg, packets of 1000 bytes
+    std::pair<uint16_t, uint32_t> qps[] = {{1, 1000}, {1, 1000}, {2, 1000}, {7, 5}, {4, 1000}};
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        Ptr<RdmaQueuePair> qp = CreateObject<RdmaQueuePair>(qps[i].first,
+                                                            Ipv4Address(0x0b000001),
+                                                            Ipv4Address(0x0b000101),
+                                                            i,
+                                                            100);
+        qp->SetSize(qps[i].second * 1000);
+        eq->m_qpGrp->AddQp(qp);
+        eq->Activate(qp);
+    }
+    bool paused[RdmaEgressQueue::qCnt] = {};
+    paused[4] = true;
+    std::vector<uint32_t> sent;
+    for (uint32_t i = 0; i < 405; i++)
+    {
+        int idx = eq->GetNextQindex(paused);
+        NS_TEST_ASSERT_MSG_GT_OR_EQ(idx, 0, "a qp can send");
+        eq->DequeueQindex(idx);
+        sent.push_back(idx);
+    }
+    for (uint32_t i = 0; i < 5; i++)
+        NS_TEST_EXPECT_MSG_EQ(sent[i], 3, "strict PG first");
+    uint32_t count[5] = {};
+    for (uint32_t i = 5; i < 405; i++)
+        count[sent[i]]++;
+    // the quantum is a bit smaller than a packet with its headers
+    NS_TEST_EXPECT_MSG_EQ_TOL(count[2], 300, 4, "DWRR weight of PG 2");
+    NS_TEST_EXPECT_MSG_EQ_TOL(count[0], count[1], 1, "round robin in PG 1");
+    NS_TEST_EXPECT_MSG_EQ(count[4], 0, "paused PG");
+    // finished qps stay in the group until they are more than half of it
+    for (uint32_t i : {3, 4, 2})
+    {
+        NS_TEST_EXPECT_MSG_EQ(eq->m_qpGrp->GetN(), 5, "finished qps kept");
+        Ptr<RdmaQueuePair> qp = eq->m_qpGrp->Get(i);
+        qp->Acknowledge(qp->m_size);
+        eq->Activate(qp);
+    }
+    NS_TEST_EXPECT_MSG_EQ(eq->m_qpGrp->GetN(), 2, "finished qps removed");
+
+    // a qp waiting for its rate limiter is not served before its time
+    Ptr<RdmaQueuePair> qp1 = eq->m_qpGrp->Get(0);
+    Ptr<RdmaQueuePair> qp2 = eq->m_qpGrp->Get(1);
+    NS_TEST_ASSERT_MSG_EQ(qp1->m_pg, 1, "qp of PG 1");
+    for (uint32_t i = 0; i < eq->m_qpGrp->GetN(); i++)
+        eq->m_qpGrp->Get(i)->m_nextAvail = MicroSeconds(i == 0 ? 1 : 2);
+    NS_TEST_EXPECT_MSG_EQ(eq->GetNextQindex(paused), -1024, "all qps wait");
+    NS_TEST_EXPECT_MSG_EQ(eq->GetNextAvail(), MicroSeconds(1), "first qp to wake up");
+    // a higher rate makes a qp available earlier
+    qp2->m_nextAvail = NanoSeconds(500);
+    eq->Activate(qp2);
+    NS_TEST_EXPECT_MSG_EQ(eq->GetNextAvail(), MicroSeconds(1), "active qps are not pacing");
+    Simulator::Schedule(NanoSeconds(500), [&]() {
+        int idx = eq->GetNextQindex(paused);
+        NS_TEST_EXPECT_MSG_EQ(idx, (int)qp2->m_grpIdx, "qp with the higher rate");
+    });
+    Simulator::Schedule(MicroSeconds(1), [&]() {
+        qp2->m_nextAvail = MicroSeconds(5);
+        int idx = eq->GetNextQindex(paused);
+        NS_TEST_EXPECT_MSG_EQ(idx, (int)qp1->m_grpIdx, "qp back from pacing");
+    });
+    Simulator::Run();
+    Simulator::Destroy();
+}
+
+/**
+ * \brief BEgressQueue serves queue 0 first, then the other queues which are
+ * not paused in round robin, in the order of their packets.
+ */
+class QbbEgressQueueRRTest : public TestCase
+{
+  public:
+    QbbEgressQueueRRTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbEgressQueueRRTest::QbbEgressQueueRRTest()
+    : TestCase("BEgressQueue round robin")
+{
+}
+
+void
+QbbEgressQueueRRTest::DoRun()
+{
+    Ptr<BEgressQueue> q = CreateObject<BEgressQueue>();
+    // the size of a packet tells its queue and its order in the queue
+    for (uint32_t n = 0; n < 40; n++)
+    {
+        for (uint32_t i : {1, 3, 6})
+            q->Enqueue(Create<Packet>(1000 * (i + 1) + n), i);
+    }
+    q->Enqueue(Create<Packet>(1000), 0);
+    q->SetPaused(0, true);
+    q->SetPaused(3, true);
+
+    std::vector<uint32_t> order[BEgressQueue::qCnt];
+    std::vector<uint32_t> served;
+    for (uint32_t n = 0; n < 41; n++)
+    {
+        Ptr<Packet> p = q->DequeueRR();
+        NS_TEST_ASSERT_MSG_NE(p, nullptr, "a queue can send");
+        uint32_t i = q->GetLastQueue();
+        NS_TEST_EXPECT_MSG_EQ(p->GetSize() / 1000, i + 1, "packet of the queue");
+        order[i].push_back(p->GetSize() % 1000);
+        served.push_back(i);
+    }
+    NS_TEST_EXPECT_MSG_EQ(served[0], 0, "queue 0 first, even paused");
+    for (uint32_t n = 1; n < 41; n++)
+        NS_TEST_EXPECT_MSG_EQ(served[n], (n % 2 ? 1u : 6u), "round robin");
+    NS_TEST_EXPECT_MSG_EQ(order[3].size(), 0, "paused queue");
+    for (uint32_t n = 0; n < 20; n++)
+        NS_TEST_EXPECT_MSG_EQ(order[6][n], n, "FIFO");
+
+    // with queue 6 paused, queue 1 is served until it is empty
+    q->SetPaused(6, true);
+    for (uint32_t n = 0; n < 20; n++)
+    {
+        q->DequeueRR();
+        NS_TEST_EXPECT_MSG_EQ(q->GetLastQueue(), 1, "queue 1 served");
+    }
+    NS_TEST_EXPECT_MSG_EQ(q->GetNBytes(1), 0, "queue 1 empty");
+    q->SetPaused(3, false);
+    NS_TEST_EXPECT_MSG_NE(q->DequeueRR(), nullptr, "queue 3 resumed");
+    NS_TEST_EXPECT_MSG_EQ(q->GetLastQueue(), 3, "queue 3 served");
+    // the array of paused queues replaces SetPaused
+    bool paused[BEgressQueue::qCnt] = {};
+    paused[3] = true;
+    paused[6] = true;
+    NS_TEST_EXPECT_MSG_EQ(q->DequeueRR(paused), nullptr, "all queues paused");
+    paused[3] = false;
+    uint64_t bytes = q->GetNBytesTotal();
+    for (uint32_t n = 0; n < 39; n++)
+        bytes -= q->DequeueRR(paused)->GetSize();
+    NS_TEST_EXPECT_MSG_EQ(q->GetNBytes(3), 0, "queue 3 drained");
+    NS_TEST_EXPECT_MSG_EQ(bytes, q->GetNBytes(6), "queue 6 left");
+}
+
+/**
+ * \brief MultiPoolSwitchMmu keeps its service pools apart, drops the lossy
+ * packets beyond their dynamic thresholds and pauses the lossless PGs.
+ */
+class QbbMultiPoolMmuTest : public TestCase
+{
+  public:
+    QbbMultiPoolMmuTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbMultiPoolMmuTest::QbbMultiPoolMmuTest()
+    : TestCase("MultiPoolSwitchMmu pools and thresholds")
+{
+}
+
+void
+QbbMultiPoolMmuTest::DoRun()
+{
+    Ptr<SwitchNode> sw = CreateObject<SwitchNode>();
+    NS_TEST_EXPECT_MSG_EQ(sw->GetMmuType(), SwitchMmu::GetTypeId(), "default MMU");
+    sw->SetAttribute("MmuType", TypeIdValue(MultiPoolSwitchMmu::GetTypeId()));
+    Ptr<MultiPoolSwitchMmu> mmu = DynamicCast<MultiPoolSwitchMmu>(sw->m_mmu);
+    NS_TEST_ASSERT_MSG_NE(mmu, nullptr, "MmuType picks the MMU");
+
+    for (uint32_t p = 1; p <= 2; p++)
+        mmu->ConfigHdrm(p, 10000);
+    mmu->ConfigPool(0, 400000);
+    mmu->ConfigPool(1, 100000);
+    mmu->ConfigNPort(2);
+    NS_TEST_EXPECT_MSG_EQ(mmu->pool_size[0], 400000, "configured pool kept");
+    mmu->ConfigPriority(3, 0, true, 1, 1);
+    mmu->ConfigPriority(1, 1, false, 1, 0.5);
+
+    // lossy priority 1 from port 1 to port 2: the egress queue, with the
+    // smaller alpha, fills up to its threshold, then the packets are dropped
+    uint32_t admitted = 0;
+    while (mmu->CheckIngressAdmission(1, 1, 1000) && mmu->CheckEgressAdmission(2, 1, 1000))
+    {
+        mmu->UpdateIngressAdmission(1, 1, 1000);
+        mmu->UpdateEgressAdmission(2, 1, 1000);
+        admitted++;
+    }
+    uint32_t shared = mmu->egress_bytes[2][1] - mmu->queue_reserve;
+    NS_TEST_EXPECT_MSG_LT_OR_EQ(shared, mmu->GetQueueThreshold(1), "queue under its threshold");
+    NS_TEST_EXPECT_MSG_EQ_TOL(shared, 100000 / 3, 1000, "queue threshold of alpha 1/2");
+    NS_TEST_EXPECT_MSG_EQ(mmu->queue_pool_used[1], shared, "shared bytes of pool 1");
+    NS_TEST_EXPECT_MSG_EQ(mmu->hdrm_bytes[1][1], 0, "no headroom for lossy PGs");
+    NS_TEST_EXPECT_MSG_EQ(mmu->CheckShouldPause(1, 1), false, "no PFC for lossy PGs");
+    // the lossless pool is untouched
+    NS_TEST_EXPECT_MSG_EQ(mmu->GetPgThreshold(3), 400000, "pool 0 free");
+
+    // lossless priority 3 from port 1: PFC once at the PG threshold, then the
+    // headroom, then drops
+    uint32_t lossless = 0;
+    bool pausedAt = false;
+    while (mmu->CheckIngressAdmission(1, 3, 1000))
+    {
+        mmu->UpdateIngressAdmission(1, 3, 1000);
+        mmu->UpdateEgressAdmission(2, 3, 1000);
+        lossless++;
+        if (!pausedAt && mmu->CheckShouldPause(1, 3))
+        {
+            pausedAt = true;
+            mmu->SetPause(1, 3);
+            NS_TEST_EXPECT_MSG_LT_OR_EQ(mmu->hdrm_bytes[1][3], 1000, "pause at the headroom");
+            NS_TEST_EXPECT_MSG_EQ_TOL(mmu->GetSharedUsed(1, 3), 200000, 1000, "PG threshold");
+        }
+    }
+    NS_TEST_EXPECT_MSG_EQ(pausedAt, true, "lossless PG paused");
+    NS_TEST_EXPECT_MSG_GT(mmu->hdrm_bytes[1][3], 9000, "headroom used");
+    NS_TEST_EXPECT_MSG_LT_OR_EQ(mmu->hdrm_bytes[1][3], 10000, "headroom limit");
+    NS_TEST_EXPECT_MSG_EQ(mmu->CheckEgressAdmission(2, 3, 1000), true, "lossless queue");
+    NS_TEST_EXPECT_MSG_EQ(mmu->queue_pool_used[1], shared, "pool 1 untouched");
+
+    // draining returns every counter to 0, and resumes the PG
+    for (uint32_t i = 0; i < lossless; i++)
+    {
+        mmu->RemoveFromIngressAdmission(1, 3, 1000);
+        mmu->RemoveFromEgressAdmission(2, 3, 1000);
+    }
+    NS_TEST_EXPECT_MSG_EQ(mmu->CheckShouldResume(1, 3), true, "PG resumed");
+    for (uint32_t i = 0; i < admitted; i++)
+    {
+        mmu->RemoveFromIngressAdmission(1, 1, 1000);
+        mmu->RemoveFromEgressAdmission(2, 1, 1000);
+    }
+    for (uint32_t i = 0; i < MultiPoolSwitchMmu::poolCnt; i++)
+    {
+        NS_TEST_EXPECT_MSG_EQ(mmu->pg_pool_used[i], 0, "PG bytes of a pool");
+        NS_TEST_EXPECT_MSG_EQ(mmu->queue_pool_used[i], 0, "queue bytes of a pool");
+    }
+    for (uint32_t q : {1, 3})
+    {
+        NS_TEST_EXPECT_MSG_EQ(mmu->ingress_bytes[1][q], 0, "ingress bytes");
+        NS_TEST_EXPECT_MSG_EQ(mmu->hdrm_bytes[1][q], 0, "headroom bytes");
+        NS_TEST_EXPECT_MSG_EQ(mmu->egress_bytes[2][q], 0, "egress bytes");
+    }
+
+    // pool 0 left to its default follows the buffer size and the ports,
+    // whichever order they are configured in
+    Ptr<MultiPoolSwitchMmu> fresh = CreateObject<MultiPoolSwitchMmu>();
+    for (uint32_t p = 1; p <= 2; p++)
+        fresh->ConfigHdrm(p, 10000);
+    fresh->ConfigNPort(2);
+    fresh->ConfigBufferSize(1000000);
+    NS_TEST_EXPECT_MSG_EQ(fresh->pool_size[0],
+                          1000000 - 2 * 10000 - 2 * fresh->reserve,
+                          "pool 0 sized after ConfigBufferSize");
+    fresh->ConfigBufferSize(2000000);
+    fresh->ConfigNPort(1);
+    NS_TEST_EXPECT_MSG_EQ(fresh->pool_size[0],
+                          2000000 - 10000 - fresh->reserve,
+                          "pool 0 sized after ConfigNPort");
+}
+
+/**
+ * \brief QbbTelemetry samples the switch queues of a device, and keeps its
+ * PFC pause intervals and counters.
+ */
+class QbbTelemetryTest : public TestCase
+{
+  public:
+    QbbTelemetryTest();
+
+  private:
+    void DoRun() override;
+};
+
+QbbTelemetryTest::QbbTelemetryTest()
+    : TestCase("QbbTelemetry queue samples and PFC pauses")
+{
+}
+
+void
+QbbTelemetryTest::DoRun()
+{
+    // a switch sends a burst of 10 packets of 1000 bytes to a host
+    Ptr<SwitchNode> sw = CreateObject<SwitchNode>();
+    Ptr<Node> host = CreateObject<Node>();
+    QbbHelper qbb;
+    qbb.SetDeviceAttribute("DataRate", StringValue("8Gbps"));
+    qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(1)));
+    qbb.Install(sw, host);
+    qbb.SetTelemetryAttribute("SampleInterval", UintegerValue(4));
+    qbb.SetTelemetryAttribute("PauseRingSize", UintegerValue(2));
+    qbb.SetTelemetryAttribute("SnapshotInterval", TimeValue(MicroSeconds(5)));
+    NodeContainer nodes;
+    nodes.Add(sw);
+    nodes.Add(host);
+    qbb.EnableTelemetry(nodes);
+    Ptr<QbbNetDevice> dev = DynamicCast<QbbNetDevice>(sw->GetDevice(0));
+    Ptr<QbbTelemetry> telemetry = dev->GetTelemetry();
+    NS_TEST_ASSERT_MSG_NE(telemetry, nullptr, "telemetry enabled");
+    std::vector<Time> snapshots;
+    telemetry->TraceConnectWithoutContext(
+        "Snapshot",
+        Callback<void, Ptr<const QbbTelemetry>>(
+            [&snapshots](Ptr<const QbbTelemetry> t) { snapshots.push_back(Simulator::Now()); }));
+
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        Ptr<Packet> p = Create<Packet>(1000 - 20 - 2);
+        Ipv4Header ip;
+        ip.SetProtocol(0xFF);
+        ip.SetPayloadSize(p->GetSize());
+        p->AddHeader(ip);
+        PppHeader ppp;
+        ppp.SetProtocol(0x0021);
+        p->AddHeader(ppp);
+        size = p->GetSize();
+        CustomHeader ch(CustomHeader::L3_Header);
+        dev->SwitchSend(0, p, ch);
+    }
+    Simulator::Run();
+
+    // one packet takes 1 us on the link
+    QbbTelemetry::QueueCounters c = telemetry->GetCounters(0);
+    NS_TEST_EXPECT_MSG_EQ(c.packets, 10, "packets dequeued");
+    NS_TEST_EXPECT_MSG_EQ(c.bytes, 10 * size, "bytes dequeued");
+    NS_TEST_EXPECT_MSG_EQ(c.maxQlen, 9 * size, "the first packet is sent at once");
+    NS_TEST_EXPECT_MSG_EQ(c.maxSojourn, MicroSeconds(9), "sojourn of the last packet");
+    std::vector<QbbTelemetry::QueueSample> samples = telemetry->GetSamples();
+    NS_TEST_ASSERT_MSG_EQ(samples.size(), 3, "one sample every 4 packets");
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        NS_TEST_EXPECT_MSG_EQ(samples[i].time, MicroSeconds(4 * i), "sample time");
+        NS_TEST_EXPECT_MSG_EQ(samples[i].sojourn, MicroSeconds(4 * i), "sample sojourn");
+        // the first packet leaves before the others are enqueued
+        uint32_t qlen = i == 0 ? 0 : (9 - 4 * i) * size;
+        NS_TEST_EXPECT_MSG_EQ(samples[i].qlen, qlen, "sample queue length");
+    }
+    NS_TEST_EXPECT_MSG_EQ(snapshots.size(), 2, "snapshots while the device records");
+    NS_TEST_EXPECT_MSG_EQ(snapshots[0], MicroSeconds(5), "first snapshot");
+
+    // the pauses of a queue, a repeated pause refreshes the pause in progress
+    Time start = Simulator::Now();
+    Simulator::Schedule(MicroSeconds(1), &QbbTelemetry::RecordPfc, telemetry, 3, true);
+    Simulator::Schedule(MicroSeconds(2), &QbbTelemetry::RecordPfc, telemetry, 3, true);
+    Simulator::Schedule(MicroSeconds(4), &QbbTelemetry::RecordPfc, telemetry, 3, false);
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        Time t = MicroSeconds(10 + 10 * i);
+        Simulator::Schedule(t, &QbbTelemetry::RecordPfc, telemetry, 5, true);
+        Simulator::Schedule(t + MicroSeconds(5), &QbbTelemetry::RecordPfc, telemetry, 5, false);
+    }
+    Simulator::Schedule(MicroSeconds(30), &QbbTelemetry::RecordPfc, telemetry, 5, true);
+    Simulator::Stop(MicroSeconds(31));
+    Simulator::Run();
+    c = telemetry->GetCounters(3);
+    NS_TEST_EXPECT_MSG_EQ(c.pauses, 1, "pauses of queue 3");
+    NS_TEST_EXPECT_MSG_EQ(c.pauseTime, MicroSeconds(3), "pause time of queue 3");
+    c = telemetry->GetCounters(5);
+    NS_TEST_EXPECT_MSG_EQ(c.pauses, 3, "pauses of queue 5");
+    NS_TEST_EXPECT_MSG_EQ(c.pauseTime, MicroSeconds(11), "with the pause in progress");
+    NS_TEST_EXPECT_MSG_EQ(telemetry->IsPaused(5), true, "queue 5 paused");
+    std::vector<QbbTelemetry::PauseInterval> pauses = telemetry->GetPauses();
+    NS_TEST_ASSERT_MSG_EQ(pauses.size(), 2, "the ring keeps the last intervals");
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        NS_TEST_EXPECT_MSG_EQ(pauses[i].qIndex, 5, "queue of the interval");
+        NS_TEST_EXPECT_MSG_EQ(pauses[i].start, start + MicroSeconds(10 + 10 * i), "start");
+        NS_TEST_EXPECT_MSG_EQ(pauses[i].end, start + MicroSeconds(15 + 10 * i), "end");
+    }
+    telemetry->RecordEcnMark(3);
+    NS_TEST_EXPECT_MSG_EQ(telemetry->GetCounters(3).ecnMarks, 1, "ECN marks");
+    telemetry->Reset();
+    NS_TEST_EXPECT_MSG_EQ(telemetry->GetSamples().size(), 0, "samples reset");
+    NS_TEST_EXPECT_MSG_EQ(telemetry->GetCounters(3).pauses, 0, "counters reset");
+    NS_TEST_EXPECT_MSG_EQ(telemetry->IsPaused(5), true, "pause state kept");
+    Simulator::Destroy();
+}
+
+/**
+ * \brief PfcDeadlockDetector finds the paused queues of a routing loop between
+ * two switches which wait for each other, and no deadlock while a queue on
+ * the way can progress.
+ */
+class QbbPfcDeadlockTest : public TestCase
+{
+  public:
+    QbbPfcDeadlockTest();
+
+  private:
+    void DoRun() override;
+    // send packets of 1000 bytes to dst, received by sw on inDev
+    static void Inject(Ptr<SwitchNode> sw, uint32_t inDev, Ipv4Address dst, uint32_t n);
+};
+
+QbbPfcDeadlockTest::QbbPfcDeadlockTest()
+    : TestCase("PfcDeadlockDetector wait-for graph of the paused queues")
+{
+}
+
+void
+QbbPfcDeadlockTest::Inject(Ptr<SwitchNode> sw, uint32_t inDev, Ipv4Address dst, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        // the TCP header of CustomHeader, with a data offset of 5 words
+        uint8_t tcp[1000 - 20 - 14] = {};
+        tcp[16] = 0x50;
+        Ptr<Packet> l3 = Create<Packet>(tcp, sizeof(tcp));
+        Ipv4Header ip;
+        ip.SetSource(Ipv4Address("11.0.1.1"));
+        ip.SetDestination(dst);
+        ip.SetProtocol(0x6);
+        ip.SetPayloadSize(l3->GetSize());
+        l3->AddHeader(ip);
+        // the L2 header of CustomHeader is PPP and 12 bytes of padding
+        uint8_t buf[1000] = {0x00, 0x21};
+        l3->CopyData(buf + 14, l3->GetSize());
+        Ptr<Packet> p = Create<Packet>(buf, sizeof(buf));
+        p->AddPacketTag(FlowIdTag(inDev));
+        CustomHeader ch(CustomHeader::L2_Header | CustomHeader::L3_Header |
+                        CustomHeader::L4_Header);
+        p->PeekHeader(ch);
+        sw->SwitchReceiveFromDevice(sw->GetDevice(inDev), p, ch);
+    }
+}
+
+void
+QbbPfcDeadlockTest::DoRun()
+{
+    // two links between two switches, sw1 sends on port 0 to port 0 of sw2,
+    // which sends on port 1 back to port 1 of sw1, and a host on port 2 of sw2
+    Ptr<SwitchNode> sw1 = CreateObject<SwitchNode>();
+    Ptr<SwitchNode> sw2 = CreateObject<SwitchNode>();
+    Ptr<Node> host = CreateObject<Node>();
+    QbbHelper qbb;
+    qbb.SetDeviceAttribute("DataRate", StringValue("8Gbps"));
+    qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(1)));
+    qbb.Install(sw1, sw2);
+    qbb.Install(sw1, sw2);
+    qbb.Install(sw2, host);
+    NodeContainer nodes;
+    nodes.Add(sw1);
+    nodes.Add(sw2);
+    nodes.Add(host);
+    qbb.SetDeadlockDetectorAttribute("CheckInterval", TimeValue(MicroSeconds(100)));
+    Ptr<PfcDeadlockDetector> detector = qbb.EnableDeadlockDetection(nodes);
+    NS_TEST_EXPECT_MSG_EQ(DynamicCast<QbbNetDevice>(host->GetDevice(0))->GetDeadlockDetector(),
+                          detector,
+                          "one detector for the network");
+    std::vector<PfcDeadlockDetector::PausedQueue> report;
+    detector->SetDeadlockCallback(PfcDeadlockDetector::DeadlockCallback(
+        [&report](const std::vector<PfcDeadlockDetector::PausedQueue>& queues) {
+            report.insert(report.end(), queues.begin(), queues.end());
+        }));
+    for (Ptr<SwitchNode> sw : {sw1, sw2})
+    {
+        for (uint32_t p = 0; p <= 2; p++)
+        {
+            sw->m_mmu->pfc_a_shift[p] = 0;
+            sw->m_mmu->ConfigHdrm(p, 20000);
+        }
+        sw->m_mmu->ConfigNPort(2);
+    }
+    Ipv4Address loop("11.0.100.1");
+    Ipv4Address sink("11.0.101.1");
+    sw1->AddTableEntry(loop, 0);
+    sw2->AddTableEntry(loop, 1);
+    sw2->AddTableEntry(sink, 2);
+
+    // the PFC state of the loop: each switch pauses its ingress from the
+    // other, whose egress queue to it holds packets of its own paused ingress
+    Ptr<QbbNetDevice> dev1 = DynamicCast<QbbNetDevice>(sw1->GetDevice(0));
+    Ptr<QbbNetDevice> dev2 = DynamicCast<QbbNetDevice>(sw2->GetDevice(1));
+    for (Ptr<QbbNetDevice> dev : {dev1, dev2})
+    {
+        dev->GetQueue()->SetPaused(1, true);
+        detector->RecordPfc(dev, 1, true);
+    }
+    detector->RecordPfc(dev1, 1, true);
+    NS_TEST_EXPECT_MSG_EQ(detector->GetPausedQueues().size(), 2, "a repeated pause refreshes");
+    Inject(sw1, 1, loop, 10);
+    Inject(sw2, 0, loop, 10);
+    NS_TEST_EXPECT_MSG_EQ(sw1->GetBytes(1, 0, 1), 10000, "bytes of sw1 held by the pause");
+    NS_TEST_EXPECT_MSG_EQ(detector->FindDeadlock().size(), 0, "the ingresses are not paused");
+    sw1->m_mmu->SetPause(1, 1);
+    sw2->m_mmu->SetPause(0, 1);
+    NS_TEST_EXPECT_MSG_EQ(detector->FindDeadlock().size(), 2, "the loop is deadlocked");
+
+    // the check reports the deadlock once, then stops
+    Simulator::Run();
+    NS_TEST_EXPECT_MSG_EQ(Simulator::Now(), MicroSeconds(100), "one check");
+    NS_TEST_ASSERT_MSG_EQ(report.size(), 2, "the two queues of the loop");
+    std::sort(report.begin(), report.end(), [](const auto& a, const auto& b) {
+        return a.device->GetNode()->GetId() < b.device->GetNode()->GetId();
+    });
+    NS_TEST_EXPECT_MSG_EQ(report[0].device, dev1, "sw1 to sw2 paused");
+    NS_TEST_EXPECT_MSG_EQ(report[1].device, dev2, "sw2 to sw1 paused");
+    for (const auto& q : report)
+    {
+        NS_TEST_EXPECT_MSG_EQ(q.qIndex, 1, "queue of TCP");
+        NS_TEST_EXPECT_MSG_EQ(q.since, Time(0), "time of the pause");
+    }
+    NS_TEST_EXPECT_MSG_EQ(detector->GetReported(), 2, "reported queues");
+
+    // a packet of the paused ingress of sw2 waits in a queue to the host,
+    // which may progress even when paused
+    Ptr<QbbNetDevice> toHost = DynamicCast<QbbNetDevice>(sw2->GetDevice(2));
+    toHost->GetQueue()->SetPaused(1, true);
+    Inject(sw2, 0, sink, 1);
+    NS_TEST_EXPECT_MSG_EQ(detector->FindDeadlock().size(), 0, "sw2 may drain to the host");
+    detector->RecordPfc(toHost, 1, true);
+    NS_TEST_EXPECT_MSG_EQ(detector->FindDeadlock().size(), 0, "a host is not deadlocked");
+    Simulator::Stop(MicroSeconds(250));
+    Simulator::Run();
+    NS_TEST_EXPECT_MSG_EQ(report.size(), 2, "no other deadlock");
+    detector->RecordPfc(toHost, 1, false);
+    detector->RecordPfc(dev2, 1, false);
+    NS_TEST_EXPECT_MSG_EQ(detector->GetPausedQueues().size(), 1, "resumed queues removed");
+    NS_TEST_EXPECT_MSG_EQ(detector->GetPausedQueues()[0].device, dev1, "last paused queue");
+    Simulator::Destroy();
+}
+
+/**
+ * \brief TestSuite for the qbb/RDMA models
+ */
+class QbbTestSuite : public TestSuite
+{
+  public:
+    QbbTestSuite();
+};
+
+QbbTestSuite::QbbTestSuite()
+    : TestSuite("devices-qbb", Type::UNIT)
+{
+    AddTestCase(new QbbTraceWriterTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbEcmpFibTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbRoutingHelperTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbFctCollectorTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbHelperBulkInstallTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbSnapshotTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbDcqcnLazyTimersTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbCcPolicyTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbAckCoalescingTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbSelectiveRepeatTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbMessageVerbsTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbFluidModeTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbTrainTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbPgSchedulerTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbEgressQueueRRTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbMultiPoolMmuTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbTelemetryTest, TestCase::Duration::QUICK);
+    AddTestCase(new QbbPfcDeadlockTest, TestCase::Duration::QUICK);
+}
+
+static QbbTestSuite g_qbbTestSuite; //!< The testsuite
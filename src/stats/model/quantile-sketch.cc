@@ -0,0 +1,405 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "quantile-sketch.h"
+
+#include "ns3/abort.h"
+#include "ns3/double.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("QuantileSketch");
+
+NS_OBJECT_ENSURE_REGISTERED(QuantileSketchCalculator);
+
+QuantileSketch::Store::Store()
+    : offset(0),
+      count(0)
+{
+}
+
+void
+QuantileSketch::Store::Add(int32_t key, uint64_t n, uint32_t maxBins)
+{
+    count += n;
+    if (bins.empty())
+    {
+        offset = key;
+        bins.push_back(n);
+        return;
+    }
+    int64_t index = (int64_t)key - offset;
+    if (index >= 0 && index < (int64_t)bins.size())
+    {
+        bins[index] += n;
+        return;
+    }
+
+    // extend the range of keys, collapsing the lowest bins if it gets too wide
+    int64_t lo = std::min<int64_t>(offset, key);
+    int64_t hi = std::max<int64_t>(offset + (int64_t)bins.size() - 1, key);
+    if (hi - lo + 1 > maxBins)
+    {
+        lo = hi - maxBins + 1;
+    }
+    std::vector<uint64_t> extended(hi - lo + 1, 0);
+    for (uint32_t i = 0; i < bins.size(); i++)
+    {
+        extended[std::max<int64_t>((int64_t)offset + i, lo) - lo] += bins[i];
+    }
+    extended[std::max<int64_t>(key, lo) - lo] += n;
+    bins.swap(extended);
+    offset = lo;
+}
+
+int32_t
+QuantileSketch::Store::KeyAtRank(uint64_t rank, bool ascending) const
+{
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < bins.size(); i++)
+    {
+        uint32_t index = ascending ? i : bins.size() - 1 - i;
+        seen += bins[index];
+        if (seen > rank)
+        {
+            return (int32_t)(offset + index);
+        }
+    }
+    return ascending ? (int32_t)(offset + bins.size() - 1) : offset;
+}
+
+QuantileSketch::QuantileSketch(double relativeAccuracy, uint32_t maxBins)
+    : m_relativeAccuracy(relativeAccuracy),
+      m_maxBins(maxBins)
+{
+    NS_ABORT_MSG_IF(relativeAccuracy <= 0 || relativeAccuracy >= 1,
+                    "QuantileSketch: relative accuracy " << relativeAccuracy
+                                                         << " not in (0, 1)");
+    NS_ABORT_MSG_IF(maxBins == 0, "QuantileSketch: no bins");
+    m_gamma = (1 + relativeAccuracy) / (1 - relativeAccuracy);
+    m_logGamma = std::log(m_gamma);
+    m_minIndexable = std::numeric_limits<double>::min() * m_gamma;
+    Clear();
+}
+
+int32_t
+QuantileSketch::Key(double value) const
+{
+    return (int32_t)std::ceil(std::log(value) / m_logGamma);
+}
+
+double
+QuantileSketch::Value(int32_t key) const
+{
+    // within m_relativeAccuracy of any value of (gamma^(key-1), gamma^key]
+    return 2 * std::exp(key * m_logGamma) / (1 + m_gamma);
+}
+
+void
+QuantileSketch::Add(double value, uint64_t count)
+{
+    if (count == 0 || std::isnan(value))
+    {
+        return;
+    }
+    if (value > m_minIndexable)
+    {
+        m_positive.Add(Key(value), count, m_maxBins);
+    }
+    else if (value < -m_minIndexable)
+    {
+        m_negative.Add(Key(-value), count, m_maxBins);
+    }
+    else
+    {
+        m_zeroCount += count;
+    }
+    m_sum += value * count;
+    m_sqrSum += value * value * count;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+}
+
+void
+QuantileSketch::Merge(const QuantileSketch& other)
+{
+    NS_ABORT_MSG_IF(other.m_gamma != m_gamma,
+                    "QuantileSketch: cannot merge sketches of different accuracies");
+    for (uint32_t i = 0; i < other.m_positive.bins.size(); i++)
+    {
+        if (other.m_positive.bins[i])
+        {
+            m_positive.Add((int32_t)(other.m_positive.offset + i),
+                          other.m_positive.bins[i],
+                          m_maxBins);
+        }
+    }
+    for (uint32_t i = 0; i < other.m_negative.bins.size(); i++)
+    {
+        if (other.m_negative.bins[i])
+        {
+            m_negative.Add((int32_t)(other.m_negative.offset + i),
+                          other.m_negative.bins[i],
+                          m_maxBins);
+        }
+    }
+    m_zeroCount += other.m_zeroCount;
+    m_sum += other.m_sum;
+    m_sqrSum += other.m_sqrSum;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+double
+QuantileSketch::GetQuantile(double q) const
+{
+    uint64_t count = GetCount();
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(std::min(std::max(q, 0.0), 1.0) * (count - 1));
+    double value;
+    if (rank < m_negative.count)
+    {
+        // the most negative values have the highest keys
+        value = -Value(m_negative.KeyAtRank(rank, false));
+    }
+    else if (rank < m_negative.count + m_zeroCount)
+    {
+        value = 0;
+    }
+    else
+    {
+        value = Value(m_positive.KeyAtRank(rank - m_negative.count - m_zeroCount, true));
+    }
+    return std::min(std::max(value, m_min), m_max);
+}
+
+void
+QuantileSketch::Clear()
+{
+    m_positive = Store();
+    m_negative = Store();
+    m_zeroCount = 0;
+    m_sum = 0;
+    m_sqrSum = 0;
+    m_min = std::numeric_limits<double>::infinity();
+    m_max = -std::numeric_limits<double>::infinity();
+}
+
+double
+QuantileSketch::GetRelativeAccuracy() const
+{
+    return m_relativeAccuracy;
+}
+
+uint64_t
+QuantileSketch::GetCount() const
+{
+    return m_negative.count + m_zeroCount + m_positive.count;
+}
+
+double
+QuantileSketch::GetSum() const
+{
+    return m_sum;
+}
+
+double
+QuantileSketch::GetSqrSum() const
+{
+    return m_sqrSum;
+}
+
+double
+QuantileSketch::GetMin() const
+{
+    return GetCount() ? m_min : 0;
+}
+
+double
+QuantileSketch::GetMax() const
+{
+    return GetCount() ? m_max : 0;
+}
+
+uint32_t
+QuantileSketch::GetNBins() const
+{
+    return m_positive.bins.size() + m_negative.bins.size();
+}
+
+TypeId
+QuantileSketchCalculator::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::QuantileSketchCalculator")
+            .SetParent<DataCalculator>()
+            .SetGroupName("Stats")
+            .AddConstructor<QuantileSketchCalculator>()
+            .AddAttribute("RelativeAccuracy",
+                          "Relative accuracy of the quantiles.",
+                          DoubleValue(0.01),
+                          MakeDoubleAccessor(&QuantileSketchCalculator::m_relativeAccuracy),
+                          MakeDoubleChecker<double>(0, 1))
+            .AddAttribute("MaxBins",
+                          "Maximum number of bins of a sketch, for each sign of the values.",
+                          UintegerValue(2048),
+                          MakeUintegerAccessor(&QuantileSketchCalculator::m_maxBins),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("MaxStreams",
+                          "Maximum number of logical processes updating the calculator.",
+                          UintegerValue(LpStreams<QuantileSketch>::DEFAULT_MAX_STREAMS),
+                          MakeUintegerAccessor(&QuantileSketchCalculator::SetMaxStreams,
+                                               &QuantileSketchCalculator::GetMaxStreams),
+                          MakeUintegerChecker<uint32_t>(1));
+    return tid;
+}
+
+QuantileSketchCalculator::QuantileSketchCalculator()
+    : m_relativeAccuracy(0.01),
+      m_maxBins(2048),
+      m_sketches("QuantileSketchCalculator")
+{
+    NS_LOG_FUNCTION(this);
+}
+
+QuantileSketchCalculator::~QuantileSketchCalculator()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+void
+QuantileSketchCalculator::DoDispose()
+{
+    NS_LOG_FUNCTION(this);
+    DataCalculator::DoDispose();
+}
+
+void
+QuantileSketchCalculator::SetMaxStreams(uint32_t maxStreams)
+{
+    m_sketches.SetMaxStreams(maxStreams);
+}
+
+uint32_t
+QuantileSketchCalculator::GetMaxStreams() const
+{
+    return m_sketches.GetMaxStreams();
+}
+
+void
+QuantileSketchCalculator::Update(double value)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+    m_sketches
+        .Get(Simulator::GetSystemId(),
+             [this]() { return new QuantileSketch(m_relativeAccuracy, m_maxBins); })
+        ->Add(value);
+}
+
+void
+QuantileSketchCalculator::Reset()
+{
+    NS_LOG_FUNCTION(this);
+    m_sketches.ForEach([](QuantileSketch* sketch) { sketch->Clear(); });
+}
+
+QuantileSketch
+QuantileSketchCalculator::GetSketch() const
+{
+    QuantileSketch merged(m_relativeAccuracy, m_maxBins);
+    m_sketches.ForEach([&merged](QuantileSketch* sketch) { merged.Merge(*sketch); });
+    return merged;
+}
+
+double
+QuantileSketchCalculator::GetQuantile(double q) const
+{
+    return GetSketch().GetQuantile(q);
+}
+
+void
+QuantileSketchCalculator::Output(DataOutputCallback& callback) const
+{
+    NS_LOG_FUNCTION(this << &callback);
+    callback.OutputStatistic(m_context, m_key, this);
+    QuantileSketch sketch = GetSketch();
+    if (sketch.GetCount() > 0)
+    {
+        callback.OutputSingleton(m_context, m_key + "-p50", sketch.GetQuantile(0.5));
+        callback.OutputSingleton(m_context, m_key + "-p90", sketch.GetQuantile(0.9));
+        callback.OutputSingleton(m_context, m_key + "-p99", sketch.GetQuantile(0.99));
+        callback.OutputSingleton(m_context, m_key + "-p999", sketch.GetQuantile(0.999));
+    }
+}
+
+long
+QuantileSketchCalculator::getCount() const
+{
+    return GetSketch().GetCount();
+}
+
+double
+QuantileSketchCalculator::getSum() const
+{
+    return GetSketch().GetSum();
+}
+
+double
+QuantileSketchCalculator::getSqrSum() const
+{
+    return GetSketch().GetSqrSum();
+}
+
+double
+QuantileSketchCalculator::getMin() const
+{
+    return GetSketch().GetMin();
+}
+
+double
+QuantileSketchCalculator::getMax() const
+{
+    return GetSketch().GetMax();
+}
+
+double
+QuantileSketchCalculator::getMean() const
+{
+    QuantileSketch sketch = GetSketch();
+    return sketch.GetCount() ? sketch.GetSum() / sketch.GetCount() : NaN;
+}
+
+double
+QuantileSketchCalculator::getStddev() const
+{
+    return std::sqrt(getVariance());
+}
+
+double
+QuantileSketchCalculator::getVariance() const
+{
+    QuantileSketch sketch = GetSketch();
+    uint64_t n = sketch.GetCount();
+    if (n < 2)
+    {
+        return NaN;
+    }
+    return (sketch.GetSqrSum() - sketch.GetSum() * sketch.GetSum() / n) / (n - 1);
+}
+
+} // namespace ns3
@@ -0,0 +1,203 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include "data-calculator.h"
+#include "data-output-interface.h"
+
+#include "ns3/lp-streams.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * \ingroup stats
+ * \brief Mergeable quantile sketch with relative accuracy guarantees.
+ *
+ * Values are counted in logarithmically sized bins, as in DDSketch
+ * (Masson et al., "DDSketch: A Fast and Fully-Mergeable Quantile Sketch
+ * with Relative-Error Guarantees", VLDB 2019): bin k holds the values in
+ * (gamma^(k-1), gamma^k], with gamma = (1 + a) / (1 - a) for a relative
+ * accuracy a, so any quantile is returned within a factor a of a value of
+ * that rank.  Negative values are counted in a mirrored set of bins, and
+ * values closer to zero than the smallest indexable value as zero.
+ *
+ * The number of bins grows with the logarithm of the range of the values.
+ * Once it would exceed the maximum number of bins, the lowest bins are
+ * collapsed, so only the accuracy of the smallest values degrades.  With
+ * the default 1% accuracy, 2048 bins cover 17 orders of magnitude.
+ *
+ * Two sketches with the same accuracy can be merged; the result is the
+ * sketch of the union of their values.
+ */
+class QuantileSketch
+{
+  public:
+    /**
+     * \param relativeAccuracy the relative accuracy of the quantiles, in (0, 1)
+     * \param maxBins the maximum number of bins of each sign
+     */
+    QuantileSketch(double relativeAccuracy = 0.01, uint32_t maxBins = 2048);
+
+    /**
+     * Add a value
+     * \param value the value
+     * \param count the number of times to add it
+     */
+    void Add(double value, uint64_t count = 1);
+
+    /**
+     * Add the values of another sketch
+     * \param other a sketch with the same relative accuracy
+     */
+    void Merge(const QuantileSketch& other);
+
+    /**
+     * \param q the quantile, in [0, 1]
+     * \return the value of rank q * (count - 1), 0 if the sketch is empty
+     */
+    double GetQuantile(double q) const;
+
+    /// Remove all the values
+    void Clear();
+
+    /// \return the relative accuracy
+    double GetRelativeAccuracy() const;
+    /// \return the number of values
+    uint64_t GetCount() const;
+    /// \return the sum of the values
+    double GetSum() const;
+    /// \return the sum of the squares of the values
+    double GetSqrSum() const;
+    /// \return the smallest value, 0 if the sketch is empty
+    double GetMin() const;
+    /// \return the largest value, 0 if the sketch is empty
+    double GetMax() const;
+    /// \return the number of bins in use
+    uint32_t GetNBins() const;
+
+  private:
+    /// Counts of consecutive bins
+    struct Store
+    {
+        std::vector<uint64_t> bins; //!< counts, bins[i] is the count of key offset + i
+        int32_t offset;             //!< key of bins[0]
+        uint64_t count;             //!< sum of the counts
+
+        Store();
+        /**
+         * \param key the key of the bin
+         * \param count the count to add
+         * \param maxBins the maximum number of bins
+         */
+        void Add(int32_t key, uint64_t count, uint32_t maxBins);
+        /**
+         * \param rank a rank, counting from 0 upwards
+         * \param ascending whether ranks count from the lowest key
+         * \return the key of the value of this rank
+         */
+        int32_t KeyAtRank(uint64_t rank, bool ascending) const;
+    };
+
+    /**
+     * \param value a positive value
+     * \return the key of its bin
+     */
+    int32_t Key(double value) const;
+    /**
+     * \param key a key
+     * \return the value representing the bin
+     */
+    double Value(int32_t key) const;
+
+    double m_relativeAccuracy; //!< relative accuracy
+    double m_gamma;            //!< ratio of the bounds of a bin
+    double m_logGamma;         //!< log(m_gamma)
+    double m_minIndexable;     //!< smallest positive value with a bin of its own
+    uint32_t m_maxBins;        //!< maximum number of bins of each store
+    Store m_positive;          //!< bins of the positive values
+    Store m_negative;          //!< bins of the opposite of the negative values
+    uint64_t m_zeroCount;      //!< number of values counted as zero
+    double m_sum;              //!< sum of the values
+    double m_sqrSum;           //!< sum of the squares of the values
+    double m_min;              //!< smallest value
+    double m_max;              //!< largest value
+};
+
+/**
+ * \ingroup stats
+ * \brief DataCalculator of the quantiles of a set of values.
+ *
+ * The values are added to a QuantileSketch of the logical process calling
+ * Update (Simulator::GetSystemId), so that with the multithreaded simulator
+ * each thread updates its own sketch without locking.  The sketches are
+ * merged when the results are read.  Output writes the summary statistics
+ * and the 50th, 90th, 99th and 99.9th percentiles.
+ */
+class QuantileSketchCalculator : public DataCalculator, public StatisticalSummary
+{
+  public:
+    QuantileSketchCalculator();
+    ~QuantileSketchCalculator() override;
+
+    /**
+     * Register this type.
+     * \return The TypeId.
+     */
+    static TypeId GetTypeId();
+
+    /**
+     * Add a value to the sketch of the calling logical process
+     * \param value the value
+     */
+    void Update(double value);
+
+    /// Remove all the values
+    void Reset();
+
+    /// \return the sketch of all the values, merged from the logical processes
+    QuantileSketch GetSketch() const;
+
+    /**
+     * \param q the quantile, in [0, 1]
+     * \return the value of rank q * (count - 1), 0 if there are no values
+     */
+    double GetQuantile(double q) const;
+
+    void Output(DataOutputCallback& callback) const override;
+
+    long getCount() const override;
+    double getSum() const override;
+    double getSqrSum() const override;
+    double getMin() const override;
+    double getMax() const override;
+    double getMean() const override;
+    double getStddev() const override;
+    double getVariance() const override;
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    /**
+     * \param maxStreams the maximum number of logical processes
+     */
+    void SetMaxStreams(uint32_t maxStreams);
+    /// \return the maximum number of logical processes
+    uint32_t GetMaxStreams() const;
+
+    double m_relativeAccuracy; //!< relative accuracy of the sketches
+    uint32_t m_maxBins;        //!< maximum number of bins of the sketches
+    /// sketch of each logical process, created by its first Update
+    LpStreams<QuantileSketch> m_sketches;
+};
+
+} // namespace ns3
+
+#endif /* QUANTILE_SKETCH_H */
@@ -0,0 +1,175 @@
+//
+// SPDX-License-Identifier: GPL-2.0-only
+//
+
+#include "ns3/quantile-sketch.h"
+#include "ns3/test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \ingroup stats-tests
+ *
+ * \brief QuantileSketch Test
+ */
+class QuantileSketchTestCase : public TestCase
+{
+  public:
+    QuantileSketchTestCase();
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Check the quantiles of a sketch against the exact quantiles of its values
+     * \param sketch the sketch
+     * \param values the values added to the sketch
+     * \param msg the name of the set of values
+     */
+    void CheckQuantiles(const QuantileSketch& sketch, std::vector<double> values, std::string msg);
+};
+
+QuantileSketchTestCase::QuantileSketchTestCase()
+    : TestCase("QuantileSketch")
+{
+}
+
+void
+QuantileSketchTestCase::CheckQuantiles(const QuantileSketch& sketch,
+                                       std::vector<double> values,
+                                       std::string msg)
+{
+    std::sort(values.begin(), values.end());
+    NS_TEST_EXPECT_MSG_EQ(sketch.GetCount(), values.size(), msg << ": count");
+    for (double q : {0.0, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0})
+    {
+        double exact = values[(uint64_t)(q * (values.size() - 1))];
+        NS_TEST_EXPECT_MSG_EQ_TOL(sketch.GetQuantile(q),
+                                  exact,
+                                  std::abs(exact) * sketch.GetRelativeAccuracy() + 1e-12,
+                                  msg << ": quantile " << q);
+    }
+}
+
+void
+QuantileSketchTestCase::DoRun()
+{
+    // uniform values
+    {
+        QuantileSketch sketch;
+        std::vector<double> values;
+        for (int i = 1; i <= 10000; i++)
+        {
+            values.push_back(i * 0.37);
+            sketch.Add(i * 0.37);
+        }
+        CheckQuantiles(sketch, values, "uniform");
+        NS_TEST_EXPECT_MSG_EQ_TOL(sketch.GetMin(), 0.37, 1e-12, "min");
+        NS_TEST_EXPECT_MSG_EQ_TOL(sketch.GetMax(), 3700, 1e-9, "max");
+    }
+
+    // heavy tailed values, over 9 orders of magnitude
+    QuantileSketch tail;
+    std::vector<double> tailValues;
+    for (int i = 1; i <= 10000; i++)
+    {
+        double v = 1e6 / std::pow(i / 10000.0, 2.25) * 1e-9;
+        tailValues.push_back(v);
+        tail.Add(v);
+    }
+    CheckQuantiles(tail, tailValues, "heavy tail");
+
+    // merging two sketches is adding all the values to one
+    {
+        QuantileSketch a;
+        QuantileSketch b;
+        QuantileSketch all;
+        for (uint32_t i = 0; i < tailValues.size(); i++)
+        {
+            (i % 3 ? a : b).Add(tailValues[i]);
+            all.Add(tailValues[i]);
+        }
+        a.Merge(b);
+        NS_TEST_EXPECT_MSG_EQ(a.GetCount(), all.GetCount(), "merged count");
+        NS_TEST_EXPECT_MSG_EQ(a.GetNBins(), all.GetNBins(), "merged bins");
+        for (double q : {0.0, 0.25, 0.5, 0.75, 0.99, 1.0})
+        {
+            NS_TEST_EXPECT_MSG_EQ(a.GetQuantile(q), all.GetQuantile(q), "merged quantile " << q);
+        }
+        NS_TEST_EXPECT_MSG_EQ_TOL(a.GetSum(), all.GetSum(), all.GetSum() * 1e-12, "merged sum");
+    }
+
+    // negative values and zeros
+    {
+        QuantileSketch sketch;
+        std::vector<double> values;
+        for (int i = -500; i <= 1500; i++)
+        {
+            values.push_back(i);
+            sketch.Add(i);
+        }
+        sketch.Add(0, 99);
+        values.insert(values.end(), 99, 0);
+        CheckQuantiles(sketch, values, "signed");
+        NS_TEST_EXPECT_MSG_EQ(sketch.GetQuantile(0.25), 0, "zero quantile");
+    }
+
+    // the lowest bins collapse when the number of bins is bounded
+    {
+        QuantileSketch sketch(0.01, 64);
+        for (int i = 0; i <= 1000; i++)
+        {
+            sketch.Add(std::pow(10, i / 100.0));
+        }
+        NS_TEST_EXPECT_MSG_EQ(sketch.GetNBins(), 64, "bounded bins");
+        NS_TEST_EXPECT_MSG_EQ_TOL(sketch.GetQuantile(1), 1e10, 1e10 * 1e-9, "max after collapse");
+        NS_TEST_EXPECT_MSG_EQ_TOL(sketch.GetQuantile(0.99),
+                                  std::pow(10, 9.9),
+                                  std::pow(10, 9.9) * 0.01,
+                                  "high quantile after collapse");
+        NS_TEST_EXPECT_MSG_GT(sketch.GetQuantile(0.5), 1e5 * 1.01, "collapsed low bins");
+    }
+
+    // the calculator merges the sketches of the logical processes
+    {
+        Ptr<QuantileSketchCalculator> calculator = CreateObject<QuantileSketchCalculator>();
+        for (double v : tailValues)
+        {
+            calculator->Update(v);
+        }
+        CheckQuantiles(calculator->GetSketch(), tailValues, "calculator");
+        NS_TEST_EXPECT_MSG_EQ(calculator->getCount(), (long)tailValues.size(), "calculator count");
+        NS_TEST_EXPECT_MSG_EQ(calculator->GetQuantile(0.5),
+                              tail.GetQuantile(0.5),
+                              "calculator median");
+        calculator->Disable();
+        calculator->Update(1);
+        NS_TEST_EXPECT_MSG_EQ(calculator->getCount(), (long)tailValues.size(), "disabled");
+        calculator->Reset();
+        NS_TEST_EXPECT_MSG_EQ(calculator->getCount(), 0, "reset");
+    }
+}
+
+/**
+ * \ingroup stats-tests
+ *
+ * \brief QuantileSketch TestSuite
+ */
+class QuantileSketchTestSuite : public TestSuite
+{
+  public:
+    QuantileSketchTestSuite();
+};
+
+QuantileSketchTestSuite::QuantileSketchTestSuite()
+    : TestSuite("quantile-sketch", Type::UNIT)
+{
+    AddTestCase(new QuantileSketchTestCase, TestCase::Duration::QUICK);
+}
+
+/// Static variable for test initialization
+static QuantileSketchTestSuite g_quantileSketchTestSuite;
@@ -0,0 +1,228 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the forwarding cost of Ipv4GlobalRouting as the
+// number of routes grows.  A router with --ifaces interfaces gets /32 host
+// routes, each with --ecmp equal-cost next hops, and one /24 network route
+// per 16 host routes.  For every table size the program times
+// Ipv4GlobalRouting::RouteOutput with per-flow ECMP on random destinations,
+// and, for reference, a linear scan of the same routes as the lookup did
+// before it was indexed, and checks that both pick the same interface.
+// Sample usage:  ./ns3 run 'bench-global-routing --max=65536 --lookups=1000000'
+
+#include "ns3/boolean.h"
+#include "ns3/command-line.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-global-routing.h"
+#include "ns3/ipv4-queue-disc-item.h"
+#include "ns3/ipv4-routing-table-entry.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/simulator.h"
+#include "ns3/system-wall-clock-ms.h"
+#include "ns3/udp-header.h"
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <random>
+#include <vector>
+
+using namespace ns3;
+
+/// The routes of the router, scanned the way LookupGlobal used to
+struct LinearTable
+{
+    std::list<Ipv4RoutingTableEntry> hostRoutes;    ///< routes to hosts
+    std::list<Ipv4RoutingTableEntry> networkRoutes; ///< routes to networks
+
+    /**
+     * \param dest destination address
+     * \param flowHash flow hash for per-flow ECMP routing
+     * \return the interface of the selected route, -1 if none
+     */
+    int32_t Lookup(Ipv4Address dest, uint32_t flowHash) const
+    {
+        std::vector<const Ipv4RoutingTableEntry*> allRoutes;
+        for (auto i = hostRoutes.begin(); i != hostRoutes.end(); i++)
+        {
+            if (i->GetDest() == dest)
+            {
+                allRoutes.push_back(&*i);
+            }
+        }
+        if (allRoutes.empty())
+        {
+            for (auto j = networkRoutes.begin(); j != networkRoutes.end(); j++)
+            {
+                if (j->GetDestNetworkMask().IsMatch(dest, j->GetDestNetwork()))
+                {
+                    allRoutes.push_back(&*j);
+                }
+            }
+        }
+        if (allRoutes.empty())
+        {
+            return -1;
+        }
+        return allRoutes[flowHash % allRoutes.size()]->GetInterface();
+    }
+};
+
+static Ipv4Address
+HostAddress(uint32_t i)
+{
+    return Ipv4Address(0x0a000001 + (i << 8));
+}
+
+static Ipv4Address
+NetworkAddress(uint32_t i)
+{
+    return Ipv4Address(0xac000000 + (i << 8));
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t max = 65536;
+    uint32_t lookups = 1000000;
+    uint32_t ifaces = 8;
+    uint32_t ecmp = 4;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the route lookup of Ipv4GlobalRouting");
+    cmd.AddValue("max", "largest number of host routes", max);
+    cmd.AddValue("lookups", "number of lookups per table size", lookups);
+    cmd.AddValue("ifaces", "number of interfaces of the router", ifaces);
+    cmd.AddValue("ecmp", "number of next hops of a destination", ecmp);
+    cmd.Parse(argc, argv);
+
+    if (ecmp == 0 || ecmp > ifaces)
+    {
+        std::cerr << "Error-- ecmp must be in [1, ifaces]" << std::endl;
+        return 1;
+    }
+
+    Ptr<Node> node = CreateObject<Node>();
+    InternetStackHelper stack;
+    stack.Install(node);
+    Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+    Ptr<SimpleChannel> channel = CreateObject<SimpleChannel>();
+    for (uint32_t i = 0; i < ifaces; i++)
+    {
+        Ptr<SimpleNetDevice> dev = CreateObject<SimpleNetDevice>();
+        dev->SetAddress(Mac48Address::Allocate());
+        dev->SetChannel(channel);
+        node->AddDevice(dev);
+        uint32_t interface = ipv4->AddInterface(dev);
+        ipv4->AddAddress(interface,
+                         Ipv4InterfaceAddress(Ipv4Address(0xc0a80001 + (i << 8)), "/24"));
+        ipv4->SetUp(interface);
+    }
+
+    Ptr<Ipv4GlobalRouting> routing = CreateObject<Ipv4GlobalRouting>();
+    routing->SetAttribute("FlowEcmpRouting", BooleanValue(true));
+    routing->SetIpv4(ipv4);
+    LinearTable linear;
+
+    Ptr<Packet> packet = Create<Packet>(1000);
+    UdpHeader udp;
+    packet->AddHeader(udp);
+    Ipv4Header header;
+    header.SetSource(Ipv4Address("192.168.0.1"));
+    header.SetProtocol(17);
+
+    std::mt19937 rng(1);
+    std::cout << "routes  indexed ns/lookup  linear ns/lookup" << std::endl;
+    uint32_t nHosts = 0;
+    for (uint32_t size = 16; size <= max; size *= 4)
+    {
+        for (; nHosts < size; nHosts++)
+        {
+            for (uint32_t k = 0; k < ecmp; k++)
+            {
+                uint32_t interface = 1 + (nHosts + k) % ifaces;
+                Ipv4Address gw(0xc0a80002 + ((interface - 1) << 8));
+                routing->AddHostRouteTo(HostAddress(nHosts), gw, interface);
+                linear.hostRoutes.push_back(
+                    Ipv4RoutingTableEntry::CreateHostRouteTo(HostAddress(nHosts), gw, interface));
+            }
+            if (nHosts % 16 == 0)
+            {
+                uint32_t interface = 1 + (nHosts / 16) % ifaces;
+                Ipv4Address gw(0xc0a80002 + ((interface - 1) << 8));
+                routing->AddNetworkRouteTo(NetworkAddress(nHosts / 16),
+                                           "255.255.255.0",
+                                           gw,
+                                           interface);
+                linear.networkRoutes.push_back(
+                    Ipv4RoutingTableEntry::CreateNetworkRouteTo(NetworkAddress(nHosts / 16),
+                                                                "255.255.255.0",
+                                                                gw,
+                                                                interface));
+            }
+        }
+
+        // three of four lookups hit a host route, the others a network route
+        std::vector<Ipv4Address> dests(4096);
+        for (auto& dest : dests)
+        {
+            uint32_t r = rng();
+            dest = r % 4 ? HostAddress(r % nHosts)
+                         : Ipv4Address(NetworkAddress((r >> 2) % (nHosts / 16)).Get() + 7);
+        }
+
+        Socket::SocketErrno err;
+        header.SetDestination(dests[0]);
+        routing->RouteOutput(packet, header, nullptr, err); // builds the index
+        SystemWallClockMs clock;
+        clock.Start();
+        for (uint32_t k = 0; k < lookups; k++)
+        {
+            header.SetDestination(dests[k % dests.size()]);
+            routing->RouteOutput(packet, header, nullptr, err);
+        }
+        double indexedNs = clock.End() * 1e6 / lookups;
+
+        // the scan is slow, keep its work roughly constant
+        uint32_t linearLookups = std::max<uint64_t>(1000, (uint64_t)lookups * 16 / size);
+        clock.Start();
+        for (uint32_t k = 0; k < linearLookups; k++)
+        {
+            header.SetDestination(dests[k % dests.size()]);
+            uint32_t flowHash = Ipv4QueueDiscItem(packet, Address(), 17, header).Hash(0);
+            linear.Lookup(header.GetDestination(), flowHash);
+        }
+        double linearNs = clock.End() * 1e6 / linearLookups;
+
+        for (auto& dest : dests)
+        {
+            header.SetDestination(dest);
+            uint32_t flowHash = Ipv4QueueDiscItem(packet, Address(), 17, header).Hash(0);
+            Ptr<Ipv4Route> route = routing->RouteOutput(packet, header, nullptr, err);
+            int32_t interface = route ? ipv4->GetInterfaceForDevice(route->GetOutputDevice()) : -1;
+            if (interface != linear.Lookup(dest, flowHash))
+            {
+                std::cerr << "Error-- different routes to " << dest << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << routing->GetNRoutes() << "  " << indexedNs << "  " << linearNs << std::endl;
+    }
+
+    Simulator::Destroy();
+    return 0;
+}
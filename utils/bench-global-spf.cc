@@ -0,0 +1,238 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the cost of global routing updates when links of a
+// k-ary fat-tree fail and recover.  Every host and switch is a global router.
+// Each flap takes a random switch-to-switch link down, updates the routes,
+// brings it back up and updates them again.  The updates are timed with
+// Ipv4GlobalRoutingHelper::UpdateRoutingTables, and for reference a few with
+// RecomputeRoutingTables.  With --check, the tables after every update are
+// compared with those of a full recomputation, destination by destination.
+// Sample usage:  ./ns3 run 'bench-global-spf --k=16 --flaps=20'
+
+#include "ns3/command-line.h"
+#include "ns3/global-router-interface.h"
+#include "ns3/global-value.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-global-routing-helper.h"
+#include "ns3/ipv4-global-routing.h"
+#include "ns3/ipv4-routing-table-entry.h"
+#include "ns3/point-to-point-helper.h"
+#include "ns3/simulator.h"
+#include "ns3/system-wall-clock-ms.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+
+using namespace ns3;
+
+/// A route as (destination, mask, gateway, interface)
+typedef std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> Route;
+
+/**
+ * \param nodes the routers
+ * \return the routes of every router, sorted by destination and mask, in
+ * table order for a given destination and mask
+ */
+static std::vector<std::vector<Route>>
+GetTables(const NodeContainer& nodes)
+{
+    std::vector<std::vector<Route>> tables(nodes.GetN());
+    for (uint32_t i = 0; i < nodes.GetN(); i++)
+    {
+        Ptr<Ipv4GlobalRouting> gr = nodes.Get(i)->GetObject<GlobalRouter>()->GetRoutingProtocol();
+        for (uint32_t r = 0; r < gr->GetNRoutes(); r++)
+        {
+            Ipv4RoutingTableEntry* e = gr->GetRoute(r);
+            tables[i].emplace_back(e->GetDest().Get(),
+                                   e->GetDestNetworkMask().Get(),
+                                   e->GetGateway().Get(),
+                                   e->GetInterface());
+        }
+        std::stable_sort(tables[i].begin(), tables[i].end(), [](const Route& a, const Route& b) {
+            return std::make_pair(std::get<0>(a), std::get<1>(a)) <
+                   std::make_pair(std::get<0>(b), std::get<1>(b));
+        });
+    }
+    return tables;
+}
+
+/**
+ * \param a tables after an update
+ * \param b tables after a full recomputation
+ * \return true if both have the same host routes in the same order, and the
+ * same network routes
+ */
+static bool
+SameTables(std::vector<std::vector<Route>> a, std::vector<std::vector<Route>> b)
+{
+    for (uint32_t i = 0; i < a.size(); i++)
+    {
+        // only the order of host routes to a destination is kept by an update
+        auto network = [](const Route& r) { return std::get<1>(r) != 0xffffffff; };
+        auto ai = std::stable_partition(a[i].begin(), a[i].end(), network);
+        auto bi = std::stable_partition(b[i].begin(), b[i].end(), network);
+        std::sort(a[i].begin(), ai);
+        std::sort(b[i].begin(), bi);
+        if (a[i] != b[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t k = 16;
+    uint32_t flaps = 20;
+    uint32_t recomputes = 2;
+    uint32_t threads = 0;
+    bool check = false;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark global routing updates on link flaps in a fat-tree");
+    cmd.AddValue("k", "number of ports of a switch, even", k);
+    cmd.AddValue("flaps", "number of link flaps", flaps);
+    cmd.AddValue("recomputes", "number of timed full recomputations", recomputes);
+    cmd.AddValue("threads", "number of SPF threads, 0 for one per hardware thread", threads);
+    cmd.AddValue("check", "compare every update with a full recomputation", check);
+    cmd.Parse(argc, argv);
+
+    if (k < 2 || k % 2)
+    {
+        std::cerr << "Error-- k must be even" << std::endl;
+        return 1;
+    }
+    GlobalValue::Bind("GlobalRoutingThreads", UintegerValue(threads));
+
+    uint32_t half = k / 2;
+    NodeContainer hosts;
+    NodeContainer edges;
+    NodeContainer aggs;
+    NodeContainer cores;
+    hosts.Create(k * half * half);
+    edges.Create(k * half);
+    aggs.Create(k * half);
+    cores.Create(half * half);
+    NodeContainer all(hosts, edges, aggs, cores);
+    InternetStackHelper stack;
+    stack.Install(all);
+
+    PointToPointHelper p2p;
+    Ipv4AddressHelper address("10.0.0.0", "255.255.255.252");
+    std::vector<NetDeviceContainer> fabric; // switch-to-switch links
+    auto connect = [&](Ptr<Node> a, Ptr<Node> b) {
+        NetDeviceContainer devices = p2p.Install(a, b);
+        address.Assign(devices);
+        address.NewNetwork();
+        return devices;
+    };
+    for (uint32_t pod = 0; pod < k; pod++)
+    {
+        for (uint32_t e = 0; e < half; e++)
+        {
+            Ptr<Node> edge = edges.Get(pod * half + e);
+            for (uint32_t h = 0; h < half; h++)
+            {
+                connect(hosts.Get((pod * half + e) * half + h), edge);
+            }
+            for (uint32_t a = 0; a < half; a++)
+            {
+                fabric.push_back(connect(edge, aggs.Get(pod * half + a)));
+            }
+        }
+        for (uint32_t a = 0; a < half; a++)
+        {
+            for (uint32_t c = 0; c < half; c++)
+            {
+                fabric.push_back(connect(aggs.Get(pod * half + a), cores.Get(a * half + c)));
+            }
+        }
+    }
+
+    SystemWallClockMs clock;
+    clock.Start();
+    Ipv4GlobalRoutingHelper::PopulateRoutingTables();
+    double populateMs = clock.End();
+    uint64_t routes = 0;
+    for (uint32_t i = 0; i < all.GetN(); i++)
+    {
+        routes += all.Get(i)->GetObject<GlobalRouter>()->GetRoutingProtocol()->GetNRoutes();
+    }
+    std::cout << "fat-tree k=" << k << ": " << all.GetN() << " routers, " << routes
+              << " routes, populated in " << populateMs << " ms" << std::endl;
+
+    std::mt19937 rng(1);
+    auto setLink = [](const NetDeviceContainer& devices, bool up) {
+        for (uint32_t d = 0; d < 2; d++)
+        {
+            Ptr<Ipv4> ipv4 = devices.Get(d)->GetNode()->GetObject<Ipv4>();
+            uint32_t interface = ipv4->GetInterfaceForDevice(devices.Get(d));
+            up ? ipv4->SetUp(interface) : ipv4->SetDown(interface);
+        }
+    };
+    double updateMs = 0;
+    uint32_t mismatches = 0;
+    for (uint32_t f = 0; f < flaps; f++)
+    {
+        const NetDeviceContainer& link = fabric[rng() % fabric.size()];
+        for (bool up : {false, true})
+        {
+            setLink(link, up);
+            clock.Start();
+            Ipv4GlobalRoutingHelper::UpdateRoutingTables();
+            updateMs += clock.End();
+            if (check)
+            {
+                std::vector<std::vector<Route>> updated = GetTables(all);
+                Ipv4GlobalRoutingHelper::RecomputeRoutingTables();
+                mismatches += !SameTables(updated, GetTables(all));
+            }
+        }
+    }
+
+    double recomputeMs = 0;
+    for (uint32_t r = 0; r < recomputes; r++)
+    {
+        clock.Start();
+        Ipv4GlobalRoutingHelper::RecomputeRoutingTables();
+        recomputeMs += clock.End();
+    }
+
+    if (flaps)
+    {
+        std::cout << "update: " << updateMs / (2 * flaps) << " ms" << std::endl;
+    }
+    if (recomputes)
+    {
+        std::cout << "recompute: " << recomputeMs / recomputes << " ms" << std::endl;
+    }
+    if (check)
+    {
+        std::cout << mismatches << " of " << 2 * flaps << " updates differ from a recomputation"
+                  << std::endl;
+    }
+
+    Simulator::Destroy();
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program replays a sequence of INT headers through the per-hop
+// utilization step of HPCC, once with the per-hop loop RdmaHw::UpdateRateHp
+// had before HpIntBatch and once with HpIntBatch, the structure-of-arrays,
+// branch-free form of the same computation which RdmaHw now runs, checks
+// that both give bit-identical results and reports the time of each.
+// The headers are read from a file of IntHeader records as written by
+// IntHeader::Serialize, or generated for a path of --hops switches.
+// Sample usage:  ./ns3 run 'bench-hpcc-int --n=1000000 --hops=5'
+//                ./ns3 run 'bench-hpcc-int --save=int.bin'
+//                ./ns3 run 'bench-hpcc-int --input=int.bin'
+
+#include "ns3/buffer.h"
+#include "ns3/command-line.h"
+#include "ns3/hp-int-batch.h"
+#include "ns3/int-header.h"
+#include "ns3/system-wall-clock-ms.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdlib.h> // for exit ()
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+static const uint64_t g_maxRate = 100000000000lu;
+static const uint32_t g_win = 108000;
+
+/// Result of one replay, compared bit by bit
+struct Result
+{
+    double sumU;     ///< sum of max U over the ACKs
+    uint64_t sumTau; ///< sum of the tau of max U
+    uint64_t any;    ///< ACKs with at least one updated hop
+};
+
+static std::vector<IntHeader>
+Generate(uint32_t n, uint32_t hops)
+{
+    std::mt19937 rng(1);
+    std::vector<IntHeader> acks(n);
+    uint64_t time[IntHeader::maxHop] = {0};
+    uint64_t bytes[IntHeader::maxHop] = {0};
+    uint32_t qlen[IntHeader::maxHop] = {0};
+    for (uint32_t k = 0; k < n; k++)
+    {
+        IntHeader& ih = acks[k];
+        uint64_t gap = 80 + rng() % 2000; // ns between two ACKs
+        for (uint32_t i = 0; i < hops; i++)
+        {
+            time[i] += gap;
+            bytes[i] += gap * (80 + rng() % 45) / 8; // 80-125% of 100Gbps
+            qlen[i] = rng() % 4 ? std::min<uint32_t>(qlen[i] + rng() % 3000, 1000000) : 0;
+            ih.PushHop(time[i] & ((1u << IntHop::timeWidth) - 1),
+                       bytes[i],
+                       qlen[i],
+                       g_maxRate);
+        }
+    }
+    return acks;
+}
+
+// the per-hop loop of RdmaHw::UpdateRateHp before HpIntBatch, as the reference
+static Result
+RunScalar(std::vector<IntHeader>& acks, bool skipIdle)
+{
+    Result r = {0, 0, 0};
+    IntHop last[IntHeader::maxHop];
+    memset(last, 0, sizeof(last));
+    for (auto& ih : acks)
+    {
+        double U = 0;
+        uint64_t dt = 0;
+        bool updated_any = false;
+        for (uint32_t i = 0; i < ih.IntHeader_t.nhop; i++)
+        {
+            if (skipIdle && ih.IntHeader_t.hop[i].GetQlen() == 0)
+                continue;
+            updated_any = true;
+            uint64_t tau = ih.IntHeader_t.hop[i].GetTimeDelta(last[i]);
+            double duration = tau * 1e-9;
+            double txRate = (ih.IntHeader_t.hop[i].GetBytesDelta(last[i])) * 8 / duration;
+            double u = txRate / ih.IntHeader_t.hop[i].GetLineRate() +
+                       (double)std::min(ih.IntHeader_t.hop[i].GetQlen(), last[i].GetQlen()) *
+                           g_maxRate / ih.IntHeader_t.hop[i].GetLineRate() / g_win;
+            if (u > U)
+            {
+                U = u;
+                dt = tau;
+            }
+            last[i] = ih.IntHeader_t.hop[i];
+        }
+        r.sumU += U;
+        r.sumTau += dt;
+        r.any += updated_any;
+    }
+    return r;
+}
+
+static Result
+RunBatch(std::vector<IntHeader>& acks, bool skipIdle)
+{
+    Result r = {0, 0, 0};
+    IntHop last[IntHeader::maxHop];
+    memset(last, 0, sizeof(last));
+    HpIntBatch b;
+    for (auto& ih : acks)
+    {
+        b.Load(ih, last, skipIdle);
+        b.Compute(g_maxRate, g_win);
+        for (uint32_t i = 0; i < ih.IntHeader_t.nhop; i++)
+        {
+            if (b.updated[i])
+                last[i] = ih.IntHeader_t.hop[i];
+        }
+        r.sumU += b.maxU;
+        r.sumTau += b.maxTau;
+        r.any += b.anyUpdated;
+    }
+    return r;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t n = 1000000;
+    uint32_t hops = 5;
+    uint32_t rounds = 10;
+    std::string input;
+    std::string save;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the per-hop INT utilization of HPCC");
+    cmd.AddValue("n", "number of generated INT headers", n);
+    cmd.AddValue("hops", "number of hops of the generated INT headers", hops);
+    cmd.AddValue("rounds", "number of replays of the INT headers", rounds);
+    cmd.AddValue("input", "file of IntHeader records to replay", input);
+    cmd.AddValue("save", "write the generated INT headers to this file", save);
+    cmd.Parse(argc, argv);
+
+    IntHeader::mode = IntHeader::NORMAL;
+    uint32_t recordSize = IntHeader::GetStaticSize();
+    std::vector<IntHeader> acks;
+    if (!input.empty())
+    {
+        FILE* f = fopen(input.c_str(), "rb");
+        if (f == nullptr)
+        {
+            std::cerr << "Error-- cannot read INT file '" << input << "'" << std::endl;
+            exit(1);
+        }
+        std::vector<uint8_t> record(recordSize);
+        while (fread(record.data(), recordSize, 1, f) == 1)
+        {
+            Buffer buf(0);
+            buf.AddAtStart(recordSize);
+            buf.Begin().Write(record.data(), recordSize);
+            acks.emplace_back();
+            acks.back().Deserialize(buf.Begin());
+            if (acks.back().IntHeader_t.nhop > IntHeader::maxHop)
+            {
+                std::cerr << "Error-- bad INT record " << acks.size() - 1 << std::endl;
+                exit(1);
+            }
+        }
+        fclose(f);
+    }
+    else
+    {
+        if (hops == 0 || hops > IntHeader::maxHop)
+        {
+            std::cerr << "Error-- hops must be in [1, " << IntHeader::maxHop << "]" << std::endl;
+            exit(1);
+        }
+        acks = Generate(n, hops);
+    }
+    if (!save.empty())
+    {
+        FILE* f = fopen(save.c_str(), "wb");
+        if (f == nullptr)
+        {
+            std::cerr << "Error-- cannot open output file '" << save << "'" << std::endl;
+            exit(1);
+        }
+        std::vector<uint8_t> record(recordSize);
+        for (auto& ih : acks)
+        {
+            Buffer buf(0);
+            buf.AddAtStart(recordSize);
+            ih.Serialize(buf.Begin());
+            buf.CopyData(record.data(), recordSize);
+            fwrite(record.data(), recordSize, 1, f);
+        }
+        fclose(f);
+    }
+
+    std::cout << acks.size() << " INT headers, " << rounds << " rounds" << std::endl;
+    for (bool skipIdle : {false, true})
+    {
+        Result scalar = {0, 0, 0};
+        Result batch = {0, 0, 0};
+        SystemWallClockMs clock;
+        clock.Start();
+        for (uint32_t k = 0; k < rounds; k++)
+            scalar = RunScalar(acks, skipIdle);
+        int64_t scalarMs = clock.End();
+        clock.Start();
+        for (uint32_t k = 0; k < rounds; k++)
+            batch = RunBatch(acks, skipIdle);
+        int64_t batchMs = clock.End();
+
+        bool same = memcmp(&scalar.sumU, &batch.sumU, sizeof(double)) == 0 &&
+                    scalar.sumTau == batch.sumTau && scalar.any == batch.any;
+        std::cout << (skipIdle ? "fast react: " : "update:     ") << "scalar " << scalarMs
+                  << " ms, batch " << batchMs << " ms, results "
+                  << (same ? "identical" : "DIFFER") << std::endl;
+        if (!same)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -9,6 +9,8 @@
 // This program can be used to benchmark packet serialization/deserialization
 // operations using Headers and Tags, for various numbers of packets 'n'
 // Sample usage:  ./ns3 run 'bench-packets --n=10000'
+// With multithreaded simulation enabled, each benchmark can be run on several
+// threads at once, e.g. ./ns3 run 'bench-packets --n=10000 --threads=16'
 
 #include "ns3/command-line.h"
 #include "ns3/packet-metadata.h"
@@ -16,11 +18,14 @@
 #include "ns3/system-wall-clock-ms.h"
 
 #include <algorithm>
+#include <barrier>
 #include <iostream>
 #include <limits>
 #include <sstream>
 #include <stdlib.h> // for exit ()
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace ns3;
 
@@ -339,37 +344,131 @@ benchByteTags(uint32_t n)
     }
 }
 
+/**
+ * Create packets on each thread and destroy them on the next one, so that
+ * every buffer is recycled by a thread other than the one that created it.
+ *
+ * \param n number of packets per thread
+ * \param threads number of threads
+ */
+static void
+benchCrossThread(uint32_t n, uint32_t threads)
+{
+    BenchHeader<25> ipv4;
+    BenchHeader<8> udp;
+    const uint32_t batch = 1000;
+    std::vector<std::vector<Ptr<Packet>>> queues(threads);
+    std::barrier sync(threads);
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            for (uint32_t done = 0; done < n; done += batch)
+            {
+                for (uint32_t i = done; i < std::min(n, done + batch); i++)
+                {
+                    Ptr<Packet> p = Create<Packet>(1000);
+                    p->AddHeader(udp);
+                    p->AddHeader(ipv4);
+                    queues[t].push_back(p);
+                }
+                sync.arrive_and_wait();
+                queues[(t + 1) % threads].clear();
+                sync.arrive_and_wait();
+            }
+        });
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
 static uint64_t
-runBenchOneIteration(void (*bench)(uint32_t), uint32_t n)
+runBenchOneIteration(void (*bench)(uint32_t), uint32_t n, uint32_t threads)
 {
     SystemWallClockMs time;
     time.Start();
-    (*bench)(n);
+    if (threads == 1)
+    {
+        (*bench)(n);
+    }
+    else
+    {
+        std::vector<std::thread> workers;
+        for (uint32_t t = 0; t < threads; t++)
+        {
+            workers.emplace_back(bench, n);
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
     uint64_t deltaMs = time.End();
     return deltaMs;
 }
 
 static void
-runBench(void (*bench)(uint32_t), uint32_t n, uint32_t minIterations, const char* name)
+printBench(uint64_t minDelay, uint32_t n, uint32_t threads, const char* name)
 {
-    uint64_t minDelay = std::numeric_limits<uint64_t>::max();
-    for (uint32_t i = 0; i < minIterations; i++)
-    {
-        uint64_t delay = runBenchOneIteration(bench, n);
-        minDelay = std::min(minDelay, delay);
-    }
     double ps = n;
+    ps *= threads;
     ps *= 1000;
     ps /= minDelay;
     std::cout << ps << " packets/s"
               << " (" << minDelay << " ms elapsed)\t" << name << std::endl;
 }
 
+static void
+runBench(void (*bench)(uint32_t),
+         uint32_t n,
+         uint32_t threads,
+         uint32_t minIterations,
+         const char* name)
+{
+    uint64_t minDelay = std::numeric_limits<uint64_t>::max();
+    for (uint32_t i = 0; i < minIterations; i++)
+    {
+        uint64_t delay = runBenchOneIteration(bench, n, threads);
+        minDelay = std::min(minDelay, delay);
+    }
+    printBench(minDelay, n, threads, name);
+}
+
+static void
+runCrossThreadBench(uint32_t n, uint32_t threads, uint32_t minIterations, const char* name)
+{
+    uint64_t minDelay = std::numeric_limits<uint64_t>::max();
+    for (uint32_t i = 0; i < minIterations; i++)
+    {
+        SystemWallClockMs time;
+        time.Start();
+        benchCrossThread(n, threads);
+        uint64_t delay = time.End();
+        minDelay = std::min(minDelay, delay);
+    }
+    printBench(minDelay, n, threads, name);
+}
+
+#ifdef NS3_MTP
+static void
+printFreeListStats(const FreeListStats& stats, const char* name)
+{
+    uint64_t creations = stats.hits + stats.misses;
+    double hitRate = creations ? 100.0 * stats.hits / creations : 0;
+    std::cout << name << " free lists: " << stats.threads << " threads, " << hitRate
+              << "% hit rate, " << stats.localFrees << " local frees, " << stats.remoteFrees
+              << " cross-thread frees, " << stats.drops << " dropped" << std::endl;
+}
+#endif
+
 int
 main(int argc, char* argv[])
 {
     uint32_t n = 0;
     uint32_t minIterations = 1;
+    uint32_t threads = 1;
     bool enablePrinting = false;
 
     CommandLine cmd(__FILE__);
@@ -379,6 +478,7 @@ main(int argc, char* argv[])
                  "number of subiterations to minimize iteration time over",
                  minIterations);
     cmd.AddValue("enable-printing", "enable packet printing", enablePrinting);
+    cmd.AddValue("threads", "number of threads running each benchmark concurrently", threads);
     cmd.Parse(argc, argv);
 
     if (n == 0)
@@ -387,15 +487,36 @@ main(int argc, char* argv[])
                   << "by command-line argument --n=(number of packets)" << std::endl;
         exit(1);
     }
-    std::cout << "Running bench-packets with n=" << n << std::endl;
+    if (threads == 0)
+    {
+        std::cerr << "Error-- number of threads must be at least 1" << std::endl;
+        exit(1);
+    }
+#ifndef NS3_MTP
+    if (threads > 1)
+    {
+        std::cerr << "Error-- running on multiple threads requires multithreaded "
+                  << "simulation support (--enable-mtp)" << std::endl;
+        exit(1);
+    }
+#endif
+    std::cout << "Running bench-packets with n=" << n << " threads=" << threads << std::endl;
     std::cout << "All tests begin by adding UDP and IPv4 headers." << std::endl;
 
-    runBench(&benchA, n, minIterations, "Copy packet, remove headers");
-    runBench(&benchB, n, minIterations, "Just add headers");
-    runBench(&benchC, n, minIterations, "Remove by func call");
-    runBench(&benchD, n, minIterations, "Intermixed add/remove headers and tags");
-    runBench(&benchFragment, n, minIterations, "Fragmentation and concatenation");
-    runBench(&benchByteTags, n, minIterations, "Benchmark byte tags");
+    runBench(&benchA, n, threads, minIterations, "Copy packet, remove headers");
+    runBench(&benchB, n, threads, minIterations, "Just add headers");
+    runBench(&benchC, n, threads, minIterations, "Remove by func call");
+    runBench(&benchD, n, threads, minIterations, "Intermixed add/remove headers and tags");
+    runBench(&benchFragment, n, threads, minIterations, "Fragmentation and concatenation");
+    runBench(&benchByteTags, n, threads, minIterations, "Benchmark byte tags");
+    if (threads > 1)
+    {
+        runCrossThreadBench(n, threads, minIterations, "Destroy packets on another thread");
+    }
+#ifdef NS3_MTP
+    printFreeListStats(Buffer::GetFreeListStats(), "Buffer");
+    printFreeListStats(PacketMetadata::GetFreeListStats(), "PacketMetadata");
+#endif
 
     return 0;
 }
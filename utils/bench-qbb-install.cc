@@ -0,0 +1,130 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the setup time of the links of a k-ary fat-tree
+// built with QbbHelper.  The links are installed once one by one with
+// QbbHelper::Install(a, b), and once in bulk with
+// QbbHelper::Install(nodes, links) for every thread count of --threads.
+// Each run builds its own nodes.  The times are reported in total and per
+// 10k links.
+// Sample usage:  ./ns3 run 'bench-qbb-install --k=24 --threads=1,2,4,8'
+
+#include "ns3/command-line.h"
+#include "ns3/node-container.h"
+#include "ns3/qbb-helper.h"
+#include "ns3/simulator.h"
+#include "ns3/system-wall-clock-ms.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace ns3;
+
+/**
+ * \param k number of ports of a switch, even
+ * \return the links of the fat-tree, as pairs of node indices: the hosts
+ * first, then the edge, aggregation and core switches
+ */
+static std::vector<std::pair<uint32_t, uint32_t>>
+FatTreeLinks(uint32_t k)
+{
+    uint32_t half = k / 2;
+    uint32_t edges = k * half * half;
+    uint32_t aggs = edges + k * half;
+    uint32_t cores = aggs + k * half;
+    std::vector<std::pair<uint32_t, uint32_t>> links;
+    for (uint32_t pod = 0; pod < k; pod++)
+    {
+        for (uint32_t e = 0; e < half; e++)
+        {
+            uint32_t edge = edges + pod * half + e;
+            for (uint32_t h = 0; h < half; h++)
+            {
+                links.emplace_back((pod * half + e) * half + h, edge);
+            }
+            for (uint32_t a = 0; a < half; a++)
+            {
+                links.emplace_back(edge, aggs + pod * half + a);
+            }
+        }
+        for (uint32_t a = 0; a < half; a++)
+        {
+            for (uint32_t c = 0; c < half; c++)
+            {
+                links.emplace_back(aggs + pod * half + a, cores + a * half + c);
+            }
+        }
+    }
+    return links;
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t k = 16;
+    std::string threadList = "1,2,4";
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the installation of qbb links in a fat-tree");
+    cmd.AddValue("k", "number of ports of a switch, even", k);
+    cmd.AddValue("threads", "comma separated thread counts of the bulk installs", threadList);
+    cmd.Parse(argc, argv);
+
+    if (k < 2 || k % 2)
+    {
+        std::cerr << "Error-- k must be even" << std::endl;
+        return 1;
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> links = FatTreeLinks(k);
+    uint32_t nNodes = k * k * k / 4 + k * k + k * k / 4;
+    std::cout << "fat-tree k=" << k << ": " << nNodes << " nodes, " << links.size() << " links"
+              << std::endl;
+
+    auto report = [&](std::string name, double ms) {
+        std::cout << name << ": " << ms << " ms, " << ms * 10000 / links.size()
+                  << " ms per 10k links" << std::endl;
+    };
+
+    QbbHelper qbb;
+    SystemWallClockMs clock;
+    {
+        NodeContainer nodes;
+        nodes.Create(nNodes);
+        clock.Start();
+        for (const auto& link : links)
+        {
+            qbb.Install(nodes.Get(link.first), nodes.Get(link.second));
+        }
+        report("one by one", clock.End());
+    }
+
+    std::istringstream threads(threadList);
+    std::string t;
+    while (std::getline(threads, t, ','))
+    {
+        NodeContainer nodes;
+        nodes.Create(nNodes);
+        qbb.SetThreads(std::stoul(t));
+        clock.Start();
+        NetDeviceContainer devices = qbb.Install(nodes, links);
+        report("bulk, " + t + " threads", clock.End());
+    }
+
+    Simulator::Destroy();
+    return 0;
+}
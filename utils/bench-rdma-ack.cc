@@ -0,0 +1,200 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program counts the ACKs the RDMA receive path generates per GB of
+// data, for the ACK modes of RdmaHw: one ACK per packet, ACKs coalesced per
+// --window microseconds, coalesced per --window or --bytes, and ACKs merged
+// while they are queued in the NIC.  Two hosts linked by a qbb link send
+// --flows flows of --size bytes to each other, or one way with --oneWay.
+// The second host may send slower than the first with --rate2, so that its
+// ACKs wait behind its data.
+// The devices hand the packets they receive to the RdmaHw of their host.
+// Each mode reports the ACKs received by the senders, per GB of data, the
+// events executed, the completion time of the last flow and the wall clock
+// time of the run.
+// Sample usage:  ./ns3 run 'bench-rdma-ack --flows=4 --size=100000000 --window=2'
+//                ./ns3 run 'bench-rdma-ack --flows=1 --rate2=10Gbps'
+
+#include "ns3/boolean.h"
+#include "ns3/command-line.h"
+#include "ns3/custom-header.h"
+#include "ns3/double.h"
+#include "ns3/node-container.h"
+#include "ns3/ppp-header.h"
+#include "ns3/qbb-helper.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/system-wall-clock-ms.h"
+#include "ns3/uinteger.h"
+
+#include <iostream>
+#include <string>
+
+using namespace ns3;
+
+static uint64_t g_acks = 0; //!< ACKs and NACKs received by the hosts
+
+/**
+ * Hand a packet received by a device to the RdmaHw of its host.
+ * \param hw the RdmaHw of the host
+ * \param packet the packet, with its PPP header
+ */
+static void
+DeliverToRdmaHw(Ptr<RdmaHw> hw, Ptr<const Packet> packet)
+{
+    Ptr<Packet> p = packet->Copy();
+    PppHeader ppp;
+    p->RemoveHeader(ppp);
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    if (ch.l3Prot == 0xFC || ch.l3Prot == 0xFD)
+        g_acks++;
+    hw->Receive(p, ch);
+}
+
+/// Notification of the application of a flow, unused
+static void
+FlowDone()
+{
+}
+
+/**
+ * Record the completion time of the last flow.
+ * \param end the completion time
+ * \param qp the flow which completed
+ */
+static void
+FlowComplete(Time* end, Ptr<RdmaQueuePair> qp)
+{
+    *end = Simulator::Now();
+}
+
+/// ACK mode of a run
+struct AckMode
+{
+    std::string name;
+    double window;  // AckCoalesceInterval, us
+    uint32_t bytes; // AckCoalesceBytes
+    bool merge;     // AckMergeQueued
+};
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t flows = 4;
+    uint64_t size = 100000000;
+    bool oneWay = false;
+    double window = 2;
+    uint32_t bytes = 4000;
+    std::string rate = "100Gbps";
+    std::string rate2;
+    double delay = 1;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the ACKs of the RDMA receive path");
+    cmd.AddValue("flows", "number of flows from each host", flows);
+    cmd.AddValue("size", "size of a flow in bytes", size);
+    cmd.AddValue("oneWay", "send from the first host only", oneWay);
+    cmd.AddValue("window", "AckCoalesceInterval of the coalescing modes, us", window);
+    cmd.AddValue("bytes", "AckCoalesceBytes of the byte coalescing mode", bytes);
+    cmd.AddValue("rate", "data rate of the link", rate);
+    cmd.AddValue("rate2", "data rate of the device of the second host, --rate if empty", rate2);
+    cmd.AddValue("delay", "delay of the link, us", delay);
+    cmd.Parse(argc, argv);
+
+    AckMode modes[] = {
+        {"per packet", 0, 0, false},
+        {"window", window, 0, false},
+        {"window or bytes", window, bytes, false},
+        {"merge queued", 0, 0, true},
+    };
+    double gb = (oneWay ? 1 : 2) * flows * (double)size / 1e9;
+    for (const AckMode& mode : modes)
+    {
+        NodeContainer hosts;
+        hosts.Create(2);
+        QbbHelper qbb;
+        qbb.SetDeviceAttribute("DataRate", StringValue(rate));
+        qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(delay)));
+        NetDeviceContainer devices = qbb.Install(hosts.Get(0), hosts.Get(1));
+        if (!rate2.empty())
+            devices.Get(1)->SetAttribute("DataRate", StringValue(rate2));
+
+        Ptr<RdmaDriver> drivers[2];
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+            hw->SetAttribute("CcMode", UintegerValue(1));
+            hw->SetAttribute("L2AckInterval", UintegerValue(1));
+            hw->SetAttribute("AckCoalesceInterval", DoubleValue(mode.window));
+            hw->SetAttribute("AckCoalesceBytes", UintegerValue(mode.bytes));
+            hw->SetAttribute("AckMergeQueued", BooleanValue(mode.merge));
+            drivers[i] = CreateObject<RdmaDriver>();
+            drivers[i]->SetNode(hosts.Get(i));
+            drivers[i]->SetRdmaHw(hw);
+            hosts.Get(i)->AggregateObject(drivers[i]);
+            drivers[i]->Init();
+            devices.Get(i)->TraceConnectWithoutContext("MacRx",
+                                                       MakeBoundCallback(&DeliverToRdmaHw, hw));
+        }
+        Ipv4Address ip[2];
+        for (uint32_t i = 0; i < 2; i++)
+            ip[i] = Ipv4Address(0x0b000001 + (hosts.Get(i)->GetId() << 8));
+        for (uint32_t i = 0; i < 2; i++)
+            drivers[i]->m_rdma->AddTableEntry(ip[1 - i], 0, false);
+
+        for (uint32_t i = 0; i < (oneWay ? 1u : 2u); i++)
+        {
+            for (uint32_t f = 0; f < flows; f++)
+            {
+                drivers[i]->AddQueuePair(hosts.Get(i)->GetId(),
+                                         hosts.Get(1 - i)->GetId(),
+                                         f,
+                                         size,
+                                         3,
+                                         ip[i],
+                                         ip[1 - i],
+                                         100 + f,
+                                         200 + f,
+                                         0,
+                                         0,
+                                         MakeCallback(&FlowDone),
+                                         MakeCallback(&FlowDone));
+            }
+        }
+
+        g_acks = 0;
+        Time end;
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            drivers[i]->TraceConnectWithoutContext("QpComplete",
+                                                   MakeBoundCallback(&FlowComplete, &end));
+        }
+        SystemWallClockMs clock;
+        clock.Start();
+        uint64_t events = Simulator::GetEventCount();
+        Simulator::Run();
+        events = Simulator::GetEventCount() - events;
+        int64_t ms = clock.End();
+        std::cout << mode.name << ": " << g_acks << " ACKs, " << g_acks / gb << " ACKs per GB, "
+                  << events << " events, last flow done at " << end.GetMicroSeconds() << " us, "
+                  << ms << " ms" << std::endl;
+        Simulator::Destroy();
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program compares the loss recovery modes of RdmaHw, go-back-N and
+// selective repeat, on a lossy incast: --senders hosts each send a flow of
+// --size bytes to one receiver host, which has a qbb link to every sender.
+// The devices of the receiver drop the data packets they receive with the
+// probability --loss, except the last packet of a flow: RdmaHw has no
+// retransmission timeout, a lost tail is never recovered.
+// The devices hand the packets they receive to the RdmaHw of their host.
+// Each mode reports the goodput, the completion time of the last flow, the
+// data sent on the wire per byte delivered, the events executed per KB
+// delivered and the wall clock time of the run.
+// Sample usage:  ./ns3 run 'bench-rdma-loss --senders=16 --loss=0.01'
+
+#include "ns3/boolean.h"
+#include "ns3/command-line.h"
+#include "ns3/custom-header.h"
+#include "ns3/error-model.h"
+#include "ns3/node-container.h"
+#include "ns3/pointer.h"
+#include "ns3/ppp-header.h"
+#include "ns3/qbb-helper.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/system-wall-clock-ms.h"
+#include "ns3/uinteger.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+static uint64_t g_wireBytes = 0; //!< payload of the data packets which reached the receiver
+
+/// Drop data packets at random, but the last packet of a flow
+class DataLossModel : public ErrorModel
+{
+  public:
+    /**
+     * \param rate the probability to drop a data packet
+     * \param size the size of the flows
+     * \param stream the stream of the random variable
+     */
+    DataLossModel(double rate, uint64_t size, int64_t stream)
+        : m_rate(rate),
+          m_size(size)
+    {
+        m_random = CreateObject<UniformRandomVariable>();
+        m_random->SetStream(stream);
+    }
+
+  private:
+    bool DoCorrupt(Ptr<Packet> packet) override
+    {
+        Ptr<Packet> p = packet->Copy();
+        PppHeader ppp;
+        p->RemoveHeader(ppp);
+        CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+        p->PeekHeader(ch);
+        if (ch.l3Prot != 0x11)
+            return false;
+        uint32_t payload = p->GetSize() - ch.GetSerializedSize();
+        g_wireBytes += payload;
+        return ch.udp.seq + payload < m_size && m_random->GetValue() < m_rate;
+    }
+
+    void DoReset() override
+    {
+    }
+
+    double m_rate;
+    uint64_t m_size;
+    Ptr<UniformRandomVariable> m_random;
+};
+
+/**
+ * Hand a packet received by a device to the RdmaHw of its host.
+ * \param hw the RdmaHw of the host
+ * \param packet the packet, with its PPP header
+ */
+static void
+DeliverToRdmaHw(Ptr<RdmaHw> hw, Ptr<const Packet> packet)
+{
+    Ptr<Packet> p = packet->Copy();
+    PppHeader ppp;
+    p->RemoveHeader(ppp);
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    hw->Receive(p, ch);
+}
+
+/// Notification of the application of a flow, unused
+static void
+FlowDone()
+{
+}
+
+/**
+ * Record the completion time of the last flow.
+ * \param end the completion time
+ * \param qp the flow which completed
+ */
+static void
+FlowComplete(Time* end, Ptr<RdmaQueuePair> qp)
+{
+    *end = Simulator::Now();
+}
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t senders = 8;
+    uint64_t size = 10000000;
+    double loss = 0.001;
+    std::string rate = "100Gbps";
+    double delay = 5;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the loss recovery of RdmaHw on a lossy incast");
+    cmd.AddValue("senders", "number of senders", senders);
+    cmd.AddValue("size", "size of a flow in bytes", size);
+    cmd.AddValue("loss", "probability to drop a data packet", loss);
+    cmd.AddValue("rate", "data rate of the links", rate);
+    cmd.AddValue("delay", "delay of the links, us", delay);
+    cmd.Parse(argc, argv);
+
+    for (bool selectiveRepeat : {false, true})
+    {
+        NodeContainer hosts;
+        hosts.Create(senders + 1);
+        QbbHelper qbb;
+        qbb.SetDeviceAttribute("DataRate", StringValue(rate));
+        qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(delay)));
+        for (uint32_t i = 1; i <= senders; i++)
+        {
+            NetDeviceContainer devices = qbb.Install(hosts.Get(0), hosts.Get(i));
+            Ptr<ErrorModel> em = CreateObject<DataLossModel>(loss, size, i);
+            devices.Get(0)->SetAttribute("ReceiveErrorModel", PointerValue(em));
+        }
+
+        std::vector<Ptr<RdmaDriver>> drivers(senders + 1);
+        std::vector<Ipv4Address> ip(senders + 1);
+        for (uint32_t i = 0; i <= senders; i++)
+        {
+            Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+            hw->SetAttribute("CcMode", UintegerValue(1));
+            hw->SetAttribute("L2AckInterval", UintegerValue(1));
+            hw->SetAttribute("SelectiveRepeat", BooleanValue(selectiveRepeat));
+            drivers[i] = CreateObject<RdmaDriver>();
+            drivers[i]->SetNode(hosts.Get(i));
+            drivers[i]->SetRdmaHw(hw);
+            hosts.Get(i)->AggregateObject(drivers[i]);
+            drivers[i]->Init();
+            for (uint32_t d = 0; d < hosts.Get(i)->GetNDevices(); d++)
+            {
+                hosts.Get(i)->GetDevice(d)->TraceConnectWithoutContext(
+                    "MacRx",
+                    MakeBoundCallback(&DeliverToRdmaHw, hw));
+            }
+            ip[i] = Ipv4Address(0x0b000001 + (hosts.Get(i)->GetId() << 8));
+        }
+        for (uint32_t i = 1; i <= senders; i++)
+        {
+            // the device of the receiver to sender i is its device i - 1
+            drivers[0]->m_rdma->AddTableEntry(ip[i], i - 1, false);
+            drivers[i]->m_rdma->AddTableEntry(ip[0], 0, false);
+            drivers[i]->AddQueuePair(hosts.Get(i)->GetId(),
+                                     hosts.Get(0)->GetId(),
+                                     i,
+                                     size,
+                                     3,
+                                     ip[i],
+                                     ip[0],
+                                     100,
+                                     200,
+                                     0,
+                                     0,
+                                     MakeCallback(&FlowDone),
+                                     MakeCallback(&FlowDone));
+        }
+
+        g_wireBytes = 0;
+        Time end;
+        for (uint32_t i = 1; i <= senders; i++)
+        {
+            drivers[i]->TraceConnectWithoutContext("QpComplete",
+                                                   MakeBoundCallback(&FlowComplete, &end));
+        }
+        SystemWallClockMs clock;
+        clock.Start();
+        uint64_t events = Simulator::GetEventCount();
+        Simulator::Run();
+        events = Simulator::GetEventCount() - events;
+        int64_t ms = clock.End();
+        double bytes = (double)senders * size;
+        std::cout << (selectiveRepeat ? "selective repeat" : "go-back-N") << ": "
+                  << bytes * 8 / end.GetNanoSeconds() << " Gbps goodput, last flow done at "
+                  << end.GetMicroSeconds() << " us, " << g_wireBytes / bytes
+                  << " bytes sent per byte, " << events / (bytes / 1000) << " events per KB, "
+                  << ms << " ms" << std::endl;
+        Simulator::Destroy();
+    }
+    return 0;
+}
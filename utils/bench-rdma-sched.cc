@@ -0,0 +1,175 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the cost of the qp scheduler of the NIC, the round
+// robin over all the qps and the PgScheduler of RdmaEgressQueue, against the
+// number of qps.  A host opens persistent qps to another host over a qbb
+// link, as many as given by --qps, spread over --pgs PGs.  --active of them
+// send a message each, of --bytes bytes in all; the other qps are idle, as
+// the qps of the peers a collective does not talk to at the moment.
+// The devices hand the packets they receive to the RdmaHw of their host.
+// Each scheduler and number of qps reports the data packets sent, the
+// completion time of the last message and the wall clock time per packet.
+// Sample usage:  ./ns3 run 'bench-rdma-sched --qps=16,1024,16384 --active=8'
+
+#include "ns3/boolean.h"
+#include "ns3/command-line.h"
+#include "ns3/config.h"
+#include "ns3/custom-header.h"
+#include "ns3/node-container.h"
+#include "ns3/ppp-header.h"
+#include "ns3/qbb-helper.h"
+#include "ns3/qbb-net-device.h"
+#include "ns3/rdma-driver.h"
+#include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/system-wall-clock-ms.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+static uint64_t g_packets = 0; //!< data packets received
+
+/**
+ * Hand a packet received by a device to the RdmaHw of its host.
+ * \param hw the RdmaHw of the host
+ * \param packet the packet, with its PPP header
+ */
+static void
+DeliverToRdmaHw(Ptr<RdmaHw> hw, Ptr<const Packet> packet)
+{
+    Ptr<Packet> p = packet->Copy();
+    PppHeader ppp;
+    p->RemoveHeader(ppp);
+    CustomHeader ch(CustomHeader::L3_Header | CustomHeader::L4_Header);
+    ch.getInt = 1;
+    p->PeekHeader(ch);
+    if (ch.l3Prot == 0x11)
+        g_packets++;
+    hw->Receive(p, ch);
+}
+
+/**
+ * Record the completion time of the last message.
+ * \param end the completion time
+ * \param qp the qp of the message
+ * \param msg the message which completed
+ */
+static void
+MessageComplete(Time* end, Ptr<RdmaQueuePair> qp, const RdmaMessage& msg)
+{
+    *end = Simulator::Now();
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::string qpCounts = "16,256,4096";
+    uint32_t active = 16;
+    uint64_t bytes = 100000000;
+    uint32_t pgs = 4;
+    std::string rate = "100Gbps";
+    double delay = 1;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the qp scheduler of the NIC against the number of qps");
+    cmd.AddValue("qps", "comma separated numbers of qps", qpCounts);
+    cmd.AddValue("active", "number of qps which send", active);
+    cmd.AddValue("bytes", "bytes sent by all the qps", bytes);
+    cmd.AddValue("pgs", "number of PGs of the qps", pgs);
+    cmd.AddValue("rate", "data rate of the link", rate);
+    cmd.AddValue("delay", "delay of the link, us", delay);
+    cmd.Parse(argc, argv);
+
+    std::vector<uint32_t> counts;
+    std::istringstream in(qpCounts);
+    for (std::string n; std::getline(in, n, ',');)
+        counts.push_back(std::stoul(n));
+
+    for (uint32_t qps : counts)
+    {
+        for (bool pgScheduler : {false, true})
+        {
+            Config::SetDefault("ns3::RdmaEgressQueue::PgScheduler", BooleanValue(pgScheduler));
+            NodeContainer hosts;
+            hosts.Create(2);
+            QbbHelper qbb;
+            qbb.SetDeviceAttribute("DataRate", StringValue(rate));
+            qbb.SetChannelAttribute("Delay", TimeValue(MicroSeconds(delay)));
+            NetDeviceContainer devices = qbb.Install(hosts.Get(0), hosts.Get(1));
+
+            Ptr<RdmaDriver> drivers[2];
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                Ptr<RdmaHw> hw = CreateObject<RdmaHw>();
+                hw->SetAttribute("CcMode", UintegerValue(1));
+                hw->SetAttribute("L2AckInterval", UintegerValue(1));
+                drivers[i] = CreateObject<RdmaDriver>();
+                drivers[i]->SetNode(hosts.Get(i));
+                drivers[i]->SetRdmaHw(hw);
+                hosts.Get(i)->AggregateObject(drivers[i]);
+                drivers[i]->Init();
+                devices.Get(i)->TraceConnectWithoutContext(
+                    "MacRx",
+                    MakeBoundCallback(&DeliverToRdmaHw, hw));
+            }
+            Ipv4Address ip[2];
+            for (uint32_t i = 0; i < 2; i++)
+                ip[i] = Ipv4Address(0x0b000001 + (hosts.Get(i)->GetId() << 8));
+            for (uint32_t i = 0; i < 2; i++)
+                drivers[i]->m_rdma->AddTableEntry(ip[1 - i], 0, false);
+
+            // the active qps are spread over the qps
+            uint32_t n = std::min(active, qps);
+            for (uint32_t q = 0; q < qps; q++)
+            {
+                Ptr<RdmaQueuePair> qp = drivers[0]->CreateQueuePair(hosts.Get(0)->GetId(),
+                                                                    hosts.Get(1)->GetId(),
+                                                                    q,
+                                                                    q % pgs,
+                                                                    ip[0],
+                                                                    ip[1],
+                                                                    q,
+                                                                    100,
+                                                                    0,
+                                                                    0,
+                                                                    Callback<void>());
+                if (q % (qps / n) == 0 && q / (qps / n) < n)
+                    drivers[0]->PostMessage(qp, RdmaMessage::WRITE, bytes / n, Callback<void>());
+            }
+
+            g_packets = 0;
+            Time end;
+            drivers[0]->TraceConnectWithoutContext("MessageComplete",
+                                                   MakeBoundCallback(&MessageComplete, &end));
+            SystemWallClockMs clock;
+            clock.Start();
+            Simulator::Run();
+            int64_t ms = clock.End();
+            std::cout << qps << " qps, " << (pgScheduler ? "PG scheduler" : "round robin")
+                      << ": " << g_packets << " packets, last message done at "
+                      << end.GetMicroSeconds() << " us, " << ms << " ms, "
+                      << ms * 1e6 / g_packets << " ns per packet" << std::endl;
+            Simulator::Destroy();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program measures the admission checks per second of the switch MMU
+// models, SwitchMmu and MultiPoolSwitchMmu.  It replays --packets packets of
+// random ports, priorities and sizes through the MMU the way SwitchNode
+// does: the ingress and egress admission checks, the accounting of the
+// admitted packets and the PFC checks, and, once --backlog packets are
+// buffered, the dequeue of the oldest one with its ECN and resume checks.
+// The packets of a paused PG are held back, as its sender would, while the
+// buffer drains.
+// The multi-pool MMU has a lossless priority 3 in pool 0 and lossy
+// priorities 1 and 2 in pool 1.
+// Each model reports the packets checked, admitted and held back, and the
+// admission checks per second.
+// Sample usage:  ./ns3 run 'bench-switch-mmu --ports=64 --backlog=100000'
+
+#include "ns3/command-line.h"
+#include "ns3/switch-mmu.h"
+#include "ns3/system-wall-clock-ms.h"
+
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace ns3;
+
+/// A packet buffered in the MMU
+struct MmuPacket
+{
+    uint32_t in;
+    uint32_t out;
+    uint32_t qIndex;
+    uint32_t size;
+};
+
+int
+main(int argc, char* argv[])
+{
+    uint32_t ports = 64;
+    uint64_t packets = 10000000;
+    uint32_t backlog = 100000;
+    uint32_t bufferSize = 32 * 1024 * 1024;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Benchmark the admission checks of the switch MMU models");
+    cmd.AddValue("ports", "number of ports of the switch", ports);
+    cmd.AddValue("packets", "number of packets offered", packets);
+    cmd.AddValue("backlog", "number of packets buffered before a dequeue", backlog);
+    cmd.AddValue("bufferSize", "buffer of the switch, bytes", bufferSize);
+    cmd.Parse(argc, argv);
+
+    std::mt19937 rng(1);
+    std::vector<MmuPacket> trace(packets);
+    for (MmuPacket& p : trace)
+    {
+        p.in = 1 + rng() % ports;
+        p.out = 1 + rng() % ports;
+        p.qIndex = 1 + rng() % 3;
+        p.size = 64 + rng() % 1437;
+    }
+
+    for (bool multiPool : {false, true})
+    {
+        Ptr<SwitchMmu> mmu = CreateObject<SwitchMmu>();
+        if (multiPool)
+            mmu = CreateObject<MultiPoolSwitchMmu>();
+        mmu->ConfigBufferSize(bufferSize);
+        for (uint32_t p = 1; p <= ports; p++)
+        {
+            mmu->pfc_a_shift[p] = 3;
+            mmu->ConfigEcn(p, 100, 400, 0.2);
+            mmu->ConfigHdrm(p, 20 * 1000);
+        }
+        mmu->ConfigNPort(ports);
+        if (multiPool)
+        {
+            Ptr<MultiPoolSwitchMmu> pools = DynamicCast<MultiPoolSwitchMmu>(mmu);
+            uint32_t shared = bufferSize - mmu->total_hdrm - mmu->total_rsrv;
+            pools->ConfigPool(0, shared / 2);
+            pools->ConfigPool(1, shared / 2);
+            pools->ConfigPriority(3, 0, true, 1.0 / 8, 1.0 / 8);
+            pools->ConfigPriority(1, 1, false, 1, 1);
+            pools->ConfigPriority(2, 1, false, 0.5, 0.5);
+        }
+
+        std::deque<MmuPacket> buffered;
+        uint64_t checked = 0;
+        uint64_t admitted = 0;
+        uint64_t cn = 0;
+        SystemWallClockMs clock;
+        clock.Start();
+        for (const MmuPacket& p : trace)
+        {
+            bool held = mmu->paused[p.in][p.qIndex];
+            if (!buffered.empty() && (held || buffered.size() >= backlog))
+            {
+                const MmuPacket& d = buffered.front();
+                mmu->RemoveFromIngressAdmission(d.in, d.qIndex, d.size);
+                mmu->RemoveFromEgressAdmission(d.out, d.qIndex, d.size);
+                cn += mmu->ShouldSendCN(d.out, d.qIndex);
+                if (mmu->CheckShouldResume(d.in, d.qIndex))
+                    mmu->SetResume(d.in, d.qIndex);
+                buffered.pop_front();
+            }
+            if (held)
+                continue;
+            checked++;
+            if (mmu->CheckIngressAdmission(p.in, p.qIndex, p.size) &&
+                mmu->CheckEgressAdmission(p.out, p.qIndex, p.size))
+            {
+                mmu->UpdateIngressAdmission(p.in, p.qIndex, p.size);
+                mmu->UpdateEgressAdmission(p.out, p.qIndex, p.size);
+                if (mmu->CheckShouldPause(p.in, p.qIndex))
+                    mmu->SetPause(p.in, p.qIndex);
+                buffered.push_back(p);
+                admitted++;
+            }
+        }
+        int64_t ms = clock.End();
+        std::cout << (multiPool ? "MultiPoolSwitchMmu" : "SwitchMmu") << ": " << checked
+                  << " packets checked, " << admitted << " admitted, " << packets - checked
+                  << " held back by PFC, " << cn << " CNs, " << checked / (ms * 1e3)
+                  << " M admission checks per second" << std::endl;
+    }
+    return 0;
+}
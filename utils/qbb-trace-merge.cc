@@ -0,0 +1,159 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// This program merges the per-logical-process streams of a trace written by
+// ns3::TraceWriter into a single time-ordered output, either as a sequence of
+// raw TraceFormat records (the format of QbbHelper::EnableTracing (FILE*, ...))
+// or as text.
+// Sample usage:  ./ns3 run 'qbb-trace-merge --input=mix.tr --output=mix.txt --text'
+
+#include "ns3/command-line.h"
+#include "ns3/trace-writer.h"
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <stdlib.h> // for exit ()
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace ns3;
+
+static void
+PrintRecord(FILE* out, const TraceFormat& tr)
+{
+    fprintf(out,
+            "%lu n:%u %u:%u %u %s ecn:%x %08x %08x %u",
+            tr.time,
+            tr.node,
+            tr.intf,
+            tr.qidx,
+            tr.qlen,
+            EventToStr((EventEnum)tr.event),
+            tr.ecn,
+            tr.sip,
+            tr.dip,
+            tr.l3Prot);
+    switch (tr.l3Prot)
+    {
+    case 0x6:
+        fprintf(out, " %u %u", tr.data.sport, tr.data.dport);
+        break;
+    case 0x11:
+        fprintf(out,
+                " %u %u %u %lu %u(%u)",
+                tr.data.sport,
+                tr.data.dport,
+                tr.data.seq,
+                tr.data.ts,
+                tr.data.pg,
+                tr.data.payload);
+        break;
+    case 0xFC:
+    case 0xFD:
+        fprintf(out,
+                " %u %u %u %u %u %lu",
+                tr.ack.sport,
+                tr.ack.dport,
+                tr.ack.flags,
+                tr.ack.pg,
+                tr.ack.seq,
+                tr.ack.ts);
+        break;
+    case 0xFE:
+        fprintf(out, " %u %u %u", tr.pfc.time, tr.pfc.qlen, tr.pfc.qIndex);
+        break;
+    case 0xFF:
+        fprintf(out,
+                " %u %u %u %u %u",
+                tr.cnp.fid,
+                tr.cnp.qIndex,
+                tr.cnp.ecnBits,
+                tr.cnp.TraceFormat_t.qfb,
+                tr.cnp.TraceFormat_t.total);
+        break;
+    default:
+        break;
+    }
+    fprintf(out, " %u\n", tr.size);
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::string input;
+    std::string output;
+    bool text = false;
+
+    CommandLine cmd(__FILE__);
+    cmd.Usage("Merge a TraceWriter file into a time-ordered trace");
+    cmd.AddValue("input", "trace file written by ns3::TraceWriter", input);
+    cmd.AddValue("output", "merged output file (default: stdout)", output);
+    cmd.AddValue("text", "write text lines instead of raw TraceFormat records", text);
+    cmd.Parse(argc, argv);
+
+    TraceReader reader;
+    if (input.empty() || !reader.Open(input))
+    {
+        std::cerr << "Error-- cannot read trace file '" << input << "'" << std::endl;
+        exit(1);
+    }
+    FILE* out = output.empty() ? stdout : fopen(output.c_str(), text ? "w" : "wb");
+    if (out == nullptr)
+    {
+        std::cerr << "Error-- cannot open output file '" << output << "'" << std::endl;
+        exit(1);
+    }
+
+    // each stream is in time order, so a k-way merge keeps one record per stream
+    uint32_t n = reader.GetNStreams();
+    std::vector<TraceFormat> head(n);
+    typedef std::pair<uint64_t, uint32_t> Entry; // (time, stream)
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (reader.Read(i, head[i]))
+        {
+            heap.emplace(head[i].time, i);
+        }
+    }
+    uint64_t records = 0;
+    while (!heap.empty())
+    {
+        uint32_t i = heap.top().second;
+        heap.pop();
+        if (text)
+        {
+            PrintRecord(out, head[i]);
+        }
+        else
+        {
+            head[i].Serialize(out);
+        }
+        records++;
+        if (reader.Read(i, head[i]))
+        {
+            heap.emplace(head[i].time, i);
+        }
+    }
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    std::cerr << "merged " << records << " records from " << n << " streams" << std::endl;
+    return 0;
+}